@@ -70,6 +70,7 @@ typedef CS_RETCODE(*CS_CSLIBMSG_FUNC) (CS_CONTEXT *, CS_CLIENTMSG *);
 typedef CS_RETCODE(*CS_CLIENTMSG_FUNC) (CS_CONTEXT *, CS_CONNECTION *, CS_CLIENTMSG *);
 typedef CS_RETCODE(*CS_SERVERMSG_FUNC) (CS_CONTEXT *, CS_CONNECTION *, CS_SERVERMSG *);
 typedef CS_RETCODE(*CS_INTERRUPT_FUNC) (CS_CONNECTION *);
+typedef CS_RETCODE(*CS_COMPLETION_FUNC) (CS_CONNECTION *, CS_COMMAND *, CS_INT, CS_RETCODE);
 
 
 #define CS_IODATA          TDS_STATIC_CAST(CS_INT, 1600)
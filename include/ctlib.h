@@ -153,6 +153,7 @@ struct _cs_context
 	CS_CLIENTMSG_FUNC clientmsg_cb;
 	CS_SERVERMSG_FUNC servermsg_cb;
 	CS_INTERRUPT_FUNC interrupt_cb;
+	CS_COMPLETION_FUNC completion_cb;
 	/* code changes start here - CS_CONFIG - 01*/
 	void *userdata;
 	int userdata_len;
@@ -164,6 +165,11 @@ struct _cs_context
 
 	/** structures uses large identifiers */
 	bool use_large_identifiers;
+
+	/** default CS_NETIO for new connections */
+	CS_INT netio;
+	/** connections allocated in this context, see ct_poll */
+	CS_CONNECTION *conns;
 };
 
 static inline size_t cs_servermsg_len(CS_CONTEXT *ctx)
@@ -199,6 +205,25 @@ struct _cs_connection
 	CS_DYNAMIC *dynlist;
 	char *server_addr;
 	bool network_auth;
+
+	/** next connection in context */
+	CS_CONNECTION *next;
+	CS_COMPLETION_FUNC completion_cb;
+	/** CS_SYNC_IO, CS_ASYNC_IO or CS_DEFER_IO */
+	CS_INT netio;
+	/**
+	 * Asynchronous operation waiting completion (CT_SEND, CT_RESULTS
+	 * or CT_FETCH), 0 if none. Completed by ct_poll.
+	 */
+	CS_INT async_op;
+	CS_COMMAND *async_cmd;
+	/** output of pending operation (result type or rows read) */
+	CS_INT *async_out;
+	/** status of operation already executed but not reported yet */
+	CS_RETCODE async_status;
+	bool async_done;
+	/** we are executing a pending operation */
+	bool async_running;
 };
 
 /*
@@ -401,9 +426,11 @@ CS_INT _ct_get_string_length(const char *buf, CS_INT buflen);
 
 int _cs_convert_not_client(CS_CONTEXT *ctx, const TDSCOLUMN *curcol, CONV_RESULT *convert_buffer, unsigned char **p_src);
 
-TDS_INT _cs_cs2tds(CS_CONTEXT * ctx, const CS_DATAFMT_COMMON * srcfmt, const void *srcdata, int desttype, CONV_RESULT * cres);
+TDS_INT _cs_cs2tds(CS_CONTEXT * ctx, const CS_DATAFMT_COMMON * srcfmt, const void *srcdata, int desttype, CONV_RESULT * cres,
+		   TDS_CONVERT_CACHE * cache);
 CS_RETCODE _cs_convert(CS_CONTEXT * ctx, const CS_DATAFMT_COMMON * srcfmt, CS_VOID * srcdata,
-		       const CS_DATAFMT_COMMON * destfmt, CS_VOID * destdata, CS_INT * resultlen);
+		       const CS_DATAFMT_COMMON * destfmt, CS_VOID * destdata, CS_INT * resultlen,
+		       TDS_CONVERT_CACHE * cache);
 bool _ct_is_large_identifiers_version(CS_INT version);
 const CS_DATAFMT_COMMON * _ct_datafmt_common(CS_CONTEXT * ctx, const CS_DATAFMT * datafmt);
 const CS_DATAFMT_LARGE *_ct_datafmt_conv_in(CS_CONTEXT * ctx, const CS_DATAFMT * datafmt, CS_DATAFMT_LARGE * fmtbuf);
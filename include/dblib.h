@@ -81,6 +81,9 @@ typedef struct
 	TDS_INT lastrow;
 	TDS_INT maxerrs;
 	TDS_INT batch;
+	/** where to start reading the file, see bcp_setfilestart() */
+	TDS_INT8 start_offset;
+	TDS_INT start_row;
 } BCP_HOSTFILEINFO;
 
 /* linked list of rpc parameters */
@@ -171,8 +174,8 @@ enum {
  * internal prototypes
  */
 RETCODE dbgetnull(DBPROCESS *dbproc, int bindtype, int varlen, BYTE* varaddr);
-void copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE * src, DBINT srclen,
-			   BYTE * dest, DBINT destlen,
+void copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, TDS_CONVERT_FUNC convert,
+			   const BYTE * src, DBINT srclen, BYTE * dest, DBINT destlen,
 			   int bindtype, DBINT *indicator);
 
 int dbperror (DBPROCESS *dbproc, DBINT msgno, long errnum, ...);
@@ -199,6 +199,8 @@ struct _drecord
 	SQLSMALLINT sql_desc_unnamed;
 	SQLSMALLINT sql_desc_unsigned;
 	SQLSMALLINT sql_desc_updatable;
+	/** conversion of bound data, resolved on first fetch */
+	TDS_CONVERT_CACHE convert;
 };
 
 struct _hdesc
@@ -270,6 +272,7 @@ struct _hcattr
 	SQLUINTEGER mars_enabled;
 	SQLUINTEGER cursor_type;
 	SQLUINTEGER bulk_enabled;
+	SQLUINTEGER bulk_insert;
 #ifdef TDS_NO_DM
 	SQLUINTEGER trace;
 	DSTR tracefile;
@@ -442,6 +445,16 @@ struct _hstmt
 	TDS_ODBC_SPECIAL_ROWS special_row;
 	/* do NOT free cursor, free from socket or attach to connection */
 	TDSCURSOR *cursor;
+	/** rows decoded in advance by a block fetch, see odbc_SQLFetch */
+	TDSROWBATCH *row_batch;
+	/** next row of row_batch to return */
+	TDS_UINT row_batch_next;
+	/** bytes of every column copied as is from row_batch, 0 to convert */
+	unsigned *row_batch_copy;
+	/** rows prefetched at last sequential cursor fetch, 0 if not prefetching */
+	SQLULEN cursor_prefetch;
+	/** row of row_batch at start of current rowset, prefetched cursor blocks only */
+	TDS_UINT cursor_rowset_start;
 };
 
 typedef struct _henv TDS_ENV;
@@ -570,7 +583,10 @@ int odbc_build_connect_string(TDS_ERRS *errs, TDS_PARSED_PARAM *params, char **o
  * convert_tds2sql.c
  */
 SQLLEN odbc_tds2sql_col(TDS_STMT * stmt, TDSCOLUMN *curcol, int desttype,
-			TDS_CHAR * dest, SQLULEN destlen, const struct _drecord *drec_ixd);
+			TDS_CHAR * dest, SQLULEN destlen, const struct _drecord *drec_ixd, TDS_CONVERT_CACHE *cache);
+SQLLEN odbc_tds2sql_batch(TDS_STMT * stmt, TDSCOLUMN *curcol, const TDS_CHAR *src, TDS_INT srclen,
+			  int desttype, TDS_CHAR * dest, SQLULEN destlen, const struct _drecord *drec_ixd,
+			  TDS_CONVERT_CACHE *cache);
 SQLLEN odbc_tds2sql_int4(TDS_STMT * stmt, TDS_INT *src, int desttype, TDS_CHAR * dest, SQLULEN destlen);
 
 
@@ -732,6 +748,8 @@ int odbc_bcp_batch(TDS_DBC *dbc);
 int odbc_bcp_done(TDS_DBC *dbc);
 void odbc_bcp_bind(TDS_DBC *dbc, const void * varaddr, int prefixlen, int varlen, const void * terminator, int termlen,
 		   int vartype, int table_column);
+bool odbc_bcp_insert_params(TDS_STMT *stmt);
+void odbc_bcp_add_rows(TDS_STMT *stmt);
 
 /*
  * sqlwchar.c
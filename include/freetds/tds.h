@@ -55,6 +55,7 @@ typedef struct tds_socket TDSSOCKET;
 typedef struct tds_column TDSCOLUMN;
 typedef struct tds_bcpinfo TDSBCPINFO;
 typedef struct tds_result_info TDSRESULTINFO;
+typedef struct tds_query_cache TDSQUERYCACHE;
 
 #include <freetds/version.h>
 #include <freetds/sysdep_private.h>
@@ -467,6 +468,8 @@ is_tds_type_valid(int type)
 #define TDS_STR_DBFILENAME	"database filename"
 /* Application Intent MSSQL 2012 support */
 #define TDS_STR_READONLY_INTENT "read-only intent"
+/* number of network packets cached by a connection */
+#define TDS_STR_PACKET_CACHE "packet cache size"
 /* configurable cipher suite to send to openssl's SSL_set_cipher_list() function */
 #define TLS_STR_OPENSSL_CIPHERS "openssl ciphers"
 /* configurable cipher suite to send to gnutls's gnutls_priority_set_direct() function */
@@ -537,6 +540,8 @@ typedef struct tds_login
 	tds_dir_char *dump_file;
 	int debug_flags;
 	int text_size;
+	/** packets to cache for connection, -1 if not specified */
+	int packet_cache_size;
 	DSTR routing_address;
 	uint16_t routing_port;
 
@@ -676,6 +681,27 @@ typedef struct tds_column_funcs
 #endif
 } TDSCOLUMNFUNCS;
 
+struct tds_context;
+union conv_result;
+
+/**
+ * Function converting data, same parameters as tds_convert().
+ * Returned by tds_get_convert_func() to resolve a conversion once.
+ */
+typedef TDS_INT (*TDS_CONVERT_FUNC)(const struct tds_context *context, int srctype, const void *src, TDS_UINT srclen,
+				    int desttype, union conv_result *cr);
+
+/**
+ * Conversion function resolved for a source/destination pair.
+ * Use tds_get_convert_func_cached() to fill it.
+ */
+typedef struct tds_convert_cache
+{
+	TDS_CONVERT_FUNC func;
+	int srctype;
+	int desttype;
+} TDS_CONVERT_CACHE;
+
 /** 
  * Metadata about columns in regular and compute rows 
  */
@@ -726,6 +752,11 @@ struct tds_column
 
 	unsigned char *column_data;
 	void (*column_data_free)(struct tds_column * column);
+	/**
+	 * Row buffer saved while column_data points into a received packet
+	 * (see tds_get_column_view), NULL otherwise.
+	 */
+	unsigned char *column_data_saved;
 	uint8_t column_nullable:1;
 	uint8_t column_writeable:1;
 	uint8_t column_identity:1;
@@ -754,6 +785,8 @@ struct tds_column
 	TDS_SMALLINT *column_nullbind;
 	TDS_CHAR *column_varaddr;
 	TDS_INT *column_lenbind;
+	/** conversion for bound data, resolved at bind time or on first conversion */
+	TDS_CONVERT_CACHE column_convert;
 	TDS_INT column_textpos;
 	TDS_INT column_text_sqlgetdatapos;
 	TDS_CHAR column_text_sqlputdatainfo;
@@ -795,6 +828,59 @@ struct tds_result_info
 	bool more_results;
 };
 
+/** How a column of a TDSROWBATCH is decoded, resolved once when batch is allocated */
+typedef enum tds_row_batch_kind
+{
+	TDS_BATCH_FIXED,	/**< fixed size, read directly into batch */
+	TDS_BATCH_VARLEN,	/**< 1 or 2 bytes length prefix, no conversion or padding */
+	TDS_BATCH_DIRECT,	/**< any other non-blob type, get_data() writes into batch */
+	TDS_BATCH_BLOB		/**< blob, decoded in current_row and copied into heap */
+} TDS_ROW_BATCH_KIND;
+
+/**
+ * Values of a column in a TDSROWBATCH.
+ * Non-blob values are stored contiguously, \c stride bytes each,
+ * blob cells contain a size_t offset inside \c heap.
+ */
+typedef struct tds_row_batch_column
+{
+	TDSCOLUMN *column;
+	unsigned char *data;
+	/** size of every value, -1 if NULL */
+	TDS_INT *lengths;
+	TDS_INT stride;
+	TDS_ROW_BATCH_KIND kind;
+
+	unsigned char *heap;
+	size_t heap_len, heap_size;
+} TDSROWBATCHCOLUMN;
+
+/**
+ * Hold multiple rows decoded by tds_process_rows_batch() in columnar form.
+ */
+typedef struct tds_row_batch
+{
+	TDSRESULTINFO *info;
+	TDS_UINT max_rows;
+	TDS_UINT num_rows;
+	TDS_USMALLINT num_cols;
+	TDSROWBATCHCOLUMN *columns;
+} TDSROWBATCH;
+
+/**
+ * Get pointer to a value in a batch.
+ * Value is not valid if lengths[row] is negative (NULL).
+ */
+inline static const unsigned char *
+tds_row_batch_value(const TDSROWBATCH *batch, unsigned col, unsigned row)
+{
+	const TDSROWBATCHCOLUMN *bcol = &batch->columns[col];
+
+	if (bcol->kind == TDS_BATCH_BLOB)
+		return bcol->heap + ((const size_t *) bcol->data)[row];
+	return bcol->data + (size_t) bcol->stride * row;
+}
+
 /** values for tds->state */
 typedef enum tds_states
 {
@@ -1031,6 +1117,8 @@ typedef struct tds_multiple
 {
 	TDS_MULTIPLE_TYPE type;
 	unsigned int flags;
+	/** variables declared in emulated RPCs, used to generate unique names */
+	unsigned int num_vars;
 } TDSMULTIPLE;
 
 /* forward declaration */
@@ -1094,6 +1182,22 @@ typedef struct tds_packet
 #define tds_packet_get_data_start(pkt) 0
 #endif
 
+/** Number of size classes in packet cache */
+#define TDS_PACKET_CACHE_CLASSES 8
+/** Default number of packets cached by a connection */
+#define TDS_DEF_PACKET_CACHE 8
+
+/** Counters to help tuning packet cache, protected by list_mtx */
+typedef struct tds_packet_cache_stats
+{
+	/** packet requests satisfied by the cache */
+	unsigned long hits;
+	/** packet requests which required an allocation */
+	unsigned long misses;
+	/** packets freed as cache was full */
+	unsigned long discarded;
+} TDSPACKETCACHESTATS;
+
 typedef struct tds_poll_wakeup
 {
 	TDS_SYS_SOCKET s_signal, s_signaled;
@@ -1128,6 +1232,9 @@ struct tds_connection
 	int char_conv_count;
 	TDSICONV **char_convs;
 
+	/** cache of queries converted to be sent with RPCs, see query.c */
+	TDSQUERYCACHE *query_cache;
+
 	TDS_UCHAR collation[5];
 	TDS_UCHAR tds72_transaction[8];
 
@@ -1152,8 +1259,12 @@ struct tds_connection
 #endif
 	tds_mutex list_mtx;
 
+	/** packets cached to be reused, by size class (see tds_get_packet) */
+	TDSPACKET *packet_cache[TDS_PACKET_CACHE_CLASSES];
 	unsigned num_cached_packets;
-	TDSPACKET *packet_cache;
+	/** maximum number of packets to keep in cache */
+	unsigned max_cached_packets;
+	TDSPACKETCACHESTATS packet_cache_stats;
 
 	int spid;
 	int client_spid;
@@ -1254,6 +1365,16 @@ struct tds_socket
 #endif
 	/* packet we received */
 	TDSPACKET *recv_packet;
+	/**
+	 * Received packets still referred by column views.
+	 * They are released when next row is read.
+	 */
+	TDSPACKET *pinned_packets;
+	/** complete packets read by tds_read_ahead, returned first by tds_read_packet */
+	TDSPACKET *ahead_packets;
+	/** packet tds_read_ahead is reading, ahead_pos bytes already received */
+	TDSPACKET *ahead_packet;
+	unsigned ahead_pos;
 	/** packet we are preparing to send */
 	TDSPACKET *send_packet;
 
@@ -1271,6 +1392,12 @@ struct tds_socket
 	bool bulk_query;		/**< true is query sent was a bulk query so we need to switch state to QUERYING */
 	bool has_status; 		/**< true is ret_status is valid */
 	bool in_row;			/**< true if we are getting rows */
+	/**
+	 * true to let row columns point to data in received packets
+	 * instead of copying them; data are valid till next row is read
+	 */
+	bool column_views;
+	bool recv_packet_pinned;	/**< true if recv_packet is referred by column views */
 	volatile 
 	unsigned char in_cancel; 	/**< indicate we are waiting a cancel reply; discard tokens till acknowledge; 
 	1 mean we have to send cancel packet, 2 already sent. */
@@ -1334,6 +1461,8 @@ int tds_config_boolean(const char *option, const char *value, TDSLOGIN * login);
 TDSLOCALE *tds_get_locale(void);
 TDSRET tds_alloc_row(TDSRESULTINFO * res_info);
 TDSRET tds_alloc_compute_row(TDSCOMPUTEINFO * res_info);
+TDSROWBATCH *tds_alloc_row_batch(TDSCONNECTION * conn, TDSRESULTINFO * res_info, TDS_UINT max_rows);
+void tds_free_row_batch(TDSROWBATCH * batch);
 BCPCOLDATA * tds_alloc_bcp_column_data(unsigned int column_size);
 TDSDYNAMIC *tds_lookup_dynamic(TDSCONNECTION * conn, const char *id);
 /*@observer@*/ const char *tds_prtype(int token);
@@ -1456,6 +1585,7 @@ void tds_convert_string_free(const char *original, const char *converted);
 	do { if (original != converted) free((char*) converted); } while(0)
 #endif
 TDSRET tds_get_column_declaration(TDSSOCKET * tds, TDSCOLUMN * curcol, char *out);
+void tds_query_cache_free(TDSCONNECTION * conn);
 
 TDSRET tds_cursor_declare(TDSSOCKET * tds, TDSCURSOR * cursor, bool *send);
 TDSRET tds_cursor_setrows(TDSSOCKET * tds, TDSCURSOR * cursor, bool *send);
@@ -1472,6 +1602,7 @@ TDSRET tds_multiple_init(TDSSOCKET *tds, TDSMULTIPLE *multiple, TDS_MULTIPLE_TYP
 TDSRET tds_multiple_done(TDSSOCKET *tds, TDSMULTIPLE *multiple);
 TDSRET tds_multiple_query(TDSSOCKET *tds, TDSMULTIPLE *multiple, const char *query, TDSPARAMINFO * params);
 TDSRET tds_multiple_execute(TDSSOCKET *tds, TDSMULTIPLE *multiple, TDSDYNAMIC * dyn);
+TDSRET tds_multiple_rpc(TDSSOCKET *tds, TDSMULTIPLE *multiple, const char *rpc_name, TDSPARAMINFO * params);
 
 
 /* token.c */
@@ -1481,11 +1612,15 @@ TDSRET tds_process_simple_query(TDSSOCKET * tds);
 int tds5_send_optioncmd(TDSSOCKET * tds, TDS_OPTION_CMD tds_command, TDS_OPTION tds_option, TDS_OPTION_ARG * tds_argument,
 			TDS_INT * tds_argsize);
 TDSRET tds_process_tokens(TDSSOCKET * tds, /*@out@*/ TDS_INT * result_type, /*@out@*/ int *done_flags, unsigned flag);
+TDSRET tds_process_rows_batch(TDSSOCKET * tds, TDSROWBATCH * batch);
 
 
 /* data.c */
 void tds_set_param_type(TDSCONNECTION * conn, TDSCOLUMN * curcol, TDS_SERVER_TYPE type);
 void tds_set_column_type(TDSCONNECTION * conn, TDSCOLUMN * curcol, TDS_SERVER_TYPE type);
+TDS_ROW_BATCH_KIND tds_get_row_batch_kind(TDSCONNECTION * conn, const TDSCOLUMN * col);
+TDSRET tds_get_column_view(TDSSOCKET * tds, TDSCOLUMN * curcol);
+void tds_copy_column_views(TDSRESULTINFO * info);
 #ifdef WORDS_BIGENDIAN
 void tds_swap_datatype(int coltype, void *b);
 #endif
@@ -1596,8 +1731,10 @@ void tds_connection_flush(TDSSOCKET *tds);
 #define TDSSELREAD  POLLIN
 #define TDSSELWRITE POLLOUT
 int tds_select(TDSSOCKET * tds, unsigned tds_sel, int timeout_seconds);
+int tds_select_any(TDSSOCKET ** sockets, const unsigned *tds_sels, unsigned num, int timeout_ms);
 void tds_connection_close(TDSCONNECTION *conn);
 ptrdiff_t tds_goodread(TDSSOCKET * tds, unsigned char *buf, size_t buflen);
+ptrdiff_t tds_read_nowait(TDSSOCKET * tds, unsigned char *buf, size_t buflen);
 ptrdiff_t tds_goodwrite(TDSSOCKET * tds, const unsigned char *buffer, size_t buflen);
 int tds_socket_set_nonblocking(TDS_SYS_SOCKET sock);
 int tds_wakeup_init(TDSPOLLWAKEUP *wakeup);
@@ -1612,7 +1749,9 @@ tds_wakeup_get_fd(const TDSPOLLWAKEUP *wakeup)
 
 /* packet.c */
 int tds_read_packet(TDSSOCKET * tds);
+int tds_read_ahead(TDSSOCKET * tds, size_t min_len);
 TDSRET tds_write_packet(TDSSOCKET * tds, unsigned char final);
+void tds_release_pinned_packets(TDSSOCKET * tds);
 #if ENABLE_ODBC_MARS
 int tds_append_cancel(TDSSOCKET *tds);
 TDSRET tds_append_syn(TDSSOCKET *tds);
@@ -89,6 +89,24 @@ TDS_SERVER_TYPE tds_get_null_type(TDS_SERVER_TYPE srctype);
 ptrdiff_t tds_char2hex(TDS_CHAR * dest, size_t destlen, const TDS_CHAR * src, size_t srclen);
 size_t tds_hex_trim(const TDS_CHAR ** p_src, size_t srclen);
 TDS_INT tds_convert(const TDSCONTEXT * context, int srctype, const void *src, TDS_UINT srclen, int desttype, CONV_RESULT * cr);
+TDS_CONVERT_FUNC tds_get_convert_func(int srctype, int desttype);
+
+/**
+ * Return conversion function for a source/destination pair, resolving
+ * it only if the pair changed since last call.
+ */
+static inline TDS_CONVERT_FUNC
+tds_get_convert_func_cached(TDS_CONVERT_CACHE *cache, int srctype, int desttype)
+{
+	if (!cache->func || cache->srctype != srctype || cache->desttype != desttype) {
+		cache->func = tds_get_convert_func(srctype, desttype);
+		cache->srctype = srctype;
+		cache->desttype = desttype;
+	}
+	return cache->func;
+}
+TDS_INT tds_convert_to_buffer(const TDSCONTEXT * context, int srctype, const void *src, TDS_UINT srclen,
+			      int desttype, void *dest, TDS_UINT destlen, bool *truncated);
 
 size_t tds_strftime(char *buf, size_t maxsize, const char *format, const TDSDATEREC * timeptr, int prec);
 
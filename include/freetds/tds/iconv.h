@@ -99,6 +99,7 @@ struct tdsiconvinfo
 	struct tdsiconvdir to, from;
 
 #define TDS_ENCODING_MEMCPY   1
+#define TDS_ENCODING_BUILTIN  2
 	unsigned int flags;
 
 	/* 
@@ -159,7 +159,7 @@ TDSRET tds_dynamic_stream_init(TDSDYNAMICSTREAM * stream, void **ptr, size_t all
  * are performed on the file pointer while it's active in this structure.
  */
 enum
-{ TDSFILESTREAM_BLOCKSIZE = 512 };
+{ TDSFILESTREAM_BLOCKSIZE = 64 * 1024 };
 
 typedef struct tds_file_stream
 {
@@ -170,18 +170,16 @@ typedef struct tds_file_stream
 	FILE *f;
 	offset_type offset;
 
-	/** Circular buffer; assume nobody is going to use a gigantic terminator... */
-	char cbuf[50];
-	size_t cpos;
-
 	/** Terminator to compare against - Memory not owned by the TDSFILESTREAM;
 	 * make sure to not leave dangling pointers here.
 	 */
 	const char *terminator;
 	size_t term_len;
+	/** terminator was found, no more data for current field */
+	bool term_found;
 
-	/* Read buffering */
-	char inbuf[TDSFILESTREAM_BLOCKSIZE];
+	/* Read buffering, TDSFILESTREAM_BLOCKSIZE bytes */
+	char *inbuf;
 	size_t inpos;
 	size_t inlen;
 
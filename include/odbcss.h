@@ -59,6 +59,11 @@ extern "C" {
 #define SQL_INFO_FREETDS_TDS_VERSION	1300
 #define SQL_INFO_FREETDS_SOCKET	1301
 
+/* FreeTDS specific, execute simple INSERTs with parameter arrays using bulk copy */
+#define SQL_COPT_FREETDS_BULK_INSERT	1310
+#define SQL_BULK_INSERT_OFF	0
+#define SQL_BULK_INSERT_ON	1
+
 #ifndef SQL_MARS_ENABLED_NO
 #define SQL_MARS_ENABLED_NO	0
 #endif
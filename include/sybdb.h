@@ -1322,6 +1322,7 @@ RETCODE bcp_colptr(DBPROCESS * dbproc, BYTE * colptr, int table_column);
 RETCODE bcp_control(DBPROCESS * dbproc, int field, DBINT value);
 int bcp_getbatchsize(DBPROCESS * dbproc); /* FreeTDS only */
 int bcp_gethostcolcount(DBPROCESS * dbproc);	/* FreeTDS only */
+RETCODE bcp_setfilestart(DBPROCESS * dbproc, DBBIGINT offset, DBINT row);	/* FreeTDS only */
 RETCODE bcp_exec(DBPROCESS * dbproc, DBINT * rows_copied);
 DBBOOL bcp_getl(LOGINREC * login);
 RETCODE bcp_options(DBPROCESS * dbproc, int option, BYTE * value, int valuelen);
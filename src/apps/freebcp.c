@@ -58,8 +58,10 @@
 #include <sybfront.h>
 #include <sybdb.h>
 
+#include <freetds/time.h>
 #include <freetds/macros.h>
 #include <freetds/bool.h>
+#include <freetds/thread.h>
 #include <freetds/version.h>
 #include <freetds/utils.h>
 #include <freetds/utils/path.h>
@@ -73,16 +75,43 @@ enum
 };
 typedef int BCPFORMAT;
 
+/* maximum number of connections used with -j */
+#define MAX_WORKERS 64
+
+/* a connection copying part of the data file */
+typedef struct
+{
+	int index;
+	DBPROCESS *dbproc;
+	char *hostfile;		/* part of the data file written by this worker (out) */
+	char *errorfile;
+	int firstrow;
+	int lastrow;
+	DBBIGINT offset;	/* where rows for this worker start in the data file */
+	DBINT start_row;	/* number of the row at offset */
+	DBINT rows_copied;
+	int sent;		/* rows sent in committed batches */
+	bool ok;
+#ifdef TDS_HAVE_MUTEX
+	bool started;
+	tds_thread thread;
+#endif
+} BCPWORKER;
+
 int tdsdump_open(const char *filename);
 
 static void pusage(void);
 static int process_parameters(int, char **, BCPPARAMDATA *);
 static int unescape(char arg[]);
+static LOGINREC *init_login(BCPPARAMDATA * pdata);
 static int login_to_database(BCPPARAMDATA * pdata, DBPROCESS ** pdbproc);
 
 static int setoptions(DBPROCESS * dbproc, BCPPARAMDATA * params);
 static BCPFORMAT get_format(BCPPARAMDATA * params);
+static int file_setup(BCPPARAMDATA * pdata, DBPROCESS * dbproc, DBINT dir, const char *hostfile, const char *errorfile,
+		      int firstrow, int lastrow);
 static int file_process(BCPPARAMDATA * pdata, DBPROCESS * dbproc, DBINT dir);
+static int parallel_process(BCPPARAMDATA * pdata);
 static int err_handler(DBPROCESS * dbproc, int severity, int dberr, int oserr, char *dberrstr, char *oserrstr);
 static int msg_handler(DBPROCESS * dbproc TDS_UNUSED, DBINT msgno, int msgstate, int severity, char *msgtext, char *srvname,
 		       char *procname, int line);
@@ -114,17 +143,20 @@ main(int argc, char **argv)
 		fprintf(stderr, "User name: \"%s\"\n", params.user);
 	}
 
+	if (params.workers > 1) {
+		ok = parallel_process(&params);
+	} else {
+		if (login_to_database(&params, &dbproc) == FALSE) {
+			exit(EXIT_FAILURE);
+		}
 
-	if (login_to_database(&params, &dbproc) == FALSE) {
-		exit(EXIT_FAILURE);
-	}
-
-	if (!setoptions(dbproc, &params))
-		return FALSE;
+		if (!setoptions(dbproc, &params))
+			return FALSE;
 
-	ok = file_process(&params, dbproc, params.direction);
+		ok = file_process(&params, dbproc, params.direction);
 
-	dbclose(dbproc);
+		dbclose(dbproc);
+	}
 	dbexit();
 	bcpparamdata_free(&params);
 
@@ -268,7 +300,7 @@ process_parameters(int argc, char **argv, BCPPARAMDATA *pdata)
 	 * Get the rest of the arguments
 	 */
 	optind = 4;		/* start processing options after table, direction, & filename */
-	while ((ch = getopt(argc, argv, "m:f:e:F:L:b:t:r:U:P:i:I:S:h:T:A:o:O:0:C:ncEdvVD:k")) != -1) {
+	while ((ch = getopt(argc, argv, "m:f:e:F:L:b:t:r:U:P:i:I:S:h:T:A:o:O:0:C:ncEdvVD:kj:")) != -1) {
 		switch (ch) {
 		case 'v':
 		case 'V':
@@ -362,6 +394,9 @@ process_parameters(int argc, char **argv, BCPPARAMDATA *pdata)
 		case 'k':
 			pdata->ignoreDefaults = true;
 			break;
+		case 'j':
+			pdata->workers = atoi(optarg);
+			break;
 		case '?':
 		default:
 			pusage();
@@ -409,6 +444,22 @@ process_parameters(int argc, char **argv, BCPPARAMDATA *pdata)
 		}
 	}
 
+	/* Parallel copy: the data file or the query rows are split in ranges */
+	if (pdata->workers > 1) {
+		if (pdata->workers > MAX_WORKERS) {
+			fprintf(stderr, "-j cannot be greater than %d.\n", MAX_WORKERS);
+			return (FALSE);
+		}
+		if (pdata->direction == DB_IN && !pdata->cflag) {
+			fprintf(stderr, "-j can be used only copying in character data files (-c).\n");
+			return (FALSE);
+		}
+		if (pdata->direction == DB_IN && (pdata->fieldtermlen < 1 || pdata->rowtermlen < 1)) {
+			fprintf(stderr, "-j requires non empty field and row terminators.\n");
+			return (FALSE);
+		}
+	}
+
 	/* -k will be implemented on MSSQL by -hKEEP_NULLS */
 	if (pdata->ignoreDefaults) {
 		if (!pdata->hint)
@@ -475,15 +526,15 @@ process_Eflag(BCPPARAMDATA *pdata, DBPROCESS *dbproc)
 	return TRUE;
 }
 
-static int
-login_to_database(BCPPARAMDATA *pdata, DBPROCESS **pdbproc)
+static LOGINREC *
+init_login(BCPPARAMDATA *pdata)
 {
 	LOGINREC *login;
 
 	/* Initialize DB-Library. */
 
 	if (dbinit() == FAIL)
-		return (FALSE);
+		return NULL;
 
 	/*
 	 * Install the user-supplied error-handling and message-handling
@@ -504,7 +555,7 @@ login_to_database(BCPPARAMDATA *pdata, DBPROCESS **pdbproc)
 
 	login = dblogin();
 	if (!login)
-		return FALSE;
+		return NULL;
 
 	if (pdata->user)
 		DBSETLUSER(login, pdata->user);
@@ -528,6 +579,17 @@ login_to_database(BCPPARAMDATA *pdata, DBPROCESS **pdbproc)
 
 	BCP_SETL(login, TRUE);
 
+	return login;
+}
+
+static int
+login_to_database(BCPPARAMDATA *pdata, DBPROCESS **pdbproc)
+{
+	LOGINREC *login = init_login(pdata);
+
+	if (!login)
+		return (FALSE);
+
 	/*
 	 * Get a connection to the database.
 	 */
@@ -567,10 +629,9 @@ format_column(BCPPARAMDATA *pdata, DBPROCESS *dbproc, BCPFORMAT file_format, int
 }
 
 static int
-file_process(BCPPARAMDATA *pdata, DBPROCESS *dbproc, DBINT dir)
+file_setup(BCPPARAMDATA *pdata, DBPROCESS *dbproc, DBINT dir, const char *hostfile, const char *errorfile,
+	   int firstrow, int lastrow)
 {
-	DBINT li_rowsread = 0;
-	DBINT li_rowscopied = 0;
 	int i;
 	int li_numcols;
 
@@ -579,14 +640,14 @@ file_process(BCPPARAMDATA *pdata, DBPROCESS *dbproc, DBINT dir)
 	if (file_format == BCPFORMAT_NONE)
 		return FALSE;
 
-	if (FAIL == bcp_init(dbproc, pdata->dbobject, pdata->hostfilename, pdata->errorfile, dir))
+	if (FAIL == bcp_init(dbproc, pdata->dbobject, hostfile, errorfile, dir))
 		return FALSE;
 
 	if (!set_bcp_hints(pdata, dbproc))
 		return FALSE;
 
-	bcp_control(dbproc, BCPFIRST, pdata->firstrow);
-	bcp_control(dbproc, BCPLAST, pdata->lastrow);
+	bcp_control(dbproc, BCPFIRST, firstrow);
+	bcp_control(dbproc, BCPLAST, lastrow);
 	bcp_control(dbproc, BCPMAXERRS, pdata->maxerrors);
 
 	switch (file_format) {
@@ -620,6 +681,18 @@ file_process(BCPPARAMDATA *pdata, DBPROCESS *dbproc, DBINT dir)
 	if (!process_Eflag(pdata, dbproc))
 		return FALSE;
 
+	return TRUE;
+}
+
+static int
+file_process(BCPPARAMDATA *pdata, DBPROCESS *dbproc, DBINT dir)
+{
+	DBINT li_rowsread = 0;
+	DBINT li_rowscopied = 0;
+
+	if (!file_setup(pdata, dbproc, dir, pdata->hostfilename, pdata->errorfile, pdata->firstrow, pdata->lastrow))
+		return FALSE;
+
 	printf("\nStarting copy...\n\n");
 
 	if (FAIL == bcp_exec(dbproc, &li_rowscopied)) {
@@ -635,6 +708,343 @@ file_process(BCPPARAMDATA *pdata, DBPROCESS *dbproc, DBINT dir)
 	return TRUE;
 }
 
+/* find first occurrence of a terminator in a buffer */
+static const char *
+find_term(const char *p, const char *end, const char *term, int termlen)
+{
+	while (end - p >= termlen) {
+		p = (const char *) memchr(p, term[0], end - p - termlen + 1);
+		if (!p)
+			return NULL;
+		if (memcmp(p, term, termlen) == 0)
+			return p;
+		++p;
+	}
+	return NULL;
+}
+
+/*
+ * Scan a character data file to find where rows start, splitting it in
+ * parts of similar size. Fields are parsed like db-lib does, so a row is
+ * num_cols fields, the last one terminated by the row terminator.
+ * Fill offset and start_row of the workers and return the number of parts found.
+ */
+static int
+split_file(BCPPARAMDATA *pdata, int num_cols, BCPWORKER *workers, int num_workers)
+{
+	enum { BLOCK_SIZE = 64 * 1024 };
+	FILE *f;
+	char *buf;
+	DBBIGINT size, base = 0;
+	size_t len = 0, pos = 0;
+	DBINT row = 1;
+	int field = 0, found = 1;
+
+	workers[0].offset = 0;
+	workers[0].start_row = 1;
+
+	if ((f = fopen(pdata->hostfilename, "rb")) == NULL) {
+		fprintf(stderr, "%s: unable to open %s: %s\n", "freebcp", pdata->hostfilename, strerror(errno));
+		return 0;
+	}
+#ifdef HAVE_FSEEKO
+	size = fseeko(f, 0, SEEK_END) == 0 ? (DBBIGINT) ftello(f) : -1;
+#else
+	size = fseek(f, 0, SEEK_END) == 0 ? (DBBIGINT) ftell(f) : -1;
+#endif
+	buf = (char *) malloc(BLOCK_SIZE);
+	if (size < 0 || !buf || fseek(f, 0, SEEK_SET) != 0) {
+		free(buf);
+		fclose(f);
+		return 1;
+	}
+
+	while (found < num_workers) {
+		const char *term = field + 1 < num_cols ? pdata->fieldterm : pdata->rowterm;
+		int termlen = field + 1 < num_cols ? pdata->fieldtermlen : pdata->rowtermlen;
+		const char *p = find_term(buf + pos, buf + len, term, termlen);
+		size_t keep, got;
+
+		if (p) {
+			pos = p - buf + termlen;
+			if (++field < num_cols)
+				continue;
+
+			/* a new row starts here */
+			field = 0;
+			++row;
+			if (base + (DBBIGINT) pos < size && base + (DBBIGINT) pos >= size * found / num_workers) {
+				workers[found].offset = base + pos;
+				workers[found].start_row = row;
+				++found;
+			}
+			continue;
+		}
+
+		/* keep bytes which could be the start of a terminator and read more */
+		keep = TDS_MIN(len - pos, (size_t) termlen - 1);
+		memmove(buf, buf + len - keep, keep);
+		base += len - keep;
+		len = keep;
+		pos = 0;
+		got = fread(buf + len, 1, BLOCK_SIZE - len, f);
+		if (got == 0)
+			break;
+		len += got;
+	}
+
+	free(buf);
+	fclose(f);
+	return found;
+}
+
+/* count rows of the table or query to copy out, -1 on error */
+static DBINT
+count_rows(BCPPARAMDATA *pdata, DBPROCESS *dbproc)
+{
+	DBINT rows = -1;
+	RETCODE ret;
+
+	if (pdata->direction == DB_QUERYOUT)
+		ret = dbfcmd(dbproc, "select count(*) from (%s) freebcp_count", pdata->dbobject);
+	else
+		ret = dbfcmd(dbproc, "select count(*) from %s", pdata->dbobject);
+	if (ret == FAIL || dbsqlexec(dbproc) == FAIL)
+		return -1;
+
+	while ((ret = dbresults(dbproc)) == SUCCEED) {
+		while (dbnextrow(dbproc) == REG_ROW) {
+			if (rows < 0 && dbdatlen(dbproc, 1) > 0)
+				dbconvert(dbproc, dbcoltype(dbproc, 1), dbdata(dbproc, 1), dbdatlen(dbproc, 1),
+					  SYBINT4, (BYTE *) &rows, sizeof(rows));
+		}
+	}
+	return ret == FAIL ? -1 : rows;
+}
+
+/*
+ * Split the rows to copy out in ranges of similar size, by row number.
+ * The rows are counted unless a last row was specified; the last range
+ * is left open so rows added meanwhile are not lost.
+ * Fill start_row of the workers and return the number of ranges.
+ */
+static int
+split_rows(BCPPARAMDATA *pdata, DBPROCESS *dbproc, BCPWORKER *workers, int num_workers)
+{
+	DBINT first = TDS_MAX(pdata->firstrow, 1), last = pdata->lastrow;
+	int i;
+
+	if (last <= 0 && (last = count_rows(pdata, dbproc)) < 0) {
+		fprintf(stderr, "Unable to count rows to copy, use -L to specify the last row.\n");
+		return 0;
+	}
+
+	/* at least a row for every range */
+	if (last - first + 1 < num_workers)
+		num_workers = TDS_MAX(last - first + 1, 1);
+	for (i = 0; i < num_workers; ++i)
+		workers[i].start_row = first + (DBINT) ((DBBIGINT) (last - first + 1) * i / num_workers);
+	return num_workers;
+}
+
+/* write the parts copied out by the workers, in order, into the data file */
+static int
+merge_parts(BCPPARAMDATA *pdata, BCPWORKER *workers, int num_workers)
+{
+	enum { BLOCK_SIZE = 64 * 1024 };
+	FILE *out, *in;
+	char *buf;
+	size_t len;
+	int i, ok = TRUE;
+
+	if ((out = fopen(pdata->hostfilename, "wb")) == NULL) {
+		fprintf(stderr, "%s: unable to open %s: %s\n", "freebcp", pdata->hostfilename, strerror(errno));
+		return FALSE;
+	}
+	buf = (char *) malloc(BLOCK_SIZE);
+	if (!buf) {
+		fclose(out);
+		return FALSE;
+	}
+
+	for (i = 0; ok && i < num_workers; ++i) {
+		if ((in = fopen(workers[i].hostfile, "rb")) == NULL) {
+			fprintf(stderr, "%s: unable to open %s: %s\n", "freebcp", workers[i].hostfile, strerror(errno));
+			ok = FALSE;
+			break;
+		}
+		while ((len = fread(buf, 1, BLOCK_SIZE, in)) > 0) {
+			if (fwrite(buf, 1, len, out) != len) {
+				ok = FALSE;
+				break;
+			}
+		}
+		if (ferror(in))
+			ok = FALSE;
+		fclose(in);
+	}
+	if (fclose(out) != 0)
+		ok = FALSE;
+	if (!ok)
+		fprintf(stderr, "%s: error writing %s\n", "freebcp", pdata->hostfilename);
+
+	free(buf);
+	return ok;
+}
+
+static void
+worker_exec(BCPWORKER *worker)
+{
+	worker->ok = bcp_exec(worker->dbproc, &worker->rows_copied) != FAIL;
+}
+
+#ifdef TDS_HAVE_MUTEX
+static TDS_THREAD_PROC_DECLARE(worker_proc, arg)
+{
+	worker_exec((BCPWORKER *) arg);
+	return TDS_THREAD_RESULT(0);
+}
+#endif
+
+/*
+ * Copy data using multiple connections concurrently.
+ * Every connection copies a range of rows. Copying in it commits its own
+ * batches; copying out it writes its own part of the data file, parts are
+ * joined at the end.
+ */
+static int
+parallel_process(BCPPARAMDATA *pdata)
+{
+	LOGINREC *login;
+	BCPWORKER *workers;
+	DBPROCESS *dbproc;
+	struct timeval start, end;
+	DBINT total = 0;
+	double elapsed;
+	int i, num_workers, active = 0;
+	int ok = FALSE;
+
+	if ((login = init_login(pdata)) == NULL)
+		return FALSE;
+
+	workers = tds_new0(BCPWORKER, pdata->workers);
+	if (!workers) {
+		dbloginfree(login);
+		return FALSE;
+	}
+
+	/* first connection is used to get the columns of the data file or to count rows */
+	if ((dbproc = dbopen(login, pdata->server)) == NULL) {
+		fprintf(stderr, "Can't connect to server \"%s\".\n", pdata->server);
+		goto cleanup;
+	}
+	workers[0].dbproc = dbproc;
+	if (pdata->direction == DB_IN) {
+		if (FAIL == bcp_init(dbproc, pdata->dbobject, pdata->hostfilename, NULL, DB_IN))
+			goto cleanup;
+		num_workers = split_file(pdata, bcp_gethostcolcount(dbproc), workers, pdata->workers);
+	} else {
+		num_workers = split_rows(pdata, dbproc, workers, pdata->workers);
+	}
+	if (num_workers < 1)
+		goto cleanup;
+
+	for (i = 0; i < num_workers; ++i) {
+		BCPWORKER *worker = &workers[active];
+		int firstrow = TDS_MAX(pdata->firstrow, workers[i].start_row);
+		int lastrow = i + 1 < num_workers ? workers[i + 1].start_row - 1 : 0;
+
+		if (pdata->lastrow > 0 && (lastrow == 0 || lastrow > pdata->lastrow))
+			lastrow = pdata->lastrow;
+		/* no rows to copy for this part */
+		if (lastrow > 0 && firstrow > lastrow)
+			continue;
+
+		worker->index = active;
+		worker->offset = workers[i].offset;
+		worker->start_row = workers[i].start_row;
+		worker->firstrow = firstrow;
+		worker->lastrow = lastrow;
+		if (!worker->dbproc) {
+			if ((worker->dbproc = dbopen(login, pdata->server)) == NULL) {
+				fprintf(stderr, "Can't connect to server \"%s\".\n", pdata->server);
+				goto cleanup;
+			}
+		}
+		++active;
+		if (pdata->errorfile && asprintf(&worker->errorfile, "%s.%d", pdata->errorfile, active) < 0) {
+			worker->errorfile = NULL;
+			goto cleanup;
+		}
+		if (pdata->direction != DB_IN && asprintf(&worker->hostfile, "%s.%d", pdata->hostfilename, active) < 0) {
+			worker->hostfile = NULL;
+			goto cleanup;
+		}
+
+		dbsetuserdata(worker->dbproc, (BYTE *) worker);
+		if (!setoptions(worker->dbproc, pdata)
+		    || !file_setup(pdata, worker->dbproc, pdata->direction,
+				   worker->hostfile ? worker->hostfile : pdata->hostfilename,
+				   worker->errorfile, firstrow, lastrow))
+			goto cleanup;
+		if (pdata->direction == DB_IN
+		    && bcp_setfilestart(worker->dbproc, worker->offset, worker->start_row) == FAIL)
+			goto cleanup;
+	}
+
+	printf("\nStarting copy using %d connections...\n\n", active);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < active; ++i) {
+#ifdef TDS_HAVE_MUTEX
+		if (tds_thread_create(&workers[i].thread, worker_proc, &workers[i]) == 0) {
+			workers[i].started = true;
+			continue;
+		}
+#endif
+		worker_exec(&workers[i]);
+	}
+
+	ok = TRUE;
+	for (i = 0; i < active; ++i) {
+		BCPWORKER *worker = &workers[i];
+
+#ifdef TDS_HAVE_MUTEX
+		if (worker->started)
+			tds_thread_join(worker->thread, NULL);
+#endif
+		if (!worker->ok) {
+			fprintf(stderr, "bcp copy %s failed for rows starting at %d\n",
+				(pdata->direction == DB_IN) ? "in" : "out", worker->firstrow);
+			ok = FALSE;
+			continue;
+		}
+		total += worker->rows_copied;
+	}
+	if (ok && pdata->direction != DB_IN)
+		ok = merge_parts(pdata, workers, active);
+	gettimeofday(&end, NULL);
+
+	elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%d rows copied.\n", total);
+	printf("Clock Time (ms.): total = %ld (%.2f rows per sec.)\n", (long) (elapsed * 1000.0),
+	       elapsed > 0 ? total / elapsed : 0.0);
+
+cleanup:
+	for (i = 0; i < pdata->workers; ++i) {
+		if (workers[i].dbproc)
+			dbclose(workers[i].dbproc);
+		free(workers[i].errorfile);
+		if (workers[i].hostfile) {
+			remove(workers[i].hostfile);
+			free(workers[i].hostfile);
+		}
+	}
+	free(workers);
+	dbloginfree(login);
+	return ok;
+}
+
 static int
 setoptions(DBPROCESS *dbproc, BCPPARAMDATA *params)
 {
@@ -720,7 +1130,7 @@ pusage(void)
 	fprintf(stderr, "        [-U username] [-P password] [-I interfaces_file] [-S server] [-D database]\n");
 	fprintf(stderr, "        [-v] [-d] [-h \"hint [,...]\" [-O \"set connection_option on|off, ...]\"\n");
 	fprintf(stderr, "        [-A packet size] [-T text or image size] [-E]\n");
-	fprintf(stderr, "        [-i input_file] [-o output_file] [-k]\n");
+	fprintf(stderr, "        [-i input_file] [-o output_file] [-k] [-j connections]\n");
 	fprintf(stderr, "        \n");
 	fprintf(stderr, "example: freebcp testdb.dbo.inserttest in inserttest.txt -S mssql -U guest -P password -c\n");
 }
@@ -732,7 +1142,12 @@ err_handler(DBPROCESS *dbproc, int severity, int dberr, int oserr TDS_UNUSED, ch
 
 	if (dberr == SYBEBBCI) { /* Batch successfully bulk copied to the server */
 		int batch = bcp_getbatchsize(dbproc);
-		printf("%d rows sent to SQL Server.\n", sent += batch);
+		BCPWORKER *worker = (BCPWORKER *) dbgetuserdata(dbproc);
+
+		if (worker)
+			printf("%d rows sent to SQL Server by connection %d.\n", worker->sent += batch, worker->index + 1);
+		else
+			printf("%d rows sent to SQL Server.\n", sent += batch);
 		return INT_CANCEL;
 	}
 
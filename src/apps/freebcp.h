@@ -51,6 +51,7 @@ typedef struct pd
 	char *options;
 	char *charset;
 	int packetsize;
+	int workers;
 	bool fflag;
 	bool nflag;
 	bool cflag;
@@ -132,6 +132,121 @@ test_error(void)
 	tsql(clean);
 }
 
+/* check rows loaded in bcp_in table */
+static void
+check_rows(const char *expected)
+{
+	char *out = tsql_out("SELECT CAST(COUNT(*) AS VARCHAR(20)) + ':' + CAST(SUM(num) AS VARCHAR(20)) FROM bcp_in "
+			     "WHERE txt = 'row ' + CAST(num AS VARCHAR(20))\n");
+
+	assert(out);
+	if (!strstr(out, expected)) {
+		fprintf(stderr, "Expected %s, got:\n%s\n", expected, out);
+		exit(1);
+	}
+	free(out);
+}
+
+static void
+test_parallel(void)
+{
+	static const char clean[] = "IF OBJECT_ID('bcp_in') IS NOT NULL DROP TABLE bcp_in\n";
+	char *data, *p;
+	int i;
+
+	data = (char *) malloc(1000 * 32);
+	assert(data);
+	for (p = data, i = 1; i <= 1000; ++i)
+		p += sprintf(p, "%d|row %d\n", i, i);
+
+	tsql(clean);
+	tsql("CREATE TABLE bcp_in(num INT NOT NULL, txt VARCHAR(20) NULL)\n");
+	freebcp("bcp_in", data, "-c -t \"|\" -b 100 -j 3 ");
+	check_rows("1000:500500");
+
+	/* first and last rows refer to the whole file */
+	tsql("TRUNCATE TABLE bcp_in\n");
+	freebcp("bcp_in", data, "-c -t \"|\" -b 100 -j 4 -F 101 -L 900 ");
+	check_rows("800:400400");
+
+	tsql(clean);
+	free(data);
+}
+
+/* copy out using freebcp, return content of data file */
+static char *
+freebcp_out(const char *object_name, const char *direction, const char *added_options)
+{
+	char cmd[2048];
+	char *const end = cmd + sizeof(cmd) - 1;
+	char *p, *data;
+
+	strcpy(cmd, "freebcp" EXE_SUFFIX);
+	p = strchr(cmd, 0);
+	p = add_string(p, end, " ");
+	p = quote_arg(p, end, object_name);
+	p = add_string(p, end, " ");
+	p = add_string(p, end, direction);
+	p = add_string(p, end, " parallel.txt ");
+	p = add_string(p, end, added_options);
+	p = add_server(p, end);
+	*p = 0;
+	printf("Executing: %s\n", cmd);
+	if (system(cmd) != 0) {
+		fprintf(stderr, "Failed command\n");
+		exit(1);
+	}
+	data = read_file("parallel.txt");
+	assert(data);
+	unlink("parallel.txt");
+	return data;
+}
+
+/* build rows first-last as written by freebcp */
+static char *
+rows_data(int first, int last)
+{
+	char *data = (char *) malloc((last - first + 1) * 32 + 1), *p = data;
+	int i;
+
+	assert(data);
+	*p = 0;
+	for (i = first; i <= last; ++i)
+		p += sprintf(p, "%d|row %d\n", i, i);
+	return data;
+}
+
+static void
+check_data(char *data, char *expected)
+{
+	if (strcmp(data, expected) != 0) {
+		fprintf(stderr, "Wrong data copied out:\n%s\n", data);
+		exit(1);
+	}
+	free(data);
+	free(expected);
+}
+
+static void
+test_parallel_out(void)
+{
+	static const char clean[] = "IF OBJECT_ID('bcp_out') IS NOT NULL DROP TABLE bcp_out\n";
+	char *data = rows_data(1, 1000);
+
+	tsql(clean);
+	tsql("CREATE TABLE bcp_out(num INT NOT NULL PRIMARY KEY, txt VARCHAR(20) NULL)\n");
+	freebcp("bcp_out", data, "-c -t \"|\" ");
+
+	/* parts written by every connection are joined in order */
+	check_data(freebcp_out("bcp_out", "out", "-c -t \"|\" -j 3 "), data);
+
+	/* first and last rows refer to the whole result */
+	check_data(freebcp_out("SELECT num, txt FROM bcp_out ORDER BY num", "queryout", "-c -t \"|\" -j 4 -F 101 -L 900 "),
+		   rows_data(101, 900));
+
+	tsql(clean);
+}
+
 TEST_MAIN()
 {
 	cleanup();
@@ -141,6 +256,8 @@ TEST_MAIN()
 		return 1;
 
 	test_error();
+	test_parallel();
+	test_parallel_out();
 
 	cleanup();
 	return 0;
@@ -773,7 +773,7 @@ _blk_get_col_data(TDSBCPINFO *bulk, TDSCOLUMN *bindcol, int index TDS_UNUSED, in
 		}
 
 		/* if convert return FAIL mark error but process other columns */
-		destlen = _cs_cs2tds(ctx, &srcfmt, src, desttype, p_cres);
+		destlen = _cs_cs2tds(ctx, &srcfmt, src, desttype, p_cres, &bindcol->column_convert);
 		if (destlen < 0) {
 			switch (destlen) {
 			case TDS_CONVERT_SYNTAX:
@@ -503,12 +503,19 @@ cs_config(CS_CONTEXT * ctx, CS_INT action, CS_INT property, CS_VOID * buffer, CS
 	return CS_FAIL;
 }
 
+/**
+ * Convert data from client to a TDS type.
+ * @param cache if not NULL conversion function is cached here, used
+ *              converting many values (like bound columns)
+ */
 TDS_INT
-_cs_cs2tds(CS_CONTEXT *ctx, const CS_DATAFMT_COMMON *srcfmt, const void *srcdata, int desttype, CONV_RESULT *cres)
+_cs_cs2tds(CS_CONTEXT *ctx, const CS_DATAFMT_COMMON *srcfmt, const void *srcdata, int desttype, CONV_RESULT *cres,
+	   TDS_CONVERT_CACHE *cache)
 {
 	TDS_SERVER_TYPE src_type;
 	int src_len, len;
 	CS_INT datatype;
+	TDS_CONVERT_FUNC convert = tds_convert;
 
 	datatype = srcfmt->datatype;
 	src_type = _ct_get_server_type(NULL, datatype);
@@ -541,7 +548,10 @@ _cs_cs2tds(CS_CONTEXT *ctx, const CS_DATAFMT_COMMON *srcfmt, const void *srcdata
 
 	tdsdump_log(TDS_DBG_FUNC, "converting type %d (%d bytes) to type = %d\n", src_type, src_len, desttype);
 
-	len = tds_convert(ctx->tds_ctx, src_type, srcdata, src_len, desttype, cres);
+	/* sized types are written directly in destination buffer */
+	if (cache)
+		convert = tds_get_convert_func_cached(cache, src_type, desttype);
+	len = convert(ctx->tds_ctx, src_type, srcdata, src_len, desttype, cres);
 
 	tdsdump_log(TDS_DBG_FUNC, "_cs_cs2tds() tds_convert returned %d\n", len);
 
@@ -569,7 +579,8 @@ is_power_of_two_or_zero(CS_INT value)
 
 CS_RETCODE
 _cs_convert(CS_CONTEXT *ctx, const CS_DATAFMT_COMMON *srcfmt, CS_VOID *srcdata,
-	    const CS_DATAFMT_COMMON *destfmt, CS_VOID *destdata, CS_INT *resultlen)
+	    const CS_DATAFMT_COMMON *destfmt, CS_VOID *destdata, CS_INT *resultlen,
+	    TDS_CONVERT_CACHE *cache)
 {
 	CONV_RESULT cr, *p_cr = &cr;
 	TDS_INT res;
@@ -691,7 +702,7 @@ _cs_convert(CS_CONTEXT *ctx, const CS_DATAFMT_COMMON *srcfmt, CS_VOID *srcdata,
 		break;
 	}
 
-	res = _cs_cs2tds(ctx, srcfmt, srcdata, desttype, p_cr);
+	res = _cs_cs2tds(ctx, srcfmt, srcdata, desttype, p_cr, cache);
 	if (res < 0) {
 		/* other errors are already reported */
 		switch (res) {
@@ -769,7 +780,8 @@ _cs_convert(CS_CONTEXT *ctx, const CS_DATAFMT_COMMON *srcfmt, CS_VOID *srcdata,
 CS_RETCODE
 cs_convert(CS_CONTEXT *ctx, CS_DATAFMT *srcfmt, CS_VOID *srcdata, CS_DATAFMT *destfmt, CS_VOID *destdata, CS_INT *resultlen)
 {
-	return _cs_convert(ctx, _ct_datafmt_common(ctx, srcfmt), srcdata, _ct_datafmt_common(ctx, destfmt), destdata, resultlen);
+	return _cs_convert(ctx, _ct_datafmt_common(ctx, srcfmt), srcdata, _ct_datafmt_common(ctx, destfmt), destdata, resultlen,
+			   NULL);
 }
 
 CS_RETCODE
@@ -57,6 +57,12 @@ static void _ct_initialise_cmd(CS_COMMAND *cmd);
 static CS_RETCODE _ct_cancel_cleanup(CS_COMMAND * cmd);
 static CS_INT _ct_map_compute_op(CS_INT comp_op);
 static bool query_has_for_update(const char *query);
+static bool _ct_async(CS_CONNECTION * con);
+static CS_RETCODE _ct_async_start(CS_CONNECTION * con, const char *funcname, CS_INT op, CS_COMMAND * cmd, CS_INT * out);
+static void _ct_async_clear(CS_CONNECTION * con);
+
+/** bytes which let an asynchronous read proceed before reply is complete */
+#define CT_ASYNC_READ_AHEAD (64 * 1024)
 
 /* Added for CT_DIAG */
 /* Code changes starts here - CT_DIAG - 01 */
@@ -158,6 +164,9 @@ _ct_get_user_api_layer_error(int error)
 	case 9:
 		return "The %1! parameter must be set to CS_UNUSED.";
 		break;
+	case 14:
+		return "An asynchronous operation is already pending for this connection.";
+		break;
 	case 15:
 		return "Use direction CS_BLK_IN or CS_BLK_OUT for a bulk copy operation.";
 		break;
@@ -319,6 +328,7 @@ ct_init(CS_CONTEXT * ctx, CS_INT version)
 	ctx->tds_ctx->msg_handler = _ct_handle_server_message;
 	ctx->tds_ctx->err_handler = _ct_handle_client_message;
 	ctx->use_large_identifiers = _ct_is_large_identifiers_version(version);
+	ctx->netio = CS_SYNC_IO;
 
 	return CS_SUCCEED;
 }
@@ -350,6 +360,9 @@ ct_con_alloc(CS_CONTEXT * ctx, CS_CONNECTION ** con)
 
 	/* so we know who we belong to */
 	(*con)->ctx = ctx;
+	(*con)->netio = ctx->netio;
+	(*con)->next = ctx->conns;
+	ctx->conns = *con;
 
 	/* tds_set_packet((*con)->tds_login, TDS_DEF_BLKSZ); */
 	return CS_SUCCEED;
@@ -390,6 +403,9 @@ ct_callback(CS_CONTEXT * ctx, CS_CONNECTION * con, CS_INT action, CS_INT type, C
 		case CS_INTERRUPT_CB:
 			out_func = (CS_VOID *) (con ? con->interrupt_cb : ctx->interrupt_cb);
 			break;
+		case CS_COMPLETION_CB:
+			out_func = (CS_VOID *) (con ? con->completion_cb : ctx->completion_cb);
+			break;
 #if ENABLE_EXTRA_CHECKS
 		case CS_QUERY_HAS_FOR_UPDATE:
 			out_func = (CS_VOID *) query_has_for_update;
@@ -434,6 +450,12 @@ ct_callback(CS_CONTEXT * ctx, CS_CONNECTION * con, CS_INT action, CS_INT type, C
 		else
 			ctx->interrupt_cb = (CS_INTERRUPT_FUNC) funcptr;
 		break;
+	case CS_COMPLETION_CB:
+		if (con)
+			con->completion_cb = (CS_COMPLETION_FUNC) (void (*)(void)) funcptr;
+		else
+			ctx->completion_cb = (CS_COMPLETION_FUNC) (void (*)(void)) funcptr;
+		break;
 	default:
 		_ctclient_msg(ctx, con, "ct_callback()", 1, 1, 1, 5, "%d, %s", type, "type");
 		return CS_FAIL;
@@ -623,6 +645,18 @@ ct_con_props(CS_CONNECTION * con, CS_INT action, CS_INT property, CS_VOID * buff
 		case CS_SEC_DELEGATION:
 		        tds_login->gssapi_use_delegation = !!(*(CS_INT *) buffer);
 			break;
+		case CS_NETIO:
+			memcpy(&intval, buffer, sizeof(intval));
+			if (intval != CS_SYNC_IO && intval != CS_ASYNC_IO && intval != CS_DEFER_IO) {
+				_ctclient_msg(NULL, con, "ct_con_props(SET,NETIO)", 1, 1, 1, 5, "%d, %s", intval, "buffer");
+				return CS_FAIL;
+			}
+			if (con->async_op) {
+				_ctclient_msg(NULL, con, "ct_con_props(SET,NETIO)", 1, 1, 1, 14, "");
+				return CS_FAIL;
+			}
+			con->netio = intval;
+			break;
 		default:
 			tdsdump_log(TDS_DBG_ERROR, "Unknown property %d\n", property);
 			break;
@@ -762,6 +796,12 @@ ct_con_props(CS_CONNECTION * con, CS_INT action, CS_INT property, CS_VOID * buff
 		case CS_ENDPOINT:
 			*(CS_INT *) buffer = tds_get_s(con->tds_socket);
 			break;
+		case CS_NETIO:
+			intval = con->netio ? con->netio : CS_SYNC_IO;
+			memcpy(buffer, &intval, sizeof(intval));
+			if (out_len)
+				*out_len = sizeof(intval);
+			break;
 		default:
 			tdsdump_log(TDS_DBG_ERROR, "Unknown property %d\n", property);
 			break;
@@ -1079,6 +1119,9 @@ ct_send(CS_COMMAND * cmd)
 		return CS_FAIL;
 	}
 
+	if (_ct_async(cmd->con))
+		return _ct_async_start(cmd->con, "ct_send", CT_SEND, cmd, NULL);
+
 	cmd->results_state = _CS_RES_NONE;
 
 	if (cmd->command_type == CS_DYNAMIC_CMD) {
@@ -1329,6 +1372,14 @@ ct_results(CS_COMMAND * cmd, CS_INT * result_type)
 	if (!cmd->con || !cmd->con->tds_socket)
 		return CS_FAIL;
 
+	if (!result_type) {
+		_ctclient_msg(NULL, cmd->con, "ct_results", 1, 1, 1, 3, "%s", "result_type");
+		return CS_FAIL;
+	}
+
+	if (_ct_async(cmd->con))
+		return _ct_async_start(cmd->con, "ct_results", CT_RESULTS, cmd, result_type);
+
 	cmd->bind_count = CS_UNUSED;
 
 	context = cmd->con->ctx;
@@ -1749,11 +1800,27 @@ ct_fetch(CS_COMMAND * cmd, CS_INT type, CS_INT offset, CS_INT option, CS_INT * p
 		return CS_FAIL;
 	}
 
+	if (type != CS_UNUSED) {
+		_ctclient_msg(NULL, cmd->con, "ct_fetch", 1, 1, 1, 9, "%s", "type");
+		return CS_FAIL;
+	}
+	if (offset != CS_UNUSED) {
+		_ctclient_msg(NULL, cmd->con, "ct_fetch", 1, 1, 1, 9, "%s", "offset");
+		return CS_FAIL;
+	}
+	if (option != CS_UNUSED) {
+		_ctclient_msg(NULL, cmd->con, "ct_fetch", 1, 1, 1, 9, "%s", "option");
+		return CS_FAIL;
+	}
+
 	if (cmd->cancel_state == _CS_CANCEL_PENDING) {
 		_ct_cancel_cleanup(cmd);
 		return CS_CANCELED;
 	}
 
+	if (_ct_async(cmd->con))
+		return _ct_async_start(cmd->con, "ct_fetch", CT_FETCH, cmd, prows_read);
+
 	if (!prows_read)
 		prows_read = &rows_read_dummy;
 
@@ -2017,7 +2084,7 @@ _ct_bind_data(CS_CONTEXT *ctx, TDSRESULTINFO * resinfo, TDSRESULTINFO *bindinfo,
 		destfmt.format = bindcol->column_bindfmt;
 
 		/* if convert return FAIL mark error but process other columns */
-		ret = _cs_convert(ctx, &srcfmt, src, &destfmt, dest, pdatalen);
+		ret = _cs_convert(ctx, &srcfmt, src, &destfmt, dest, pdatalen, &bindcol->column_convert);
 		if (ret != CS_SUCCEED) {
 			tdsdump_log(TDS_DBG_FUNC, "cs_convert-result = %d\n", ret);
 			result = 1;
@@ -2055,6 +2122,9 @@ ct_cmd_drop(CS_COMMAND * cmd)
 		if (con) {
 			CS_COMMAND **pvictim;
 
+			if (con->async_cmd == cmd)
+				_ct_async_clear(con);
+
 			for (pvictim = &con->cmds; *pvictim != cmd; ) {
 				if (!*pvictim) {
 					tdsdump_log(TDS_DBG_FUNC, "ct_cmd_drop() : cannot find command entry in list \n");
@@ -2078,6 +2148,7 @@ ct_close(CS_CONNECTION * con, CS_INT option)
 {
 	tdsdump_log(TDS_DBG_FUNC, "ct_close(%p, %d)\n", con, option);
 
+	_ct_async_clear(con);
 	tds_close_socket(con->tds_socket);
 	tds_free_socket(con->tds_socket);
 	con->tds_socket = NULL;
@@ -2092,6 +2163,13 @@ ct_con_drop(CS_CONNECTION * con)
 	tdsdump_log(TDS_DBG_FUNC, "ct_con_drop(%p)\n", con);
 
 	if (con) {
+		CS_CONNECTION **pcon;
+
+		for (pcon = &con->ctx->conns; *pcon; pcon = &(*pcon)->next)
+			if (*pcon == con) {
+				*pcon = con->next;
+				break;
+			}
 		free(con->userdata);
 		if (con->tds_login)
 			tds_free_login(con->tds_login);
@@ -2354,6 +2432,10 @@ ct_cancel(CS_CONNECTION * conn, CS_COMMAND * cmd, CS_INT type)
 
 	tdsdump_log(TDS_DBG_FUNC, "ct_cancel(%p, %p, %d)\n", conn, cmd, type);
 
+	/* pending asynchronous operation won't be completed */
+	if (conn || (cmd && cmd->con))
+		_ct_async_clear(conn ? conn : cmd->con);
+
 	/*
 	 * Comments taken from Sybase ct-library reference manual
 	 * ------------------------------------------------------
@@ -2380,9 +2462,14 @@ ct_cancel(CS_CONNECTION * conn, CS_COMMAND * cmd, CS_INT type)
 		}
 
 		tdsdump_log(TDS_DBG_FUNC, "ct_cancel() - fetching results()\n");
+		/* cancel is always synchronous */
+		if (cmd->con)
+			cmd->con->async_running = true;
 		do {
 			ret = ct_fetch(cmd, CS_UNUSED, CS_UNUSED, CS_UNUSED, NULL);
 		} while ((ret == CS_SUCCEED) || (ret == CS_ROW_FAIL));
+		if (cmd->con)
+			cmd->con->async_running = false;
 
 		if (cmd->con && cmd->con->tds_socket)
 			tds_free_all_results(cmd->con->tds_socket);
@@ -2811,6 +2898,26 @@ ct_config(CS_CONTEXT * ctx, CS_INT action, CS_INT property, CS_VOID * buffer, CS
 	case CS_NOTE_EMPTY_DATA:
 		ret = config_bool(action, buf, &ctx->config.cs_note_empty_data);
 		break;
+	case CS_NETIO:
+		switch (action) {
+		case CS_SET:
+			if (*buf != CS_SYNC_IO && *buf != CS_ASYNC_IO && *buf != CS_DEFER_IO) {
+				ret = CS_FAIL;
+				break;
+			}
+			ctx->netio = *buf;
+			break;
+		case CS_GET:
+			*buf = ctx->netio ? ctx->netio : CS_SYNC_IO;
+			break;
+		case CS_CLEAR:
+			ctx->netio = CS_SYNC_IO;
+			break;
+		default:
+			ret = CS_FAIL;
+			break;
+		}
+		break;
 	default:
 		ret = CS_SUCCEED;
 		break;
@@ -4027,15 +4134,213 @@ SEND_OPTION:
 	return CS_SUCCEED;
 }				/* end ct_options() */
 
+/**
+ * Check if a call on the connection should be executed asynchronously.
+ */
+static bool
+_ct_async(CS_CONNECTION * con)
+{
+	return (con->netio == CS_ASYNC_IO || con->netio == CS_DEFER_IO) && !con->async_running;
+}
+
+/**
+ * Register an asynchronous operation on the connection.
+ * Arguments must be already validated, the operation is executed by
+ * ct_poll once it can proceed.
+ * \return CS_PENDING or CS_BUSY if another operation is pending
+ */
+static CS_RETCODE
+_ct_async_start(CS_CONNECTION * con, const char *funcname, CS_INT op, CS_COMMAND * cmd, CS_INT * out)
+{
+	tdsdump_log(TDS_DBG_FUNC, "_ct_async_start(%p, %s, %d, %p, %p)\n", con, funcname, op, cmd, out);
+
+	if (con->async_op) {
+		_ctclient_msg(NULL, con, funcname, 1, 1, 1, 14, "");
+		return CS_BUSY;
+	}
+
+	con->async_op = op;
+	con->async_cmd = cmd;
+	con->async_out = out;
+	con->async_done = false;
+	return CS_PENDING;
+}
+
+static void
+_ct_async_clear(CS_CONNECTION * con)
+{
+	con->async_op = 0;
+	con->async_cmd = NULL;
+	con->async_out = NULL;
+	con->async_done = false;
+}
+
+/**
+ * Check if pending asynchronous operation can be executed without blocking.
+ * Reading operations can proceed when the reply is complete or enough data
+ * are buffered, data received are read ahead meanwhile.
+ * \return 1 if operation can proceed, 0 if it has to wait, -1 on error
+ */
+static int
+_ct_async_ready(CS_CONNECTION * con)
+{
+	if (con->async_done)
+		return 1;
+	/* wait socket to be writable */
+	if (con->async_op == CT_SEND)
+		return IS_TDSDEAD(con->tds_socket) ? -1 : 0;
+	return tds_read_ahead(con->tds_socket, CT_ASYNC_READ_AHEAD);
+}
+
+/**
+ * Execute pending asynchronous operation, connection should be ready.
+ */
+static void
+_ct_async_run(CS_CONNECTION * con)
+{
+	CS_COMMAND *cmd = con->async_cmd;
+
+	con->async_running = true;
+	switch (con->async_op) {
+	case CT_SEND:
+		con->async_status = ct_send(cmd);
+		break;
+	case CT_RESULTS:
+		con->async_status = ct_results(cmd, con->async_out);
+		break;
+	case CT_FETCH:
+		con->async_status = ct_fetch(cmd, CS_UNUSED, CS_UNUSED, CS_UNUSED, con->async_out);
+		break;
+	default:
+		con->async_status = CS_FAIL;
+		break;
+	}
+	con->async_running = false;
+	con->async_done = true;
+}
+
+/**
+ * Complete asynchronous operations started with CS_ASYNC_IO or CS_DEFER_IO.
+ * Waits up to milliseconds for either the given connection or any connection
+ * of the context to be ready, executes the pending operation of the first
+ * one ready and reports it, calling the completion callback if set.
+ * A send is executed once the socket is writable; requests larger than
+ * the socket buffer can still block while written.
+ * Reads are executed once the reply is completely received or at least
+ * CT_ASYNC_READ_AHEAD bytes are buffered, so they block only on larger
+ * replies, when a single row does not fit in the buffered data.
+ * With TLS a read is executed as soon as some data are available.
+ * Without a background thread operations progress only inside this
+ * function, so CS_ASYNC_IO behaves like CS_DEFER_IO.
+ */
 CS_RETCODE
 ct_poll(CS_CONTEXT * ctx, CS_CONNECTION * connection, CS_INT milliseconds, CS_CONNECTION ** compconn, CS_COMMAND ** compcmd,
 	CS_INT * compid, CS_INT * compstatus)
 {
-	tdsdump_log(TDS_DBG_FUNC, "UNIMPLEMENTED ct_poll()\n");
+	CS_CONNECTION *con, **cons = NULL;
+	TDSSOCKET **sockets = NULL;
+	unsigned *sels = NULL;
+	CS_COMPLETION_FUNC completion_cb;
+	CS_INT op;
+	CS_COMMAND *cmd;
+	unsigned num, start = tds_gettime_ms();
+	int idx, timeout = -1;
+
 	tdsdump_log(TDS_DBG_FUNC, "ct_poll(%p, %p, %d, %p, %p, %p, %p)\n",
 				ctx, connection, milliseconds, compconn, compcmd, compid, compstatus);
 
-	return CS_FAIL;
+	if (!!ctx == !!connection) {
+		_ctclient_msg(ctx, connection, "ct_poll()", 1, 1, 1, 51, "");
+		return CS_FAIL;
+	}
+	if (milliseconds < 0 && milliseconds != CS_NO_LIMIT) {
+		_ctclient_msg(ctx, connection, "ct_poll()", 1, 1, 1, 5, "%d, %s", milliseconds, "milliseconds");
+		return CS_FAIL;
+	}
+	if (connection)
+		ctx = connection->ctx;
+
+	for (;;) {
+		/* look for operations which can proceed, reading data already received */
+		num = 0;
+		for (con = connection ? connection : ctx->conns; con; con = connection ? NULL : con->next) {
+			if (!con->async_op)
+				continue;
+			if (_ct_async_ready(con))
+				goto ready;
+			++num;
+		}
+		if (!num) {
+			free(cons);
+			free(sockets);
+			free(sels);
+			return CS_QUIET;
+		}
+
+		if (milliseconds != CS_NO_LIMIT) {
+			timeout = milliseconds - (int) (tds_gettime_ms() - start);
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+		if (!cons) {
+			cons = tds_new(CS_CONNECTION *, num);
+			sockets = tds_new(TDSSOCKET *, num);
+			sels = tds_new(unsigned, num);
+			if (!cons || !sockets || !sels) {
+				free(cons);
+				free(sockets);
+				free(sels);
+				_ctclient_msg(ctx, connection, "ct_poll()", 1, 1, 1, 2, "");
+				return CS_FAIL;
+			}
+		}
+		num = 0;
+		for (con = connection ? connection : ctx->conns; con; con = connection ? NULL : con->next) {
+			if (!con->async_op)
+				continue;
+			cons[num] = con;
+			sockets[num] = con->tds_socket;
+			sels[num++] = con->async_op == CT_SEND ? TDSSELWRITE : TDSSELREAD;
+		}
+		idx = tds_select_any(sockets, sels, num, timeout);
+		if (idx < 0) {
+			free(cons);
+			free(sockets);
+			free(sels);
+			return idx == -1 ? CS_TIMED_OUT : CS_FAIL;
+		}
+		con = cons[idx];
+		if (con->async_op == CT_SEND)
+			goto ready;
+		/* read data received and check again */
+	}
+
+ready:
+	free(cons);
+	free(sockets);
+	free(sels);
+
+	if (!con->async_done)
+		_ct_async_run(con);
+
+	op = con->async_op;
+	cmd = con->async_cmd;
+	if (compconn)
+		*compconn = con;
+	if (compcmd)
+		*compcmd = cmd;
+	if (compid)
+		*compid = op;
+	if (compstatus)
+		*compstatus = con->async_status;
+	_ct_async_clear(con);
+
+	completion_cb = con->completion_cb ? con->completion_cb : con->ctx->completion_cb;
+	if (completion_cb)
+		completion_cb(con, cmd, op, con->async_status);
+
+	return CS_SUCCEED;
 }
 
 static CS_RETCODE
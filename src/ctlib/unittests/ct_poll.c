@@ -0,0 +1,105 @@
+/*
+ * Purpose: Test asynchronous execution using CS_DEFER_IO and ct_poll
+ */
+
+#include "common.h"
+
+static int completions = 0;
+
+static CS_RETCODE
+on_completion(CS_CONNECTION *con, CS_COMMAND *cmd, CS_INT function, CS_RETCODE status)
+{
+	printf("completion %d on %p/%p status %d\n", function, con, cmd, status);
+	++completions;
+	return CS_SUCCEED;
+}
+
+static CS_RETCODE
+wait_completion(CS_CONTEXT *ctx, CS_CONNECTION *conn, CS_COMMAND *cmd, CS_INT function)
+{
+	CS_CONNECTION *compconn;
+	CS_COMMAND *compcmd;
+	CS_INT compid, compstatus;
+	CS_RETCODE ret;
+
+	do {
+		ret = ct_poll(ctx, NULL, 1000, &compconn, &compcmd, &compid, &compstatus);
+	} while (ret == CS_TIMED_OUT);
+
+	assert(ret == CS_SUCCEED);
+	assert(compconn == conn);
+	assert(compcmd == cmd);
+	assert(compid == function);
+	return compstatus;
+}
+
+TEST_MAIN()
+{
+	bool verbose = false;
+	CS_CONTEXT *ctx;
+	CS_CONNECTION *conn;
+	CS_COMMAND *cmd;
+	CS_INT netio, result_type, rows_read, value = 0, num_rows = 0;
+	CS_DATAFMT datafmt;
+	CS_RETCODE ret;
+
+	check_call(try_ctlogin, (&ctx, &conn, &cmd, verbose));
+
+	check_call(ct_callback, (NULL, conn, CS_SET, CS_COMPLETION_CB, (CS_VOID *) on_completion));
+
+	netio = CS_DEFER_IO;
+	check_call(ct_con_props, (conn, CS_SET, CS_NETIO, &netio, CS_UNUSED, NULL));
+	netio = 0;
+	check_call(ct_con_props, (conn, CS_GET, CS_NETIO, &netio, CS_UNUSED, NULL));
+	assert(netio == CS_DEFER_IO);
+
+	/* nothing pending */
+	assert(ct_poll(NULL, conn, 0, NULL, NULL, NULL, NULL) == CS_QUIET);
+
+	check_call(ct_command, (cmd, CS_LANG_CMD, "SELECT 123", CS_NULLTERM, CS_UNUSED));
+	assert(ct_send(cmd) == CS_PENDING);
+	assert(wait_completion(ctx, conn, cmd, CT_SEND) == CS_SUCCEED);
+
+	/* arguments are checked before operations are queued */
+	check_fail(ct_results, (cmd, NULL));
+	check_last_message(CTMSG_CLIENT, 0x01010103, "result_type");
+	assert(ct_poll(NULL, conn, 0, NULL, NULL, NULL, NULL) == CS_QUIET);
+
+	for (;;) {
+		assert(ct_results(cmd, &result_type) == CS_PENDING);
+		ret = wait_completion(ctx, conn, cmd, CT_RESULTS);
+		if (ret != CS_SUCCEED)
+			break;
+		if (result_type != CS_ROW_RESULT)
+			continue;
+
+		memset(&datafmt, 0, sizeof(datafmt));
+		datafmt.datatype = CS_INT_TYPE;
+		datafmt.maxlength = sizeof(value);
+		datafmt.count = 1;
+		check_call(ct_bind, (cmd, 1, &datafmt, &value, NULL, NULL));
+
+		check_fail(ct_fetch, (cmd, CS_TRUE, CS_UNUSED, CS_UNUSED, &rows_read));
+		check_last_message(CTMSG_CLIENT, 0x01010109, "type");
+
+		for (;;) {
+			assert(ct_fetch(cmd, CS_UNUSED, CS_UNUSED, CS_UNUSED, &rows_read) == CS_PENDING);
+			ret = wait_completion(ctx, conn, cmd, CT_FETCH);
+			if (ret != CS_SUCCEED)
+				break;
+			num_rows += rows_read;
+		}
+		assert(ret == CS_END_DATA);
+	}
+	assert(ret == CS_END_RESULTS);
+	assert(num_rows == 1 && value == 123);
+	assert(completions > 4);
+
+	netio = CS_SYNC_IO;
+	check_call(ct_con_props, (conn, CS_SET, CS_NETIO, &netio, CS_UNUSED, NULL));
+	check_call(run_command, (cmd, "SELECT 1"));
+
+	check_call(try_ctlogout, (ctx, conn, cmd, verbose));
+
+	return 0;
+}
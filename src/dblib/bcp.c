@@ -604,6 +604,40 @@ bcp_gethostcolcount(DBPROCESS *dbproc)
 	return dbproc->hostfileinfo->host_colcount;
 }
 
+/**
+ * \ingroup dblib_bcp
+ * \brief Start reading the host data file from a given position
+ *
+ * \param dbproc contains all information needed by db-lib to manage communications with the server.
+ * \param offset byte offset of a row in the host data file.
+ * \param row number (1 based) of the row starting at \a offset.
+ * \remarks This function is specific to FreeTDS. It allows to split a data file
+ *     and load parts concurrently using multiple connections.
+ *     Rows before \a offset are not read at all; BCPFIRST and BCPLAST keep
+ *     using the row numbers of the whole file.
+ *
+ * \return SUCCEED or FAIL.
+ * \sa bcp_control(), bcp_exec(), bcp_init()
+ */
+RETCODE
+bcp_setfilestart(DBPROCESS *dbproc, DBBIGINT offset, DBINT row)
+{
+	tdsdump_log(TDS_DBG_FUNC, "bcp_setfilestart(%p, %" PRId64 ", %d)\n", dbproc, offset, row);
+	CHECK_CONN(FAIL);
+	CHECK_PARAMETER(dbproc->bcpinfo, SYBEBCPI, FAIL);
+	CHECK_PARAMETER(dbproc->hostfileinfo, SYBEBIVI, FAIL);
+	DBPERROR_RETURN(dbproc->bcpinfo->direction != DB_IN, SYBEBCPN);
+
+	if (offset < 0 || row < 1) {
+		dbperror(dbproc, SYBEIFNB, 0);
+		return FAIL;
+	}
+
+	dbproc->hostfileinfo->start_offset = offset;
+	dbproc->hostfileinfo->start_row = row;
+	return SUCCEED;
+}
+
 /** 
  * \ingroup dblib_bcp
  * \brief Set bulk copy options.
@@ -963,11 +997,10 @@ _bcp_exec_out(DBPROCESS * dbproc, DBINT * rows_copied)
 		if (dbproc->hostfileinfo->firstrow > row_of_query)
 			continue;
 		if (dbproc->hostfileinfo->lastrow > 0 && row_of_query > dbproc->hostfileinfo->lastrow) {
-			/* TODO: If this is freebcp we could now just return success,
-			 * rather than waste time processing the rest of data.
-			 * In other cases we could perhaps send a cancel request.
-			 */
-			continue;
+			/* following rows are not needed, stop the query */
+			if (TDS_FAILED(tds_send_cancel(tds)) || TDS_FAILED(tds_process_cancel(tds)))
+				goto Cleanup;
+			break;
 		}
 
 		/* Go through the hostfile columns, finding those that relate to database columns. */
@@ -1489,12 +1522,21 @@ _bcp_exec_in(DBPROCESS *dbproc, DBINT *rows_copied)
 		return FAIL;
 	}
 
+	row_of_hostfile = 0;
+	if (dbproc->hostfileinfo->start_row > 1 || dbproc->hostfileinfo->start_offset > 0) {
+		if (TDS_FAILED(tds_file_stream_seek_set(&hoststream, dbproc->hostfileinfo->start_offset))) {
+			tds_file_stream_close(&hoststream);
+			dbperror(dbproc, SYBEBCRE, errno);
+			return FAIL;
+		}
+		row_of_hostfile = dbproc->hostfileinfo->start_row - 1;
+	}
+
 	if (TDS_FAILED(tds_bcp_start_copy_in(tds, dbproc->bcpinfo))) {
 		tds_file_stream_close(&hoststream);
 		return FAIL;
 	}
 
-	row_of_hostfile = 0;
 	rows_written_so_far = 0;
 
 	row_error_count = 0;
@@ -353,7 +353,7 @@ buffer_transfer_bound_data(DBPROC_ROWBUF *buf, TDS_INT res_type, TDS_INT compute
 		if (is_blob_col(curcol))
 			src = (BYTE *) ((TDSBLOB *) src)->textvalue;
 
-		copy_data_to_host_var(dbproc, srctype, src, srclen,
+		copy_data_to_host_var(dbproc, srctype, curcol->column_convert.func, src, srclen,
 					(BYTE *) curcol->column_varaddr,  curcol->column_bindlen,
 						 curcol->column_bindtype, (DBINT*) curcol->column_nullbind);
 	}
@@ -69,7 +69,7 @@ static const char *tds_prdatatype(int datatype_token);
 
 static int default_err_handler(DBPROCESS * dbproc, int severity, int dberr, int oserr, char *dberrstr, char *oserrstr);
 
-void copy_data_to_host_var(DBPROCESS *, TDS_SERVER_TYPE, const BYTE *, int, BYTE *, DBINT, int, DBINT *);
+void copy_data_to_host_var(DBPROCESS *, TDS_SERVER_TYPE, TDS_CONVERT_FUNC, const BYTE *, int, BYTE *, DBINT, int, DBINT *);
 RETCODE dbgetnull(DBPROCESS *dbproc, int bindtype, int varlen, BYTE* varaddr);
 
 /**
@@ -2174,6 +2174,9 @@ dbnextrow(DBPROCESS * dbproc)
 		bool rows_set = false;
 		buffer_save_row(dbproc);
 
+		/* saved rows are copied from the row buffer, avoid views if buffering */
+		tds->column_views = dbproc->row_buf.capacity <= 1;
+
 		/* Get the row from the TDS stream.  */
 again:
 		switch (tds_process_tokens(tds, &res_type, NULL, mask)) {
@@ -2353,6 +2356,8 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 	int i;
 	int len;
 	TDS_SERVER_TYPE srctype, desttype;
+	bool truncated;
+	char conv_buf[256];
 
 	tdsdump_log(TDS_DBG_FUNC, "dbconvert_ps(%p, %s, %p, %d, %s, %p, %d, %p)\n",
 		    dbproc, tds_prdatatype(db_srctype), src, srclen,
@@ -2518,7 +2523,27 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 
 	tdsdump_log(TDS_DBG_INFO1, "dbconvert_ps() calling tds_convert\n");
 
-	len = tds_convert(g_dblib_ctx.tds_ctx, srctype, src, srclen, desttype, &dres);
+	switch (desttype) {
+	case SYBBINARY:
+	case SYBVARBINARY:
+	case SYBIMAGE:
+	case SYBCHAR:
+	case SYBVARCHAR:
+	case SYBTEXT:
+		/*
+		 * Avoid allocation for small results.
+		 * Result is copied to destination only if it fits.
+		 */
+		len = tds_convert_to_buffer(g_dblib_ctx.tds_ctx, srctype, src, srclen, desttype,
+					    conv_buf, sizeof(conv_buf), &truncated);
+		dres.c = conv_buf;
+		if (!truncated)
+			break;
+		/* fall thru */
+	default:
+		len = tds_convert(g_dblib_ctx.tds_ctx, srctype, src, srclen, desttype, &dres);
+		break;
+	}
 	tdsdump_log(TDS_DBG_INFO1, "dbconvert_ps() called tds_convert returned %d\n", len);
 
 	if (len < 0) {
@@ -2539,7 +2564,8 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 				memset(dest + len, 0, destlen - len);
 			ret = len;
 		}
-		free(dres.ib);
+		if (dres.ib != conv_buf)
+			free(dres.ib);
 		break;
 	case SYBINT1:
 	case SYBINT2:
@@ -2610,7 +2636,8 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 			break;
 		}
 
-		free(dres.c);
+		if (dres.c != conv_buf)
+			free(dres.c);
 
 		break;
 	default:
@@ -2743,6 +2770,7 @@ dbbind(DBPROCESS * dbproc, int column, int vartype, DBINT varlen, BYTE * varaddr
 	colinfo->column_varaddr = (char *) varaddr;
 	colinfo->column_bindtype = vartype;
 	colinfo->column_bindlen = varlen;
+	tds_get_convert_func_cached(&colinfo->column_convert, srctype, desttype);
 
 	return SUCCEED;
 }				/* dbbind()  */
@@ -7493,14 +7521,15 @@ tds_prdatatype(int datatype_token)
 }
 #if 1
 void
-copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE * src, DBINT srclen, 
-		      BYTE * dest, DBINT destlen,
+copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, TDS_CONVERT_FUNC convert,
+		      const BYTE * src, DBINT srclen, BYTE * dest, DBINT destlen,
 		      int bindtype, DBINT *indicator)
 {
 	CONV_RESULT dres;
 	DBINT ret;
 	int len;
 	DBINT indicator_value = 0;
+	char conv_buf[256];
 
 	bool limited_dest_space = false;
 	TDS_SERVER_TYPE desttype = dblib_bound_type(bindtype);
@@ -7678,7 +7707,30 @@ copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE *
 
 	} /* end srctype == desttype */
 
-	len = tds_convert(g_dblib_ctx.tds_ctx, srctype, src, srclen, desttype, &dres);
+	/* conversion resolved at bind time, if any */
+	if (!convert)
+		convert = tds_convert;
+
+	switch (desttype) {
+	case SYBVARBINARY:
+	case SYBBINARY:
+	case SYBIMAGE:
+	case SYBCHAR:
+	case SYBVARCHAR:
+	case SYBTEXT:
+		/* avoid allocation for small results, most of the data */
+		dres.cc.c = conv_buf;
+		dres.cc.len = sizeof(conv_buf);
+		len = convert(g_dblib_ctx.tds_ctx, srctype, src, srclen,
+			      is_binary_type(desttype) ? TDS_CONVERT_BINARY : TDS_CONVERT_CHAR, &dres);
+		dres.c = conv_buf;
+		if (len <= (int) sizeof(conv_buf))
+			break;
+		/* fall thru */
+	default:
+		len = convert(g_dblib_ctx.tds_ctx, srctype, src, srclen, desttype, &dres);
+		break;
+	}
 
 	tdsdump_log(TDS_DBG_INFO1, "copy_data_to_host_var(): tds_convert returned %d\n", len);
 
@@ -7710,7 +7762,8 @@ copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE *
 					memset(dest + len, 0, destlen - len);
 			}
 		}
-		TDS_ZERO_FREE(dres.ib);
+		if (dres.ib != conv_buf)
+			TDS_ZERO_FREE(dres.ib);
 		break;
 	case SYBINT1:
 	case SYBINT2:
@@ -7796,7 +7849,8 @@ copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE *
 				break;
 		} 
 
-		free(dres.c);
+		if (dres.c != conv_buf)
+			free(dres.c);
 		break;
 	default:
 		tdsdump_log(TDS_DBG_INFO1, "error: copy_data_to_host_var(): unrecognized desttype %d \n", desttype);
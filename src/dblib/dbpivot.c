@@ -941,6 +941,7 @@ dbnextrow_pivoted(DBPROCESS *dbproc, PIVOT_T *pp)
 		
 		copy_data_to_host_var(	dbproc, 
 					pval->type, 
+					NULL,
 					(BYTE *) col_buffer(pval),
 					pval->len, 
 					(BYTE *) pcol->column_varaddr,  
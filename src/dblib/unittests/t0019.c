@@ -58,7 +58,8 @@ test(int srctype, const void *srcdata, int srclen, int dsttype, int dstlen)
 
 	correct = 0;
 	if (len == -1) {
-		if (strcmp(cur_result, "error") == 0)
+		/* on errors destination should be untouched */
+		if (strcmp(cur_result, "error") == 0 && strspn(buf, "*") == sizeof(buf))
 			correct = 1;
 	} else {
 		if (strcmp(cur_result, out) == 0)
@@ -76,6 +77,8 @@ test(int srctype, const void *srcdata, int srclen, int dsttype, int dstlen)
 
 TEST_MAIN()
 {
+	static const DBINT int_value = 1234567;
+
 	if (dbinit() == FAIL)
 		return 1;
 
@@ -93,6 +96,9 @@ TEST_MAIN()
 	TEST((SYBCHAR, "ciao\0\0", 6, SYBCHAR, 4), "error");
 	TEST((SYBCHAR, "ciao  ", 6, SYBCHAR, 6), "len=6 63 69 61 6F 20 20 2A 2A 2A 2A");
 	TEST((SYBCHAR, "ciao\0\0", 6, SYBCHAR, 6), "len=6 63 69 61 6F 00 00 2A 2A 2A 2A");
+	TEST((SYBINT4, &int_value, 4, SYBCHAR, 4), "error");
+	TEST((SYBINT4, &int_value, 4, SYBCHAR, 7), "len=7 31 32 33 34 35 36 37 2A 2A 2A");
+	TEST((SYBCHAR, "61626364", 8, SYBVARBINARY, 3), "error");
 
 	/* convert from NULL to BINARY */
 	TEST((SYBBINARY,    "", 0, SYBBINARY, 6), "len=6 00 00 00 00 00 00 2A 2A 2A 2A");
@@ -22,6 +22,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <assert.h>
 
 #if HAVE_STRING_H
@@ -45,6 +46,7 @@
 #include <freetds/tds/convert.h>
 #include <freetds/odbc.h>
 #include <freetds/utils/string.h>
+#include <freetds/utils.h>
 #define TDSODBC_BCP
 #include <odbcss.h>
 
@@ -58,6 +60,8 @@ _bcp_get_term_var(const TDS_CHAR * pdata, const TDS_CHAR * term, int term_len);
 #define ODBCBCP_ERROR_DBINT(code) \
 	do {odbc_errs_add(&dbc->errs, code, NULL); return -1;} while(0)
 
+#define TDS_ISSPACE(c) isspace((unsigned char) (c))
+
 /**
  * \ingroup odbc_bcp
  * \brief Prepare for bulk copy operation on a table
@@ -693,6 +697,758 @@ _bcp_get_term_var(const TDS_CHAR * pdata, const TDS_CHAR * term, int term_len)
 	return bufpos;
 }
 
+/** Parameter array or bound rows sent to a table using bulk copy */
+typedef struct
+{
+	TDS_STMT *stmt;
+	/** data of current row, already converted from application buffers */
+	TDSPARAMINFO *params;
+	/** for each table column, index of the parameter with its data, -1 if none */
+	int *param_nums;
+	/** for each table column, allocated size of bcp_column_data */
+	size_t *sizes;
+} ODBC_BCP_PARAMS;
+
+static const char *
+_bcp_skip_spaces(const char *s)
+{
+	while (TDS_ISSPACE(*s))
+		++s;
+	return s;
+}
+
+static bool
+_bcp_is_name_char(char c)
+{
+	return isalnum((unsigned char) c) || c == '_' || c == '@' || c == '#' || c == '$' || (c & 0x80) != 0;
+}
+
+/**
+ * Skip a keyword, case insensitive, with leading spaces.
+ * \return pointer after the keyword or NULL if not found
+ */
+static const char *
+_bcp_skip_keyword(const char *s, const char *keyword)
+{
+	size_t len = strlen(keyword);
+
+	s = _bcp_skip_spaces(s);
+	if (strncasecmp(s, keyword, len) != 0 || _bcp_is_name_char(s[len]))
+		return NULL;
+	return s + len;
+}
+
+/**
+ * Skip an identifier, possibly quoted.
+ * \param multipart accept names like db.owner.table
+ * \return pointer after the name or NULL if no name is found
+ */
+static const char *
+_bcp_skip_name(const char *s, bool multipart)
+{
+	const char *start = s;
+
+	for (;;) {
+		if (*s == '[' || *s == '\"')
+			s = tds_skip_quoted(s);
+		else
+			while (_bcp_is_name_char(*s))
+				++s;
+		if (!multipart || *s != '.')
+			break;
+		++s;
+	}
+	return s == start ? NULL : s;
+}
+
+static char *
+_bcp_unquote_name(const char *s, const char *end)
+{
+	char *name, *p, quote;
+
+	if (*s != '[' && *s != '\"')
+		return tds_strndup(s, end - s);
+
+	quote = *s == '[' ? ']' : '\"';
+	name = p = tds_new(char, end - s);
+	if (!name)
+		return NULL;
+	for (++s; s < end - 1; ++s) {
+		*p++ = *s;
+		if (*s == quote)
+			++s;
+	}
+	*p = 0;
+	return name;
+}
+
+static void
+_bcp_free_names(char **names, int num_names)
+{
+	int i;
+
+	if (!names)
+		return;
+	for (i = 0; i < num_names; ++i)
+		free(names[i]);
+	free(names);
+}
+
+/**
+ * Parse a statement like "INSERT [INTO] table [(column, ...)] VALUES (?, ...)".
+ * \param query      statement to parse
+ * \param[out] table name of the table
+ * \param[out] names names of the columns, NULL if not specified
+ * \return number of values or -1 if statement is not in this form
+ */
+static int
+_bcp_parse_insert(const char *query, DSTR *table, char ***names)
+{
+	const char *s, *end;
+	int num_names = 0, num_values = 0;
+
+	*names = NULL;
+
+	if (!(s = _bcp_skip_keyword(query, "INSERT")))
+		return -1;
+	if ((end = _bcp_skip_keyword(s, "INTO")) != NULL)
+		s = end;
+	s = _bcp_skip_spaces(s);
+	if (!(end = _bcp_skip_name(s, true)) || !tds_dstr_copyn(table, s, end - s))
+		return -1;
+
+	s = _bcp_skip_spaces(end);
+	if (*s == '(') {
+		do {
+			s = _bcp_skip_spaces(s + 1);
+			if (!(end = _bcp_skip_name(s, false)) || !TDS_RESIZE(*names, num_names + 1))
+				goto error;
+			if (!((*names)[num_names] = _bcp_unquote_name(s, end)))
+				goto error;
+			++num_names;
+			s = _bcp_skip_spaces(end);
+		} while (*s == ',');
+		if (*s != ')')
+			goto error;
+		++s;
+	}
+
+	if (!(s = _bcp_skip_keyword(s, "VALUES")))
+		goto error;
+	s = _bcp_skip_spaces(s);
+	if (*s != '(')
+		goto error;
+	do {
+		s = _bcp_skip_spaces(s + 1);
+		if (*s != '?')
+			goto error;
+		++num_values;
+		s = _bcp_skip_spaces(s + 1);
+	} while (*s == ',');
+	if (*s != ')')
+		goto error;
+
+	s = _bcp_skip_spaces(s + 1);
+	if (*s == ';')
+		s = _bcp_skip_spaces(s + 1);
+	if (*s || (*names && num_names != num_values))
+		goto error;
+	return num_values;
+
+error:
+	_bcp_free_names(*names, num_names);
+	*names = NULL;
+	return -1;
+}
+
+static unsigned char *
+_bcp_param_reserve(ODBC_BCP_PARAMS *bp, TDSCOLUMN *bindcol, int index, size_t size)
+{
+	BCPCOLDATA *coldata = bindcol->bcp_column_data;
+	unsigned char *data;
+
+	if (size <= bp->sizes[index])
+		return coldata->data;
+
+	data = (unsigned char *) realloc(coldata->data, size);
+	if (!data) {
+		odbc_errs_add(&bp->stmt->errs, "HY001", NULL);
+		return NULL;
+	}
+	coldata->data = data;
+	bp->sizes[index] = size;
+	return data;
+}
+
+static TDSRET
+_bcp_param_put_chars(ODBC_BCP_PARAMS *bp, TDSCOLUMN *bindcol, int index, TDSICONV *conv, const char *src, size_t srclen)
+{
+	BCPCOLDATA *coldata = bindcol->bcp_column_data;
+	size_t destlen;
+	char *dest;
+
+	/* 4 bytes for each byte are enough for any conversion we support */
+	destlen = conv ? srclen * 4 + 4 : srclen;
+	if (!(dest = (char *) _bcp_param_reserve(bp, bindcol, index, TDS_MAX(destlen, 1))))
+		return TDS_FAIL;
+
+	if (!conv) {
+		memcpy(dest, src, srclen);
+	} else if (tds_iconv(bp->stmt->dbc->tds_socket, conv, to_server, &src, &srclen, &dest, &destlen) == (size_t) -1) {
+		odbc_errs_add(&bp->stmt->errs, "22018", NULL);
+		return TDS_FAIL;
+	}
+	coldata->datalen = dest - (char *) coldata->data;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Fill a bcp column from the parameter bound to it.
+ * The parameter was already converted from the application buffers
+ * by odbc_sql2tds(), here it's converted to the column type.
+ * Columns without parameter are sent as NULL.
+ */
+static TDSRET
+_bcp_get_param_data(TDSBCPINFO *bcpinfo, TDSCOLUMN *bindcol, int index, int offset TDS_UNUSED)
+{
+	ODBC_BCP_PARAMS *bp = (ODBC_BCP_PARAMS *) bcpinfo->parent;
+	TDS_STMT *stmt = bp->stmt;
+	BCPCOLDATA *coldata = bindcol->bcp_column_data;
+	TDSCOLUMN *param;
+	TDS_SERVER_TYPE srctype, desttype;
+	const char *src;
+	TDS_INT srclen, len, limit;
+	unsigned char *dest;
+	CONV_RESULT cr;
+
+	coldata->is_null = true;
+	coldata->datalen = 0;
+	if (bp->param_nums[index] < 0)
+		return TDS_SUCCESS;
+	param = bp->params->columns[bp->param_nums[index]];
+	if (param->column_cur_size < 0)
+		return TDS_SUCCESS;
+
+	src = (const char *) param->column_data;
+	if (is_blob_col(param))
+		src = ((TDSBLOB *) src)->textvalue;
+	srclen = param->column_cur_size;
+	srctype = tds_get_conversion_type(param->column_type, param->column_size);
+	desttype = tds_get_conversion_type(bindcol->column_type, bindcol->column_size);
+
+	if (is_char_type(desttype)) {
+		TDSICONV *conv = bindcol->char_conv;
+		TDSRET rc;
+
+		if (!is_char_type(srctype)) {
+			len = tds_convert(stmt->dbc->env->tds_ctx, srctype, src, srclen, SYBVARCHAR, &cr);
+			if (len < 0) {
+				odbc_convert_err_set(&stmt->errs, len);
+				return TDS_FAIL;
+			}
+			rc = _bcp_param_put_chars(bp, bindcol, index, conv, cr.c, len);
+			free(cr.c);
+		} else {
+			/* parameter is in application encoding, see odbc_sql2tds */
+			if (param->char_conv && conv)
+				conv = tds_iconv_get_info(stmt->dbc->tds_socket->conn, param->char_conv->from.charset.canonic,
+							  conv->to.charset.canonic);
+#ifdef ENABLE_ODBC_WIDE
+			else
+				conv = NULL;
+#endif
+			rc = _bcp_param_put_chars(bp, bindcol, index, conv, src, srclen);
+		}
+		TDS_PROPAGATE(rc);
+	} else if (srctype == desttype && !is_numeric_type(desttype)) {
+		if (!(dest = _bcp_param_reserve(bp, bindcol, index, TDS_MAX(srclen, 1))))
+			return TDS_FAIL;
+		memcpy(dest, src, srclen);
+		coldata->datalen = srclen;
+	} else {
+		if (is_numeric_type(desttype)) {
+			cr.n.precision = bindcol->column_prec;
+			cr.n.scale = bindcol->column_scale;
+		}
+		len = tds_convert(stmt->dbc->env->tds_ctx, srctype, src, srclen, desttype, &cr);
+		if (len < 0) {
+			odbc_convert_err_set(&stmt->errs, len);
+			return TDS_FAIL;
+		}
+		if (is_binary_type(desttype)) {
+			dest = _bcp_param_reserve(bp, bindcol, index, TDS_MAX(len, 1));
+			if (dest)
+				memcpy(dest, cr.ib, len);
+			free(cr.ib);
+		} else {
+			dest = _bcp_param_reserve(bp, bindcol, index, TDS_MAX(len, 1));
+			if (dest)
+				memcpy(dest, &cr, len);
+		}
+		if (!dest)
+			return TDS_FAIL;
+		coldata->datalen = len;
+	}
+
+	/* data would be truncated */
+	limit = is_char_type(desttype) ? bindcol->on_server.column_size : bindcol->column_size;
+	if (!is_blob_col(bindcol) && coldata->datalen > limit) {
+		odbc_errs_add(&stmt->errs, "22001", NULL);
+		return TDS_FAIL;
+	}
+	coldata->is_null = false;
+	return TDS_SUCCESS;
+}
+
+static void
+_bcp_param_null_error(TDSBCPINFO *bcpinfo, int index TDS_UNUSED, int offset TDS_UNUSED)
+{
+	ODBC_BCP_PARAMS *bp = (ODBC_BCP_PARAMS *) bcpinfo->parent;
+
+	odbc_errs_add(&bp->stmt->errs, "23000", NULL);
+}
+
+/** Assign errors added starting from \a first to a given parameter row */
+static void
+_bcp_set_errors_row(TDS_STMT *stmt, int first, int row)
+{
+	for (; first < stmt->errs.num_errors; ++first)
+		stmt->errs.errs[first].row = row;
+}
+
+/**
+ * Check statement parameters can be sent using bulk copy and map them to table columns.
+ * \return false if the statement should be executed normally
+ */
+static bool
+_bcp_param_map(TDS_STMT *stmt, TDSBCPINFO *bcpinfo, char **names, int num_values, int *param_nums)
+{
+	TDSRESULTINFO *bindinfo = bcpinfo->bindinfo;
+	int i, j, num_cols = 0;
+
+	for (i = 0; i < bindinfo->num_cols; ++i) {
+		TDSCOLUMN *col = bindinfo->columns[i];
+		const struct _drecord *drec_apd, *drec_ipd;
+		int c_type;
+
+		param_nums[i] = -1;
+		/* these columns cannot be inserted or behave differently using bulk copy */
+		if (col->column_computed || (col->column_timestamp && !names))
+			return false;
+		if (col->column_identity || col->column_timestamp)
+			continue;
+
+		if (!names) {
+			j = num_cols;
+		} else {
+			for (j = 0; j < num_values; ++j)
+				if (strcasecmp(names[j], tds_dstr_cstr(&col->column_name)) == 0)
+					break;
+		}
+		/* all columns must be specified, defaults are not handled */
+		if (j >= num_values)
+			return false;
+		param_nums[i] = j;
+		++num_cols;
+
+		/* wide characters can be converted only to other characters */
+		drec_apd = &stmt->apd->records[j];
+		drec_ipd = &stmt->ipd->records[j];
+		c_type = drec_apd->sql_desc_concise_type;
+		if (c_type == SQL_C_DEFAULT)
+			c_type = odbc_sql_to_c_type_default(drec_ipd->sql_desc_concise_type);
+		if (c_type == SQL_C_WCHAR && !is_char_type(tds_get_conversion_type(col->column_type, col->column_size)))
+			return false;
+	}
+	return num_cols == num_values;
+}
+
+/**
+ * \ingroup odbc_bcp
+ * \brief Execute a simple INSERT statement with an array of parameters using bulk copy
+ *
+ * \param stmt statement to execute, with parameters already prepared
+ * \remarks Only statements like "INSERT [INTO] table [(column, ...)] VALUES (?, ...)"
+ *	specifying all table columns (beside identity ones) are handled.
+ *	Rows with conversion errors are reported in the parameter status array and
+ *	not sent, if the server refuses the data all rows are reported as failed.
+ *	Result is set in stmt->errs.lastrc.
+ * \return false if the statement cannot be executed using bulk copy and should be
+ *	executed normally
+ * \sa SQL_COPT_FREETDS_BULK_INSERT
+ */
+bool
+odbc_bcp_insert_params(TDS_STMT *stmt)
+{
+	TDSSOCKET *tds = stmt->tds;
+	TDSBCPINFO *bcpinfo = NULL;
+	ODBC_BCP_PARAMS bp;
+	SQLUSMALLINT *status_ptr = stmt->ipd->header.sql_desc_array_status_ptr;
+	char **names = NULL;
+	int num_values, i, n_errs, rows_copied = 0;
+	unsigned int row, num_rows = stmt->num_param_rows;
+	bool found_error = false, handled = false;
+	TDSRET rc;
+
+	tdsdump_log(TDS_DBG_FUNC, "odbc_bcp_insert_params(%p)\n", stmt);
+
+	memset(&bp, 0, sizeof(bp));
+	bp.stmt = stmt;
+
+	if (!IS_TDS7_PLUS(tds->conn))
+		return false;
+
+	if (!(bcpinfo = tds_alloc_bcpinfo()))
+		return false;
+
+	num_values = _bcp_parse_insert(tds_dstr_cstr(&stmt->query), &bcpinfo->tablename, &names);
+	if (num_values <= 0 || num_values != (int) stmt->param_count
+	    || num_values > stmt->apd->header.sql_desc_count || num_values > stmt->ipd->header.sql_desc_count)
+		goto cleanup;
+
+	/* only input parameters, all data must be available */
+	for (i = 0; i < num_values; ++i) {
+		const struct _drecord *drec_apd = &stmt->apd->records[i];
+		const struct _drecord *drec_ipd = &stmt->ipd->records[i];
+
+		if (drec_ipd->sql_desc_parameter_type != SQL_PARAM_INPUT)
+			goto cleanup;
+		for (row = 0; row < num_rows; ++row) {
+			SQLLEN len = odbc_get_param_len(drec_apd, drec_ipd, stmt->apd, row);
+
+			if (len < 0 && len != SQL_NULL_DATA && len != SQL_NTS)
+				goto cleanup;
+		}
+	}
+
+	/* from now errors are reported to the application */
+	handled = true;
+	bcpinfo->direction = TDS_BCP_IN;
+	if (TDS_FAILED(tds_bcp_init(tds, bcpinfo)))
+		goto all_failed;
+
+	bp.param_nums = tds_new(int, bcpinfo->bindinfo->num_cols);
+	bp.sizes = tds_new0(size_t, bcpinfo->bindinfo->num_cols);
+	if (!bp.param_nums || !bp.sizes || !_bcp_param_map(stmt, bcpinfo, names, num_values, bp.param_nums)) {
+		handled = false;
+		goto cleanup;
+	}
+
+	tdsdump_log(TDS_DBG_INFO1, "odbc_bcp_insert_params: sending %u rows to %s\n",
+		    num_rows, tds_dstr_cstr(&bcpinfo->tablename));
+
+	/* keep INSERT semantic */
+	if (!tds_dstr_copy(&bcpinfo->hint, "KEEP_NULLS, CHECK_CONSTRAINTS, FIRE_TRIGGERS")
+	    || TDS_FAILED(tds_bcp_start_copy_in(tds, bcpinfo)))
+		goto all_failed;
+
+	bcpinfo->parent = &bp;
+	for (row = 0; row < num_rows; ++row) {
+		SQLUSMALLINT param_status = SQL_PARAM_SUCCESS;
+
+		n_errs = stmt->errs.num_errors;
+		stmt->curr_param_row = row;
+		rc = start_parse_prepared_query(stmt, true) == SQL_SUCCESS ? TDS_SUCCESS : TDS_FAIL;
+		bp.params = stmt->params;
+		if (TDS_SUCCEED(rc))
+			rc = tds_bcp_send_record(tds, bcpinfo, _bcp_get_param_data, _bcp_param_null_error, (int) row);
+		if (TDS_FAILED(rc)) {
+			param_status = SQL_PARAM_ERROR;
+			found_error = true;
+			_bcp_set_errors_row(stmt, n_errs, row + 1);
+		}
+		if (status_ptr)
+			status_ptr[row] = param_status;
+		if (IS_TDSDEAD(tds))
+			break;
+	}
+	stmt->curr_param_row = TDS_MIN(row + 1, num_rows);
+
+	/* server reply is for all rows */
+	n_errs = stmt->errs.num_errors;
+	if (TDS_FAILED(tds_bcp_done(tds, &rows_copied))) {
+		found_error = true;
+		if (status_ptr)
+			for (row = 0; row < stmt->curr_param_row; ++row)
+				status_ptr[row] = SQL_PARAM_ERROR;
+		rows_copied = 0;
+	}
+	_bcp_set_errors_row(stmt, n_errs, 0);
+	stmt->row_count = rows_copied;
+	goto done;
+
+all_failed:
+	found_error = true;
+	if (status_ptr)
+		for (row = 0; row < num_rows; ++row)
+			status_ptr[row] = SQL_PARAM_ERROR;
+	stmt->curr_param_row = num_rows;
+
+done:
+	if (stmt->ipd->header.sql_desc_rows_processed_ptr)
+		*stmt->ipd->header.sql_desc_rows_processed_ptr = stmt->curr_param_row;
+	if (found_error) {
+		/* see odbc_SQLExecute */
+		stmt->errs.lastrc = status_ptr ? SQL_SUCCESS_WITH_INFO : SQL_ERROR;
+	}
+	tds_free_all_results(tds);
+
+cleanup:
+	_bcp_free_names(names, num_values);
+	free(bp.param_nums);
+	free(bp.sizes);
+	tds_free_bcpinfo(bcpinfo);
+	return handled;
+}
+
+/**
+ * Get the table of a statement like "SELECT ... FROM table [WHERE ...]".
+ * \param query      statement to parse
+ * \param[out] table name of the table
+ * \return true if the statement is in this form
+ */
+static bool
+_bcp_parse_select(const char *query, DSTR *table)
+{
+	const char *s, *end = NULL;
+	int level = 0;
+
+	if (!(s = _bcp_skip_keyword(query, "SELECT")))
+		return false;
+
+	/* search FROM, outside subqueries */
+	for (;;) {
+		s = _bcp_skip_spaces(s);
+		if (!*s)
+			return false;
+		if (level == 0 && (end = _bcp_skip_keyword(s, "FROM")) != NULL)
+			break;
+		if (*s == '\'' || *s == '\"' || *s == '[') {
+			s = tds_skip_quoted(s);
+		} else if (_bcp_is_name_char(*s)) {
+			while (_bcp_is_name_char(*s))
+				++s;
+		} else {
+			if (*s == '(')
+				++level;
+			else if (*s == ')')
+				--level;
+			++s;
+		}
+	}
+
+	s = _bcp_skip_spaces(end);
+	if (!(end = _bcp_skip_name(s, true)) || !tds_dstr_copyn(table, s, end - s))
+		return false;
+
+	/* a single table, without alias or joins */
+	s = _bcp_skip_spaces(end);
+	if (*s == ';')
+		s = _bcp_skip_spaces(s + 1);
+	return !*s || _bcp_skip_keyword(s, "WHERE") || _bcp_skip_keyword(s, "ORDER");
+}
+
+/**
+ * Map bound columns of the result set to table columns.
+ * Identity, timestamp and computed columns are not inserted.
+ * \return number of bound columns, -1 if a column is not found
+ */
+static int
+_bcp_rows_map(TDS_STMT *stmt, TDSBCPINFO *bcpinfo, int *param_nums, int *col_nums, bool *all_bound)
+{
+	TDSRESULTINFO *bindinfo = bcpinfo->bindinfo;
+	const TDS_DESC *ard = stmt->ard, *ird = stmt->ird;
+	int i, n, num_params = 0;
+
+	for (i = 0; i < bindinfo->num_cols; ++i)
+		param_nums[i] = -1;
+
+	for (n = 0; n < ard->header.sql_desc_count && n < ird->header.sql_desc_count; ++n) {
+		const struct _drecord *drec_ird = &ird->records[n];
+		const DSTR *name = &drec_ird->sql_desc_base_column_name;
+
+		if (!ard->records[n].sql_desc_data_ptr)
+			continue;
+		if (tds_dstr_isempty(name))
+			name = &drec_ird->sql_desc_name;
+
+		for (i = 0; i < bindinfo->num_cols; ++i)
+			if (strcasecmp(tds_dstr_cstr(name), tds_dstr_cstr(&bindinfo->columns[i]->column_name)) == 0)
+				break;
+		if (i >= bindinfo->num_cols) {
+			odbc_errs_add(&stmt->errs, "42S22", NULL);
+			return -1;
+		}
+		if (bindinfo->columns[i]->column_identity || bindinfo->columns[i]->column_timestamp
+		    || bindinfo->columns[i]->column_computed || param_nums[i] >= 0)
+			continue;
+		param_nums[i] = num_params;
+		col_nums[num_params++] = n;
+	}
+
+	*all_bound = true;
+	for (i = 0; i < bindinfo->num_cols; ++i) {
+		const TDSCOLUMN *col = bindinfo->columns[i];
+
+		if (param_nums[i] < 0 && !col->column_identity && !col->column_timestamp && !col->column_computed)
+			*all_bound = false;
+	}
+	return num_params;
+}
+
+/**
+ * \ingroup odbc_bcp
+ * \brief Insert rows from the buffers bound to a result set using bulk copy
+ *
+ * Implements SQLBulkOperations(SQL_ADD).
+ * \param stmt statement with the result set, locked and idle
+ * \remarks The table is taken from the statement, which must be like
+ *	"SELECT ... FROM table [WHERE ...]". Bound columns are matched to
+ *	table columns by name; columns not bound get their default value.
+ *	Rows marked SQL_ROW_IGNORE in the row operation array are skipped.
+ *	Rows with conversion errors are reported in the row status array and
+ *	not sent, if the server refuses the data all rows are reported as failed.
+ *	Result is set in stmt->errs.lastrc.
+ */
+void
+odbc_bcp_add_rows(TDS_STMT *stmt)
+{
+	TDSSOCKET *tds = stmt->tds;
+	const TDS_DESC *ard = stmt->ard, *ird = stmt->ird;
+	SQLUSMALLINT *status_ptr = ird->header.sql_desc_array_status_ptr;
+	const SQLUSMALLINT *operation_ptr = ard->header.sql_desc_array_status_ptr;
+	SQLULEN row, num_rows = ard->header.sql_desc_array_size;
+	TDSBCPINFO *bcpinfo;
+	ODBC_BCP_PARAMS bp;
+	int *col_nums = NULL;
+	int i, n_errs, num_params, rows_copied = 0, rows_sent = 0, rows_failed = 0;
+	bool all_bound;
+	TDSRET rc;
+
+	tdsdump_log(TDS_DBG_FUNC, "odbc_bcp_add_rows(%p)\n", stmt);
+
+	memset(&bp, 0, sizeof(bp));
+	bp.stmt = stmt;
+
+	if (!IS_TDS7_PLUS(tds->conn)) {
+		odbc_errs_add(&stmt->errs, "HYC00", "SQLBulkOperations: bulk copy is supported only by Microsoft SQL Server");
+		return;
+	}
+
+	if (!(bcpinfo = tds_alloc_bcpinfo())) {
+		odbc_errs_add(&stmt->errs, "HY001", NULL);
+		return;
+	}
+	if (!_bcp_parse_select(tds_dstr_cstr(&stmt->query), &bcpinfo->tablename)) {
+		odbc_errs_add(&stmt->errs, "HYC00", "SQLBulkOperations: statement is not a SELECT from a single table");
+		goto cleanup;
+	}
+
+	bcpinfo->direction = TDS_BCP_IN;
+	if (TDS_FAILED(tds_bcp_init(tds, bcpinfo)))
+		goto failed;
+
+	bp.param_nums = tds_new(int, bcpinfo->bindinfo->num_cols);
+	bp.sizes = tds_new0(size_t, bcpinfo->bindinfo->num_cols);
+	col_nums = tds_new(int, TDS_MAX(ard->header.sql_desc_count, 1));
+	if (!bp.param_nums || !bp.sizes || !col_nums) {
+		odbc_errs_add(&stmt->errs, "HY001", NULL);
+		goto cleanup;
+	}
+	if ((num_params = _bcp_rows_map(stmt, bcpinfo, bp.param_nums, col_nums, &all_bound)) < 0)
+		goto cleanup;
+	for (i = 0; i < num_params; ++i) {
+		TDSPARAMINFO *params = tds_alloc_param_result(bp.params);
+
+		if (!params) {
+			odbc_errs_add(&stmt->errs, "HY001", NULL);
+			goto cleanup;
+		}
+		bp.params = params;
+	}
+
+	tdsdump_log(TDS_DBG_INFO1, "odbc_bcp_add_rows: sending %u rows to %s\n",
+		    (unsigned) num_rows, tds_dstr_cstr(&bcpinfo->tablename));
+
+	/* like INSERT, unbound columns get their defaults */
+	if (!tds_dstr_copy(&bcpinfo->hint, all_bound ? "KEEP_NULLS, CHECK_CONSTRAINTS, FIRE_TRIGGERS"
+						     : "CHECK_CONSTRAINTS, FIRE_TRIGGERS")) {
+		odbc_errs_add(&stmt->errs, "HY001", NULL);
+		goto cleanup;
+	}
+	if (TDS_FAILED(tds_bcp_start_copy_in(tds, bcpinfo)))
+		goto failed;
+
+	bcpinfo->parent = &bp;
+	for (row = 0; row < num_rows && !IS_TDSDEAD(tds); ++row) {
+		if (operation_ptr && operation_ptr[row] == SQL_ROW_IGNORE)
+			continue;
+
+		n_errs = stmt->errs.num_errors;
+		rc = TDS_SUCCESS;
+		for (i = 0; i < num_params && TDS_SUCCEED(rc); ++i) {
+			int n = col_nums[i];
+
+			switch (odbc_sql2tds(stmt, &ird->records[n], &ard->records[n], bp.params->columns[i], true, ard, row)) {
+			case SQL_SUCCESS:
+			case SQL_SUCCESS_WITH_INFO:
+				break;
+			case SQL_NEED_DATA:
+				odbc_errs_add(&stmt->errs, "HYC00", "SQLBulkOperations: data at execution not supported");
+				/* fall through */
+			default:
+				rc = TDS_FAIL;
+				break;
+			}
+		}
+		if (TDS_SUCCEED(rc))
+			rc = tds_bcp_send_record(tds, bcpinfo, _bcp_get_param_data, _bcp_param_null_error, (int) row);
+		if (TDS_FAILED(rc)) {
+			++rows_failed;
+			_bcp_set_errors_row(stmt, n_errs, (int) row + 1);
+		} else {
+			++rows_sent;
+		}
+		if (status_ptr)
+			status_ptr[row] = TDS_FAILED(rc) ? SQL_ROW_ERROR : SQL_ROW_ADDED;
+	}
+
+	/* server reply is for all rows */
+	n_errs = stmt->errs.num_errors;
+	if (TDS_FAILED(tds_bcp_done(tds, &rows_copied))) {
+		if (status_ptr)
+			for (row = 0; row < num_rows; ++row)
+				if (status_ptr[row] == SQL_ROW_ADDED)
+					status_ptr[row] = SQL_ROW_ERROR;
+		rows_failed += rows_sent;
+		rows_sent = 0;
+		rows_copied = 0;
+	}
+	_bcp_set_errors_row(stmt, n_errs, 0);
+	stmt->row_count = rows_copied;
+
+	if (rows_failed)
+		stmt->errs.lastrc = rows_sent ? SQL_SUCCESS_WITH_INFO : SQL_ERROR;
+	goto cleanup;
+
+failed:
+	if (!stmt->errs.num_errors)
+		odbc_errs_add(&stmt->errs, "HY000", NULL);
+	stmt->errs.lastrc = SQL_ERROR;
+	if (status_ptr)
+		for (row = 0; row < num_rows; ++row)
+			if (!operation_ptr || operation_ptr[row] != SQL_ROW_IGNORE)
+				status_ptr[row] = SQL_ROW_ERROR;
+
+cleanup:
+	tds_free_all_results(tds);
+	tds_free_param_results(bp.params);
+	free(bp.param_nums);
+	free(bp.sizes);
+	free(col_nums);
+	tds_free_bcpinfo(bcpinfo);
+}
+
 void
 odbc_bcp_free_storage(TDS_DBC *dbc)
 {
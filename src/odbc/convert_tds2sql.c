@@ -279,7 +279,7 @@ odbc_convert_to_binary(TDSCOLUMN *curcol, int srctype, TDS_CHAR * src, TDS_UINT
 static SQLLEN
 odbc_tds2sql(TDS_STMT * stmt, TDSCOLUMN *curcol, int srctype, TDS_CHAR * src, TDS_UINT srclen,
 	     int desttype, TDS_CHAR * dest, SQLULEN destlen,
-	     const struct _drecord *drec_ixd)
+	     const struct _drecord *drec_ixd, TDS_CONVERT_CACHE *cache)
 {
 	TDS_INT nDestSybType;
 	TDS_INT nRetVal = TDS_CONVERT_FAIL;
@@ -292,6 +292,7 @@ odbc_tds2sql(TDS_STMT * stmt, TDSCOLUMN *curcol, int srctype, TDS_CHAR * src, TD
 	bool binary_conversion = false;
 	SQLULEN cplen;
 	TDS_CHAR conv_buf[256];
+	TDS_CONVERT_FUNC convert;
 
 	tdsdump_log(TDS_DBG_FUNC, "odbc_tds2sql: src is %d dest = %d\n", srctype, desttype);
 
@@ -356,8 +357,6 @@ odbc_tds2sql(TDS_STMT * stmt, TDSCOLUMN *curcol, int srctype, TDS_CHAR * src, TD
 		}
 
 		nDestSybType = TDS_CONVERT_CHAR;
-		ores.cc.len = destlen;
-		ores.cc.c = dest;
 	}
 
 	if (desttype == SQL_C_CHAR || desttype == SQL_C_WCHAR) {
@@ -419,7 +418,13 @@ odbc_tds2sql(TDS_STMT * stmt, TDSCOLUMN *curcol, int srctype, TDS_CHAR * src, TD
 		memcpy(dest, buf, TDS_MIN(destlen, (SQLULEN) nRetVal));
 	} else {
 normal_conversion:
-		nRetVal = tds_convert(context, srctype, src, srclen, nDestSybType, &ores);
+		/* bound columns resolve the conversion only once */
+		convert = cache ? tds_get_convert_func_cached(cache, srctype, nDestSybType) : tds_convert;
+		if (nDestSybType == TDS_CONVERT_CHAR) {
+			ores.cc.c = dest;
+			ores.cc.len = (TDS_UINT) destlen;
+		}
+		nRetVal = convert(context, srctype, src, srclen, nDestSybType, &ores);
 	}
 	if (nRetVal < 0) {
 		odbc_convert_err_set(&stmt->errs, nRetVal);
@@ -618,7 +623,7 @@ normal_conversion:
 }
 
 SQLLEN odbc_tds2sql_col(TDS_STMT * stmt, TDSCOLUMN *curcol, int desttype, TDS_CHAR * dest, SQLULEN destlen,
-			const struct _drecord *drec_ixd)
+			const struct _drecord *drec_ixd, TDS_CONVERT_CACHE *cache)
 {
 	int srctype = tds_get_conversion_type(curcol->on_server.column_type, curcol->on_server.column_size);
 	TDS_CHAR *src = (TDS_CHAR *) curcol->column_data;
@@ -637,11 +642,24 @@ SQLLEN odbc_tds2sql_col(TDS_STMT * stmt, TDSCOLUMN *curcol, int desttype, TDS_CH
 		src += curcol->column_text_sqlgetdatapos;
 		srclen -= curcol->column_text_sqlgetdatapos;
 	}
-	return odbc_tds2sql(stmt, curcol, srctype, src, srclen, desttype, dest, destlen, drec_ixd);
+	return odbc_tds2sql(stmt, curcol, srctype, src, srclen, desttype, dest, destlen, drec_ixd, cache);
+}
+
+/**
+ * Convert a non-blob value of a column taken from a row batch,
+ * same as odbc_tds2sql_col() but data are not in the column buffer.
+ */
+SQLLEN odbc_tds2sql_batch(TDS_STMT * stmt, TDSCOLUMN *curcol, const TDS_CHAR *src, TDS_INT srclen,
+			  int desttype, TDS_CHAR * dest, SQLULEN destlen, const struct _drecord *drec_ixd,
+			  TDS_CONVERT_CACHE *cache)
+{
+	int srctype = tds_get_conversion_type(curcol->on_server.column_type, curcol->on_server.column_size);
+
+	return odbc_tds2sql(stmt, curcol, srctype, (TDS_CHAR *) src, srclen, desttype, dest, destlen, drec_ixd, cache);
 }
 
 SQLLEN odbc_tds2sql_int4(TDS_STMT * stmt, TDS_INT *src, int desttype, TDS_CHAR * dest, SQLULEN destlen)
 {
 	return odbc_tds2sql(stmt, NULL, SYBINT4, (TDS_CHAR *) src, sizeof(*src),
-			    desttype, dest, destlen, NULL);
+			    desttype, dest, destlen, NULL, NULL);
 }
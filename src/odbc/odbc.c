@@ -84,6 +84,7 @@ static int odbc_process_tokens(TDS_STMT * stmt, unsigned flag);
 static bool odbc_lock_statement(TDS_STMT* stmt);
 static void odbc_unlock_statement(TDS_STMT* stmt);
 static bool read_params(TDS_STMT *stmt);
+static void odbc_free_row_batch(TDS_STMT * stmt);
 
 #if ENABLE_EXTRA_CHECKS
 static void odbc_ird_check(TDS_STMT * stmt);
@@ -122,6 +123,10 @@ static void odbc_ird_check(TDS_STMT * stmt);
 
 #define DEFAULT_QUERY_TIMEOUT (~((SQLUINTEGER) 0))
 
+/* limits of rows prefetched at once from a server cursor */
+#define ODBC_PREFETCH_MAX_ROWS 1024u
+#define ODBC_PREFETCH_MAX_BYTES (1024u * 1024u)
+
 /*
  * Note: I *HATE* hungarian notation, it has to be the most idiotic thing
  * I've ever seen. So, you will note it is avoided other than in the function
@@ -390,7 +395,7 @@ odbc_connect(TDS_DBC * dbc, TDSLOGIN * login)
 
 	if (dbc->attr.mars_enabled != SQL_MARS_ENABLED_NO)
 		login->mars = 1;
-	if (dbc->attr.bulk_enabled != SQL_BCP_OFF)
+	if (dbc->attr.bulk_enabled != SQL_BCP_OFF || dbc->attr.bulk_insert != SQL_BULK_INSERT_OFF)
 		tds_set_bulk(login, true);
 
 #ifdef ENABLE_ODBC_WIDE
@@ -878,6 +883,8 @@ odbc_lock_statement(TDS_STMT* stmt)
 	if (tds) {
 		tds->query_timeout = (stmt->attr.query_timeout != DEFAULT_QUERY_TIMEOUT) ?
 			stmt->attr.query_timeout : stmt->dbc->default_query_timeout;
+		/* fetched data are converted before reading next row */
+		tds->column_views = true;
 		tds_set_parent(tds, stmt);
 		stmt->tds = tds;
 		return true;
@@ -901,6 +908,8 @@ odbc_lock_statement(TDS_STMT* stmt)
 	if (tds) {
 		tds->query_timeout = (stmt->attr.query_timeout != DEFAULT_QUERY_TIMEOUT) ?
 			stmt->attr.query_timeout : stmt->dbc->default_query_timeout;
+		/* fetched data are converted before reading next row */
+		tds->column_views = true;
 		tds_set_parent(tds, stmt);
 		stmt->tds = tds;
 	}
@@ -948,6 +957,10 @@ SQLMoreResults(SQLHSTMT hstmt)
 	if (!tds)
 		ODBC_EXIT(stmt, SQL_NO_DATA);
 
+	/* rows decoded in advance belong to current results */
+	if (!stmt->cursor)
+		odbc_free_row_batch(stmt);
+
 	stmt->row_count = TDS_NO_COUNT;
 	stmt->special_row = ODBC_SPECIAL_NONE;
 
@@ -1325,6 +1338,10 @@ SQLSetPos(SQLHSTMT hstmt, SQLSETPOSIROW irow, SQLUSMALLINT fOption, SQLUSMALLINT
 
 	tds = stmt->tds;
 
+	/* with prefetched rows server block can start before current rowset */
+	if (irow > 0)
+		irow += stmt->cursor_rowset_start;
+
 	if (TDS_FAILED(tds_cursor_update(tds, stmt->cursor, op, irow, params))) {
 		tds_free_param_results(params);
 		ODBC_SAFE_ERROR(stmt);
@@ -1343,6 +1360,41 @@ SQLSetPos(SQLHSTMT hstmt, SQLSETPOSIROW irow, SQLUSMALLINT fOption, SQLUSMALLINT
 	ODBC_EXIT_(stmt);
 }
 
+#if (ODBCVER >= 0x0300)
+SQLRETURN ODBC_PUBLIC ODBC_API
+SQLBulkOperations(SQLHSTMT hstmt, SQLSMALLINT Operation)
+{
+	ODBC_ENTER_HSTMT;
+
+	tdsdump_log(TDS_DBG_FUNC, "SQLBulkOperations(%p, %d)\n", hstmt, (int) Operation);
+
+	/* TODO bookmark operations */
+	if (Operation != SQL_ADD) {
+		odbc_errs_add(&stmt->errs, "HYC00", "SQLBulkOperations: only SQL_ADD is implemented");
+		ODBC_EXIT_(stmt);
+	}
+
+	if (stmt->ird->header.sql_desc_count <= 0 || stmt->ard->header.sql_desc_array_size < 1) {
+		odbc_errs_add(&stmt->errs, "HY010", NULL);
+		ODBC_EXIT_(stmt);
+	}
+
+	if (!odbc_lock_statement(stmt))
+		ODBC_EXIT_(stmt);
+
+	/* rows are sent using bulk copy, connection must not have pending results */
+	if (stmt->tds->state != TDS_IDLE) {
+		odbc_errs_add(&stmt->errs, "24000", NULL);
+		ODBC_EXIT_(stmt);
+	}
+
+	odbc_bcp_add_rows(stmt);
+	odbc_unlock_statement(stmt);
+
+	ODBC_EXIT_(stmt);
+}
+#endif
+
 ODBC_FUNC(SQLTablePrivileges, (P(SQLHSTMT,hstmt), PCHARIN(CatalogName,SQLSMALLINT),
 	PCHARIN(SchemaName,SQLSMALLINT), PCHARIN(TableName,SQLSMALLINT) WIDE))
 {
@@ -1765,6 +1817,7 @@ odbc_SQLAllocConnect(SQLHENV henv, SQLHDBC FAR * phdbc)
 	dbc->attr.txn_isolation = SQL_TXN_READ_COMMITTED;
 	dbc->attr.mars_enabled = SQL_MARS_ENABLED_NO;
 	dbc->attr.bulk_enabled = SQL_BCP_OFF;
+	dbc->attr.bulk_insert = SQL_BULK_INSERT_OFF;
 
 	tds_mutex_init(&dbc->mtx);
 	*phdbc = (SQLHDBC) dbc;
@@ -3434,6 +3487,8 @@ odbc_cursor_execute(TDS_STMT * stmt)
 		return TDS_FAIL;
 	}
 	stmt->cursor = cursor;
+	stmt->cursor_prefetch = 0;
+	stmt->cursor_rowset_start = 0;
 
 	/* TODO cursor add enums for tds7 */
 	switch (stmt->attr.cursor_type) {
@@ -3551,13 +3606,25 @@ odbc_SQLExecute(TDS_STMT * stmt)
 		return SQL_ERROR;
 	}
 
+	/* rows decoded in advance belong to previous results */
+	odbc_free_row_batch(stmt);
+
 	stmt->curr_param_row = 0;
 	stmt->num_param_rows = TDS_MAX(1, stmt->apd->header.sql_desc_array_size);
 
 	stmt->row_count = TDS_NO_COUNT;
 
+	/* send simple INSERTs with parameter arrays as a bulk copy */
+	if (stmt->num_param_rows > 1 && stmt->dbc->attr.bulk_insert != SQL_BULK_INSERT_OFF && !stmt->prepared_query_is_rpc
+	    && stmt->attr.cursor_type == SQL_CURSOR_FORWARD_ONLY && stmt->attr.concurrency == SQL_CONCUR_READ_ONLY
+	    && odbc_bcp_insert_params(stmt)) {
+		stmt->row_status = PRE_NORMAL_ROW;
+		odbc_populate_ird(stmt);
+		odbc_unlock_statement(stmt);
+		ODBC_RETURN_(stmt);
+	}
+
 	if (stmt->prepared_query_is_rpc) {
-		/* TODO support stmt->apd->header.sql_desc_array_size for RPC */
 		/* get rpc name */
 		/* TODO change method */
 		/* TODO cursor change way of calling */
@@ -3569,7 +3636,32 @@ odbc_SQLExecute(TDS_STMT * stmt)
 		stmt->prepared_pos = end - name;
 		tmp = *end;
 		*end = 0;
-		ret = tds_submit_rpc(tds, name, stmt->params, odbc_init_headers(stmt, &head));
+		if (stmt->num_param_rows <= 1) {
+			ret = tds_submit_rpc(tds, name, stmt->params, odbc_init_headers(stmt, &head));
+		} else {
+			/* pack multiple calls in a single request */
+			TDSMULTIPLE multiple;
+
+			ret = tds_multiple_init(tds, &multiple, TDS_MULTIPLE_RPC, odbc_init_headers(stmt, &head));
+			for (stmt->curr_param_row = 0; TDS_SUCCEED(ret); ) {
+				int res;
+
+				ret = tds_multiple_rpc(tds, &multiple, name, stmt->params);
+				if (++stmt->curr_param_row >= stmt->num_param_rows)
+					break;
+				/* than process others parameters, parser needs the full query */
+				/* TODO handle all results*/
+				*end = tmp;
+				stmt->prepared_pos = end - name;
+				res = start_parse_prepared_query(stmt, true);
+				*end = 0;
+				if (res != SQL_SUCCESS)
+					break;
+			}
+			if (TDS_SUCCEED(ret))
+				ret = tds_multiple_done(tds, &multiple);
+			stmt->prepared_pos = end - name;
+		}
 		*end = tmp;
 	} else if (stmt->attr.cursor_type != SQL_CURSOR_FORWARD_ONLY || stmt->attr.concurrency != SQL_CONCUR_READ_ONLY) {
 		ret = odbc_cursor_execute(stmt);
@@ -3913,7 +4005,8 @@ odbc_process_tokens(TDS_STMT * stmt, unsigned flag)
 			/* test for internal_sp not very fine, used for param set  -- freddy77 */
 			if ((done_flags & (TDS_DONE_COUNT|TDS_DONE_ERROR)) != 0
 			    || (stmt->errs.lastrc == SQL_SUCCESS_WITH_INFO && stmt->dbc->env->attr.odbc_version == SQL_OV_ODBC3)
-			    || (result_type == TDS_DONEPROC_RESULT && tds->current_op == TDS_OP_EXECUTE)) {
+			    || (result_type == TDS_DONEPROC_RESULT && tds->current_op == TDS_OP_EXECUTE)
+			    || (result_type == TDS_DONEPROC_RESULT && stmt->prepared_query_is_rpc && stmt->num_param_rows > 1)) {
 				/* FIXME this row is used only as a flag for update binding,
 				 * should be cleared if binding/result changed */
 				stmt->row = 0;
@@ -3991,8 +4084,195 @@ odbc_fix_data_type_col(TDS_STMT *stmt, int idx)
 	}
 }
 
+static void
+odbc_free_row_batch(TDS_STMT * stmt)
+{
+	tds_free_row_batch(stmt->row_batch);
+	stmt->row_batch = NULL;
+	stmt->row_batch_next = 0;
+	TDS_ZERO_FREE(stmt->row_batch_copy);
+	stmt->cursor_prefetch = 0;
+	stmt->cursor_rowset_start = 0;
+}
+
+/**
+ * Decode following rows of resinfo into stmt->row_batch,
+ * batch is reallocated if needed.
+ * \param max_rows maximum rows to decode
+ * \return true if some rows were decoded
+ */
+static bool
+odbc_decode_row_batch(TDS_STMT * stmt, TDSRESULTINFO * resinfo, TDS_UINT max_rows)
+{
+	TDSSOCKET *tds = stmt->tds;
+	TDSROWBATCH *batch = stmt->row_batch;
+	int i;
+
+	if (batch && (batch->info != resinfo || batch->max_rows < max_rows)) {
+		tds_free_row_batch(batch);
+		stmt->row_batch = batch = NULL;
+		TDS_ZERO_FREE(stmt->row_batch_copy);
+	}
+	if (!batch) {
+		for (i = 0; i < resinfo->num_cols; ++i)
+			if (is_blob_col(resinfo->columns[i]))
+				return false;
+		batch = tds_alloc_row_batch(tds->conn, resinfo, max_rows);
+		stmt->row_batch_copy = tds_new0(unsigned, resinfo->num_cols);
+		if (!batch || !stmt->row_batch_copy) {
+			tds_free_row_batch(batch);
+			TDS_ZERO_FREE(stmt->row_batch_copy);
+			return false;
+		}
+		batch->num_rows = 0;
+		stmt->row_batch = batch;
+	}
+
+	stmt->row_batch_next = 0;
+	if (TDS_FAILED(tds_process_rows_batch(tds, batch))) {
+		batch->num_rows = 0;
+		return false;
+	}
+	return batch->num_rows > 0;
+}
+
+/**
+ * Decode following rows of current results at once into stmt->row_batch.
+ * Used only for normal rows of forward only results without blobs,
+ * other cases are handled row by row by odbc_process_tokens().
+ * \param num_rows number of rows in the rowset
+ * \return true if some rows were decoded
+ */
+static bool
+odbc_fill_row_batch(TDS_STMT * stmt, SQLULEN num_rows)
+{
+	TDSSOCKET *tds = stmt->tds;
+	TDSRESULTINFO *resinfo = tds->current_results;
+
+	if (num_rows <= 1 || stmt->cursor || stmt->special_row != ODBC_SPECIAL_NONE)
+		return false;
+	if (!resinfo || resinfo != tds->res_info)
+		return false;
+
+	return odbc_decode_row_batch(stmt, resinfo, (TDS_UINT) TDS_MIN(num_rows, 4096u));
+}
+
+/**
+ * Compute how many rows of a server cursor can be prefetched.
+ * Only read only cursors are prefetched, positioned updates refer
+ * to the whole block fetched by the server and dynamic cursors
+ * should show changes at every fetch. Blobs are never buffered.
+ * \return maximum rows to fetch, 0 if prefetch is not possible
+ */
+static TDS_UINT
+odbc_cursor_prefetch_max(TDS_STMT * stmt, SQLULEN num_rows)
+{
+	const TDSRESULTINFO *resinfo = stmt->cursor->res_info;
+	size_t row_size = 0;
+	int i;
+
+	if (stmt->attr.concurrency != SQL_CONCUR_READ_ONLY || stmt->attr.cursor_type == SQL_CURSOR_DYNAMIC)
+		return 0;
+	if (!resinfo || !resinfo->num_cols || num_rows > ODBC_PREFETCH_MAX_ROWS)
+		return 0;
+
+	for (i = 0; i < resinfo->num_cols; ++i) {
+		TDSCOLUMN *col = resinfo->columns[i];
+
+		if (is_blob_col(col))
+			return 0;
+		row_size += col->funcs->row_len(col);
+	}
+	row_size = TDS_MAX(row_size, 1u);
+	return (TDS_UINT) TDS_MAX(TDS_MIN(ODBC_PREFETCH_MAX_BYTES / row_size, ODBC_PREFETCH_MAX_ROWS), num_rows);
+}
+
+/**
+ * Decide how every bound column is copied from stmt->row_batch.
+ * Fixed types with the same representation in C are copied as is,
+ * others are converted. Called once per fetch as bindings can change.
+ */
+static void
+odbc_resolve_row_batch(TDS_STMT * stmt)
+{
+	const TDS_DESC *const ard = stmt->ard;
+	const TDSROWBATCH *batch = stmt->row_batch;
+	int i;
+
+	for (i = 0; i < batch->num_cols; i++) {
+		const TDSCOLUMN *colinfo = batch->columns[i].column;
+		const struct _drecord *drec_ard;
+		int c_type;
+		unsigned size = 0;
+
+		stmt->row_batch_copy[i] = 0;
+		if (i >= ard->header.sql_desc_count || !ard->records[i].sql_desc_data_ptr)
+			continue;
+		drec_ard = &ard->records[i];
+
+		c_type = drec_ard->sql_desc_concise_type;
+		if (c_type == SQL_C_DEFAULT)
+			c_type = odbc_sql_to_c_type_default(stmt->ird->records[i].sql_desc_concise_type);
+
+		switch (tds_get_conversion_type(colinfo->column_type, colinfo->column_size)) {
+		case SYBINT1:
+			if (c_type == SQL_C_UTINYINT)
+				size = sizeof(SQLCHAR);
+			break;
+		case SYBBIT:
+			if (c_type == SQL_C_BIT)
+				size = sizeof(SQLCHAR);
+			break;
+		case SYBINT2:
+			if (c_type == SQL_C_SSHORT || c_type == SQL_C_SHORT)
+				size = sizeof(SQLSMALLINT);
+			break;
+		case SYBINT4:
+			if ((c_type == SQL_C_SLONG || c_type == SQL_C_LONG) && sizeof(SQLINTEGER) == 4)
+				size = sizeof(SQLINTEGER);
+			break;
+		case SYBINT8:
+			if (c_type == SQL_C_SBIGINT)
+				size = sizeof(SQLBIGINT);
+			break;
+		case SYBREAL:
+			if (c_type == SQL_C_FLOAT)
+				size = sizeof(SQLREAL);
+			break;
+		case SYBFLT8:
+			if (c_type == SQL_C_DOUBLE)
+				size = sizeof(SQLDOUBLE);
+			break;
+		default:
+			break;
+		}
+		stmt->row_batch_copy[i] = size;
+	}
+}
+
+/**
+ * Move a row of stmt->row_batch to current row so SQLGetData can
+ * read the last row fetched.
+ */
+static void
+odbc_row_batch_to_current(TDS_STMT * stmt, TDS_UINT row)
+{
+	const TDSROWBATCH *batch = stmt->row_batch;
+	int i;
+
+	for (i = 0; i < batch->num_cols; i++) {
+		TDSCOLUMN *colinfo = batch->columns[i].column;
+		TDS_INT len = batch->columns[i].lengths[row];
+
+		colinfo->column_cur_size = len;
+		if (len >= 0)
+			memcpy(colinfo->column_data, tds_row_batch_value(batch, i, row), colinfo->funcs->row_len(colinfo));
+	}
+}
+
 static SQLUSMALLINT
-copy_row(TDS_STMT * const stmt, const SQLLEN row_offset, const SQLULEN curr_row)
+copy_row(TDS_STMT * const stmt, const SQLLEN row_offset, const SQLULEN curr_row,
+	 const TDSROWBATCH *batch, TDS_UINT batch_row)
 {
 	const TDS_DESC *const ard = stmt->ard;
 	TDSRESULTINFO *const resinfo = stmt->tds->current_results;
@@ -4005,6 +4285,7 @@ copy_row(TDS_STMT * const stmt, const SQLLEN row_offset, const SQLULEN curr_row)
 		TDSCOLUMN *colinfo;
 		struct _drecord *drec_ard;
 		SQLLEN len;
+		TDS_INT cur_size;
 
 		colinfo = resinfo->columns[i];
 		colinfo->column_text_sqlgetdatapos = 0;
@@ -4012,7 +4293,8 @@ copy_row(TDS_STMT * const stmt, const SQLLEN row_offset, const SQLULEN curr_row)
 		drec_ard = (i < ard->header.sql_desc_count) ? &ard->records[i] : NULL;
 		if (!drec_ard)
 			continue;
-		if (colinfo->column_cur_size < 0) {
+		cur_size = batch ? batch->columns[i].lengths[batch_row] : colinfo->column_cur_size;
+		if (cur_size < 0) {
 			if (drec_ard->sql_desc_indicator_ptr) {
 				*AT_ROW(drec_ard->sql_desc_indicator_ptr, SQLLEN) = SQL_NULL_DATA;
 			} else if (drec_ard->sql_desc_data_ptr) {
@@ -4041,7 +4323,17 @@ copy_row(TDS_STMT * const stmt, const SQLLEN row_offset, const SQLULEN curr_row)
 			} else {
 				data_ptr += odbc_get_octet_len(c_type, drec_ard) * curr_row;
 			}
-			len = odbc_tds2sql_col(stmt, colinfo, c_type, data_ptr, drec_ard->sql_desc_octet_length, drec_ard);
+			if (!batch) {
+				len = odbc_tds2sql_col(stmt, colinfo, c_type, data_ptr, drec_ard->sql_desc_octet_length, drec_ard,
+						       &drec_ard->convert);
+			} else if (stmt->row_batch_copy[i]) {
+				len = stmt->row_batch_copy[i];
+				memcpy(data_ptr, tds_row_batch_value(batch, i, batch_row), len);
+			} else {
+				len = odbc_tds2sql_batch(stmt, colinfo, (const TDS_CHAR *) tds_row_batch_value(batch, i, batch_row),
+							 cur_size, c_type, data_ptr, drec_ard->sql_desc_octet_length, drec_ard,
+							 &drec_ard->convert);
+			}
 			if (len == SQL_NULL_DATA)
 				return SQL_ROW_ERROR;
 
@@ -4076,7 +4368,8 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 	SQLULEN dummy, *fetched_ptr;
 	SQLUSMALLINT *status_ptr, row_status = SQL_ROW_SUCCESS;
 	TDS_INT result_type;
-	bool truncated = false;
+	bool truncated = false, from_batch, batch_resolved = false;
+	int last_batch_row = -1;
 
 	SQLLEN row_offset = 0;
 
@@ -4098,11 +4391,38 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 	if (stmt->cursor && odbc_lock_statement(stmt)) {
 		TDSCURSOR *cursor = stmt->cursor;
 		TDS_CURSOR_FETCH fetch_type = TDS_CURSOR_FETCH_NEXT;
+		const TDSROWBATCH *batch = stmt->row_batch;
+		TDS_UINT rowset_start = 0, max_rows;
+		SQLULEN fetch_rows = num_rows;
 
 		tds = stmt->tds;
 
+		/*
+		 * A previous sequential fetch could have prefetched a block of rows,
+		 * the server is positioned at block start, not at current rowset.
+		 */
+		if (!batch || batch->info != cursor->res_info || !stmt->cursor_prefetch)
+			batch = NULL;
+		else
+			rowset_start = stmt->cursor_rowset_start;
+		stmt->cursor_rowset_start = 0;
+
 		switch (FetchOrientation) {
 		case SQL_FETCH_NEXT:
+			if (!batch)
+				break;
+			/* return buffered rows if enough or if server has no more rows */
+			if (batch->num_rows - stmt->row_batch_next >= num_rows || batch->num_rows < cursor->cursor_rows) {
+				stmt->cursor_rowset_start = stmt->row_batch_next;
+				tds_set_current_results(tds, cursor->res_info);
+				stmt->row_status = IN_NORMAL_ROW;
+				goto buffered;
+			}
+			/* some rows left, fetch again from first row not returned */
+			if (stmt->row_batch_next < batch->num_rows) {
+				fetch_type = TDS_CURSOR_FETCH_RELATIVE;
+				FetchOffset = stmt->row_batch_next;
+			}
 			break;
 		case SQL_FETCH_FIRST:
 			fetch_type = TDS_CURSOR_FETCH_FIRST;
@@ -4112,12 +4432,17 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 			break;
 		case SQL_FETCH_PRIOR:
 			fetch_type = TDS_CURSOR_FETCH_PREV;
+			if (rowset_start) {
+				fetch_type = TDS_CURSOR_FETCH_RELATIVE;
+				FetchOffset = (SQLLEN) rowset_start - (SQLLEN) num_rows;
+			}
 			break;
 		case SQL_FETCH_ABSOLUTE:
 			fetch_type = TDS_CURSOR_FETCH_ABSOLUTE;
 			break;
 		case SQL_FETCH_RELATIVE:
 			fetch_type = TDS_CURSOR_FETCH_RELATIVE;
+			FetchOffset += rowset_start;
 			break;
 		/* TODO cursor bookmark */
 		default:
@@ -4125,9 +4450,25 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 			return SQL_ERROR;
 		}
 
-		if (cursor->cursor_rows != num_rows) {
+		/* application is reading sequentially, fetch more rows every time */
+		max_rows = 0;
+		if (FetchOrientation == SQL_FETCH_NEXT)
+			max_rows = odbc_cursor_prefetch_max(stmt, num_rows);
+		if (max_rows) {
+			fetch_rows = stmt->cursor_prefetch ? stmt->cursor_prefetch * 2 : num_rows;
+			fetch_rows = TDS_MAX(TDS_MIN(fetch_rows, max_rows), num_rows);
+			fetch_rows -= fetch_rows % num_rows;
+		}
+		stmt->cursor_prefetch = max_rows ? fetch_rows : 0;
+
+		/* rows buffered are not valid after a new fetch */
+		stmt->row_batch_next = 0;
+		if (stmt->row_batch)
+			stmt->row_batch->num_rows = 0;
+
+		if (cursor->cursor_rows != fetch_rows) {
 			bool send = false;
-			cursor->cursor_rows = num_rows;
+			cursor->cursor_rows = fetch_rows;
 			/* TODO handle change rows (tds5) */
 			/*
 			 * TODO curerntly we support cursors only using tds7+
@@ -4144,9 +4485,21 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 		}
 
 		/* TODO handle errors in a better way */
-		odbc_process_tokens(stmt, TDS_RETURN_ROW|TDS_STOPAT_COMPUTE|TDS_STOPAT_ROW);
+		result_type = odbc_process_tokens(stmt, TDS_RETURN_ROW|TDS_STOPAT_COMPUTE|TDS_STOPAT_ROW);
 		stmt->row_status = PRE_NORMAL_ROW;
+		if (result_type == TDS_ROW_RESULT && stmt->cursor_prefetch) {
+			/* decode whole block, rows following rowset are kept for next fetches */
+			if (!odbc_decode_row_batch(stmt, cursor->res_info, (TDS_UINT) fetch_rows)) {
+				odbc_free_row_batch(stmt);
+				if (TDS_SUCCEED(tds_send_cancel(tds)))
+					tds_process_cancel(tds);
+				ODBC_SAFE_ERROR(stmt);
+				return SQL_ERROR;
+			}
+			stmt->row_status = IN_NORMAL_ROW;
+		}
 	}
+      buffered:
 
 	if (!tds && stmt->row_status == PRE_NORMAL_ROW && stmt->ird->header.sql_desc_count > 0)
 		ODBC_RETURN(stmt, SQL_NO_DATA);
@@ -4178,6 +4531,7 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 	curr_row = 0;
 	do {
 		row_status = SQL_ROW_SUCCESS;
+		from_batch = false;
 
 		/* do not get compute row if we are not expecting a compute row */
 		switch (stmt->row_status) {
@@ -4195,6 +4549,17 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 			break;
 
 		default:
+			/* following rows of a rowset are decoded at once, without current row */
+			if (stmt->row_status == IN_NORMAL_ROW) {
+				if (stmt->row_batch && stmt->row_batch->info == tds->current_results
+				    && stmt->row_batch_next < stmt->row_batch->num_rows)
+					from_batch = true;
+				else
+					from_batch = odbc_fill_row_batch(stmt, num_rows);
+				if (from_batch)
+					break;
+			}
+
 			/* FIXME stmt->row_count set correctly ?? TDS_DONE_COUNT not checked */
 			switch (odbc_process_tokens(stmt, TDS_STOPAT_ROWFMT|TDS_RETURN_ROW|TDS_STOPAT_COMPUTE)) {
 			case TDS_ROW_RESULT:
@@ -4252,7 +4617,17 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 
 		/* we got a row, return a row readed even if error (for ODBC specifications) */
 		++(*fetched_ptr);
-		row_status = copy_row(stmt, row_offset, curr_row);
+		last_batch_row = -1;
+		if (from_batch) {
+			if (!batch_resolved) {
+				odbc_resolve_row_batch(stmt);
+				batch_resolved = true;
+			}
+			last_batch_row = stmt->row_batch_next++;
+			row_status = copy_row(stmt, row_offset, curr_row, stmt->row_batch, last_batch_row);
+		} else {
+			row_status = copy_row(stmt, row_offset, curr_row, NULL, 0);
+		}
 		if (row_status == SQL_ROW_SUCCESS_WITH_INFO)
 			truncated = true;
 
@@ -4272,6 +4647,8 @@ odbc_SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 		odbc_errs_add(&stmt->errs, "01004", NULL);
 
       all_done:
+	if (last_batch_row >= 0 && stmt->row_status == IN_NORMAL_ROW && stmt->row_batch->info == tds->current_results)
+		odbc_row_batch_to_current(stmt, last_batch_row);
 	/* TODO cursor correct ?? */
 	if (stmt->cursor) {
 		tds_process_tokens(tds, &result_type, NULL, TDS_TOKEN_TRAILING);
@@ -4476,6 +4853,8 @@ odbc_SQLFreeStmt(SQLHSTMT hstmt, SQLUSMALLINT fOption, int force)
 				tds_process_cancel(tds);
 		}
 
+		odbc_free_row_batch(stmt);
+
 		/* free cursor */
 		retcode = odbc_free_cursor(stmt);
 		if (!force && retcode != SQL_SUCCESS)
@@ -4711,6 +5090,8 @@ odbc_SQLGetStmtAttr(SQLHSTMT hstmt, SQLINTEGER Attribute, SQLPOINTER Value,
 			TDS_UINT row_number, row_count;
 
 			tds_cursor_get_cursor_info(stmt->tds, stmt->cursor, &row_number, &row_count);
+			if (row_number)
+				row_number += stmt->cursor_rowset_start;
 			stmt->attr.row_number = row_number;
 		}
 		size = sizeof(stmt->attr.row_number);
@@ -5173,6 +5554,9 @@ ODBC_FUNC(SQLGetConnectAttr, (P(SQLHDBC,hdbc), P(SQLINTEGER,Attribute), P(SQLPOI
 	case SQL_COPT_SS_BCP:
 		*((SQLUINTEGER *) Value) = dbc->attr.bulk_enabled;
 		break;
+	case SQL_COPT_FREETDS_BULK_INSERT:
+		*((SQLUINTEGER *) Value) = dbc->attr.bulk_insert;
+		break;
 	default:
 		odbc_errs_add(&dbc->errs, "HY092", NULL);
 		break;
@@ -5272,7 +5656,7 @@ SQLGetData(SQLHSTMT hstmt, SQLUSMALLINT icol, SQLSMALLINT fCType, SQLPOINTER rgb
 		}
 		assert(fCType);
 
-		*pcbValue = odbc_tds2sql_col(stmt, colinfo, fCType, (TDS_CHAR *) rgbValue, cbValueMax, NULL);
+		*pcbValue = odbc_tds2sql_col(stmt, colinfo, fCType, (TDS_CHAR *) rgbValue, cbValueMax, NULL, NULL);
 		if (*pcbValue == SQL_NULL_DATA)
 			ODBC_EXIT(stmt, SQL_ERROR);
 
@@ -5342,7 +5726,7 @@ SQLGetFunctions(SQLHDBC hdbc, SQLUSMALLINT fFunction, SQLUSMALLINT FAR * pfExist
 	API_X(SQL_API_SQLBINDPARAM)\
 	API_X(SQL_API_SQLBINDPARAMETER)\
 	API__(SQL_API_SQLBROWSECONNECT)\
-	API3_(SQL_API_SQLBULKOPERATIONS)\
+	API3X(SQL_API_SQLBULKOPERATIONS)\
 	API_X(SQL_API_SQLCANCEL)\
 	API3X(SQL_API_SQLCLOSECURSOR)\
 	ODBC_COLATTRIBUTE(API3X(SQL_API_SQLCOLATTRIBUTE))\
@@ -6625,6 +7009,9 @@ ODBC_FUNC(SQLSetConnectAttr, (P(SQLHDBC,hdbc), P(SQLINTEGER,Attribute), P(SQLPOI
 	case SQL_COPT_SS_BCP:
 		dbc->attr.bulk_enabled = (SQLUINTEGER) u_value;
 		break;
+	case SQL_COPT_FREETDS_BULK_INSERT:
+		dbc->attr.bulk_insert = (SQLUINTEGER) u_value;
+		break;
 	case SQL_COPT_TDSODBC_IMPL_BCP_INITA:
 		if (!ValuePtr)
 			odbc_errs_add(&dbc->errs, "HY009", NULL);
@@ -37,7 +37,7 @@ test_type(TDSSOCKET *tds TDS_UNUSED, TDSCOLUMN *col)
 		SQLLEN dest_len = sizeof(buffer);
 		TDSPARAMINFO *params;
 
-		len = odbc_tds2sql_col(stmt, col, sql_c_type, buffer, sizeof(buffer), NULL);
+		len = odbc_tds2sql_col(stmt, col, sql_c_type, buffer, sizeof(buffer), NULL, NULL);
 		if (len == SQL_NULL_DATA) {
 			printf("error converting to %3d (%s)\n", sql_c_type, sql_c_type_name);
 			continue;
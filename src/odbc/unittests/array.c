@@ -1,5 +1,6 @@
 #include "common.h"
 #include <assert.h>
+#include <odbcss.h>
 
 /* Test using array binding */
 
@@ -147,6 +148,12 @@ query_test(int flags, SQLRETURN expected, const char *expected_status)
 	odbc_command_with_result(odbc_stmt, "drop table #tmp1");
 }
 
+static void
+set_bulk_insert(void)
+{
+	CHKSetConnectAttr(SQL_COPT_FREETDS_BULK_INSERT, (SQLPOINTER) SQL_BULK_INSERT_ON, 0, "S");
+}
+
 TEST_MAIN()
 {
 	odbc_use_version3 = true;
@@ -190,6 +197,40 @@ TEST_MAIN()
 		query_test(FLAG_NO_STAT, SQL_ERROR, "??????????");
 		query_test(FLAG_NO_STAT | FLAG_PREPARE, SQL_ERROR, "??????????");
 
+		/* RPC calls, all rows sent in a single request */
+		odbc_command("IF OBJECT_ID('array_ins') IS NOT NULL DROP PROC array_ins");
+		odbc_command("CREATE PROC array_ins @id int, @value varchar(50) AS "
+			     "INSERT INTO #tmp1 (id, value) VALUES (@id, @value)");
+		test_query = T("{call array_ins(?, ?)}");
+		multiply = 1;
+		query_test(0, SQL_SUCCESS, "VVVVVVVVVV");
+		multiply = 1;
+		query_test(FLAG_PREPARE, SQL_SUCCESS, "VVVVVVVVVV");
+		query_test(0, SQL_SUCCESS_WITH_INFO, "VV!!!!!!!!");
+		query_test(FLAG_PREPARE, SQL_SUCCESS_WITH_INFO, "VV!!!!!!!!");
+		odbc_command("DROP PROC array_ins");
+
+		/* simple inserts sent as bulk copy */
+		if (odbc_driver_is_freetds()) {
+			odbc_disconnect();
+			odbc_set_conn_attr = set_bulk_insert;
+			odbc_connect();
+			odbc_set_conn_attr = NULL;
+
+			test_query = T("INSERT INTO #tmp1 (id, value) VALUES (?, ?)");
+			multiply = 1;
+			query_test(0, SQL_SUCCESS, "VVVVVVVVVV");
+			multiply = 1;
+			query_test(FLAG_PREPARE, SQL_SUCCESS, "VVVVVVVVVV");
+			query_test(0, SQL_SUCCESS_WITH_INFO, "VV!!!!!!!!");
+			query_test(FLAG_PREPARE, SQL_SUCCESS_WITH_INFO, "VV!!!!!!!!");
+			query_test(FLAG_NO_STAT, SQL_ERROR, "??????????");
+
+			/* not a simple insert, sent as usual */
+			test_query = T("INSERT INTO #tmp1 (id, value) VALUES (900-?, ?)");
+			query_test(0, SQL_SUCCESS_WITH_INFO, "!!!!!!!VVV");
+		}
+
 #ifdef ENABLE_DEVELOPING
 		/* with result, see how SQLMoreResult work */
 		test_query = T("INSERT INTO #tmp1 (id) VALUES (?) SELECT * FROM #tmp1 UPDATE #tmp1 SET value = ?");
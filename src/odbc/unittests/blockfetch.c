@@ -0,0 +1,184 @@
+#include "common.h"
+
+/*
+ * Test block fetch of forward only results, following rows of a rowset
+ * are decoded at once and copied directly to bound buffers.
+ */
+
+#define NUM_ROWS 25
+#define ROWSET 10
+
+typedef struct
+{
+	SQLINTEGER n;
+	SQLLEN n_ind;
+	SQLDOUBLE f;
+	SQLLEN f_ind;
+	char s[20];
+	SQLLEN s_ind;
+	SQLINTEGER t;
+	SQLLEN t_ind;
+} Row;
+
+static void
+check_row(const Row *row, int i)
+{
+	char s[20];
+
+	sprintf(s, "row %d", i);
+	if (row->n != i || row->n_ind != sizeof(SQLINTEGER)
+	    || row->f != i * 0.5 || row->f_ind != sizeof(SQLDOUBLE)
+	    || row->t != i + 1 || row->t_ind != sizeof(SQLINTEGER)) {
+		fprintf(stderr, "Wrong row %d: %d %g %d\n", i, (int) row->n, row->f, (int) row->t);
+		exit(1);
+	}
+	if (i % 7 == 3) {
+		if (row->s_ind != SQL_NULL_DATA) {
+			fprintf(stderr, "Row %d should be NULL\n", i);
+			exit(1);
+		}
+	} else if (row->s_ind != (SQLLEN) strlen(s) || strcmp(row->s, s) != 0) {
+		fprintf(stderr, "Wrong string in row %d: %s\n", i, row->s);
+		exit(1);
+	}
+}
+
+static void
+test_fetch(bool row_wise)
+{
+	Row rows[ROWSET];
+	SQLINTEGER ns[ROWSET], ts[ROWSET];
+	SQLDOUBLE fs[ROWSET];
+	char ss[ROWSET][20];
+	SQLLEN n_inds[ROWSET], f_inds[ROWSET], s_inds[ROWSET], t_inds[ROWSET];
+	SQLULEN fetched;
+	SQLUSMALLINT statuses[ROWSET];
+	int i, n = 0;
+
+	odbc_reset_statement();
+
+	CHKSetStmtAttr(SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) ROWSET, SQL_IS_UINTEGER, "S");
+	CHKSetStmtAttr(SQL_ATTR_ROW_STATUS_PTR, statuses, 0, "S");
+	CHKSetStmtAttr(SQL_ATTR_ROWS_FETCHED_PTR, &fetched, 0, "S");
+
+	if (row_wise) {
+		CHKSetStmtAttr(SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER) sizeof(Row), SQL_IS_UINTEGER, "S");
+		CHKBindCol(1, SQL_C_SLONG, &rows[0].n, 0, &rows[0].n_ind, "S");
+		CHKBindCol(2, SQL_C_DOUBLE, &rows[0].f, 0, &rows[0].f_ind, "S");
+		CHKBindCol(3, SQL_C_CHAR, rows[0].s, sizeof(rows[0].s), &rows[0].s_ind, "S");
+		CHKBindCol(4, SQL_C_SLONG, &rows[0].t, 0, &rows[0].t_ind, "S");
+	} else {
+		CHKBindCol(1, SQL_C_SLONG, ns, 0, n_inds, "S");
+		CHKBindCol(2, SQL_C_DOUBLE, fs, 0, f_inds, "S");
+		CHKBindCol(3, SQL_C_CHAR, ss, sizeof(ss[0]), s_inds, "S");
+		CHKBindCol(4, SQL_C_SLONG, ts, 0, t_inds, "S");
+	}
+
+	CHKExecDirect(T("SELECT n, f, s, t FROM #blockfetch ORDER BY n"), SQL_NTS, "S");
+
+	for (;;) {
+		memset(rows, 0, sizeof(rows));
+		fetched = 0;
+		if (CHKFetch("SNo") == SQL_NO_DATA)
+			break;
+		if (fetched != TDS_MIN(ROWSET, NUM_ROWS - n)) {
+			fprintf(stderr, "Wrong number of rows fetched %d\n", (int) fetched);
+			exit(1);
+		}
+		for (i = 0; i < (int) fetched; ++i, ++n) {
+			if (statuses[i] != SQL_ROW_SUCCESS) {
+				fprintf(stderr, "Wrong status for row %d\n", n);
+				exit(1);
+			}
+			if (!row_wise) {
+				rows[i].n = ns[i];
+				rows[i].n_ind = n_inds[i];
+				rows[i].f = fs[i];
+				rows[i].f_ind = f_inds[i];
+				strcpy(rows[i].s, ss[i]);
+				rows[i].s_ind = s_inds[i];
+				rows[i].t = ts[i];
+				rows[i].t_ind = t_inds[i];
+			}
+			check_row(&rows[i], n);
+		}
+	}
+	if (n != NUM_ROWS) {
+		fprintf(stderr, "Got %d rows, expected %d\n", n, NUM_ROWS);
+		exit(1);
+	}
+	CHKMoreResults("No");
+	odbc_reset_statement();
+}
+
+/* change rowset size in the middle of results, rows should not be lost */
+static void
+test_change_rowset(void)
+{
+	SQLINTEGER ns[ROWSET];
+	SQLLEN n_inds[ROWSET], ind;
+	SQLULEN fetched;
+	char s[20], buf[20];
+	int i;
+
+	odbc_reset_statement();
+
+	CHKSetStmtAttr(SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) 4, SQL_IS_UINTEGER, "S");
+	CHKSetStmtAttr(SQL_ATTR_ROWS_FETCHED_PTR, &fetched, 0, "S");
+	CHKBindCol(1, SQL_C_SLONG, ns, 0, n_inds, "S");
+
+	CHKExecDirect(T("SELECT n, s FROM #blockfetch ORDER BY n"), SQL_NTS, "S");
+
+	CHKFetch("S");
+	for (i = 0; i < 4; ++i) {
+		if (ns[i] != i) {
+			fprintf(stderr, "Wrong value %d in row %d\n", (int) ns[i], i);
+			exit(1);
+		}
+	}
+
+	/* single rows, data can be read with SQLGetData */
+	CHKSetStmtAttr(SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) 1, SQL_IS_UINTEGER, "S");
+	for (i = 4; i < NUM_ROWS; ++i) {
+		CHKFetch("S");
+		if (ns[0] != i) {
+			fprintf(stderr, "Wrong value %d in row %d\n", (int) ns[0], i);
+			exit(1);
+		}
+		CHKGetData(2, SQL_C_CHAR, buf, sizeof(buf), &ind, "S");
+		sprintf(s, "row %d", i);
+		if (i % 7 == 3 ? ind != SQL_NULL_DATA : strcmp(buf, s) != 0) {
+			fprintf(stderr, "Wrong string in row %d\n", i);
+			exit(1);
+		}
+	}
+	CHKFetch("No");
+	odbc_reset_statement();
+}
+
+TEST_MAIN()
+{
+	char sql[128];
+	int i;
+
+	odbc_use_version3 = true;
+	odbc_connect();
+
+	odbc_command("CREATE TABLE #blockfetch(n INT NOT NULL, f FLOAT NOT NULL, s VARCHAR(20) NULL, t TINYINT NOT NULL)");
+	for (i = 0; i < NUM_ROWS; ++i) {
+		if (i % 7 == 3)
+			sprintf(sql, "INSERT INTO #blockfetch VALUES(%d, %d * 0.5e0, NULL, %d)", i, i, i + 1);
+		else
+			sprintf(sql, "INSERT INTO #blockfetch VALUES(%d, %d * 0.5e0, 'row %d', %d)", i, i, i, i + 1);
+		odbc_command(sql);
+	}
+
+	test_fetch(false);
+	test_fetch(true);
+	test_change_rowset();
+
+	odbc_disconnect();
+
+	printf("Done.\n");
+	return 0;
+}
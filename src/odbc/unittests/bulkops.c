@@ -0,0 +1,114 @@
+#include "common.h"
+#include <odbcss.h>
+
+/* Test SQLBulkOperations(SQL_ADD), rows are sent using bulk copy */
+
+#define NUM_ROWS 5
+
+static void
+set_bulk_insert(void)
+{
+	CHKSetConnectAttr(SQL_COPT_FREETDS_BULK_INSERT, (SQLPOINTER) SQL_BULK_INSERT_ON, 0, "S");
+}
+
+static void
+check_count(const char *where, int expected)
+{
+	char sql[256];
+
+	sprintf(sql, "IF (SELECT COUNT(*) FROM #bulkops WHERE %s) <> %d SELECT 1", where, expected);
+	odbc_check_no_row(sql);
+}
+
+static void
+add_rows(const char *first_n, SQLRETURN expected, const char *expected_status)
+{
+	char ns[NUM_ROWS][10], ss[NUM_ROWS][20];
+	SQLLEN n_inds[NUM_ROWS], s_inds[NUM_ROWS];
+	SQLUSMALLINT statuses[NUM_ROWS], operations[NUM_ROWS];
+	char status[NUM_ROWS + 1];
+	SQLRETURN ret;
+	int i;
+
+	odbc_reset_statement();
+
+	CHKExecDirect(T("SELECT n, s FROM #bulkops WHERE 1 = 0"), SQL_NTS, "S");
+	CHKFetch("No");
+
+	CHKSetStmtAttr(SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) NUM_ROWS, 0, "S");
+	CHKSetStmtAttr(SQL_ATTR_ROW_STATUS_PTR, statuses, 0, "S");
+	CHKSetStmtAttr(SQL_ATTR_ROW_OPERATION_PTR, operations, 0, "S");
+	CHKBindCol(1, SQL_C_CHAR, ns, sizeof(ns[0]), n_inds, "S");
+	CHKBindCol(2, SQL_C_CHAR, ss, sizeof(ss[0]), s_inds, "S");
+
+	for (i = 0; i < NUM_ROWS; ++i) {
+		sprintf(ns[i], "%d", i + 1);
+		n_inds[i] = SQL_NTS;
+		sprintf(ss[i], "row %d", i + 1);
+		s_inds[i] = (i == 3) ? SQL_NULL_DATA : SQL_NTS;
+		statuses[i] = SQL_ROW_NOROW;
+		operations[i] = (i == 1) ? SQL_ROW_IGNORE : SQL_ROW_PROCEED;
+	}
+	strcpy(ns[0], first_n);
+
+	ret = SQLBulkOperations(odbc_stmt, SQL_ADD);
+
+	for (i = 0; i < NUM_ROWS; ++i) {
+		switch (statuses[i]) {
+		case SQL_ROW_ADDED:
+			status[i] = 'V';
+			break;
+		case SQL_ROW_ERROR:
+			status[i] = '!';
+			break;
+		case SQL_ROW_NOROW:
+			status[i] = ' ';
+			break;
+		default:
+			fprintf(stderr, "Invalid status returned %d\n", statuses[i]);
+			exit(1);
+		}
+	}
+	status[i] = 0;
+
+	if (ret != expected || strcmp(status, expected_status) != 0) {
+		fprintf(stderr, "Invalid result: got %d \"%s\" expected %d \"%s\"\n",
+			ret, status, expected, expected_status);
+		odbc_read_error();
+		exit(1);
+	}
+	odbc_reset_statement();
+}
+
+TEST_MAIN()
+{
+	odbc_use_version3 = true;
+	odbc_set_conn_attr = set_bulk_insert;
+	odbc_connect();
+
+	if (!odbc_db_is_microsoft() || !odbc_driver_is_freetds()) {
+		odbc_disconnect();
+		printf("Test for FreeTDS with Microsoft SQL Server only\n");
+		odbc_test_skipped();
+		return 0;
+	}
+
+	odbc_command("CREATE TABLE #bulkops(id INT IDENTITY, n INT NOT NULL, s VARCHAR(20) NULL, d INT DEFAULT 7)");
+
+	/* all rows but the ignored one are added, unbound column gets its default */
+	add_rows("1", SQL_SUCCESS, "V VVV");
+	check_count("n IN (1, 3, 4, 5) AND d = 7", 4);
+	check_count("n = 2", 0);
+	check_count("n = 4 AND s IS NULL", 1);
+	check_count("n = 5 AND s = 'row 5'", 1);
+
+	/* a row with invalid data is not sent, others are */
+	odbc_command("DELETE FROM #bulkops");
+	add_rows("x", SQL_SUCCESS_WITH_INFO, "! VVV");
+	check_count("1 = 1", 3);
+
+	odbc_disconnect();
+
+	printf("Done.\n");
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include "common.h"
+
+/*
+ * Test prefetch of read only server cursors, rows are fetched in
+ * growing blocks while application reads sequentially.
+ * Scrolling must return rows relative to current rowset, not to
+ * block fetched from server.
+ */
+
+#define NUM_ROWS 100
+#define ROWSET 3
+
+static SQLINTEGER ns[ROWSET];
+static char cs[ROWSET][20];
+static SQLLEN n_inds[ROWSET], c_inds[ROWSET];
+static SQLULEN fetched;
+
+static void
+set_cursor(SQLULEN rowset)
+{
+	odbc_reset_statement();
+	CHKSetStmtAttr(SQL_ATTR_CONCURRENCY, (SQLPOINTER) SQL_CONCUR_READ_ONLY, 0, "S");
+	CHKSetStmtAttr(SQL_ATTR_CURSOR_SCROLLABLE, (SQLPOINTER) SQL_SCROLLABLE, 0, "S");
+	CHKSetStmtAttr(SQL_ATTR_CURSOR_TYPE, (SQLPOINTER) SQL_CURSOR_STATIC, 0, "S");
+	CHKSetStmtAttr(SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) (TDS_INTPTR) rowset, 0, "S");
+	CHKSetStmtAttr(SQL_ATTR_ROWS_FETCHED_PTR, &fetched, 0, "S");
+
+	CHKExecDirect(T("SELECT n, c FROM #prefetch ORDER BY n"), SQL_NTS, "S");
+
+	CHKBindCol(1, SQL_C_SLONG, ns, 0, n_inds, "S");
+	CHKBindCol(2, SQL_C_CHAR, cs, sizeof(cs[0]), c_inds, "S");
+}
+
+static void
+check_rows(int start, int num, int line)
+{
+	char s[20];
+	int i;
+
+	if ((int) fetched != num) {
+		fprintf(stderr, "Expected %d rows, got %d line %d\n", num, (int) fetched, line);
+		exit(1);
+	}
+	for (i = 0; i < num; ++i) {
+		sprintf(s, "row %d", start + i);
+		if (ns[i] != start + i || strcmp(cs[i], s) != 0) {
+			fprintf(stderr, "Wrong row %d: got %d %s, expected %d line %d\n",
+				i, (int) ns[i], cs[i], start + i, line);
+			exit(1);
+		}
+	}
+}
+
+static void
+fetch(SQLSMALLINT type, SQLLEN offset, int start, int num, int line)
+{
+	fetched = 0;
+	if (start < 0) {
+		CHKFetchScroll(type, offset, "No");
+		return;
+	}
+	CHKFetchScroll(type, offset, "S");
+	check_rows(start, num, line);
+}
+
+#define FETCH(type, offset, start, num) fetch(type, offset, start, num, __LINE__)
+
+TEST_MAIN()
+{
+	char s[20], buf[20];
+	SQLLEN ind;
+	int i;
+
+	odbc_use_version3 = true;
+	odbc_connect();
+	odbc_check_cursor();
+
+	odbc_command("CREATE TABLE #prefetch(n INT NOT NULL, c VARCHAR(20) NOT NULL)");
+	odbc_command("DECLARE @i INT SET @i = 1 "
+		     "WHILE @i <= 100 BEGIN "
+		     "INSERT INTO #prefetch VALUES(@i, 'row ' + CAST(@i AS VARCHAR(10))) SET @i = @i + 1 "
+		     "END");
+
+	/* scroll after some rows were prefetched */
+	set_cursor(ROWSET);
+	for (i = 0; i < 10; ++i)
+		FETCH(SQL_FETCH_NEXT, 0, i * ROWSET + 1, ROWSET);
+	FETCH(SQL_FETCH_PRIOR, 0, 25, ROWSET);
+	FETCH(SQL_FETCH_RELATIVE, 2, 27, ROWSET);
+	FETCH(SQL_FETCH_NEXT, 0, 30, ROWSET);
+	FETCH(SQL_FETCH_NEXT, 0, 33, ROWSET);
+	FETCH(SQL_FETCH_NEXT, 0, 36, ROWSET);
+	FETCH(SQL_FETCH_RELATIVE, -1, 35, ROWSET);
+	FETCH(SQL_FETCH_ABSOLUTE, 50, 50, ROWSET);
+	FETCH(SQL_FETCH_FIRST, 0, 1, ROWSET);
+	FETCH(SQL_FETCH_LAST, 0, NUM_ROWS - ROWSET + 1, ROWSET);
+	FETCH(SQL_FETCH_NEXT, 0, -1, 0);
+
+	/* read all rows, one at a time */
+	set_cursor(1);
+	for (i = 1; i <= NUM_ROWS; ++i) {
+		FETCH(SQL_FETCH_NEXT, 0, i, 1);
+		CHKGetData(2, SQL_C_CHAR, buf, sizeof(buf), &ind, "S");
+		sprintf(s, "row %d", i);
+		if (strcmp(buf, s) != 0) {
+			fprintf(stderr, "Wrong data %s from SQLGetData, expected %s\n", buf, s);
+			exit(1);
+		}
+	}
+	FETCH(SQL_FETCH_NEXT, 0, -1, 0);
+
+	/* change rowset size while rows are buffered */
+	set_cursor(1);
+	for (i = 1; i <= 5; ++i)
+		FETCH(SQL_FETCH_NEXT, 0, i, 1);
+	CHKSetStmtAttr(SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) ROWSET, 0, "S");
+	FETCH(SQL_FETCH_NEXT, 0, 6, ROWSET);
+	FETCH(SQL_FETCH_NEXT, 0, 9, ROWSET);
+	FETCH(SQL_FETCH_NEXT, 0, 12, ROWSET);
+
+	odbc_reset_statement();
+	odbc_disconnect();
+
+	printf("Done.\n");
+	return 0;
+}
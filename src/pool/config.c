@@ -51,6 +51,7 @@
 #define POOL_STR_MAX_POOL_CONN	"max pool conn"
 #define POOL_STR_MIN_POOL_CONN	"min pool conn"
 #define POOL_STR_MAX_POOL_USERS	"max pool users"
+#define POOL_STR_THREADS	"threads"
 
 typedef struct {
 	TDS_POOL *pool;
@@ -158,6 +159,11 @@ pool_parse(const char *option, const char *value, void *param)
 	} else if (!strcmp(option, POOL_STR_MIN_POOL_CONN)) {
 		val = pool_get_uint(value);
 		pool->min_open_conn = val;
+	} else if (!strcmp(option, POOL_STR_THREADS)) {
+		val = pool_get_uint(value);
+		if (val < 1 || val > 256)
+			val = -1;
+		pool->num_threads = val;
 	}
 	if (val < 0) {
 		free(*params->err);
@@ -55,6 +55,10 @@
 #include <arpa/inet.h>
 #endif /* HAVE_ARPA_INET_H */
 
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif /* HAVE_SYS_EPOLL_H */
+
 #ifdef _WIN32
 #include <io.h>
 #endif
@@ -62,28 +66,29 @@
 #include "pool.h"
 
 /* to be set by sig term */
-static bool got_sigterm = false;
+static volatile sig_atomic_t got_sigterm = 0;
 static const char *logfile_name = NULL;
 
 static void sigterm_handler(int sig);
-static void pool_schedule_waiters(TDS_POOL * pool);
+static void pool_schedule_waiters(TDS_POOL_SHARD * shard);
 static void pool_socket_init(TDS_POOL * pool);
-static void pool_main_loop(TDS_POOL * pool);
+static void pool_main_loop(TDS_POOL_SHARD * shard);
 static bool pool_open_logfile(void);
+static void pool_loop_init(TDS_POOL_SHARD * shard);
 
 static void
 sigterm_handler(int sig TDS_UNUSED)
 {
-	got_sigterm = true;
+	got_sigterm = 1;
 }
 
 #ifndef _WIN32
-static bool got_sighup = false;
+static volatile sig_atomic_t got_sighup = 0;
 
 static void
 sighup_handler(int sig TDS_UNUSED)
 {
-	got_sighup = true;
+	got_sighup = 1;
 }
 #endif
 
@@ -96,6 +101,23 @@ check_field(const char *pool_name, bool cond, const char *field_name)
 	}
 }
 
+static void
+pool_shard_init(TDS_POOL * pool, TDS_POOL_SHARD * shard)
+{
+	shard->pool = pool;
+	shard->listen_fd = INVALID_SOCKET;
+	shard->wakeup_fd = INVALID_SOCKET;
+	shard->event_fd = INVALID_SOCKET;
+	if (tds_mutex_init(&shard->events_mtx)) {
+		fprintf(stderr, "Error initializing pool mutex\n");
+		exit(EXIT_FAILURE);
+	}
+	dlist_member_init(&shard->active_members);
+	dlist_user_init(&shard->users);
+	dlist_user_init(&shard->waiters);
+	pool_loop_init(shard);
+}
+
 /*
  * pool_init creates a named pool and opens connections to the database
  */
@@ -104,6 +126,7 @@ pool_init(const char *name, const tds_dir_char *config_path)
 {
 	TDS_POOL *pool;
 	char *err = NULL;
+	unsigned i;
 
 	/* initialize the pool */
 
@@ -114,8 +137,7 @@ pool_init(const char *name, const tds_dir_char *config_path)
 	}
 	pool->password = strdup("");
 
-	pool->event_fd = INVALID_SOCKET;
-	if (tds_mutex_init(&pool->events_mtx)) {
+	if (tds_mutex_init(&pool->mtx)) {
 		fprintf(stderr, "Error initializing pool mutex\n");
 		exit(EXIT_FAILURE);
 	}
@@ -148,6 +170,15 @@ pool_init(const char *name, const tds_dir_char *config_path)
 
 	pool_open_logfile();
 
+	pool->num_shards = pool->num_threads > 0 ? pool->num_threads : 1;
+	pool->shards = tds_new0(TDS_POOL_SHARD, pool->num_shards);
+	if (!pool->shards) {
+		fprintf(stderr, "Could not allocate memory for pool\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < pool->num_shards; ++i)
+		pool_shard_init(pool, &pool->shards[i]);
+
 	pool_mbr_init(pool);
 	pool_user_init(pool);
 
@@ -159,13 +190,31 @@ pool_init(const char *name, const tds_dir_char *config_path)
 static void
 pool_destroy(TDS_POOL *pool)
 {
+	unsigned i;
+
 	pool_mbr_destroy(pool);
 	pool_user_destroy(pool);
 
-	CLOSESOCKET(pool->wakeup_fd);
-	CLOSESOCKET(pool->listen_fd);
-	CLOSESOCKET(pool->event_fd);
-	tds_mutex_free(&pool->events_mtx);
+	for (i = 0; i < pool->num_shards; ++i) {
+		TDS_POOL_SHARD *shard = &pool->shards[i];
+
+		/* listening socket can be shared with first shard */
+		if (i == 0 || shard->listen_fd != pool->shards[0].listen_fd)
+			CLOSESOCKET(shard->listen_fd);
+		CLOSESOCKET(shard->wakeup_fd);
+		CLOSESOCKET(shard->event_fd);
+#if HAVE_SYS_EPOLL_H
+		close(shard->epoll_fd);
+#else
+		free(shard->fds);
+		free(shard->fd_socks);
+#endif
+		tds_mutex_free(&shard->events_mtx);
+		free(shard->ready);
+	}
+	free(pool->shards);
+	tds_mutex_free(&pool->mtx);
+	free(pool->idle_heap);
 
 	free(pool->user);
 	free(pool->password);
@@ -178,20 +227,24 @@ pool_destroy(TDS_POOL *pool)
 }
 
 static void
-pool_schedule_waiters(TDS_POOL * pool)
+pool_schedule_waiters(TDS_POOL_SHARD * shard)
 {
+	TDS_POOL *pool = shard->pool;
 	TDS_POOL_USER *puser;
 
 	/* first see if there are free members to do the request */
-	if (!dlist_member_first(&pool->idle_members))
+	if (!pool_has_idle_member(pool))
 		return;
 
-	while ((puser = dlist_user_first(&pool->waiters)) != NULL) {
+	while ((puser = dlist_user_first(&shard->waiters)) != NULL) {
 		if (puser->user_state == TDS_SRV_WAIT) {
 			/* place back in query state */
 			puser->user_state = TDS_SRV_QUERY;
-			dlist_user_remove(&pool->waiters, puser);
-			dlist_user_append(&pool->users, puser);
+			dlist_user_remove(&shard->waiters, puser);
+			tds_mutex_lock(&pool->mtx);
+			shard->num_waiters--;
+			tds_mutex_unlock(&pool->mtx);
+			dlist_user_append(&shard->users, puser);
 			/* now try again */
 			pool_user_query(pool, puser);
 			return;
@@ -199,14 +252,255 @@ pool_schedule_waiters(TDS_POOL * pool)
 	}
 }
 
-typedef struct select_info
+/*
+ * Wake shards having users waiting for a member.
+ * Must be called with pool mtx locked.
+ */
+void
+pool_wakeup_waiters(TDS_POOL * pool)
 {
-	struct pollfd *fds;
-	uint32_t num_fds, alloc_fds;
-} SELECT_INFO;
+	unsigned i;
+
+	for (i = 0; i < pool->num_shards; ++i)
+		if (pool->shards[i].num_waiters > 0)
+			WRITESOCKET(pool->shards[i].event_fd, "x", 1);
+}
+
+/*
+ * Sockets are registered once into the event loop. Readiness is
+ * edge-triggered and latched into TDS_POOL_SOCKET readable/writable;
+ * sockets with readiness not consumed yet are kept in the ready list
+ * so we don't need to scan all users and members at every wakeup.
+ * readable is cleared when a read would block, writable when a write
+ * would block.
+ */
 
+/* mark socket as ready to be processed */
 static void
-pool_select_add_socket(SELECT_INFO *sel, TDS_POOL_SOCKET *sock)
+pool_socket_ready(TDS_POOL_SHARD * shard, TDS_POOL_SOCKET * sock, bool readable, bool writable)
+{
+	if (readable)
+		sock->readable = true;
+	if (writable)
+		sock->writable = true;
+	if (sock->ready_index)
+		return;
+
+	if (shard->num_ready >= shard->alloc_ready) {
+		uint32_t alloc = shard->alloc_ready ? shard->alloc_ready * 2 : 64;
+
+		if (!TDS_RESIZE(shard->ready, alloc)) {
+			fprintf(stderr, "Out of memory allocating ready sockets\n");
+			exit(EXIT_FAILURE);
+		}
+		shard->alloc_ready = alloc;
+	}
+	shard->ready[shard->num_ready++] = sock;
+	sock->ready_index = shard->num_ready;
+}
+
+/* check we can do some progress on socket */
+static bool
+pool_socket_can_process(TDS_POOL_SOCKET * sock)
+{
+	if (sock->member) {
+		TDS_POOL_MEMBER *pmbr = pool_socket_member(sock);
+
+		if (!pmbr->current_user || pmbr->doing_async)
+			return false;
+	} else if (!sock->tds) {
+		return false;
+	}
+	return (sock->poll_recv && sock->readable) || (sock->poll_send && sock->writable);
+}
+
+void
+pool_socket_add(TDS_POOL_SHARD * shard, TDS_POOL_SOCKET * sock)
+{
+#if HAVE_SYS_EPOLL_H
+	struct epoll_event ev;
+#endif
+
+	assert(sock->shard == NULL);
+	sock->shard = shard;
+	sock->readable = false;
+	sock->writable = false;
+
+#if HAVE_SYS_EPOLL_H
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+#ifdef EPOLLRDHUP
+	ev.events |= EPOLLRDHUP;
+#endif
+	ev.data.ptr = sock;
+	if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, tds_get_s(sock->tds), &ev) < 0) {
+		tdsdump_log(TDS_DBG_ERROR, "epoll_ctl error %d\n", errno);
+		/* force a read to detect the error */
+		pool_socket_ready(shard, sock, true, true);
+	}
+#endif
+}
+
+void
+pool_socket_remove(TDS_POOL_SOCKET * sock)
+{
+	TDS_POOL_SHARD *shard = sock->shard;
+
+	if (!shard)
+		return;
+
+	if (sock->ready_index) {
+		assert(shard->ready[sock->ready_index - 1] == sock);
+		shard->ready[sock->ready_index - 1] = NULL;
+		sock->ready_index = 0;
+	}
+#if HAVE_SYS_EPOLL_H
+	if (sock->tds && !TDS_IS_SOCKET_INVALID(tds_get_s(sock->tds))) {
+		struct epoll_event ev;
+
+		epoll_ctl(shard->epoll_fd, EPOLL_CTL_DEL, tds_get_s(sock->tds), &ev);
+	}
+#endif
+	sock->shard = NULL;
+}
+
+/* process sockets in ready list, keep the ones still ready */
+static void
+pool_process_ready(TDS_POOL_SHARD * shard)
+{
+	TDS_POOL *pool = shard->pool;
+	TDS_POOL_SOCKET *sock;
+	uint32_t i, n;
+
+	/* socket removed during processing leave a NULL entry */
+	for (i = 0; i < shard->num_ready; ++i) {
+		sock = shard->ready[i];
+		if (!sock)
+			continue;
+		if (sock->member)
+			pool_process_member(pool, pool_socket_member(sock));
+		else
+			pool_process_user(pool, pool_socket_user(sock));
+	}
+
+	/* compact, writable readiness is needed only after a partial write so
+	 * it will be reported again */
+	for (i = n = 0; i < shard->num_ready; ++i) {
+		sock = shard->ready[i];
+		if (!sock)
+			continue;
+		if (!sock->readable) {
+			sock->ready_index = 0;
+			continue;
+		}
+		shard->ready[n++] = sock;
+		sock->ready_index = n;
+	}
+	shard->num_ready = n;
+}
+
+/* check if some socket in ready list can be processed without waiting */
+static bool
+pool_has_ready(TDS_POOL_SHARD * shard)
+{
+	TDS_POOL_SOCKET *sock;
+	uint32_t i;
+
+	/* expired members leave a NULL entry till next pool_process_ready() */
+	for (i = 0; i < shard->num_ready; ++i) {
+		sock = shard->ready[i];
+		if (sock && pool_socket_can_process(sock))
+			return true;
+	}
+	return false;
+}
+
+/* markers used to detect listening and wakeup sockets */
+static char listen_marker, wakeup_marker;
+
+#if HAVE_SYS_EPOLL_H
+static void
+pool_loop_init(TDS_POOL_SHARD * shard)
+{
+	shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (shard->epoll_fd < 0) {
+		perror("epoll_create1");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void
+pool_loop_add_fd(TDS_POOL_SHARD * shard, TDS_SYS_SOCKET fd, void *marker)
+{
+	struct epoll_event ev;
+
+	/* level triggered, we don't read these until they would block */
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = marker;
+	if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		perror("epoll_ctl");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Wait for events.
+ * @return -1 on error, 0 on success
+ */
+static int
+pool_loop_wait(TDS_POOL_SHARD * shard, int timeout, bool *accept_ready, bool *wakeup_ready)
+{
+	struct epoll_event events[64];
+	int i, rc;
+
+	rc = epoll_wait(shard->epoll_fd, events, TDS_VECTOR_SIZE(events), timeout);
+	if (rc < 0)
+		return -1;
+
+	for (i = 0; i < rc; ++i) {
+		uint32_t revents = events[i].events;
+		void *ptr = events[i].data.ptr;
+
+		if (ptr == &listen_marker) {
+			*accept_ready = true;
+		} else if (ptr == &wakeup_marker) {
+			*wakeup_ready = true;
+		} else {
+			uint32_t recv_mask = EPOLLIN | EPOLLHUP | EPOLLERR;
+
+#ifdef EPOLLRDHUP
+			recv_mask |= EPOLLRDHUP;
+#endif
+			pool_socket_ready(shard, (TDS_POOL_SOCKET *) ptr, (revents & recv_mask) != 0,
+					  (revents & (EPOLLOUT | EPOLLERR)) != 0);
+		}
+	}
+	return 0;
+}
+#else
+static void
+pool_loop_init(TDS_POOL_SHARD * shard)
+{
+	shard->num_fds = 0;
+	shard->alloc_fds = 8;
+	if (!TDS_RESIZE(shard->fds, shard->alloc_fds) || !TDS_RESIZE(shard->fd_socks, shard->alloc_fds)) {
+		fprintf(stderr, "Out of memory allocating fds\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void
+pool_loop_add_fd(TDS_POOL_SHARD * shard, TDS_SYS_SOCKET fd, void *marker TDS_UNUSED)
+{
+	shard->fds[shard->num_fds].fd = fd;
+	shard->fds[shard->num_fds].events = POLLIN;
+	shard->fd_socks[shard->num_fds] = NULL;
+	shard->num_fds++;
+}
+
+static void
+pool_select_add_socket(TDS_POOL_SHARD *shard, TDS_POOL_SOCKET *sock)
 {
 	short events;
 	struct pollfd *fd;
@@ -222,30 +516,72 @@ pool_select_add_socket(SELECT_INFO *sel, TDS_POOL_SOCKET *sock)
 		events |= POLLIN;
 	if (sock->poll_send)
 		events |= POLLOUT;
-	if (sel->num_fds >= sel->alloc_fds) {
-		sel->alloc_fds *= 2;
-		if (!TDS_RESIZE(sel->fds, sel->alloc_fds)) {
+	if (shard->num_fds >= shard->alloc_fds) {
+		shard->alloc_fds *= 2;
+		if (!TDS_RESIZE(shard->fds, shard->alloc_fds) || !TDS_RESIZE(shard->fd_socks, shard->alloc_fds)) {
 			fprintf(stderr, "Out of memory allocating fds\n");
 			exit(EXIT_FAILURE);
 		}
 	}
-	sock->poll_index = sel->num_fds;
-	fd = &sel->fds[sel->num_fds++];
+	shard->fd_socks[shard->num_fds] = sock;
+	fd = &shard->fds[shard->num_fds++];
 	fd->fd = tds_get_s(sock->tds);
 	fd->events = events;
 	fd->revents = 0;
 }
 
+/*
+ * Wait for events.
+ * @return -1 on error, 0 on success
+ */
+static int
+pool_loop_wait(TDS_POOL_SHARD * shard, int timeout, bool *accept_ready, bool *wakeup_ready)
+{
+	TDS_POOL_MEMBER *pmbr;
+	TDS_POOL_USER *puser;
+	uint32_t i;
+	int rc;
+
+	/* first 2 are listening and wakeup sockets */
+	shard->num_fds = 2;
+	shard->fds[0].revents = 0;
+	shard->fds[1].revents = 0;
+
+	/* add the user sockets to the read list */
+	DLIST_FOREACH(dlist_user, &shard->users, puser)
+		pool_select_add_socket(shard, &puser->sock);
+
+	/* add the pool member sockets to the read list */
+	DLIST_FOREACH(dlist_member, &shard->active_members, pmbr)
+		pool_select_add_socket(shard, &pmbr->sock);
+
+	rc = poll(shard->fds, shard->num_fds, timeout);
+	if (rc < 0)
+		return -1;
+
+	*accept_ready = (shard->fds[0].revents & POLLIN) != 0;
+	*wakeup_ready = (shard->fds[1].revents & POLLIN) != 0;
+	for (i = 2; i < shard->num_fds; ++i) {
+		short revents = shard->fds[i].revents;
+
+		if (!revents)
+			continue;
+		pool_socket_ready(shard, shard->fd_socks[i], (revents & (POLLIN|POLLHUP)) != 0, (revents & POLLOUT) != 0);
+	}
+	return 0;
+}
+#endif
+
 static void
-pool_process_events(TDS_POOL *pool)
+pool_process_events(TDS_POOL_SHARD *shard)
 {
 	TDS_POOL_EVENT *events, *next;
 
-	/* detach events from pool */
-	tds_mutex_lock(&pool->events_mtx);
-	events = pool->events;
-	pool->events = NULL;
-	tds_mutex_unlock(&pool->events_mtx);
+	/* detach events from shard */
+	tds_mutex_lock(&shard->events_mtx);
+	events = shard->events;
+	shard->events = NULL;
+	tds_mutex_unlock(&shard->events_mtx);
 
 	/* process them */
 	while (events) {
@@ -285,11 +621,11 @@ pool_open_logfile(void)
 	return true;
 }
 
-static void
-pool_socket_init(TDS_POOL * pool)
+static TDS_SYS_SOCKET
+pool_listen_socket(TDS_POOL * pool)
 {
 	struct sockaddr_in sin;
-	TDS_SYS_SOCKET s, event_pair[2];
+	TDS_SYS_SOCKET s;
 	int socktrue = 1;
 
 	/* FIXME -- read the interfaces file and bind accordingly */
@@ -304,23 +640,46 @@ pool_socket_init(TDS_POOL * pool)
 	tds_socket_set_nonblocking(s);
 	/* don't keep addr in use from s.craig@andronics.com */
 	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const void *) &socktrue, sizeof(socktrue));
+#ifdef SO_REUSEPORT
+	/* every shard listens on its own socket, kernel balances connections */
+	if (pool->num_shards > 1)
+		setsockopt(s, SOL_SOCKET, SO_REUSEPORT, (const void *) &socktrue, sizeof(socktrue));
+#endif
 
-	fprintf(stderr, "Listening on port %d\n", pool->port);
 	if (bind(s, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
 		perror("bind");
 		exit(1);
 	}
 	listen(s, 5);
-	pool->listen_fd = s;
+	return s;
+}
 
-	if (socketpair(AF_UNIX, SOCK_STREAM, 0, event_pair) < 0) {
-		perror("socketpair");
-		exit(1);
+static void
+pool_socket_init(TDS_POOL * pool)
+{
+	TDS_SYS_SOCKET event_pair[2];
+	unsigned i;
+
+	fprintf(stderr, "Listening on port %d\n", pool->port);
+	for (i = 0; i < pool->num_shards; ++i) {
+		TDS_POOL_SHARD *shard = &pool->shards[i];
+
+#ifdef SO_REUSEPORT
+		shard->listen_fd = pool_listen_socket(pool);
+#else
+		/* shards share the same listening socket */
+		shard->listen_fd = i ? pool->shards[0].listen_fd : pool_listen_socket(pool);
+#endif
+
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, event_pair) < 0) {
+			perror("socketpair");
+			exit(1);
+		}
+		tds_socket_set_nonblocking(event_pair[0]);
+		tds_socket_set_nonblocking(event_pair[1]);
+		shard->event_fd = event_pair[1];
+		shard->wakeup_fd = event_pair[0];
 	}
-	tds_socket_set_nonblocking(event_pair[0]);
-	tds_socket_set_nonblocking(event_pair[1]);
-	pool->event_fd = event_pair[1];
-	pool->wakeup_fd = event_pair[0];
 }
 
 /*
@@ -329,47 +688,37 @@ pool_socket_init(TDS_POOL * pool)
  * pool members.
  */
 static void
-pool_main_loop(TDS_POOL * pool)
+pool_main_loop(TDS_POOL_SHARD * shard)
 {
-	TDS_POOL_MEMBER *pmbr;
-	TDS_POOL_USER *puser;
+	TDS_POOL *pool = shard->pool;
 	TDS_SYS_SOCKET s, wakeup;
-	SELECT_INFO sel = { NULL, 0, 8 };
-	int min_expire_left = -1;
-	int rc;
-
-	s = pool->listen_fd;
-	wakeup = pool->wakeup_fd;
-
-	/* add the listening socket to the read list */
-	if (!TDS_RESIZE(sel.fds, sel.alloc_fds)) {
-		fprintf(stderr, "Out of memory allocating fds\n");
-		exit(EXIT_FAILURE);
-	}
-	sel.fds[0].fd = s;
-	sel.fds[0].events = POLLIN;
-	sel.fds[1].fd = wakeup;
-	sel.fds[1].events = POLLIN;
-
-	while (!got_sigterm) {
-
-		sel.num_fds = 2;
-		sel.fds[0].revents = 0;
-		sel.fds[1].revents = 0;
-
-		/* add the user sockets to the read list */
-		DLIST_FOREACH(dlist_user, &pool->users, puser)
-			pool_select_add_socket(&sel, &puser->sock);
-
-		/* add the pool member sockets to the read list */
-		DLIST_FOREACH(dlist_member, &pool->active_members, pmbr)
-			pool_select_add_socket(&sel, &pmbr->sock);
-
-		if (min_expire_left > 0)
-			min_expire_left *= 1000;
+	int timeout;
+	bool accept_ready, wakeup_ready;
+	/* first shard runs in main thread and handles timers and signals */
+	const bool main_shard = (shard == &pool->shards[0]);
+
+	s = shard->listen_fd;
+	wakeup = shard->wakeup_fd;
+
+	/* add the listening and wakeup sockets */
+	pool_loop_add_fd(shard, s, &listen_marker);
+	pool_loop_add_fd(shard, wakeup, &wakeup_marker);
+
+	while (!(main_shard ? got_sigterm : shard->stop)) {
+
+		/* close old members, compute timeout for next check */
+		timeout = -1;
+		if (main_shard) {
+			timeout = pool_expire_members(pool);
+			if (timeout > 0)
+				timeout *= 1000;
+		}
+		if (pool_has_ready(shard))
+			timeout = 0;
 
-		rc = poll(sel.fds, sel.num_fds, min_expire_left);
-		if (TDS_UNLIKELY(rc < 0)) {
+		accept_ready = false;
+		wakeup_ready = false;
+		if (TDS_UNLIKELY(pool_loop_wait(shard, timeout, &accept_ready, &wakeup_ready) < 0)) {
 			char *errstr;
 
 			if (sock_errno == TDSSOCK_EINTR)
@@ -379,38 +728,110 @@ pool_main_loop(TDS_POOL * pool)
 			sock_strerror_free(errstr);
 			exit(EXIT_FAILURE);
 		}
-		if (TDS_UNLIKELY(got_sigterm))
+		/* signals are handled by main thread only */
+		if (TDS_UNLIKELY(main_shard && got_sigterm))
 			break;
 
 #ifndef _WIN32
-		if (TDS_UNLIKELY(got_sighup)) {
-			got_sighup = false;
+		if (TDS_UNLIKELY(main_shard && got_sighup)) {
+			got_sighup = 0;
 			pool_open_logfile();
 		}
 #endif
 
 		/* process events */
-		if ((sel.fds[1].revents & POLLIN) != 0) {
+		if (wakeup_ready) {
 			char buf[32];
 			READSOCKET(wakeup, buf, sizeof(buf));
 
-			pool_process_events(pool);
+			pool_process_events(shard);
 		}
 
 		/* process the sockets */
-		if ((sel.fds[0].revents & POLLIN) != 0) {
-			pool_user_create(pool, s);
+		if (accept_ready) {
+			pool_user_create(shard, s);
 		}
-		pool_process_users(pool, sel.fds, sel.num_fds);
-		min_expire_left = pool_process_members(pool, sel.fds, sel.num_fds);
+		pool_process_ready(shard);
 
 		/* back from members */
-		if (dlist_user_first(&pool->waiters))
-			pool_schedule_waiters(pool);
-	}			/* while !got_sigterm */
+		if (dlist_user_first(&shard->waiters))
+			pool_schedule_waiters(shard);
+	}			/* while !stop */
 	tdsdump_log(TDS_DBG_INFO2, "Shutdown Requested\n");
 }
 
+static TDS_THREAD_PROC_DECLARE(pool_shard_proc, arg)
+{
+	pool_main_loop((TDS_POOL_SHARD *) arg);
+	return TDS_THREAD_RESULT(0);
+}
+
+/*
+ * Start a thread for each shard after the first one,
+ * first shard is handled by main thread.
+ */
+static void
+pool_start_shards(TDS_POOL * pool)
+{
+	unsigned i;
+#ifndef _WIN32
+	sigset_t set, old_set;
+
+	/* signals are handled by the main thread */
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &set, &old_set);
+#endif
+
+	for (i = 1; i < pool->num_shards; ++i) {
+		if (tds_thread_create(&pool->shards[i].thread, pool_shard_proc, &pool->shards[i]) != 0) {
+			fprintf(stderr, "error creating thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+#ifndef _WIN32
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+#endif
+}
+
+typedef struct {
+	TDS_POOL_EVENT common;
+	TDS_POOL_SHARD *shard;
+} STOP_EVENT;
+
+static void
+stop_execute(TDS_POOL_EVENT *base_event)
+{
+	STOP_EVENT *ev = (STOP_EVENT *) base_event;
+
+	ev->shard->stop = true;
+}
+
+/*
+ * Ask other shards to exit their loops and wait for them.
+ */
+static void
+pool_stop_shards(TDS_POOL * pool)
+{
+	unsigned i;
+	STOP_EVENT *ev;
+
+	for (i = 1; i < pool->num_shards; ++i) {
+		ev = tds_new0(STOP_EVENT, 1);
+		if (!ev) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		ev->shard = &pool->shards[i];
+		pool_event_add(ev->shard, &ev->common, stop_execute);
+	}
+	for (i = 1; i < pool->num_shards; ++i)
+		tds_thread_join(pool->shards[i].thread, NULL);
+}
+
 static void
 print_usage(const char *progname)
 {
@@ -473,7 +894,9 @@ main(int argc, char **argv)
 		}
 	}
 #endif
-	pool_main_loop(pool);
+	pool_start_shards(pool);
+	pool_main_loop(&pool->shards[0]);
+	pool_stop_shards(pool);
 	printf("User logins %lu members logins %lu members at end %d\n", pool->user_logins, pool->member_logins, pool->num_active_members);
 	pool_destroy(pool);
 	printf("tdspool Shutdown\n");
@@ -69,6 +69,94 @@ pool_mbr_free_socket(TDSSOCKET *tds)
 	}
 }
 
+static void
+pool_idle_heap_set(TDS_POOL *pool, uint32_t n, TDS_POOL_MEMBER *pmbr)
+{
+	pool->idle_heap[n] = pmbr;
+	pmbr->heap_index = n + 1;
+}
+
+static void
+pool_idle_heap_up(TDS_POOL *pool, uint32_t n)
+{
+	TDS_POOL_MEMBER *pmbr = pool->idle_heap[n];
+
+	while (n > 0) {
+		uint32_t parent = (n - 1) / 2;
+
+		if (pool->idle_heap[parent]->expire_tm <= pmbr->expire_tm)
+			break;
+		pool_idle_heap_set(pool, n, pool->idle_heap[parent]);
+		n = parent;
+	}
+	pool_idle_heap_set(pool, n, pmbr);
+}
+
+static void
+pool_idle_heap_down(TDS_POOL *pool, uint32_t n)
+{
+	TDS_POOL_MEMBER *pmbr = pool->idle_heap[n];
+
+	for (;;) {
+		uint32_t child = n * 2 + 1;
+
+		if (child >= pool->num_idle_heap)
+			break;
+		if (child + 1 < pool->num_idle_heap
+		    && pool->idle_heap[child + 1]->expire_tm < pool->idle_heap[child]->expire_tm)
+			++child;
+		if (pmbr->expire_tm <= pool->idle_heap[child]->expire_tm)
+			break;
+		pool_idle_heap_set(pool, n, pool->idle_heap[child]);
+		n = child;
+	}
+	pool_idle_heap_set(pool, n, pmbr);
+}
+
+/*
+ * Insert a member in the heap of idle members so it can be closed
+ * when its age expires.
+ */
+static void
+pool_idle_heap_add(TDS_POOL *pool, TDS_POOL_MEMBER *pmbr)
+{
+	assert(!pmbr->heap_index);
+
+	if (pool->num_idle_heap >= pool->alloc_idle_heap) {
+		uint32_t alloc = pool->alloc_idle_heap ? pool->alloc_idle_heap * 2 : 16;
+
+		if (!TDS_RESIZE(pool->idle_heap, alloc)) {
+			fprintf(stderr, "Out of memory allocating idle members\n");
+			exit(EXIT_FAILURE);
+		}
+		pool->alloc_idle_heap = alloc;
+	}
+	pmbr->expire_tm = pmbr->last_used_tm + pool->max_member_age;
+	pool_idle_heap_set(pool, pool->num_idle_heap++, pmbr);
+	pool_idle_heap_up(pool, pool->num_idle_heap - 1);
+}
+
+static void
+pool_idle_heap_remove(TDS_POOL *pool, TDS_POOL_MEMBER *pmbr)
+{
+	uint32_t n = pmbr->heap_index;
+	TDS_POOL_MEMBER *last;
+
+	if (!n)
+		return;
+	--n;
+	assert(pool->idle_heap[n] == pmbr);
+	pmbr->heap_index = 0;
+
+	if (n == --pool->num_idle_heap)
+		return;
+	last = pool->idle_heap[pool->num_idle_heap];
+	pool_idle_heap_set(pool, n, last);
+	pool_idle_heap_up(pool, n);
+	if (last->heap_index == n + 1)
+		pool_idle_heap_down(pool, n);
+}
+
 /*
  * pool_mbr_login open a single pool login, to be call at init time or
  * to reconnect.
@@ -146,31 +234,67 @@ pool_mbr_login(const TDS_POOL * pool, int tds_version)
 void
 pool_assign_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr, TDS_POOL_USER *puser)
 {
+	TDS_POOL_SHARD *shard = puser->shard;
+
 	pool_mbr_check(pool);
 	assert(pmbr->current_user == NULL);
-	if (pmbr->current_user) {
-		pmbr->current_user->assigned_member = NULL;
-	} else {
-		dlist_member_remove(&pool->idle_members, pmbr);
-		dlist_member_append(&pool->active_members, pmbr);
-	}
+	assert(!dlist_member_in_list(&shard->active_members, pmbr));
+
+	/* member moves to the shard handling the user */
+	dlist_member_append(&shard->active_members, pmbr);
 	pmbr->current_user = puser;
 	puser->assigned_member = pmbr;
+	if (pmbr->sock.tds)
+		pool_socket_add(shard, &pmbr->sock);
 	pool_mbr_check(pool);
 }
 
+/*
+ * Detach member from the user, member is not in any list after this call,
+ * use pool_release_member to make it available again.
+ */
 void
-pool_deassign_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr)
+pool_deassign_member(TDS_POOL *pool TDS_UNUSED, TDS_POOL_MEMBER * pmbr)
 {
-	if (pmbr->current_user) {
-		pmbr->current_user->assigned_member = NULL;
+	TDS_POOL_USER *puser = pmbr->current_user;
+
+	if (puser) {
+		dlist_member_remove(&puser->shard->active_members, pmbr);
+		puser->assigned_member = NULL;
 		pmbr->current_user = NULL;
-		dlist_member_remove(&pool->active_members, pmbr);
-		dlist_member_append(&pool->idle_members, pmbr);
 	}
+	pool_socket_remove(&pmbr->sock);
 	pmbr->sock.poll_send = false;
 }
 
+/*
+ * Put a member detached by pool_deassign_member in the idle list,
+ * any shard can now assign it.
+ */
+void
+pool_release_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr)
+{
+	assert(!pmbr->current_user);
+
+	tds_mutex_lock(&pool->mtx);
+	dlist_member_append(&pool->idle_members, pmbr);
+	if (!pmbr->doing_async)
+		pool_idle_heap_add(pool, pmbr);
+	pool_wakeup_waiters(pool);
+	tds_mutex_unlock(&pool->mtx);
+}
+
+bool
+pool_has_idle_member(TDS_POOL *pool)
+{
+	bool ret;
+
+	tds_mutex_lock(&pool->mtx);
+	ret = dlist_member_first(&pool->idle_members) != NULL;
+	tds_mutex_unlock(&pool->mtx);
+	return ret;
+}
+
 /*
  * if a dead connection on the client side left this member in a questionable
  * state, let's bring in a correct one
@@ -191,19 +315,46 @@ pool_reset_member(TDS_POOL * pool, TDS_POOL_MEMBER * pmbr)
 		pool_free_user(pool, puser);
 	}
 
-	/* cancel whatever pending */
-	tds_init_write_buf(tds);
-	if (tds_set_state(tds, TDS_WRITING) != TDS_WRITING)
-		goto failure;
-	tds->out_flag = TDS_CANCEL;
-	if (TDS_FAILED(tds_flush_packet(tds)))
-		goto failure;
-	tds_set_state(tds, TDS_PENDING);
-	tds->in_cancel = 2;
+	/* still connecting, will be checked when connected */
+	if (pmbr->doing_async) {
+		pool_release_member(pool, pmbr);
+		return;
+	}
 
-	if (TDS_FAILED(tds_process_cancel(tds)))
+	/* part of a packet is still in the socket, we can't recover */
+	if (pool_splice_pending(&pmbr->sock))
 		goto failure;
 
+	/*
+	 * server replied to everything and no transaction is open,
+	 * let next request reset the session (RESETCONNECTION flag)
+	 */
+	if (IS_TDS72_PLUS(tds->conn) && pool_stream_idle(&pmbr->stream) && !pmbr->stream.transaction
+	    && tds->in_pos >= tds->in_len) {
+		tdsdump_log(TDS_DBG_INFO1, "member idle, deferring session reset\n");
+		pmbr->reset_pending = true;
+		pool_stream_init(&pmbr->stream, tds->conn->tds_version);
+		pool_release_member(pool, pmbr);
+		return;
+	}
+
+	/* cancel whatever pending, not needed if server replied to everything */
+	if (!pool_stream_idle(&pmbr->stream) || tds->in_pos < tds->in_len) {
+		tds_init_write_buf(tds);
+		if (tds_set_state(tds, TDS_WRITING) != TDS_WRITING)
+			goto failure;
+		tds->out_flag = TDS_CANCEL;
+		if (TDS_FAILED(tds_flush_packet(tds)))
+			goto failure;
+		tds_set_state(tds, TDS_PENDING);
+		tds->in_cancel = 2;
+
+		if (TDS_FAILED(tds_process_cancel(tds)))
+			goto failure;
+	} else {
+		tdsdump_log(TDS_DBG_INFO1, "member replied to all requests, no cancel needed\n");
+	}
+
 	if (IS_TDS71_PLUS(tds->conn)) {
 		/* this 0x9 final reset the state from mssql 2000 */
 		if (tds_set_state(tds, TDS_WRITING) != TDS_WRITING)
@@ -216,6 +367,9 @@ pool_reset_member(TDS_POOL * pool, TDS_POOL_MEMBER * pmbr)
 		if (TDS_FAILED(tds_process_simple_query(tds)))
 			goto failure;
 	}
+	pmbr->reset_pending = false;
+	pool_stream_init(&pmbr->stream, tds->conn->tds_version);
+	pool_release_member(pool, pmbr);
 	return;
 
 failure:
@@ -228,6 +382,10 @@ pool_free_member(TDS_POOL * pool, TDS_POOL_MEMBER * pmbr)
 	TDSSOCKET *tds;
 	TDS_POOL_USER *puser;
 
+	pool_socket_remove(&pmbr->sock);
+	pool_splice_free(&pmbr->sock);
+	pool_stream_free(&pmbr->stream);
+
 	tds = pmbr->sock.tds;
 	if (tds) {
 		if (!IS_TDSDEAD(tds))
@@ -246,10 +404,12 @@ pool_free_member(TDS_POOL * pool, TDS_POOL_MEMBER * pmbr)
 		pool_free_user(pool, puser);
 	}
 
-	if (dlist_member_in_list(&pool->active_members, pmbr)) {
-		pool->num_active_members--;
-		dlist_member_remove(&pool->active_members, pmbr);
-	}
+	tds_mutex_lock(&pool->mtx);
+	pool_idle_heap_remove(pool, pmbr);
+	if (dlist_member_in_list(&pool->idle_members, pmbr))
+		dlist_member_remove(&pool->idle_members, pmbr);
+	pool->num_active_members--;
+	tds_mutex_unlock(&pool->mtx);
 	free(pmbr);
 	pool_mbr_check(pool);
 }
@@ -262,7 +422,6 @@ pool_mbr_init(TDS_POOL * pool)
 	/* allocate room for pool members */
 
 	pool->num_active_members = 0;
-	dlist_member_init(&pool->active_members);
 	dlist_member_init(&pool->idle_members);
 	pool_mbr_check(pool);
 
@@ -274,6 +433,7 @@ pool_mbr_init(TDS_POOL * pool)
 			exit(1);
 		}
 		pmbr->sock.poll_recv = true;
+		pmbr->sock.member = true;
 
 		pmbr->sock.tds = pool_mbr_login(pool, 0);
 		if (!pmbr->sock.tds) {
@@ -287,6 +447,8 @@ pool_mbr_init(TDS_POOL * pool)
 			fprintf(stderr, "Current pool implementation does not support protocol versions former than 7.1\n");
 			exit(1);
 		}
+		pool_stream_init(&pmbr->stream, pmbr->sock.tds->conn->tds_version);
+		pool_idle_heap_add(pool, pmbr);
 		pool->member_logins++;
 	}
 	pool_mbr_check(pool);
@@ -295,8 +457,14 @@ pool_mbr_init(TDS_POOL * pool)
 void
 pool_mbr_destroy(TDS_POOL * pool)
 {
-	while (dlist_member_first(&pool->active_members))
-		pool_free_member(pool, dlist_member_first(&pool->active_members));
+	unsigned i;
+
+	for (i = 0; i < pool->num_shards; ++i) {
+		dlist_members *active = &pool->shards[i].active_members;
+
+		while (dlist_member_first(active))
+			pool_free_member(pool, dlist_member_first(active));
+	}
 	while (dlist_member_first(&pool->idle_members))
 		pool_free_member(pool, dlist_member_first(&pool->idle_members));
 
@@ -311,8 +479,10 @@ pool_process_data(TDS_POOL *pool, TDS_POOL_MEMBER *pmbr)
 	TDS_POOL_USER *puser = NULL;
 
 	for (;;) {
-		if (pool_packet_read(tds))
+		if (pool_packet_read(&pmbr->sock)) {
+			pmbr->sock.readable = false;
 			break;
+		}
 
 		/* disconnected */
 		if (tds->in_len == 0) {
@@ -333,7 +503,7 @@ pool_process_data(TDS_POOL *pool, TDS_POOL_MEMBER *pmbr)
 			pool_free_user(pool, puser);
 			return false;
 		}
-		if (tds->in_pos < tds->in_len)
+		if (pool_packet_pending(&pmbr->sock))
 			/* partial write, schedule a future write */
 			break;
 	}
@@ -342,74 +512,82 @@ pool_process_data(TDS_POOL *pool, TDS_POOL_MEMBER *pmbr)
 	return true;
 }
 
-/* 
- * pool_process_members
- * check the fd_set for members returning data to the client, lookup the 
- * client holding this member and forward the results.
- * @return Timeout you should call this function again or -1 for infinite
+/*
+ * pool_process_member
+ * forward data between a member and the client holding it, based on
+ * readiness reported by the event loop.
  */
-int
-pool_process_members(TDS_POOL * pool, struct pollfd *fds, unsigned num_fds)
+void
+pool_process_member(TDS_POOL * pool, TDS_POOL_MEMBER * pmbr)
 {
-	TDS_POOL_MEMBER *pmbr, *next;
-	time_t age;
-	time_t time_now;
-	int min_expire_left = -1;
-	short revents;
-
-	pool_mbr_check(pool);
-	for (next = dlist_member_first(&pool->active_members); (pmbr = next) != NULL; ) {
-		bool processed = false;
+	bool processed = false;
 
-		next = dlist_member_next(&pool->active_members, pmbr);
+	/* only active members are handled */
+	if (!pmbr->current_user || pmbr->doing_async)
+		return;
 
-		assert(pmbr->current_user);
-		if (pmbr->doing_async || pmbr->sock.poll_index > num_fds)
-			continue;
+	assert(pmbr->sock.tds);
 
-		revents = fds[pmbr->sock.poll_index].revents;
-		assert(pmbr->sock.tds);
-
-		time_now = time(NULL);
-		if (pmbr->sock.poll_recv && (revents & (POLLIN|POLLHUP)) != 0) {
-			if (!pool_process_data(pool, pmbr))
-				continue;
-			processed = true;
-		}
-		if (pmbr->sock.poll_send && (revents & POLLOUT) != 0) {
-			if (!pool_write_data(&pmbr->current_user->sock, &pmbr->sock)) {
-				pool_free_member(pool, pmbr);
-				continue;
-			}
-			processed = true;
+	if (pmbr->sock.poll_recv && pmbr->sock.readable) {
+		if (!pool_process_data(pool, pmbr))
+			return;
+		processed = true;
+	}
+	if (pmbr->sock.poll_send && pmbr->sock.writable) {
+		if (!pool_write_data(&pmbr->current_user->sock, &pmbr->sock)) {
+			pool_free_member(pool, pmbr);
+			return;
 		}
-		if (processed)
-			pmbr->last_used_tm = time_now;
+		processed = true;
 	}
+	if (processed)
+		pmbr->last_used_tm = time(NULL);
+}
 
-	if (pool->num_active_members <= pool->min_open_conn)
-		return min_expire_left;
-
-	/* close old connections */
-	time_now = time(NULL);
-	for (next = dlist_member_first(&pool->idle_members); (pmbr = next) != NULL; ) {
+/*
+ * pool_expire_members
+ * close idle members older than max_member_age.
+ * @return Timeout you should call this function again or -1 for infinite
+ */
+int
+pool_expire_members(TDS_POOL * pool)
+{
+	TDS_POOL_MEMBER *pmbr;
+	time_t time_now = time(NULL);
 
-		next = dlist_member_next(&pool->idle_members, pmbr);
+	tds_mutex_lock(&pool->mtx);
+	while (pool->num_idle_heap && pool->num_active_members > pool->min_open_conn) {
+		time_t expire_tm;
 
+		pmbr = pool->idle_heap[0];
 		assert(pmbr->sock.tds);
 		assert(!pmbr->current_user);
 
-		age = time_now - pmbr->last_used_tm;
-		if (age >= pool->max_member_age) {
-			tdsdump_log(TDS_DBG_INFO1, "member is %ld seconds old...closing\n", (long int) age);
-			pool_free_member(pool, pmbr);
-		} else {
-			int left = (int) (pool->max_member_age - age);
-			if (min_expire_left < 0 || left < min_expire_left)
-				min_expire_left = left;
+		/* used after insertion, update position */
+		expire_tm = pmbr->last_used_tm + pool->max_member_age;
+		if (expire_tm > pmbr->expire_tm) {
+			pmbr->expire_tm = expire_tm;
+			pool_idle_heap_down(pool, 0);
+			continue;
+		}
+
+		if (expire_tm > time_now) {
+			tds_mutex_unlock(&pool->mtx);
+			return (int) (expire_tm - time_now);
 		}
+
+		/* detach from idle list so nobody else can take it */
+		pool_idle_heap_remove(pool, pmbr);
+		dlist_member_remove(&pool->idle_members, pmbr);
+		tds_mutex_unlock(&pool->mtx);
+
+		tdsdump_log(TDS_DBG_INFO1, "member is %ld seconds old...closing\n", (long int) (time_now - pmbr->last_used_tm));
+		pool_free_member(pool, pmbr);
+
+		tds_mutex_lock(&pool->mtx);
 	}
-	return min_expire_left;
+	tds_mutex_unlock(&pool->mtx);
+	return -1;
 }
 
 static bool
@@ -423,6 +601,7 @@ compatible_versions(const TDSSOCKET *tds, const TDS_POOL_USER *user)
 typedef struct {
 	TDS_POOL_EVENT common;
 	TDS_POOL *pool;
+	TDS_POOL_SHARD *shard;
 	TDS_POOL_MEMBER *pmbr;
 	int tds_version;
 } CONNECT_EVENT;
@@ -446,18 +625,19 @@ static TDS_THREAD_PROC_DECLARE(connect_proc, arg)
 			tdsdump_log(TDS_DBG_ERROR, "Protocol server version not supported\n");
 			break;
 		}
+		pool_stream_init(&pmbr->stream, pmbr->sock.tds->conn->tds_version);
 
 		/* if already attached to a user we can send login directly */
 		if (pmbr->current_user)
 			if (!pool_user_send_login_ack(pool, pmbr->current_user))
 				break;
 
-		pool_event_add(pool, &ev->common, connect_execute_ok);
+		pool_event_add(ev->shard, &ev->common, connect_execute_ok);
 		return TDS_THREAD_RESULT(0);
 	}
 
 	/* failure */
-	pool_event_add(pool, &ev->common, connect_execute_ko);
+	pool_event_add(ev->shard, &ev->common, connect_execute_ko);
 	return TDS_THREAD_RESULT(0);
 }
 
@@ -473,15 +653,24 @@ static void
 connect_execute_ok(TDS_POOL_EVENT *base_event)
 {
 	CONNECT_EVENT *ev = (CONNECT_EVENT *) base_event;
+	TDS_POOL *pool = ev->pool;
 	TDS_POOL_MEMBER *pmbr = ev->pmbr;
 	TDS_POOL_USER *puser = pmbr->current_user;
 
-	ev->pool->member_logins++;
-	pmbr->doing_async = false;
-
 	pmbr->last_used_tm = time(NULL);
 
+	tds_mutex_lock(&pool->mtx);
+	pool->member_logins++;
+	pmbr->doing_async = false;
+	if (!puser) {
+		/* user left while connecting, member was released */
+		pool_idle_heap_add(pool, pmbr);
+		pool_wakeup_waiters(pool);
+	}
+	tds_mutex_unlock(&pool->mtx);
+
 	if (puser) {
+		pool_socket_add(puser->shard, &pmbr->sock);
 		pmbr->sock.poll_recv = true;
 		puser->sock.poll_recv = true;
 
@@ -492,6 +681,7 @@ connect_execute_ok(TDS_POOL_EVENT *base_event)
 /*
  * pool_assign_idle_member
  * assign a member to the user specified
+ * Idle members are shared so the member can come from any shard.
  */
 TDS_POOL_MEMBER *
 pool_assign_idle_member(TDS_POOL * pool, TDS_POOL_USER *puser)
@@ -503,15 +693,23 @@ pool_assign_idle_member(TDS_POOL * pool, TDS_POOL_USER *puser)
 	puser->sock.poll_send = false;
 
 	pool_mbr_check(pool);
+	tds_mutex_lock(&pool->mtx);
 	DLIST_FOREACH(dlist_member, &pool->idle_members, pmbr) {
 		assert(pmbr->current_user == NULL);
-		assert(!pmbr->doing_async);
+
+		/* released while still connecting */
+		if (pmbr->doing_async)
+			continue;
 
 		assert(pmbr->sock.tds);
 
 		if (!compatible_versions(pmbr->sock.tds, puser))
 			continue;
 
+		pool_idle_heap_remove(pool, pmbr);
+		dlist_member_remove(&pool->idle_members, pmbr);
+		tds_mutex_unlock(&pool->mtx);
+
 		pool_assign_member(pool, pmbr, puser);
 
 		/*
@@ -529,64 +727,69 @@ pool_assign_idle_member(TDS_POOL * pool, TDS_POOL_USER *puser)
 
 	/* if we can open a new connection open it */
 	if (pool->num_active_members >= pool->max_open_conn) {
+		tds_mutex_unlock(&pool->mtx);
 		fprintf(stderr, "No idle members left, increase \"max pool conn\"\n");
 		return NULL;
 	}
+	/* reserve the connection */
+	pool->num_active_members++;
+	tds_mutex_unlock(&pool->mtx);
 
 	pmbr = tds_new0(TDS_POOL_MEMBER, 1);
-	if (!pmbr) {
+	ev = tds_new0(CONNECT_EVENT, 1);
+	if (!pmbr || !ev) {
+		free(pmbr);
+		free(ev);
 		fprintf(stderr, "Out of memory\n");
-		return NULL;
+		goto failure;
 	}
+	pmbr->sock.member = true;
 
 	tdsdump_log(TDS_DBG_INFO1, "No open connections left, opening new member\n");
 
-	ev = tds_new0(CONNECT_EVENT, 1);
-	if (!ev) {
-		free(pmbr);
-		fprintf(stderr, "Out of memory\n");
-		return NULL;
-	}
 	ev->pmbr = pmbr;
 	ev->pool = pool;
+	ev->shard = puser->shard;
 	ev->tds_version = puser->login->tds_version;
 
+	pmbr->doing_async = true;
+	pool_assign_member(pool, pmbr, puser);
+	puser->sock.poll_send = false;
+	puser->sock.poll_recv = false;
+
 	if (tds_thread_create_detached(connect_proc, ev) != 0) {
+		pool_deassign_member(pool, pmbr);
 		free(pmbr);
 		free(ev);
 		fprintf(stderr, "error creating thread\n");
-		return NULL;
+		goto failure;
 	}
-	pmbr->doing_async = true;
 
 	pool_mbr_check(pool);
-	pool->num_active_members++;
-	dlist_member_append(&pool->idle_members, pmbr);
-	pool_mbr_check(pool);
-
-	pool_assign_member(pool, pmbr, puser);
-	puser->sock.poll_send = false;
-	puser->sock.poll_recv = false;
-
 	return pmbr;
+
+failure:
+	tds_mutex_lock(&pool->mtx);
+	pool->num_active_members--;
+	tds_mutex_unlock(&pool->mtx);
+	return NULL;
 }
 
 #if ENABLE_EXTRA_CHECKS
 void pool_mbr_check(TDS_POOL *pool)
 {
 	TDS_POOL_MEMBER *pmbr;
-	unsigned total = 0;
+	int total = 0;
 
-	DLIST_FOREACH(dlist_member, &pool->active_members, pmbr) {
-		assert(pmbr->doing_async || pmbr->sock.tds);
-		assert(pmbr->current_user);
-		++total;
-	}
+	/* active members are owned by shards, check only shared ones */
+	tds_mutex_lock(&pool->mtx);
 	DLIST_FOREACH(dlist_member, &pool->idle_members, pmbr) {
 		assert(pmbr->doing_async || pmbr->sock.tds);
 		assert(!pmbr->current_user);
+		assert(pmbr->doing_async || pmbr->heap_index);
 		++total;
 	}
-	assert(pool->num_active_members == total);
+	assert(total <= pool->num_active_members);
+	tds_mutex_unlock(&pool->mtx);
 }
 #endif
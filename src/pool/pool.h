@@ -38,6 +38,7 @@
 #endif
 
 #include <freetds/tds.h>
+#include <freetds/thread.h>
 #include <freetds/utils/dlist.h>
 #include <freetds/replacements.h>
 
@@ -56,8 +57,11 @@ typedef enum
 /* forward declaration */
 typedef struct tds_pool_event TDS_POOL_EVENT;
 typedef struct tds_pool_socket TDS_POOL_SOCKET;
+typedef struct tds_pool_stream TDS_POOL_STREAM;
+typedef struct tds_pool_stream_col TDS_POOL_STREAM_COL;
 typedef struct tds_pool_member TDS_POOL_MEMBER;
 typedef struct tds_pool_user TDS_POOL_USER;
+typedef struct tds_pool_shard TDS_POOL_SHARD;
 typedef struct tds_pool TDS_POOL;
 typedef void (*TDS_POOL_EXECUTE)(TDS_POOL_EVENT *event);
 
@@ -70,18 +74,86 @@ struct tds_pool_event
 struct tds_pool_socket
 {
 	TDSSOCKET *tds;
-	uint32_t poll_index;
+	/** shard whose event loop handles this socket, NULL if not registered */
+	TDS_POOL_SHARD *shard;
+	/** position in shard ready list plus one, 0 if not in the list */
+	uint32_t ready_index;
 	bool poll_recv;
 	bool poll_send;
+	/** readiness reported by the event loop and not consumed yet */
+	bool readable;
+	bool writable;
+	/** socket is embedded in a TDS_POOL_MEMBER, otherwise in a TDS_POOL_USER */
+	bool member;
+#if HAVE_SPLICE
+	/** pipe_fds contains a valid pipe */
+	bool has_pipe;
+	/** pipe used to move packet payload to the other socket */
+	int pipe_fds[2];
+	/** payload bytes of current packet still to read from socket */
+	uint32_t splice_left;
+	/** bytes in pipe still to write to the other socket */
+	uint32_t pipe_len;
+#endif
 };
 
 struct tds_pool_user
 {
 	TDS_POOL_SOCKET sock;
 	DLIST_FIELDS(dlist_user_item);
+	/** shard owning the user */
+	TDS_POOL_SHARD *shard;
 	TDSLOGIN *login;
 	TDS_USER_STATE user_state;
 	TDS_POOL_MEMBER *assigned_member;
+	/** last packet forwarded was not the end of a message */
+	bool in_message;
+};
+
+/** wire layout of a column value, as needed to skip it */
+struct tds_pool_stream_col
+{
+	unsigned char kind;
+	uint32_t size;
+};
+
+/**
+ * Incremental scanner of server replies (TDS 7.0-7.4).
+ * Keeps just enough state to resume at any byte so packets can be
+ * scanned while they are forwarded, without buffering them.
+ */
+struct tds_pool_stream
+{
+	TDS_USMALLINT tds_version;
+	unsigned char state;
+	/** current token */
+	unsigned char token;
+	/** a request was sent, final DONE not received yet */
+	bool pending;
+	/** an attention was sent, acknowledge not received yet */
+	bool attention;
+	/** a transaction is open (reported by TDS 7.2+ servers) */
+	bool transaction;
+
+	/** bytes to skip before reading anything else */
+	uint64_t skip;
+	/** bytes to collect in dest before proceeding */
+	uint16_t need, have;
+	unsigned char *dest;
+	unsigned char acc[16];
+
+	/** names still to skip (B_VARCHAR and US_VARCHAR) */
+	unsigned char b_names, us_names;
+	unsigned char after_names, after_type;
+
+	/** current result metadata */
+	TDS_POOL_STREAM_COL *cols;
+	unsigned char *nbc;
+	uint16_t num_cols, alloc_cols;
+	uint16_t col;
+	TDS_POOL_STREAM_COL *cur;
+	/** output parameter metadata */
+	TDS_POOL_STREAM_COL param;
 };
 
 struct tds_pool_member
@@ -91,6 +163,14 @@ struct tds_pool_member
 	bool doing_async;
 	time_t last_used_tm;
 	TDS_POOL_USER *current_user;
+	/** position in idle heap plus one, 0 if not in the heap */
+	uint32_t heap_index;
+	/** expiration time when inserted into idle heap */
+	time_t expire_tm;
+	/** scanner of replies forwarded to current user */
+	TDS_POOL_STREAM stream;
+	/** session must be reset with next request */
+	bool reset_pending;
 };
 
 #define DLIST_PREFIX dlist_member
@@ -103,6 +183,44 @@ struct tds_pool_member
 #define DLIST_ITEM_TYPE TDS_POOL_USER
 #include <freetds/utils/dlist.tmpl.h>
 
+/**
+ * Event loop handling a subset of users and members.
+ * Each shard runs in its own thread; users stay in the shard that
+ * accepted them while members move to the shard of the user they are
+ * assigned to.
+ */
+struct tds_pool_shard
+{
+	TDS_POOL *pool;
+	tds_thread thread;
+	TDS_SYS_SOCKET listen_fd;
+	tds_mutex events_mtx;
+	TDS_SYS_SOCKET wakeup_fd;
+	TDS_SYS_SOCKET event_fd;
+	TDS_POOL_EVENT *events;
+#if HAVE_SYS_EPOLL_H
+	int epoll_fd;
+#else
+	struct pollfd *fds;
+	TDS_POOL_SOCKET **fd_socks;
+	uint32_t num_fds, alloc_fds;
+#endif
+
+	/** sockets with pending readiness to process */
+	TDS_POOL_SOCKET **ready;
+	uint32_t num_ready, alloc_ready;
+
+	dlist_members active_members;
+
+	/** users in wait state */
+	dlist_users waiters;
+	/** number of waiters, protected by pool mtx */
+	int num_waiters;
+	dlist_users users;
+	/** loop must exit, set by a stop event in the shard thread */
+	bool stop;
+};
+
 struct tds_pool
 {
 	char *name;
@@ -116,38 +234,65 @@ struct tds_pool
 	int max_member_age;	/* in seconds */
 	int min_open_conn;
 	int max_open_conn;
-	tds_mutex events_mtx;
-	TDS_SYS_SOCKET listen_fd;
-	TDS_SYS_SOCKET wakeup_fd;
-	TDS_SYS_SOCKET event_fd;
-	TDS_POOL_EVENT *events;
+	int num_threads;
+
+	unsigned num_shards;
+	TDS_POOL_SHARD *shards;
+
+	/**
+	 * protects idle members, idle heap and counters,
+	 * shared between shards
+	 */
+	tds_mutex mtx;
+
+	/** idle members ordered by expiration time (binary heap) */
+	TDS_POOL_MEMBER **idle_heap;
+	uint32_t num_idle_heap, alloc_idle_heap;
 
 	int num_active_members;
-	dlist_members active_members;
 	dlist_members idle_members;
 
-	/** users in wait state */
-	dlist_users waiters;
 	int num_users;
-	dlist_users users;
 	TDSCONTEXT *ctx;
 
 	unsigned long user_logins;
 	unsigned long member_logins;
 };
 
+static inline TDS_POOL_MEMBER *
+pool_socket_member(TDS_POOL_SOCKET *sock)
+{
+	assert(sock->member);
+	return (TDS_POOL_MEMBER *) ((char *) sock - TDS_OFFSET(TDS_POOL_MEMBER, sock));
+}
+
+static inline TDS_POOL_USER *
+pool_socket_user(TDS_POOL_SOCKET *sock)
+{
+	assert(!sock->member);
+	return (TDS_POOL_USER *) ((char *) sock - TDS_OFFSET(TDS_POOL_USER, sock));
+}
+
 /* prototypes */
 
+/* main.c */
+void pool_socket_add(TDS_POOL_SHARD * shard, TDS_POOL_SOCKET * sock);
+void pool_socket_remove(TDS_POOL_SOCKET * sock);
+void pool_wakeup_waiters(TDS_POOL * pool);
+
 /* member.c */
-int pool_process_members(TDS_POOL * pool, struct pollfd *fds, unsigned num_fds);
+void pool_process_member(TDS_POOL * pool, TDS_POOL_MEMBER * pmbr);
+int pool_expire_members(TDS_POOL * pool);
 TDS_POOL_MEMBER *pool_assign_idle_member(TDS_POOL * pool, TDS_POOL_USER *user);
 void pool_mbr_init(TDS_POOL * pool);
 void pool_mbr_destroy(TDS_POOL * pool);
 void pool_free_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr);
 void pool_assign_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr, TDS_POOL_USER *puser);
 void pool_deassign_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr);
+void pool_release_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr);
+bool pool_has_idle_member(TDS_POOL *pool);
 void pool_reset_member(TDS_POOL *pool, TDS_POOL_MEMBER * pmbr);
-bool pool_packet_read(TDSSOCKET * tds);
+bool pool_packet_read(TDS_POOL_SOCKET * sock);
 #if ENABLE_EXTRA_CHECKS
 void pool_mbr_check(TDS_POOL *pool);
 #else
@@ -158,10 +303,10 @@ static inline void pool_mbr_check(TDS_POOL *pool TDS_UNUSED)
 
 
 /* user.c */
-void pool_process_users(TDS_POOL * pool, struct pollfd *fds, unsigned num_fds);
+void pool_process_user(TDS_POOL * pool, TDS_POOL_USER * puser);
 void pool_user_init(TDS_POOL * pool);
 void pool_user_destroy(TDS_POOL * pool);
-TDS_POOL_USER *pool_user_create(TDS_POOL * pool, TDS_SYS_SOCKET s);
+TDS_POOL_USER *pool_user_create(TDS_POOL_SHARD * shard, TDS_SYS_SOCKET s);
 void pool_free_user(TDS_POOL * pool, TDS_POOL_USER * puser);
 void pool_user_query(TDS_POOL * pool, TDS_POOL_USER * puser);
 bool pool_user_send_login_ack(TDS_POOL * pool, TDS_POOL_USER * puser);
@@ -169,9 +314,43 @@ void pool_user_finish_login(TDS_POOL * pool, TDS_POOL_USER * puser);
 
 /* util.c */
 void dump_login(TDSLOGIN * login);
-void pool_event_add(TDS_POOL *pool, TDS_POOL_EVENT *ev, TDS_POOL_EXECUTE execute);
+void pool_event_add(TDS_POOL_SHARD *shard, TDS_POOL_EVENT *ev, TDS_POOL_EXECUTE execute);
 int pool_write(TDS_SYS_SOCKET sock, const void *buf, size_t len);
 bool pool_write_data(TDS_POOL_SOCKET *from, TDS_POOL_SOCKET *to);
+#if HAVE_SPLICE
+void pool_splice_free(TDS_POOL_SOCKET *sock);
+
+static inline bool
+pool_splice_pending(const TDS_POOL_SOCKET *sock)
+{
+	return sock->splice_left || sock->pipe_len;
+}
+#else
+static inline void pool_splice_free(TDS_POOL_SOCKET *sock TDS_UNUSED)
+{
+}
+
+static inline bool
+pool_splice_pending(const TDS_POOL_SOCKET *sock TDS_UNUSED)
+{
+	return false;
+}
+#endif
+
+/** check packet read from socket was not fully forwarded */
+static inline bool
+pool_packet_pending(const TDS_POOL_SOCKET *sock)
+{
+	return sock->tds->in_pos < sock->tds->in_len || pool_splice_pending(sock);
+}
+
+/* stream.c */
+void pool_stream_init(TDS_POOL_STREAM *st, TDS_USMALLINT tds_version);
+void pool_stream_free(TDS_POOL_STREAM *st);
+void pool_stream_request(TDS_POOL_STREAM *st, TDS_UCHAR packet_type);
+void pool_stream_packet(TDS_POOL_STREAM *st, const unsigned char *pkt, unsigned len);
+bool pool_stream_skip(TDS_POOL_STREAM *st, const unsigned char *header, unsigned len);
+bool pool_stream_idle(const TDS_POOL_STREAM *st);
 
 /* config.c */
 bool pool_read_conf_files(const tds_dir_char *path, const char *poolname, TDS_POOL * pool, char **err);
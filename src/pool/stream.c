@@ -20,6 +20,14 @@
 /*
  * Name: stream.c
  * Description: Controls the result stream processing.
+ *
+ * Replies from the server are scanned token by token while they are
+ * forwarded to the client in order to detect the end of each response.
+ * The scanner is a state machine which can stop at any byte and resume
+ * with the next packet; only fixed size fields are collected, everything
+ * else (names, values, blobs) is skipped counting bytes.
+ * If something unknown is found the scanner gives up and the member is
+ * considered busy till it is reset.
  */
 
 #include <config.h>
@@ -33,454 +41,686 @@
 
 #if HAVE_STRING_H
 #include <string.h>
-#endif /* HAVE_STDLIB_H */
+#endif /* HAVE_STRING_H */
 
 #include "pool.h"
 #include <freetds/tds.h>
+#include <freetds/bytes.h>
+
+/* how to skip a value */
+enum {
+	POOL_COL_FIXED,		/* fixed size */
+	POOL_COL_BYTELEN,	/* 1 byte length */
+	POOL_COL_SHORTLEN,	/* 2 bytes length, 0xffff for NULL */
+	POOL_COL_LONGLEN,	/* 4 bytes length */
+	POOL_COL_TEXT,		/* text pointer, timestamp and 4 bytes length */
+	POOL_COL_PLP,		/* partially length-prefixed (varchar(max) and similar) */
+};
 
-int pool_find_end_token(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int len);
+/* scanner states, each state is entered after collecting the bytes it needs */
+enum {
+	ST_TOKEN,		/* token type */
+	ST_DONE,		/* DONE, DONEPROC or DONEINPROC body */
+	ST_SKIP_LEN2,		/* token with 2 bytes length */
+	ST_SKIP_LEN4,		/* token with 4 bytes length */
+	ST_ENVCHANGE,		/* ENVCHANGE length and type */
+	ST_FEATURE,		/* FEATUREEXTACK feature id */
+	ST_FEATURE_LEN,		/* FEATUREEXTACK feature data length */
+	ST_COLMETADATA,		/* number of columns */
+	ST_COL,			/* user type, flags and type of a column */
+	ST_COL_TABLE,		/* table name of blob columns */
+	ST_TABLE_PARTS,		/* number of parts of table name */
+	ST_COL_NAME,		/* column name */
+	ST_COL_NEXT,		/* column metadata completed */
+	ST_TYPE_DONE,		/* type information completed */
+	ST_TYPE_LEN2,		/* 2 bytes maximum length (and collation) */
+	ST_TYPE_XML,		/* XML schema present */
+	ST_TYPE_UDT,		/* UDT maximum length */
+	ST_NAME_LEN,		/* length of a B_VARCHAR or US_VARCHAR */
+	ST_ROW_START,		/* row start, NULL bitmap read for NBCROW */
+	ST_ROW_VALUE,		/* next value of a row */
+	ST_VALUE_FIXED,
+	ST_VALUE_LEN1,
+	ST_VALUE_LEN2,
+	ST_VALUE_LEN4,
+	ST_TEXTPTR_LEN,
+	ST_PLP_LEN,
+	ST_PLP_CHUNK,
+	ST_RETVAL_NAME,		/* RETURNVALUE ordinal and name length */
+	ST_RETVAL_TYPE,		/* RETURNVALUE status, user type, flags and type */
+	ST_RETVAL_VALUE,
+	ST_LOST,		/* unknown data, stop scanning */
+};
 
-struct tmp_col_struct
+/* collect need bytes then enter state */
+static void
+stream_need(TDS_POOL_STREAM *st, unsigned need, unsigned char state)
 {
-	char *column_name;
-	struct tmp_col_struct *next;
-};
+	st->dest = st->acc;
+	st->need = need;
+	st->have = 0;
+	st->state = state;
+}
 
-/*
- *  returns 1 if this end token has the final bit set
- */
-static int
-is_final_token(const unsigned char *buf)
+static void
+stream_go(TDS_POOL_STREAM *st, unsigned char state)
 {
-	return buf[1] & 0x01 ? 0 : 1;
+	stream_need(st, 0, state);
 }
 
-/*
- *  computes the number of bytes left to be read from the input stream 
- *  after this packet is completely processed.
- *  returns 1 if token overruns the current packet, 0 otherwise.
- */
-static int
-bytes_left(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int pos, int maxlen, int need)
+static void
+stream_token(TDS_POOL_STREAM *st)
 {
-	if (pos + need > maxlen) {
-		return 1;
-	} else
-		return 0;
+	stream_need(st, 1, ST_TOKEN);
 }
 
-/**
- * tds_get_token_size() returns the size of a fixed length token
- * \param marker token type.
- */
-static int
-tds_get_token_size(int marker)
+static void
+stream_lost(TDS_POOL_STREAM *st)
 {
-	/* TODO finish */
-	switch (marker) {
-	case TDS_DONE_TOKEN:
-	case TDS_DONEPROC_TOKEN:
-	case TDS_DONEINPROC_TOKEN:
-		// XXX 12 for TDS >= 7.2
-		return 8;
-	case TDS_RETURNSTATUS_TOKEN:
-		return 4;
-	case TDS_PROCID_TOKEN:
-		return 8;
-	default:
-		return 0;
-	}
+	tdsdump_log(TDS_DBG_ERROR, "pool stream: unexpected data (state %u token 0x%x), stop scanning\n",
+		    st->state, st->token);
+	st->skip = 0;
+	stream_go(st, ST_LOST);
 }
 
-/*
- * attempts to read a fixed length token, returns 1 if successful
- * bytes_read is set to the number of bytes read fromt the input stream.
- */
-static int
-read_fixed_token(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int maxlen, int *bytes_read)
+static unsigned
+stream_usertype_size(const TDS_POOL_STREAM *st)
 {
-	TDS_SMALLINT sz;
-	int marker;
-	int pos = 0;
+	return st->tds_version >= 0x702 ? 4 : 2;
+}
 
-	if (bytes_left(pmbr, buf, pos, maxlen, 1)) {
-		*bytes_read = maxlen;
-		return 0;
-	}
-	marker = buf[pos++];
-	sz = tds_get_token_size(marker);
-	if (bytes_left(pmbr, buf, pos, maxlen, sz)) {
-		*bytes_read = maxlen;
-		return 0;
+static unsigned
+stream_collation_size(const TDS_POOL_STREAM *st)
+{
+	return st->tds_version >= 0x701 ? 5 : 0;
+}
+
+static void
+stream_next_name(TDS_POOL_STREAM *st)
+{
+	if (st->b_names) {
+		--st->b_names;
+		stream_need(st, 1, ST_NAME_LEN);
+	} else if (st->us_names) {
+		--st->us_names;
+		stream_need(st, 2, ST_NAME_LEN);
 	} else {
-		*bytes_read = sz + 1;
-		return 1;
+		stream_go(st, st->after_names);
 	}
 }
 
-static int
-read_variable_token(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int maxlen, int *bytes_read)
+/* skip some B_VARCHAR names followed by some US_VARCHAR ones */
+static void
+stream_names(TDS_POOL_STREAM *st, unsigned b_names, unsigned us_names, unsigned char after)
 {
-	TDS_SMALLINT sz;
-	int pos = 0;
+	st->b_names = b_names;
+	st->us_names = us_names;
+	st->after_names = after;
+	stream_next_name(st);
+}
 
-	if (bytes_left(pmbr, buf, pos, maxlen, 3)) {
-		*bytes_read = maxlen;
-		return 0;
+/* parse TYPE_INFO of st->cur given its type */
+static void
+stream_type_info(TDS_POOL_STREAM *st, unsigned char type)
+{
+	TDS_POOL_STREAM_COL *col = st->cur;
+
+	col->kind = POOL_COL_BYTELEN;
+	col->size = 0;
+	switch (type) {
+	case SYBVOID:
+		col->kind = POOL_COL_FIXED;
+		break;
+	case SYBINT1:
+	case SYBBIT:
+		col->kind = POOL_COL_FIXED;
+		col->size = 1;
+		break;
+	case SYBINT2:
+		col->kind = POOL_COL_FIXED;
+		col->size = 2;
+		break;
+	case SYBINT4:
+	case SYBDATETIME4:
+	case SYBREAL:
+	case SYBMONEY4:
+		col->kind = POOL_COL_FIXED;
+		col->size = 4;
+		break;
+	case SYBMONEY:
+	case SYBDATETIME:
+	case SYBFLT8:
+	case SYBINT8:
+		col->kind = POOL_COL_FIXED;
+		col->size = 8;
+		break;
+	case SYBUNIQUE:
+	case SYBINTN:
+	case SYBBITN:
+	case SYBFLTN:
+	case SYBMONEYN:
+	case SYBDATETIMN:
+	case SYBCHAR:
+	case SYBVARCHAR:
+	case SYBBINARY:
+	case SYBVARBINARY:
+	/* scale */
+	case SYBMSTIME:
+	case SYBMSDATETIME2:
+	case SYBMSDATETIMEOFFSET:
+		stream_need(st, 1, ST_TYPE_DONE);
+		return;
+	case SYBMSDATE:
+		break;
+	/* size, precision and scale; legacy DECIMAL and NUMERIC too */
+	case SYBDECIMAL:
+	case SYBNUMERIC:
+	case 0x37:
+	case 0x3f:
+		stream_need(st, 3, ST_TYPE_DONE);
+		return;
+	case XSYBVARBINARY:
+	case XSYBBINARY:
+		stream_need(st, 2, ST_TYPE_LEN2);
+		return;
+	case XSYBVARCHAR:
+	case XSYBCHAR:
+	case XSYBNVARCHAR:
+	case XSYBNCHAR:
+		stream_need(st, 2 + stream_collation_size(st), ST_TYPE_LEN2);
+		return;
+	case SYBMSXML:
+		col->kind = POOL_COL_PLP;
+		stream_need(st, 1, ST_TYPE_XML);
+		return;
+	case SYBMSUDT:
+		col->kind = POOL_COL_PLP;
+		stream_need(st, 2, ST_TYPE_UDT);
+		return;
+	case SYBTEXT:
+	case SYBNTEXT:
+		col->kind = POOL_COL_TEXT;
+		stream_need(st, 4 + stream_collation_size(st), ST_TYPE_DONE);
+		return;
+	case SYBIMAGE:
+		col->kind = POOL_COL_TEXT;
+		stream_need(st, 4, ST_TYPE_DONE);
+		return;
+	case SYBVARIANT:
+		col->kind = POOL_COL_LONGLEN;
+		stream_need(st, 4, ST_TYPE_DONE);
+		return;
+	default:
+		stream_lost(st);
+		return;
 	}
+	stream_go(st, ST_TYPE_DONE);
+}
 
-	/* memcpy(&sz,&buf[1],2); */
-	/* FIX ME -- works only in emul little endian mode on bigend boxen */
-	sz = buf[1] + buf[2] * 256;
-	pos += 3;
-	if (bytes_left(pmbr, buf, pos, maxlen, sz)) {
-		*bytes_read = maxlen;
-		return 0;
-	} else {
-		*bytes_read = sz + 3;
-		return 1;
+static void
+stream_col_start(TDS_POOL_STREAM *st)
+{
+	if (st->col >= st->num_cols) {
+		stream_token(st);
+		return;
 	}
+	stream_need(st, stream_usertype_size(st) + 2 + 1, ST_COL);
 }
 
-static int
-read_row(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int maxlen, int *bytes_read)
+static bool
+stream_alloc_cols(TDS_POOL_STREAM *st, unsigned num_cols)
 {
-	TDSCOLUMN *curcol;
-	TDSRESULTINFO *info;
-	int i, colsize;
-	int pos = 1;		/* skip marker */
-
-	info = pmbr->tds->res_info;
-
-	die_if((!info), "Entered read_row() without a res_info structure.");
-
-	for (i = 0; i < info->num_cols; i++) {
-		curcol = info->columns[i];
-		if (!is_fixed_type(curcol->column_type)) {
-			if (bytes_left(pmbr, buf, pos, maxlen, 1)) {
-				*bytes_read = maxlen;
-				return 0;
-			}
-			colsize = buf[pos++];
-		} else {
-			colsize = tds_get_size_by_type(curcol->column_type);
-		}
-		if (bytes_left(pmbr, buf, pos, maxlen, colsize)) {
-			*bytes_read = maxlen;
-			return 0;
-		}
-		pos += colsize;
+	if (num_cols > st->alloc_cols) {
+		TDS_POOL_STREAM_COL *cols;
+		unsigned char *nbc;
+
+		cols = (TDS_POOL_STREAM_COL *) realloc(st->cols, num_cols * sizeof(*cols));
+		if (!cols)
+			return false;
+		st->cols = cols;
+		nbc = (unsigned char *) realloc(st->nbc, (num_cols + 7u) / 8u);
+		if (!nbc)
+			return false;
+		st->nbc = nbc;
+		st->alloc_cols = num_cols;
 	}
-
-	*bytes_read = pos;
-
-	return 1;
+	st->num_cols = num_cols;
+	return true;
 }
 
+/* start skipping the value described by st->cur */
 static void
-free_col_struct(struct tmp_col_struct *head)
+stream_value(TDS_POOL_STREAM *st)
 {
-	while (head) {
-		struct tmp_col_struct *prev = head;
-		head = prev->next;
-		free(prev->column_name);
-		free(prev);
+	switch (st->cur->kind) {
+	case POOL_COL_FIXED:
+		st->skip = st->cur->size;
+		stream_go(st, ST_VALUE_FIXED);
+		break;
+	case POOL_COL_BYTELEN:
+		stream_need(st, 1, ST_VALUE_LEN1);
+		break;
+	case POOL_COL_SHORTLEN:
+		stream_need(st, 2, ST_VALUE_LEN2);
+		break;
+	case POOL_COL_LONGLEN:
+		stream_need(st, 4, ST_VALUE_LEN4);
+		break;
+	case POOL_COL_TEXT:
+		stream_need(st, 1, ST_TEXTPTR_LEN);
+		break;
+	case POOL_COL_PLP:
+		stream_need(st, 8, ST_PLP_LEN);
+		break;
 	}
 }
 
-static int
-read_col_name(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int maxlen, int *bytes_read)
+static void
+stream_value_done(TDS_POOL_STREAM *st)
 {
-	TDS_SMALLINT hdrsize;
-	int pos = 0;
-	int num_cols = 0;
-	int namelen;
-	struct tmp_col_struct *head = NULL, *cur = NULL, *prev;
-	int col;
-	TDSCOLUMN *curcol;
-	TDSRESULTINFO *info;
-
-	/* header size */
-	if (bytes_left(pmbr, buf, pos, maxlen, 3)) {
-		*bytes_read = maxlen;
-		return 0;
+	if (st->token == TDS_PARAM_TOKEN) {
+		stream_token(st);
+		return;
 	}
-	/* FIXME -- endian */
-	hdrsize = buf[1] + buf[2] * 256;
-	pos += 3;
-
-	for (;;) {
-		prev = cur;
-		cur = (struct tmp_col_struct *)
-			malloc(sizeof(struct tmp_col_struct));
-		cur->next = NULL;
-		cur->column_name = NULL;
-
-		if (prev)
-			prev->next = cur;
-		if (!head)
-			head = cur;
-
-		if (bytes_left(pmbr, buf, pos, maxlen, 1)) {
-			*bytes_read = maxlen;
-			free_col_struct(head);
-			return 0;
-		}
-		namelen = buf[pos++];
-
-
-		if (bytes_left(pmbr, buf, pos, maxlen, namelen)) {
-			*bytes_read = maxlen;
-			free_col_struct(head);
-			return 0;
-		}
-		cur->column_name = (char *) malloc(namelen + 1);
-		strlcpy(cur->column_name, (char *) &buf[pos], namelen + 1);
-
-		pos += namelen;
-
-		num_cols++;
+	++st->col;
+	stream_go(st, ST_ROW_VALUE);
+}
 
-		if (pos >= hdrsize)
-			break;
-	}
+static void
+stream_done(TDS_POOL_STREAM *st)
+{
+	unsigned status = TDS_GET_UA2LE(st->acc);
 
-	tds_free_all_results(pmbr->tds);
-	pmbr->tds->res_info = tds_alloc_results(num_cols);
-	info = pmbr->tds->res_info;
-
-	cur = head;
-
-	for (col = 0; col < info->num_cols; col++) {
-		curcol = info->columns[col];
-		strlcpy(curcol->column_name, cur->column_name, sizeof(curcol->column_name));
-		/* FIXME ucs2 client and others */
-		curcol->column_namelen = strlen(curcol->column_name);
-		prev = cur;
-		cur = cur->next;
-		free(prev->column_name);
-		free(prev);
+	if (status & TDS_DONE_CANCELLED)
+		st->attention = false;
+	if (st->token != TDS_DONEINPROC_TOKEN && !(status & TDS_DONE_MORE_RESULTS)) {
+		tdsdump_log(TDS_DBG_INFO1, "pool stream: end of response\n");
+		st->pending = false;
 	}
-
-
-	*bytes_read = pos;
-	return 1;
+	stream_token(st);
 }
 
-static int
-read_col_info(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int maxlen, int *bytes_read)
+static void
+stream_start_token(TDS_POOL_STREAM *st)
 {
-	TDS_SMALLINT hdrsize;
-	int pos = 0;
-	int col, rest;
-	TDSCOLUMN *curcol;
-	TDSRESULTINFO *info;
-	TDSSOCKET *tds = pmbr->tds;
-
-	/* header size */
-	if (bytes_left(pmbr, buf, pos, maxlen, 3)) {
-		*bytes_read = maxlen;
-		return 0;
-	}
-	/* FIX ME -- endian */
-	hdrsize = buf[1] + buf[2] * 256;
-	pos += 3;
-
-	info = tds->res_info;
-	for (col = 0; col < info->num_cols; col++) {
-		curcol = info->columns[col];
-		if (bytes_left(pmbr, buf, pos, maxlen, 5)) {
-			*bytes_read = maxlen;
-			return 0;
-		}
-		pos += 4;
-		curcol->column_type = buf[pos++];
-
-		/* FIX ME -- blob types */
-		if (!is_fixed_type(curcol->column_type)) {
-			if (bytes_left(pmbr, buf, pos, maxlen, 1)) {
-				*bytes_read = maxlen;
-				return 0;
-			}
-			curcol->column_size = buf[pos++];
-		} else {
-			curcol->column_size = tds_get_size_by_type(curcol->column_type);
+	st->token = st->acc[0];
+	switch (st->token) {
+	case TDS_DONE_TOKEN:
+	case TDS_DONEPROC_TOKEN:
+	case TDS_DONEINPROC_TOKEN:
+		stream_need(st, st->tds_version >= 0x702 ? 12 : 8, ST_DONE);
+		break;
+	case TDS_RETURNSTATUS_TOKEN:
+		stream_token(st);
+		st->skip = 4;
+		break;
+	case TDS_ORDERBY_TOKEN:
+	case TDS_ERROR_TOKEN:
+	case TDS_INFO_TOKEN:
+	case TDS_LOGINACK_TOKEN:
+	case TDS_TABNAME_TOKEN:
+	case TDS_COLINFO_TOKEN:
+	case TDS_AUTH_TOKEN:
+		stream_need(st, 2, ST_SKIP_LEN2);
+		break;
+	case TDS_ENVCHANGE_TOKEN:
+		stream_need(st, 3, ST_ENVCHANGE);
+		break;
+	case TDS_SESSIONSTATE_TOKEN:
+	case TDS_RESULT_TOKEN:	/* FEDAUTHINFO */
+		stream_need(st, 4, ST_SKIP_LEN4);
+		break;
+	case TDS_CONTROL_FEATUREEXTACK_TOKEN:
+		stream_need(st, 1, ST_FEATURE);
+		break;
+	case TDS7_RESULT_TOKEN:
+		stream_need(st, 2, ST_COLMETADATA);
+		break;
+	case TDS_ROW_TOKEN:
+		if (!st->cols) {
+			stream_lost(st);
+			break;
 		}
-	}
-
-	rest = hdrsize + 3 - pos;
-	if (rest > 0) {
-		if (bytes_left(pmbr, buf, pos, maxlen, rest)) {
-			*bytes_read = maxlen;
-			return 0;
+		stream_go(st, ST_ROW_START);
+		break;
+	case TDS_NBC_ROW_TOKEN:
+		if (!st->cols) {
+			stream_lost(st);
+			break;
 		}
-		fprintf(stderr, "read_col_info: draining %d bytes\n", rest);
-		pos += rest;
+		stream_need(st, (st->num_cols + 7u) / 8u, ST_ROW_START);
+		st->dest = st->nbc;
+		break;
+	case TDS_PARAM_TOKEN:
+		stream_need(st, 3, ST_RETVAL_NAME);
+		break;
+	default:
+		/* compute results and TDS 5 tokens are not supported */
+		stream_lost(st);
+		break;
 	}
-	*bytes_read = pos;
-
-	return 1;
 }
 
-/*
- * TDS 5 style result sets
- */
-static int
-read_result(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int maxlen, int *bytes_read)
+/* process collected data and move to next state */
+static void
+stream_step(TDS_POOL_STREAM *st)
 {
-	TDS_SMALLINT hdrsize;
-	int pos = 0;
-	int namelen;
-	int col;
-	TDSSOCKET *tds = pmbr->tds;
-	int num_cols;
-	TDSCOLUMN *curcol;
-	TDSRESULTINFO *info;
-
-	if (bytes_left(pmbr, buf, pos, maxlen, 3)) {
-		*bytes_read = maxlen;
-		return 0;
-	}
-	/* FIX ME -- endian */
-	hdrsize = buf[1] + buf[2] * 256;
-	pos += 3;
-
-	/* read number of columns and allocate the columns structure */
-	num_cols = buf[pos] + buf[pos+1] * 256;
-	pos += 2;
-
-	tds_free_all_results(tds);
-
-	tds->res_info = tds_alloc_results(num_cols);
-	info = pmbr->tds->res_info;
-
-	/*
-	 * loop through the columns populating COLINFO struct from
- 	 * server response
-	 */
-
-	for (col = 0; col < info->num_cols; col++) {
-		curcol = info->columns[col];
-
-		namelen = buf[pos++];
-
-		strlcpy(curcol->column_name, (char *) &buf[pos], namelen + 1);
-		pos += namelen;
-
-		curcol->column_namelen = namelen;
-
-		pos++;     /* flags */
-		pos += 4;  /* user type */
-
-		tds_set_column_type(tds->conn, curcol, (int)buf[pos]);
-		switch(curcol->column_varint_size) {
-			/* FIX ME - endian */
-			case 2: curcol->column_size = buf[pos] + buf[pos+1]*256; break;
-			case 1: curcol->column_size = buf[pos]; break;
-			case 0: break;
+	uint32_t len;
+
+	switch (st->state) {
+	case ST_TOKEN:
+		stream_start_token(st);
+		break;
+	case ST_DONE:
+		stream_done(st);
+		break;
+	case ST_SKIP_LEN2:
+		stream_token(st);
+		st->skip = TDS_GET_UA2LE(st->acc);
+		break;
+	case ST_SKIP_LEN4:
+		stream_token(st);
+		st->skip = TDS_GET_UA4LE(st->acc);
+		break;
+	case ST_ENVCHANGE:
+		len = TDS_GET_UA2LE(st->acc);
+		if (!len) {
+			stream_lost(st);
+			break;
+		}
+		stream_token(st);
+		st->skip = len - 1;
+		switch (st->acc[2]) {
+		case TDS_ENV_BEGINTRANS:
+		case 11:	/* enlist DTC transaction */
+			st->transaction = true;
+			break;
+		case TDS_ENV_COMMITTRANS:
+		case TDS_ENV_ROLLBACKTRANS:
+		case 12:	/* defect DTC transaction */
+			st->transaction = false;
+			break;
 		}
-		pos+=curcol->column_varint_size;
-		if (is_numeric_type(curcol->column_type))
-			pos+=2;
+		break;
+	case ST_FEATURE:
+		if (st->acc[0] == 0xff)
+			stream_token(st);
+		else
+			stream_need(st, 4, ST_FEATURE_LEN);
+		break;
+	case ST_FEATURE_LEN:
+		stream_need(st, 1, ST_FEATURE);
+		st->skip = TDS_GET_UA4LE(st->acc);
+		break;
+
+	/* COLMETADATA */
+	case ST_COLMETADATA:
+		len = TDS_GET_UA2LE(st->acc);
+		/* no metadata, previous one still valid */
+		if (len == 0xffff) {
+			stream_token(st);
+			break;
+		}
+		if (!stream_alloc_cols(st, len)) {
+			stream_lost(st);
+			break;
+		}
+		st->col = 0;
+		stream_col_start(st);
+		break;
+	case ST_COL:
+		st->cur = &st->cols[st->col];
+		st->after_type = ST_COL_TABLE;
+		stream_type_info(st, st->acc[st->need - 1]);
+		break;
+	case ST_COL_TABLE:
+		if (st->cur->kind != POOL_COL_TEXT)
+			stream_go(st, ST_COL_NAME);
+		else if (st->tds_version >= 0x702)
+			stream_need(st, 1, ST_TABLE_PARTS);
+		else
+			stream_names(st, 0, 1, ST_COL_NAME);
+		break;
+	case ST_TABLE_PARTS:
+		stream_names(st, 0, st->acc[0], ST_COL_NAME);
+		break;
+	case ST_COL_NAME:
+		stream_names(st, 1, 0, ST_COL_NEXT);
+		break;
+	case ST_COL_NEXT:
+		++st->col;
+		stream_col_start(st);
+		break;
+
+	/* TYPE_INFO */
+	case ST_TYPE_DONE:
+		stream_go(st, st->after_type);
+		break;
+	case ST_TYPE_LEN2:
+		if (TDS_GET_UA2LE(st->acc) == 0xffff)
+			st->cur->kind = POOL_COL_PLP;
+		else
+			st->cur->kind = POOL_COL_SHORTLEN;
+		stream_go(st, st->after_type);
+		break;
+	case ST_TYPE_XML:
+		/* database, owning schema and schema collection */
+		if (st->acc[0])
+			stream_names(st, 2, 1, st->after_type);
+		else
+			stream_go(st, st->after_type);
+		break;
+	case ST_TYPE_UDT:
+		/* database, schema, type and assembly names */
+		stream_names(st, 3, 1, st->after_type);
+		break;
+	case ST_NAME_LEN:
+		len = st->need == 1 ? st->acc[0] : TDS_GET_UA2LE(st->acc);
+		stream_next_name(st);
+		st->skip = len * 2u;
+		break;
+
+	/* ROW and NBCROW */
+	case ST_ROW_START:
+		st->col = 0;
+		stream_go(st, ST_ROW_VALUE);
+		break;
+	case ST_ROW_VALUE:
+		if (st->col >= st->num_cols) {
+			stream_token(st);
+			break;
+		}
+		st->cur = &st->cols[st->col];
+		if (st->token == TDS_NBC_ROW_TOKEN && (st->nbc[st->col / 8u] & (1u << (st->col % 8u)))) {
+			++st->col;
+			break;
+		}
+		stream_value(st);
+		break;
+
+	/* values */
+	case ST_VALUE_FIXED:
+		stream_value_done(st);
+		break;
+	case ST_VALUE_LEN1:
+		stream_value_done(st);
+		st->skip = st->acc[0];
+		break;
+	case ST_VALUE_LEN2:
+		len = TDS_GET_UA2LE(st->acc);
+		stream_value_done(st);
+		if (len != 0xffff)
+			st->skip = len;
+		break;
+	case ST_VALUE_LEN4:
+		len = TDS_GET_UA4LE(st->acc);
+		stream_value_done(st);
+		if (len != 0xffffffffu)
+			st->skip = len;
+		break;
+	case ST_TEXTPTR_LEN:
+		/* NULL */
+		if (!st->acc[0]) {
+			stream_value_done(st);
+			break;
+		}
+		/* text pointer and timestamp */
+		stream_need(st, 4, ST_VALUE_LEN4);
+		st->skip = st->acc[0] + 8u;
+		break;
+	case ST_PLP_LEN:
+		if (TDS_GET_UA4LE(st->acc) == 0xffffffffu && TDS_GET_UA4LE(st->acc + 4) == 0xffffffffu)
+			stream_value_done(st);
+		else
+			stream_need(st, 4, ST_PLP_CHUNK);
+		break;
+	case ST_PLP_CHUNK:
+		len = TDS_GET_UA4LE(st->acc);
+		if (!len) {
+			stream_value_done(st);
+			break;
+		}
+		stream_need(st, 4, ST_PLP_CHUNK);
+		st->skip = len;
+		break;
+
+	/* RETURNVALUE */
+	case ST_RETVAL_NAME:
+		len = st->acc[2];
+		stream_need(st, 1 + stream_usertype_size(st) + 2 + 1, ST_RETVAL_TYPE);
+		st->skip = len * 2u;
+		break;
+	case ST_RETVAL_TYPE:
+		st->cur = &st->param;
+		st->after_type = ST_RETVAL_VALUE;
+		stream_type_info(st, st->acc[st->need - 1]);
+		break;
+	case ST_RETVAL_VALUE:
+		stream_value(st);
+		break;
 
-		/* skip locale information */
-		pos += buf[pos];
+	default:
+		stream_lost(st);
+		break;
 	}
-	return tds_alloc_row(info);
 }
 
-/* 
- * is_end_token processes one token and returns 0 for an incomplete token
- * or -1 if this is the END token, and 1 for successful processing of token.  
- * The number of bytes read from the stream is returned in 'bytes_read'.
- */
-static int
-pool_is_end_token(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int maxlen, int *bytes_read)
+/* scan some bytes of token stream */
+static void
+stream_feed(TDS_POOL_STREAM *st, const unsigned char *p, size_t len)
 {
-	TDS_SMALLINT sz;
-	int marker;
-	int ret;
-
-	if (maxlen == 0)
-		return 0;
-
-	marker = buf[0];
-	sz = tds_get_token_size(marker);
-
-	if (sz) {
-		ret = read_fixed_token(pmbr, buf, maxlen, bytes_read);
-	} else if (marker == TDS_ROW_TOKEN) {
-		ret = read_row(pmbr, buf, maxlen, bytes_read);
-	} else if (marker == TDS_COLNAME_TOKEN) {
-		ret = read_col_name(pmbr, buf, maxlen, bytes_read);
-	} else if (marker == TDS_COLFMT_TOKEN) {
-		ret = read_col_info(pmbr, buf, maxlen, bytes_read);
-	} else if (marker == TDS_RESULT_TOKEN) {
-		ret = read_result(pmbr, buf, maxlen, bytes_read);
-	} else {
-		ret = read_variable_token(pmbr, buf, maxlen, bytes_read);
+	size_t n;
+
+	while (st->state != ST_LOST) {
+		if (st->skip) {
+			n = st->skip < len ? (size_t) st->skip : len;
+			st->skip -= n;
+			p += n;
+			len -= n;
+			if (st->skip)
+				return;
+		}
+		if (st->have < st->need) {
+			n = st->need - st->have;
+			if (n > len)
+				n = len;
+			memcpy(st->dest + st->have, p, n);
+			st->have += (uint16_t) n;
+			p += n;
+			len -= n;
+			if (st->have < st->need)
+				return;
+		}
+		stream_step(st);
 	}
+}
 
-	/* fprintf(stderr,"bytes_read = %d\n",*bytes_read); */
-	if (!ret) {
-		return 0;
-	}
+/* check we are between tokens */
+static bool
+stream_at_token(const TDS_POOL_STREAM *st)
+{
+	return st->state == ST_TOKEN && !st->skip && !st->have;
+}
 
-	if (is_end_token(marker)) {
-		if (is_final_token(buf)) {
-			/* clean up */
-			return -1;
-		}
-	}
+void
+pool_stream_init(TDS_POOL_STREAM *st, TDS_USMALLINT tds_version)
+{
+	free(st->cols);
+	free(st->nbc);
+	memset(st, 0, sizeof(*st));
+	st->tds_version = tds_version;
+	stream_token(st);
+	/* only TDS 7+ replies are understood */
+	if (tds_version < 0x700)
+		stream_go(st, ST_LOST);
+}
 
-	return 1;
+void
+pool_stream_free(TDS_POOL_STREAM *st)
+{
+	free(st->cols);
+	st->cols = NULL;
+	free(st->nbc);
+	st->nbc = NULL;
+	st->num_cols = st->alloc_cols = 0;
 }
 
-int
-pool_find_end_token(TDS_POOL_MEMBER * pmbr, const unsigned char *buf, int len)
+/*
+ * Notify a packet of given type was forwarded to the server.
+ */
+void
+pool_stream_request(TDS_POOL_STREAM *st, TDS_UCHAR packet_type)
 {
-	int pos = 0, startpos, ret;
-	int bytes_read;
-	int stop = 0;
-	const unsigned char *curbuf;
-	unsigned char tmpbuf[PGSIZ + BLOCKSIZ];
-	int totlen;
-	static int last_mark;
-
-	/*
-	 * if we had part of a token left over, copy to tmpbuf
-	 */
-	if (pmbr->num_bytes_left) {
-		/* fprintf(stderr,"%d bytes left from last packet\n",pmbr->num_bytes_left); */
-		if (pmbr->num_bytes_left > 2000) {
-			fprintf(stderr, "marker is %d last mark was %d\n", pmbr->fragment[0], last_mark);
-		}
-		memcpy(tmpbuf, pmbr->fragment, pmbr->num_bytes_left);
-		memcpy(&tmpbuf[pmbr->num_bytes_left], buf, len);
-		curbuf = tmpbuf;
-		totlen = len + pmbr->num_bytes_left;
-	} else {
-		curbuf = buf;
-		totlen = len;
-	}
+	if (packet_type == TDS_CANCEL)
+		st->attention = true;
+	else
+		st->pending = true;
+}
 
-	do {
-		startpos = pos;
+/* a message must end between tokens */
+static void
+stream_check_eom(TDS_POOL_STREAM *st, const unsigned char *header)
+{
+	if (!(header[1] & TDS_STATUS_EOM) || st->state == ST_LOST)
+		return;
+	if (!stream_at_token(st))
+		stream_lost(st);
+}
 
-		ret = pool_is_end_token(pmbr, &curbuf[pos], totlen - pos, &bytes_read);
-		if (ret <= 0)
-			stop = 1;
+/*
+ * Scan a full packet (header included) received from the server.
+ */
+void
+pool_stream_packet(TDS_POOL_STREAM *st, const unsigned char *pkt, unsigned len)
+{
+	if (len < 8)
+		return;
+	stream_feed(st, pkt + 8, len - 8);
+	stream_check_eom(st, pkt);
+}
 
-		pos += bytes_read;
-	} while (!stop);
+/*
+ * Skip the payload of a packet (len bytes) without looking at it.
+ * Possible only if the scanner is inside a value which covers the
+ * whole payload.
+ * @return true if skipped, false if payload must be scanned
+ */
+bool
+pool_stream_skip(TDS_POOL_STREAM *st, const unsigned char *header, unsigned len)
+{
+	if (st->state == ST_LOST)
+		return true;
+	if (st->skip < len || (header[1] & TDS_STATUS_EOM))
+		return false;
+	st->skip -= len;
+	return true;
+}
 
-	if (ret == -1) {
-		pmbr->num_bytes_left = 0;
-		return 1;	/* found end token */
-	} else {
-		last_mark = buf[0];
-		pmbr->num_bytes_left = totlen - startpos;
-		memcpy(pmbr->fragment, &curbuf[startpos], pmbr->num_bytes_left);
-		return 0;	/* exhausted the stream */
-	}
+/*
+ * Check the server finished replying to everything we sent.
+ */
+bool
+pool_stream_idle(const TDS_POOL_STREAM *st)
+{
+	return stream_at_token(st) && !st->pending && !st->attention;
 }
@@ -48,7 +48,7 @@
 #include <freetds/server.h>
 #include <freetds/utils/string.h>
 
-static TDS_POOL_USER *pool_user_find_new(TDS_POOL * pool);
+static TDS_POOL_USER *pool_user_find_new(TDS_POOL_SHARD * shard);
 static bool pool_user_login(TDS_POOL * pool, TDS_POOL_USER * puser);
 static bool pool_user_read(TDS_POOL * pool, TDS_POOL_USER * puser);
 static void login_execute(TDS_POOL_EVENT *base_event);
@@ -57,42 +57,54 @@ static void end_login_execute(TDS_POOL_EVENT *base_event);
 void
 pool_user_init(TDS_POOL * pool)
 {
-	dlist_user_init(&pool->users);
-	dlist_user_init(&pool->waiters);
 	pool->ctx = tds_alloc_context(NULL);
 }
 
 void
 pool_user_destroy(TDS_POOL * pool)
 {
-	while (dlist_user_first(&pool->users))
-		pool_free_user(pool, dlist_user_first(&pool->users));
-	while (dlist_user_first(&pool->waiters))
-		pool_free_user(pool, dlist_user_first(&pool->waiters));
+	unsigned i;
+
+	for (i = 0; i < pool->num_shards; ++i) {
+		TDS_POOL_SHARD *shard = &pool->shards[i];
+
+		while (dlist_user_first(&shard->users))
+			pool_free_user(pool, dlist_user_first(&shard->users));
+		while (dlist_user_first(&shard->waiters))
+			pool_free_user(pool, dlist_user_first(&shard->waiters));
+	}
 
 	tds_free_context(pool->ctx);
 	pool->ctx = NULL;
 }
 
 static TDS_POOL_USER *
-pool_user_find_new(TDS_POOL * pool)
+pool_user_find_new(TDS_POOL_SHARD * shard)
 {
+	TDS_POOL *pool = shard->pool;
 	TDS_POOL_USER *puser;
 
 	/* did we exhaust the number of concurrent users? */
+	tds_mutex_lock(&pool->mtx);
 	if (pool->num_users >= MAX_POOL_USERS) {
+		tds_mutex_unlock(&pool->mtx);
 		fprintf(stderr, "Max concurrent users exceeded, increase in pool.h\n");
 		return NULL;
 	}
+	pool->num_users++;
+	tds_mutex_unlock(&pool->mtx);
 
 	puser = tds_new0(TDS_POOL_USER, 1);
 	if (!puser) {
+		tds_mutex_lock(&pool->mtx);
+		pool->num_users--;
+		tds_mutex_unlock(&pool->mtx);
 		fprintf(stderr, "Out of memory\n");
 		return NULL;
 	}
 
-	dlist_user_append(&pool->users, puser);
-	pool->num_users++;
+	puser->shard = shard;
+	dlist_user_append(&shard->users, puser);
 
 	return puser;
 }
@@ -110,7 +122,7 @@ static TDS_THREAD_PROC_DECLARE(login_proc, arg)
 
 	ev->success = pool_user_login(ev->pool, ev->puser);
 
-	pool_event_add(ev->pool, &ev->common, login_execute);
+	pool_event_add(ev->puser->shard, &ev->common, login_execute);
 	return TDS_THREAD_RESULT(0);
 }
 
@@ -144,8 +156,9 @@ login_execute(TDS_POOL_EVENT *base_event)
  * accepts a client connection and adds it to the users list and returns it
  */
 TDS_POOL_USER *
-pool_user_create(TDS_POOL * pool, TDS_SYS_SOCKET s)
+pool_user_create(TDS_POOL_SHARD * shard, TDS_SYS_SOCKET s)
 {
+	TDS_POOL *pool = shard->pool;
 	TDS_POOL_USER *puser;
 	TDS_SYS_SOCKET fd;
 	TDSSOCKET *tds;
@@ -166,7 +179,7 @@ pool_user_create(TDS_POOL * pool, TDS_SYS_SOCKET s)
 		return NULL;
 	}
 
-	puser = pool_user_find_new(pool);
+	puser = pool_user_find_new(shard);
 	if (!puser) {
 		CLOSESOCKET(fd);
 		return NULL;
@@ -174,6 +187,7 @@ pool_user_create(TDS_POOL * pool, TDS_SYS_SOCKET s)
 
 	tds = tds_alloc_socket(pool->ctx, BLOCKSIZ);
 	if (!tds) {
+		pool_free_user(pool, puser);
 		CLOSESOCKET(fd);
 		return NULL;
 	}
@@ -181,6 +195,7 @@ pool_user_create(TDS_POOL * pool, TDS_SYS_SOCKET s)
 	if (!ev || TDS_FAILED(tds_iconv_open(tds->conn, "UTF-8", 0))) {
 		free(ev);
 		tds_free_socket(tds);
+		pool_free_user(pool, puser);
 		CLOSESOCKET(fd);
 		return NULL;
 	}
@@ -192,6 +207,7 @@ pool_user_create(TDS_POOL * pool, TDS_SYS_SOCKET s)
 	puser->user_state = TDS_SRV_QUERY;
 	puser->sock.poll_recv = false;
 	puser->sock.poll_send = false;
+	pool_socket_add(shard, &puser->sock);
 
 	/* launch login asyncronously */
 	ev->puser = puser;
@@ -214,6 +230,10 @@ void
 pool_free_user(TDS_POOL *pool, TDS_POOL_USER * puser)
 {
 	TDS_POOL_MEMBER *pmbr = puser->assigned_member;
+	TDS_POOL_SHARD *shard = puser->shard;
+
+	pool_socket_remove(&puser->sock);
+	pool_splice_free(&puser->sock);
 	if (pmbr) {
 		assert(pmbr->current_user == puser);
 		pool_deassign_member(pool, pmbr);
@@ -224,44 +244,38 @@ pool_free_user(TDS_POOL *pool, TDS_POOL_USER * puser)
 	tds_free_login(puser->login);
 
 	/* make sure to decrement the waiters list if he is waiting */
-	if (puser->user_state == TDS_SRV_WAIT)
-		dlist_user_remove(&pool->waiters, puser);
-	else
-		dlist_user_remove(&pool->users, puser);
+	tds_mutex_lock(&pool->mtx);
+	if (puser->user_state == TDS_SRV_WAIT) {
+		dlist_user_remove(&shard->waiters, puser);
+		shard->num_waiters--;
+	} else {
+		dlist_user_remove(&shard->users, puser);
+	}
 	pool->num_users--;
+	tds_mutex_unlock(&pool->mtx);
 	free(puser);
 }
 
-/* 
- * pool_process_users
- * check the fd_set for user input, allocate a pool member to it, and forward
+/*
+ * pool_process_user
+ * handle user input, allocate a pool member to it, and forward
  * the query to that member.
  */
 void
-pool_process_users(TDS_POOL * pool, struct pollfd *fds, unsigned num_fds)
+pool_process_user(TDS_POOL * pool, TDS_POOL_USER * puser)
 {
-	TDS_POOL_USER *puser, *next;
-	short revents;
-
-	for (next = dlist_user_first(&pool->users); (puser = next) != NULL; ) {
+	if (!puser->sock.tds)
+		return;	/* dead connection */
 
-		next = dlist_user_next(&pool->users, puser);
-
-		if (!puser->sock.tds || puser->sock.poll_index >= num_fds)
-			continue;	/* dead connection */
-
-		revents = fds[puser->sock.poll_index].revents;
-
-		if (puser->sock.poll_recv && (revents & (POLLIN|POLLHUP)) != 0) {
-			assert(puser->user_state == TDS_SRV_QUERY);
-			if (!pool_user_read(pool, puser))
-				continue;
-		}
-		if (puser->sock.poll_send && (revents & POLLOUT) != 0) {
-			if (!pool_write_data(&puser->assigned_member->sock, &puser->sock))
-				pool_free_member(pool, puser->assigned_member);
-		}
-	}			/* for */
+	if (puser->sock.poll_recv && puser->sock.readable) {
+		assert(puser->user_state == TDS_SRV_QUERY);
+		if (!pool_user_read(pool, puser))
+			return;
+	}
+	if (puser->sock.poll_send && puser->sock.writable) {
+		if (!pool_write_data(&puser->assigned_member->sock, &puser->sock))
+			pool_free_member(pool, puser->assigned_member);
+	}
 }
 
 /*
@@ -351,7 +365,9 @@ pool_user_send_login_ack(TDS_POOL * pool, TDS_POOL_USER * puser)
 	const char *server = mtds->conn->server ? mtds->conn->server : "JDBC";
 	bool dbname_mismatch, odbc_mismatch;
 
+	tds_mutex_lock(&pool->mtx);
 	pool->user_logins++;
+	tds_mutex_unlock(&pool->mtx);
 
 	/* copy a bit of information, resize socket with block */
 	tds->conn->tds_version = mtds->conn->tds_version;
@@ -385,7 +401,16 @@ pool_user_send_login_ack(TDS_POOL * pool, TDS_POOL_USER * puser)
 			strcat(str, "USE ");
 			tds_quote_id(mtds, strchr(str, 0), tds_dstr_cstr(&login->database), -1);
 		}
-		ret = tds_submit_query(mtds, str);
+		/* do the pending reset before changing the session */
+		ret = TDS_FAIL;
+		if (tds_set_state(mtds, TDS_WRITING) == TDS_WRITING) {
+			tds_start_query(mtds, TDS_QUERY);
+			tds_put_string(mtds, str, -1);
+			ret = tds_write_packet(mtds, puser->assigned_member->reset_pending ?
+					       TDS_STATUS_EOM | TDS_STATUS_RESETCONNECTION : TDS_STATUS_EOM);
+			tds_set_state(mtds, TDS_PENDING);
+			puser->assigned_member->reset_pending = false;
+		}
 		free(str);
 		if (TDS_FAILED(ret) || TDS_FAILED(tds_process_simple_query(mtds)))
 			return false;
@@ -448,6 +473,30 @@ pool_user_send_login_ack(TDS_POOL * pool, TDS_POOL_USER * puser)
 	return true;
 }
 
+/*
+ * Inspect a client packet before forwarding it to the member.
+ * Called once per packet; only the header can be used as the payload
+ * of big packets could be moved with splice.
+ */
+static void
+pool_user_request(TDS_POOL_USER * puser, TDS_POOL_MEMBER * pmbr)
+{
+	unsigned char *pkt = puser->sock.tds->in_buf;
+	TDS_UCHAR in_flag = pkt[0];
+	bool msg_start = !puser->in_message;
+
+	puser->in_message = !(pkt[1] & TDS_STATUS_EOM);
+	pool_stream_request(&pmbr->stream, in_flag);
+	if (!msg_start)
+		return;
+
+	/* reset deferred by pool_reset_member */
+	if (pmbr->reset_pending && (in_flag == TDS_QUERY || in_flag == TDS_RPC || in_flag == TDS7_TRANS)) {
+		pkt[1] |= TDS_STATUS_RESETCONNECTION;
+		pmbr->reset_pending = false;
+	}
+}
+
 /*
  * pool_user_read
  * checks the packet type of data coming from the client and allocates a 
@@ -461,9 +510,13 @@ pool_user_read(TDS_POOL * pool, TDS_POOL_USER * puser)
 
 	for (;;) {
 		TDS_UCHAR in_flag;
+		/* header was already handled, only payload is left */
+		bool resumed = pool_packet_pending(&puser->sock);
 
-		if (pool_packet_read(tds))
+		if (pool_packet_read(&puser->sock)) {
+			puser->sock.readable = false;
 			break;
+		}
 		if (tds->in_len == 0) {
 			tdsdump_log(TDS_DBG_INFO1, "user disconnected\n");
 			pool_free_user(pool, puser);
@@ -480,6 +533,8 @@ pool_user_read(TDS_POOL * pool, TDS_POOL_USER * puser)
 		case TDS_BULK:
 		case TDS_CANCEL:
 		case TDS7_TRANS:
+			if (!resumed)
+				pool_user_request(puser, puser->assigned_member);
 			if (!pool_write_data(&puser->sock, &puser->assigned_member->sock)) {
 				pool_reset_member(pool, puser->assigned_member);
 				return false;
@@ -492,7 +547,7 @@ pool_user_read(TDS_POOL * pool, TDS_POOL_USER * puser)
 			pool_free_user(pool, puser);
 			return false;
 		}
-		if (tds->in_pos < tds->in_len)
+		if (pool_packet_pending(&puser->sock))
 			/* partial write, schedule a future write */
 			break;
 	}
@@ -514,6 +569,8 @@ pool_user_query(TDS_POOL * pool, TDS_POOL_USER * puser)
 	puser->user_state = TDS_SRV_QUERY;
 	pmbr = pool_assign_idle_member(pool, puser);
 	if (!pmbr) {
+		TDS_POOL_SHARD *shard = puser->shard;
+
 		/*
 		 * put into wait state
 		 * check when member is deallocated
@@ -522,8 +579,11 @@ pool_user_query(TDS_POOL * pool, TDS_POOL_USER * puser)
 		puser->user_state = TDS_SRV_WAIT;
 		puser->sock.poll_recv = false;
 		puser->sock.poll_send = false;
-		dlist_user_remove(&pool->users, puser);
-		dlist_user_append(&pool->waiters, puser);
+		dlist_user_remove(&shard->users, puser);
+		dlist_user_append(&shard->waiters, puser);
+		tds_mutex_lock(&pool->mtx);
+		shard->num_waiters++;
+		tds_mutex_unlock(&pool->mtx);
 	}
 }
 
@@ -541,7 +601,7 @@ static TDS_THREAD_PROC_DECLARE(end_login_proc, arg)
 
 	ev->success = pool_user_send_login_ack(pool, ev->puser);
 
-	pool_event_add(pool, &ev->common, end_login_execute);
+	pool_event_add(ev->puser->shard, &ev->common, end_login_execute);
 	return TDS_THREAD_RESULT(0);
 }
 
@@ -37,6 +37,10 @@
 
 #include <ctype.h>
 
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+
 #include "pool.h"
 #include <freetds/utils/string.h>
 #include <freetds/tds/checks.h>
@@ -57,19 +61,126 @@ dump_login(TDSLOGIN * login)
 	fprintf(stderr, "bsiz %d\n", login->block_size);
 }
 
+#if HAVE_SPLICE
+/* minimum payload size to move packets with splice */
+#define POOL_SPLICE_MIN 2048
+
+/*
+ * Check if we can forward packet payload using splice.
+ * Payload is moved from the socket to a pipe and from the pipe to the
+ * other socket without copying it to user space.
+ */
+static bool
+pool_splice_start(TDS_POOL_SOCKET *sock, unsigned int packet_len)
+{
+	TDSSOCKET *tds = sock->tds;
+
+	/* not worth for small packets, encrypted data must be decoded */
+	if (packet_len < POOL_SPLICE_MIN + 8 || tds->conn->tls_session)
+		return false;
+
+	if (!sock->has_pipe) {
+		if (pipe(sock->pipe_fds) < 0)
+			return false;
+		fcntl(sock->pipe_fds[0], F_SETFL, O_NONBLOCK);
+		fcntl(sock->pipe_fds[1], F_SETFL, O_NONBLOCK);
+		sock->has_pipe = true;
+	}
+	/* scanner must see payload unless inside a value */
+	if (sock->member && !pool_stream_skip(&pool_socket_member(sock)->stream, tds->in_buf, packet_len - 8))
+		return false;
+	sock->splice_left = packet_len - 8;
+	sock->pipe_len = 0;
+	return true;
+}
+
+void
+pool_splice_free(TDS_POOL_SOCKET *sock)
+{
+	if (!sock->has_pipe)
+		return;
+	close(sock->pipe_fds[0]);
+	close(sock->pipe_fds[1]);
+	sock->has_pipe = false;
+	sock->splice_left = 0;
+	sock->pipe_len = 0;
+}
+
+enum {
+	POOL_SPLICE_ERROR = -1,
+	POOL_SPLICE_DONE,
+	POOL_SPLICE_WAIT_SEND,
+	POOL_SPLICE_WAIT_RECV,
+};
+
+/*
+ * Move payload of current packet from a socket to the other.
+ */
+static int
+pool_splice(TDS_POOL_SOCKET *from, TDS_POOL_SOCKET *to)
+{
+	ssize_t len;
+
+	for (;;) {
+		/* empty the pipe first */
+		if (from->pipe_len) {
+			len = splice(from->pipe_fds[0], NULL, tds_get_s(to->tds), NULL, from->pipe_len,
+				     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (len < 0) {
+				int err = errno;
+				if (err == EINTR)
+					continue;
+				if (TDSSOCK_WOULDBLOCK(err))
+					return POOL_SPLICE_WAIT_SEND;
+				return POOL_SPLICE_ERROR;
+			}
+			from->pipe_len -= (uint32_t) len;
+			continue;
+		}
+		if (!from->splice_left)
+			return POOL_SPLICE_DONE;
+
+		len = splice(tds_get_s(from->tds), NULL, from->pipe_fds[1], NULL, from->splice_left,
+			     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		/* socket closed */
+		if (len == 0)
+			return POOL_SPLICE_ERROR;
+		if (len < 0) {
+			int err = errno;
+			if (err == EINTR)
+				continue;
+			if (TDSSOCK_WOULDBLOCK(err))
+				return POOL_SPLICE_WAIT_RECV;
+			return POOL_SPLICE_ERROR;
+		}
+		from->splice_left -= (uint32_t) len;
+		from->pipe_len += (uint32_t) len;
+	}
+}
+#endif
+
 /**
  * Read part of packet. Function does not block.
+ * For big packets only the header could be read, in this case the
+ * payload is moved by pool_write_data.
  * @return true if packet is not complete and we must call again,
  *         false on full packet or error.
  */
 bool
-pool_packet_read(TDSSOCKET *tds)
+pool_packet_read(TDS_POOL_SOCKET *sock)
 {
-	unsigned int packet_len;
+	TDSSOCKET *tds = sock->tds;
+	unsigned int packet_len, to_read;
 	int readed;
 
 	tdsdump_log(TDS_DBG_INFO1, "tds in_len %d in_pos %d\n", tds->in_len, tds->in_pos);
 
+#if HAVE_SPLICE
+	/* payload still to forward */
+	if (pool_splice_pending(sock))
+		return false;
+#endif
+
 	// TODO MARS
 
 	/* determine packet size */
@@ -107,15 +218,29 @@ pool_packet_read(TDSSOCKET *tds)
 				tds->recv_packet = packet;
 			}
 			CHECK_TDS_EXTRA(tds);
-			if (tds->in_len >= packet_len)
+			if (tds->in_len >= packet_len) {
+				/* follow replies of the server */
+				if (sock->member)
+					pool_stream_packet(&pool_socket_member(sock)->stream, tds->in_buf, packet_len);
+				return false;
+			}
+#if HAVE_SPLICE
+			if (tds->in_len == 8 && pool_splice_start(sock, packet_len))
 				return false;
+#endif
 		}
 
 		assert(packet_len > tds->in_len);
 		assert(packet_len <= tds->recv_packet->capacity);
 		assert(tds->in_len < tds->recv_packet->capacity);
 
-		readed = READSOCKET(tds_get_s(tds), &tds->in_buf[tds->in_len], packet_len - tds->in_len);
+		to_read = packet_len - tds->in_len;
+#if HAVE_SPLICE
+		/* read just the header of big packets */
+		if (tds->in_len < 8 && packet_len >= POOL_SPLICE_MIN + 8)
+			to_read = 8 - tds->in_len;
+#endif
+		readed = READSOCKET(tds_get_s(tds), &tds->in_buf[tds->in_len], to_read);
 		tdsdump_log(TDS_DBG_INFO1, "readed %d\n", readed);
 
 		/* socket closed */
@@ -151,7 +276,9 @@ pool_write(TDS_SYS_SOCKET sock, const void *buf, size_t len)
 		ret = WRITESOCKET(sock, p, len);
 		if (ret <= 0) {
 			int err = errno;
-			if (TDSSOCK_WOULDBLOCK(err) || err == EINTR)
+			if (ret < 0 && err == EINTR)
+				continue;
+			if (TDSSOCK_WOULDBLOCK(err))
 				break;
 			return -1;
 		}
@@ -162,14 +289,14 @@ pool_write(TDS_SYS_SOCKET sock, const void *buf, size_t len)
 }
 
 void
-pool_event_add(TDS_POOL *pool, TDS_POOL_EVENT *ev, TDS_POOL_EXECUTE execute)
+pool_event_add(TDS_POOL_SHARD *shard, TDS_POOL_EVENT *ev, TDS_POOL_EXECUTE execute)
 {
-	tds_mutex_lock(&pool->events_mtx);
+	tds_mutex_lock(&shard->events_mtx);
 	ev->execute = execute;
-	ev->next = pool->events;
-	pool->events = ev;
-	tds_mutex_unlock(&pool->events_mtx);
-	WRITESOCKET(pool->event_fd, "x", 1);
+	ev->next = shard->events;
+	shard->events = ev;
+	tds_mutex_unlock(&shard->events_mtx);
+	WRITESOCKET(shard->event_fd, "x", 1);
 }
 
 bool
@@ -193,10 +320,33 @@ pool_write_data(TDS_POOL_SOCKET *from, TDS_POOL_SOCKET *to)
 	if (tds->in_pos < tds->in_len) {
 		/* partial write, schedule a future write */
 		to->poll_send = true;
+		to->writable = false;
 		from->poll_recv = false;
-	} else {
-		to->poll_send = false;
-		from->poll_recv = true;
+		return true;
 	}
+
+#if HAVE_SPLICE
+	if (pool_splice_pending(from)) {
+		switch (pool_splice(from, to)) {
+		case POOL_SPLICE_ERROR:
+			return false;
+		case POOL_SPLICE_WAIT_SEND:
+			to->poll_send = true;
+			to->writable = false;
+			from->poll_recv = false;
+			return true;
+		case POOL_SPLICE_WAIT_RECV:
+			to->poll_send = false;
+			from->poll_recv = true;
+			from->readable = false;
+			return true;
+		}
+		/* packet forwarded, start a new one */
+		tds->in_pos = tds->in_len = 0;
+	}
+#endif
+
+	to->poll_send = false;
+	from->poll_recv = true;
 	return true;
 }
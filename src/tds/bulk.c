@@ -1465,17 +1465,33 @@ tds_bcp_start_copy_in(TDSSOCKET *tds, TDSBCPINFO *bcpinfo)
 #endif
 /** \endcond */
 
-/** Check if a circular buffer matches a string of same length. Requires length > 0.  */
-static bool
-cbuf_match(const char *cbuf, size_t cbuf_size, size_t cpos, const char *match)
+/**
+ * Make sure at least \a needed bytes are buffered, if file has enough data.
+ * Data not consumed is moved to the start of the buffer.
+ * \return number of bytes available
+ */
+static size_t
+tds_file_stream_fill(TDSFILESTREAM *stream, size_t needed)
 {
-	if (cbuf_size == 1)
-		return cbuf[0] == match[0];
-	if (cbuf_size == 2)
-		return cbuf[cpos] == match[0] && cbuf[!cpos] == match[1];
+	size_t avail = stream->inlen - stream->inpos;
+
+	if (avail >= needed)
+		return avail;
+
+	if (stream->inpos) {
+		memmove(stream->inbuf, stream->inbuf + stream->inpos, avail);
+		stream->inpos = 0;
+		stream->inlen = avail;
+	}
+	while (stream->inlen < needed) {
+		size_t readed = fread(stream->inbuf + stream->inlen, 1, TDSFILESTREAM_BLOCKSIZE - stream->inlen, stream->f);
 
-	return !memcmp(cbuf + cpos, match, cbuf_size - cpos)
-		&& !memcmp(cbuf, match + cbuf_size - cpos, cpos);
+		if (readed == 0)
+			break;
+		stream->inlen += readed;
+		stream->offset += readed;
+	}
+	return stream->inlen;
 }
 
 /**
@@ -1488,25 +1504,46 @@ static int
 tds_file_stream_read(TDSINSTREAM *stream, void *ptr, size_t len)
 {
 	TDSFILESTREAM *s = (TDSFILESTREAM *) stream;
-	char ch;
+	const size_t term_len = s->term_len;
 	char *p = (char *) ptr;
 
+	if (s->term_found || !term_len)
+		return 0;
+
 	while (len) {
-		if (cbuf_match(s->cbuf, s->term_len, s->cpos, s->terminator))
-			return p - (char *) ptr;
+		const char *start, *found;
+		size_t avail, chunk;
 
-		/* It didn't; output from the circular buffer and input a new character */
-		if (s->inpos < s->inlen)
-			ch = s->inbuf[s->inpos++];
-		else if (tds_file_stream_read_raw(s, &ch, 1) != 1)
+		avail = tds_file_stream_fill(s, term_len);
+		if (avail < term_len) {
+			/* end of file without terminator */
+			s->inpos = s->inlen;
 			return -1;
+		}
 
-		*p++ = s->cbuf[s->cpos];
-		--len;
-
-		s->cbuf[s->cpos++] = ch;
-		if (s->cpos == s->term_len)
-			s->cpos = 0;
+		/* search terminator only where it can fully fit */
+		start = s->inbuf + s->inpos;
+		chunk = avail - term_len + 1;
+		found = (const char *) memchr(start, s->terminator[0], chunk);
+		while (found && memcmp(found, s->terminator, term_len) != 0)
+			found = (const char *) memchr(found + 1, s->terminator[0], chunk - (found + 1 - start));
+		if (found)
+			chunk = found - start;
+
+		if (chunk > len) {
+			chunk = len;
+			found = NULL;
+		}
+		memcpy(p, start, chunk);
+		p += chunk;
+		len -= chunk;
+		s->inpos += chunk;
+
+		if (found) {
+			s->inpos += term_len;
+			s->term_found = true;
+			break;
+		}
 	}
 	return p - (char *) ptr;
 }
@@ -1523,7 +1560,7 @@ tds_file_stream_read_raw(TDSFILESTREAM *stream, void *ptr, size_t n)
 		/* Buffer some more data if we consumed it all */
 		if (stream->inlen == stream->inpos) {
 			stream->inpos = 0;
-			stream->inlen = fread(stream->inbuf, 1, sizeof(stream->inbuf), stream->f);
+			stream->inlen = fread(stream->inbuf, 1, TDSFILESTREAM_BLOCKSIZE, stream->f);
 			if (stream->inlen == 0)
 				break;
 			stream->offset += stream->inlen;
@@ -1585,6 +1622,12 @@ tds_file_stream_init(TDSFILESTREAM *stream, FILE *f)
 		return TDS_FAIL;
 	}
 
+	stream->inbuf = tds_new(char, TDSFILESTREAM_BLOCKSIZE);
+	if (!stream->inbuf) {
+		fclose(f);
+		return TDS_FAIL;
+	}
+
 	stream->f = f;
 	stream->stream.read = tds_file_stream_read;
 	stream->offset = offset;
@@ -1596,32 +1639,34 @@ tds_file_stream_close(TDSFILESTREAM *stream)
 {
 	int ret = stream->f ? fclose(stream->f) : 0;
 
+	free(stream->inbuf);
 	memset(stream, 0, sizeof(*stream));
 	return ret;
 }
 
-/** Sets the terminator and also performs an initial population of the circular buffer */
+/** Sets the terminator and checks there is enough data for it */
 static TDSRET
 tds_file_stream_use_terminator(TDSFILESTREAM *stream, const char *term, size_t term_len)
 {
-	size_t readed;
+	size_t avail;
 
-	if (term_len > sizeof(stream->cbuf))
+	if (term_len > TDSFILESTREAM_BLOCKSIZE)
 		return TDS_FAIL;
 
 	stream->terminator = term;
 	stream->term_len = term_len;
-	stream->cpos = 0;
+	stream->term_found = false;
 
 	if (term_len == 0)
 		return TDS_SUCCESS;
 
-	/* Have to have initial data to populate the circular buffer (if the file contains
+	/* Have to have data for at least a terminator (if the file contains
 	 * less data than the length of 1 expected terminator, it means file is corrupt)
 	 */
-	readed = tds_file_stream_read_raw(stream, stream->cbuf, term_len);
-	if (readed != term_len) {
-		if (readed == 0 && feof(stream->f))
+	avail = tds_file_stream_fill(stream, term_len);
+	if (avail < term_len) {
+		stream->inpos = stream->inlen;
+		if (avail == 0 && feof(stream->f))
 			return TDS_NO_MORE_RESULTS;
 		return TDS_FAIL;
 	}
@@ -225,6 +225,7 @@ tds_read_config_info(TDSSOCKET * tds, TDSLOGIN * login, TDSLOCALE * locale)
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "major_version", TDS_MAJOR(connection));
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "minor_version", TDS_MINOR(connection));
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "block_size", connection->block_size);
+		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "packet_cache_size", connection->packet_cache_size);
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %s\n", "language", tds_dstr_cstr(&connection->language));
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %s\n", "server_charset", tds_dstr_cstr(&connection->server_charset));
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "connect_timeout", connection->connect_timeout);
@@ -666,6 +667,11 @@ tds_parse_conf_section(const char *option, const char *value, void *param)
 	} else if (!strcmp(option, TDS_STR_TEXTSZ)) {
 		if (atoi(value) > 0)
 			login->text_size = atoi(value);
+	} else if (!strcmp(option, TDS_STR_PACKET_CACHE)) {
+		int val = atoi(value);
+
+		if (val >= 0 && val <= 4096)
+			login->packet_cache_size = val;
 	} else if (!strcmp(option, TDS_STR_CHARSET)) {
 		tdsdump_log(TDS_DBG_INFO1, "%s is %s.\n", option, value);
 		dstr_to_set = &login->server_charset;
@@ -813,6 +819,9 @@ tds_config_login(TDSLOGIN * connection, TDSLOGIN * login)
 	if (login->query_timeout)
 		connection->query_timeout = login->query_timeout;
 
+	if (login->packet_cache_size >= 0)
+		connection->packet_cache_size = login->packet_cache_size;
+
 	if (!login->check_ssl_hostname)
 		connection->check_ssl_hostname = login->check_ssl_hostname;
 
@@ -27,6 +27,7 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <locale.h>
 
 #if HAVE_ERRNO_H
 #include <errno.h>
@@ -67,6 +68,8 @@ struct tds_time
 static TDS_INT tds_convert_int(TDS_INT num, int desttype, CONV_RESULT * cr);
 static TDS_INT tds_convert_uint8(const TDS_UINT8 * src, int desttype, CONV_RESULT * cr);
 static int string_to_datetime(const char *datestr, TDS_UINT len, int desttype, CONV_RESULT * cr);
+static bool parse_iso_datetime(const char *s, const char *end, struct tds_time *t);
+static int tds_time_to_result(const struct tds_time *t, int desttype, CONV_RESULT *cr);
 static bool is_dd_mon_yyyy(char *t);
 static int store_dd_mon_yyy_date(char *datestr, struct tds_time *t);
 static const char *parse_numeric(const char *buf, const char *pend,
@@ -170,13 +173,11 @@ static const char *tds_prtype(int token);
 const char tds_hex_digits[] = "0123456789abcdef";
 
 /**
- * Copy a terminated string to result and return len or TDS_CONVERT_NOMEM
+ * Copy a terminated string of known length to result and return len or TDS_CONVERT_NOMEM
  */
 static TDS_INT
-string_to_result(int desttype, const char *s, CONV_RESULT * cr)
+string_len_to_result(int desttype, const char *s, size_t len, CONV_RESULT * cr)
 {
-	size_t len = strlen(s);
-
 	if (desttype != TDS_CONVERT_CHAR) {
 		cr->c = tds_new(TDS_CHAR, len + 1);
 		test_alloc(cr->c);
@@ -187,6 +188,15 @@ string_to_result(int desttype, const char *s, CONV_RESULT * cr)
 	return (TDS_INT)len;
 }
 
+/**
+ * Copy a terminated string to result and return len or TDS_CONVERT_NOMEM
+ */
+static TDS_INT
+string_to_result(int desttype, const char *s, CONV_RESULT * cr)
+{
+	return string_len_to_result(desttype, s, strlen(s), cr);
+}
+
 /**
  * Copy binary data to to result and return len or TDS_CONVERT_NOMEM
  */
@@ -376,6 +386,41 @@ tds_char2hex(TDS_CHAR *dest, size_t destlen, const TDS_CHAR *src, size_t srclen)
 	return (ptrdiff_t) (srclen / 2u);
 }
 
+static TDS_INT
+char_to_char(const TDS_CHAR * src, TDS_UINT srclen, int desttype, CONV_RESULT * cr)
+{
+	if (desttype == TDS_CONVERT_CHAR) {
+		memcpy(cr->cc.c, src, TDS_MIN(srclen, cr->cc.len));
+		return srclen;
+	}
+
+	cr->c = tds_new(TDS_CHAR, srclen + 1);
+	test_alloc(cr->c);
+	memcpy(cr->c, src, srclen);
+	cr->c[srclen] = 0;
+	return srclen;
+}
+
+static TDS_INT
+char_to_int4(const TDS_CHAR * src, TDS_UINT srclen, CONV_RESULT * cr)
+{
+	TDS_INT rc;
+
+	if ((rc = string_to_int(src, src + srclen, &cr->i)) < 0)
+		return rc;
+	return sizeof(TDS_INT);
+}
+
+static TDS_INT
+char_to_int8(const TDS_CHAR * src, TDS_UINT srclen, CONV_RESULT * cr)
+{
+	TDS_INT rc;
+
+	if ((rc = string_to_int8(src, src + srclen, &cr->bi)) < 0)
+		return rc;
+	return sizeof(TDS_INT8);
+}
+
 static TDS_INT
 tds_convert_char(const TDS_CHAR * src, TDS_UINT srclen, int desttype, CONV_RESULT * cr)
 {
@@ -394,15 +439,8 @@ tds_convert_char(const TDS_CHAR * src, TDS_UINT srclen, int desttype, CONV_RESUL
 
 	switch (desttype) {
 	case TDS_CONVERT_CHAR:
-		memcpy(cr->cc.c, src, TDS_MIN(srclen, cr->cc.len));
-		return srclen;
-
 	case CASE_ALL_CHAR:
-		cr->c = tds_new(TDS_CHAR, srclen + 1);
-		test_alloc(cr->c);
-		memcpy(cr->c, src, srclen);
-		cr->c[srclen] = 0;
-		return srclen;
+		return char_to_char(src, srclen, desttype, cr);
 		break;
 
 	case SYBSINT1:
@@ -439,10 +477,7 @@ tds_convert_char(const TDS_CHAR * src, TDS_UINT srclen, int desttype, CONV_RESUL
 		return sizeof(TDS_USMALLINT);
 		break;
 	case SYBINT4:
-		if ((rc = string_to_int(src, src + srclen, &tds_i)) < 0)
-			return rc;
-		cr->i = tds_i;
-		return sizeof(TDS_INT);
+		return char_to_int4(src, srclen, cr);
 		break;
 	case SYBUINT4:
 		if ((rc = string_to_int8(src, src + srclen, &tds_i8)) < 0)
@@ -453,10 +488,7 @@ tds_convert_char(const TDS_CHAR * src, TDS_UINT srclen, int desttype, CONV_RESUL
 		return sizeof(TDS_UINT);
 		break;
 	case SYBINT8:
-		if ((rc = string_to_int8(src, src + srclen, &tds_i8)) < 0)
-			return rc;
-		cr->bi = tds_i8;
-		return sizeof(TDS_INT8);
+		return char_to_int8(src, srclen, cr);
 		break;
 	case SYBUINT8:
 		if ((rc = string_to_uint8(src, src + srclen, &tds_ui8)) < 0)
@@ -757,15 +789,22 @@ tds_i32toa_fast(char out[11], int32_t v)
 }
 
 static TDS_INT
-tds_convert_int(TDS_INT num, int desttype, CONV_RESULT * cr)
+int_to_char(TDS_INT num, int desttype, CONV_RESULT * cr)
 {
 	TDS_CHAR tmp_str[16];
+	size_t len = tds_i32toa_fast(tmp_str, num);
+
+	tmp_str[len] = 0;
+	return string_len_to_result(desttype, tmp_str, len, cr);
+}
 
+static TDS_INT
+tds_convert_int(TDS_INT num, int desttype, CONV_RESULT * cr)
+{
 	switch (desttype) {
 	case TDS_CONVERT_CHAR:
 	case CASE_ALL_CHAR:
-		tmp_str[tds_i32toa_fast(tmp_str, num)] = 0;
-		return string_to_result(desttype, tmp_str, cr);
+		return int_to_char(num, desttype, cr);
 		break;
 	case SYBSINT1:
 		if (!IS_SINT1(num))
@@ -1006,6 +1045,20 @@ tds_convert_uint8(const TDS_UINT8 *src, int desttype, CONV_RESULT * cr)
 	return TDS_CONVERT_NOAVAIL;
 }
 
+static TDS_INT
+numeric_to_char(const TDS_NUMERIC *src, int desttype, CONV_RESULT *cr)
+{
+	/* if the number has precision == scale == MAXPRECISION and it's negative a "-0." is prefixed
+	 * to the digits. Also account for terminator and possible invalid out of range number. */
+	char tmpstr[MAXPRECISION + 5];
+	TDS_INT ret;
+
+	ret = tds_numeric_to_string(src, tmpstr);
+	if (ret < 0)
+		return TDS_CONVERT_FAIL;
+	return string_len_to_result(desttype, tmpstr, ret, cr);
+}
+
 static TDS_INT
 tds_convert_numeric(const TDS_NUMERIC *src, int desttype, CONV_RESULT *cr)
 {
@@ -1023,9 +1076,7 @@ tds_convert_numeric(const TDS_NUMERIC *src, int desttype, CONV_RESULT *cr)
 	switch (desttype) {
 	case TDS_CONVERT_CHAR:
 	case CASE_ALL_CHAR:
-		if (tds_numeric_to_string(src, u.tmpstr) < 0)
-			return TDS_CONVERT_FAIL;
-		return string_to_result(desttype, u.tmpstr, cr);
+		return numeric_to_char(src, desttype, cr);
 		break;
 	case SYBSINT1:
 		u.num = *src;
@@ -2051,136 +2102,325 @@ tds_convert_to_binary(int srctype, const TDS_CHAR * src, TDS_UINT srclen, int de
 	return binary_to_result(desttype, src, len, cr);
 }
 
+/*
+ * Conversion functions with TDS_CONVERT_FUNC signature, one for each
+ * source type family (and one for binary destinations).
+ * Returned by tds_get_convert_func() so callers converting many values
+ * do not have to dispatch on source type for each one.
+ */
+#define CONVERT_FUNC(name, call) \
+static TDS_INT \
+tds_convert_ ## name ## _func(const TDSCONTEXT *tds_ctx TDS_UNUSED, int srctype TDS_UNUSED, const void *src TDS_UNUSED, \
+	TDS_UINT srclen TDS_UNUSED, int desttype TDS_UNUSED, CONV_RESULT *cr TDS_UNUSED) \
+{ \
+	return call; \
+}
+
+CONVERT_FUNC(char, tds_convert_char((const TDS_CHAR *) src, srclen, desttype, cr))
+CONVERT_FUNC(money4, tds_convert_money4(tds_ctx, (const TDS_MONEY4 *) src, desttype, cr))
+CONVERT_FUNC(money, tds_convert_money(tds_ctx, (const TDS_MONEY *) src, desttype, cr))
+CONVERT_FUNC(numeric, tds_convert_numeric((const TDS_NUMERIC *) src, desttype, cr))
+CONVERT_FUNC(bit, tds_convert_bit((const TDS_CHAR *) src, desttype, cr))
+CONVERT_FUNC(int1, tds_convert_int1((const int8_t *) src, desttype, cr))
+CONVERT_FUNC(uint1, tds_convert_uint1((const TDS_TINYINT *) src, desttype, cr))
+CONVERT_FUNC(int2, tds_convert_int2((const TDS_SMALLINT *) src, desttype, cr))
+CONVERT_FUNC(uint2, tds_convert_uint2((const TDS_USMALLINT *) src, desttype, cr))
+CONVERT_FUNC(int4, tds_convert_int4((const TDS_INT *) src, desttype, cr))
+CONVERT_FUNC(uint4, tds_convert_uint4((const TDS_UINT *) src, desttype, cr))
+CONVERT_FUNC(int8, tds_convert_int8((const TDS_INT8 *) src, desttype, cr))
+CONVERT_FUNC(uint8, tds_convert_uint8((const TDS_UINT8 *) src, desttype, cr))
+CONVERT_FUNC(real, tds_convert_real((const TDS_REAL *) src, desttype, cr))
+CONVERT_FUNC(flt8, tds_convert_flt8((const TDS_FLOAT *) src, desttype, cr))
+CONVERT_FUNC(datetimeall, tds_convert_datetimeall(tds_ctx, srctype, (const TDS_DATETIMEALL *) src, desttype, cr))
+CONVERT_FUNC(datetime, tds_convert_datetime(tds_ctx, (const TDS_DATETIME *) src, desttype, 3, cr))
+CONVERT_FUNC(datetime4, tds_convert_datetime4(tds_ctx, (const TDS_DATETIME4 *) src, desttype, cr))
+CONVERT_FUNC(time, tds_convert_time(tds_ctx, (const TDS_TIME *) src, desttype, cr))
+CONVERT_FUNC(date, tds_convert_date(tds_ctx, (const TDS_DATE *) src, desttype, cr))
+CONVERT_FUNC(bigtime, tds_convert_bigtime(tds_ctx, (const TDS_BIGTIME *) src, desttype, cr))
+CONVERT_FUNC(bigdatetime, tds_convert_bigdatetime(tds_ctx, (const TDS_BIGDATETIME *) src, desttype, cr))
+CONVERT_FUNC(binary, tds_convert_binary((const TDS_UCHAR *) src, srclen, desttype, cr))
+CONVERT_FUNC(unique, tds_convert_unique(src, desttype, cr))
+CONVERT_FUNC(to_binary, tds_convert_to_binary(srctype, src, srclen, desttype, cr))
+CONVERT_FUNC(noavail, TDS_CONVERT_NOAVAIL)
+
+/*
+ * Functions for common source/destination pairs, no dispatch at all.
+ */
+#define INT_CONVERT_FUNCS(name, type) \
+CONVERT_FUNC(name ## _char, int_to_char(*(const type *) src, desttype, cr)) \
+CONVERT_FUNC(name ## _int4, (cr->i = *(const type *) src, (TDS_INT) sizeof(TDS_INT))) \
+CONVERT_FUNC(name ## _int8, (cr->bi = *(const type *) src, (TDS_INT) sizeof(TDS_INT8))) \
+CONVERT_FUNC(name ## _flt8, (cr->f = *(const type *) src, (TDS_INT) sizeof(TDS_FLOAT)))
+
+INT_CONVERT_FUNCS(int1, int8_t)
+INT_CONVERT_FUNCS(uint1, TDS_TINYINT)
+INT_CONVERT_FUNCS(int2, TDS_SMALLINT)
+INT_CONVERT_FUNCS(uint2, TDS_USMALLINT)
+INT_CONVERT_FUNCS(int4, TDS_INT)
+
+#undef INT_CONVERT_FUNCS
+
+CONVERT_FUNC(int8_int8, (memcpy(&cr->bi, src, sizeof(TDS_INT8)), (TDS_INT) sizeof(TDS_INT8)))
+CONVERT_FUNC(flt8_flt8, (memcpy(&cr->f, src, sizeof(TDS_FLOAT)), (TDS_INT) sizeof(TDS_FLOAT)))
+CONVERT_FUNC(real_real, (cr->r = *(const TDS_REAL *) src, (TDS_INT) sizeof(TDS_REAL)))
+CONVERT_FUNC(real_flt8, (cr->f = *(const TDS_REAL *) src, (TDS_INT) sizeof(TDS_FLOAT)))
+CONVERT_FUNC(char_char, char_to_char((const TDS_CHAR *) src, srclen, desttype, cr))
+CONVERT_FUNC(char_int4, char_to_int4((const TDS_CHAR *) src, srclen, cr))
+CONVERT_FUNC(char_int8, char_to_int8((const TDS_CHAR *) src, srclen, cr))
+CONVERT_FUNC(char_flt8, string_to_float((const TDS_CHAR *) src, srclen, desttype, cr))
+CONVERT_FUNC(numeric_char, numeric_to_char((const TDS_NUMERIC *) src, desttype, cr))
+
+#undef CONVERT_FUNC
+
+#define INT_PAIR(dest) \
+		case SYBSINT1: \
+			return tds_convert_int1_ ## dest ## _func; \
+		case SYBINT1: \
+		case SYBUINT1: \
+			return tds_convert_uint1_ ## dest ## _func; \
+		case SYBINT2: \
+			return tds_convert_int2_ ## dest ## _func; \
+		case SYBUINT2: \
+			return tds_convert_uint2_ ## dest ## _func; \
+		case SYBINT4: \
+			return tds_convert_int4_ ## dest ## _func
+
 /**
- * tds_convert
- * converts a type to another.
- * @p srctype and @p desttype should be SYB* TDS types, or, in case of @p desttype you can use
- * TDS_CONVERT_CHAR/TDS_CONVERT_BINARY. Nullable types are not supported, use tds_get_conversion_type
- * to get a not-nullable type.
- *
- * If you convert to SYBDECIMAL/SYBNUMERIC you MUST initialize precision and scale of cr->n.
- *
- * In case of fixed type you can pass directly the pointer to the value.
- *
- * Do not expect strings to be zero terminated. Databases support zero inside
- * string. Using strlen may result on data loss or even a segmentation fault.
- * Instead, use memcpy to copy destination using length returned.
- *
- * This function does not handle NULL, @p srclen should be >0.  Client libraries handle NULLs each in their own way.
- * @param tds_ctx  context (used in conversion to data and to return messages)
+ * Return a function for common source/destination pairs.
+ * @return conversion function or NULL if there's no specific function
+ */
+static TDS_CONVERT_FUNC
+tds_get_convert_pair_func(int srctype, int desttype)
+{
+	switch (desttype) {
+	case TDS_CONVERT_CHAR:
+	case CASE_ALL_CHAR:
+		switch (srctype) {
+		INT_PAIR(char);
+		case CASE_ALL_CHAR:
+			return tds_convert_char_char_func;
+		case SYBNUMERIC:
+		case SYBDECIMAL:
+			return tds_convert_numeric_char_func;
+		}
+		break;
+	case SYBINT4:
+		switch (srctype) {
+		INT_PAIR(int4);
+		case CASE_ALL_CHAR:
+			return tds_convert_char_int4_func;
+		}
+		break;
+	case SYBINT8:
+		switch (srctype) {
+		INT_PAIR(int8);
+		case SYBINT8:
+			return tds_convert_int8_int8_func;
+		case CASE_ALL_CHAR:
+			return tds_convert_char_int8_func;
+		}
+		break;
+	case SYBFLT8:
+		switch (srctype) {
+		INT_PAIR(flt8);
+		case SYBFLT8:
+			return tds_convert_flt8_flt8_func;
+		case SYBREAL:
+			return tds_convert_real_flt8_func;
+		case CASE_ALL_CHAR:
+			return tds_convert_char_flt8_func;
+		}
+		break;
+	case SYBREAL:
+		if (srctype == SYBREAL)
+			return tds_convert_real_real_func;
+		break;
+	}
+	return NULL;
+}
+
+#undef INT_PAIR
+
+/**
+ * Resolve the conversion from a source type to a destination type.
+ * The function returned can be called for all values of these types,
+ * avoiding the dispatch done by tds_convert() each time. Common pairs
+ * have a specific function, others use the function for the source
+ * type. Conversions not available return TDS_CONVERT_NOAVAIL when called.
+ * Destination can also be TDS_CONVERT_CHAR/TDS_CONVERT_BINARY, the function
+ * returned for a character (binary) type can be used for
+ * TDS_CONVERT_CHAR (TDS_CONVERT_BINARY) too.
  * @param srctype  type of source
- * @param src      pointer to source data to convert
- * @param srclen   length in bytes of source (not counting terminator or strings)
  * @param desttype type of destination
- * @param cr       structure to hold result
- * @return length of result or TDS_CONVERT_* failure code on failure. All TDS_CONVERT_* error constants are <0.
+ * @return conversion function, never NULL
  */
-TDS_INT
-tds_convert(const TDSCONTEXT *tds_ctx, int srctype, const void *src, TDS_UINT srclen, int desttype, CONV_RESULT *cr)
+TDS_CONVERT_FUNC
+tds_get_convert_func(int srctype, int desttype)
 {
-	TDS_INT length = 0;
+	TDS_CONVERT_FUNC func = tds_get_convert_pair_func(srctype, desttype);
 
-	assert(srclen >= 0 && srclen <= 2147483647u);
-
-	if (srctype == SYBVARIANT) {
-		const TDSVARIANT *v = (const TDSVARIANT*) src;
-		srctype = v->type;
-		src = v->data;
-		srclen = v->data_len;
-	}
+	if (func)
+		return func;
 
 	switch (desttype) {
 	case CASE_ALL_BINARY:
-		return tds_convert_to_binary(srctype, src, srclen, desttype, cr);
+		/* source type of variants is known only converting */
+		if (srctype == SYBVARIANT)
+			break;
+		return tds_convert_to_binary_func;
 	}
 
 	switch (srctype) {
+	case SYBVARIANT:
+		return tds_convert;
 	case CASE_ALL_CHAR:
-		length = tds_convert_char(src, srclen, desttype, cr);
-		break;
+		return tds_convert_char_func;
 	case SYBMONEY4:
-		length = tds_convert_money4(tds_ctx, (const TDS_MONEY4 *) src, desttype, cr);
-		break;
+		return tds_convert_money4_func;
 	case SYBMONEY:
-		length = tds_convert_money(tds_ctx, (const TDS_MONEY *) src, desttype, cr);
-		break;
+		return tds_convert_money_func;
 	case SYBNUMERIC:
 	case SYBDECIMAL:
-		length = tds_convert_numeric((const TDS_NUMERIC *) src, desttype, cr);
-		break;
+		return tds_convert_numeric_func;
 	case SYBBIT:
 	case SYBBITN:
-		length = tds_convert_bit(src, desttype, cr);
-		break;
+		return tds_convert_bit_func;
 	case SYBSINT1:
-		length = tds_convert_int1((const int8_t *) src, desttype, cr);
-		break;
+		return tds_convert_int1_func;
 	case SYBINT1:
 	case SYBUINT1:
-		length = tds_convert_uint1((const TDS_TINYINT *) src, desttype, cr);
-		break;
+		return tds_convert_uint1_func;
 	case SYBINT2:
-		length = tds_convert_int2((const TDS_SMALLINT *) src, desttype, cr);
-		break;
+		return tds_convert_int2_func;
 	case SYBUINT2:
-		length = tds_convert_uint2((const TDS_USMALLINT *) src, desttype, cr);
-		break;
+		return tds_convert_uint2_func;
 	case SYBINT4:
-		length = tds_convert_int4((const TDS_INT *) src, desttype, cr);
-		break;
+		return tds_convert_int4_func;
 	case SYBUINT4:
-		length = tds_convert_uint4((const TDS_UINT *) src, desttype, cr);
-		break;
+		return tds_convert_uint4_func;
 	case SYBINT8:
-		length = tds_convert_int8((const TDS_INT8 *) src, desttype, cr);
-		break;
+		return tds_convert_int8_func;
 	case SYBUINT8:
-		length = tds_convert_uint8((const TDS_UINT8 *) src, desttype, cr);
-		break;
+		return tds_convert_uint8_func;
 	case SYBREAL:
-		length = tds_convert_real((const TDS_REAL *) src, desttype, cr);
-		break;
+		return tds_convert_real_func;
 	case SYBFLT8:
-		length = tds_convert_flt8((const TDS_FLOAT *) src, desttype, cr);
-		break;
+		return tds_convert_flt8_func;
 	case SYBMSTIME:
 	case SYBMSDATE:
 	case SYBMSDATETIME2:
 	case SYBMSDATETIMEOFFSET:
-		length = tds_convert_datetimeall(tds_ctx, srctype, (const TDS_DATETIMEALL *) src, desttype, cr);
-		break;
+		return tds_convert_datetimeall_func;
 	case SYBDATETIME:
-		length = tds_convert_datetime(tds_ctx, (const TDS_DATETIME* ) src, desttype, 3, cr);
-		break;
+		return tds_convert_datetime_func;
 	case SYBDATETIME4:
-		length = tds_convert_datetime4(tds_ctx, (const TDS_DATETIME4* ) src, desttype, cr);
-		break;
+		return tds_convert_datetime4_func;
 	case SYBTIME:
-		length = tds_convert_time(tds_ctx, (const TDS_TIME *) src, desttype, cr);
-		break;
+		return tds_convert_time_func;
 	case SYBDATE:
-		length = tds_convert_date(tds_ctx, (const TDS_DATE *) src, desttype, cr);
-		break;
+		return tds_convert_date_func;
 	case SYB5BIGTIME:
-		length = tds_convert_bigtime(tds_ctx, (const TDS_BIGTIME *) src, desttype, cr);
-		break;
+		return tds_convert_bigtime_func;
 	case SYB5BIGDATETIME:
-		length = tds_convert_bigdatetime(tds_ctx, (const TDS_BIGDATETIME *) src, desttype, cr);
-		break;
+		return tds_convert_bigdatetime_func;
 	case CASE_ALL_BINARY:
-		length = tds_convert_binary((const TDS_UCHAR *) src, srclen, desttype, cr);
-		break;
+		return tds_convert_binary_func;
 	case SYBUNIQUE:
-		length = tds_convert_unique(src, desttype, cr);
-		break;
+		return tds_convert_unique_func;
 	case SYBNVARCHAR:
 	case SYBNTEXT:
 	case SYBMSTABLE:
 	default:
-		length = TDS_CONVERT_NOAVAIL;
 		break;
 	}
+	return tds_convert_noavail_func;
+}
+
+/**
+ * tds_convert
+ * converts a type to another.
+ * @p srctype and @p desttype should be SYB* TDS types, or, in case of @p desttype you can use
+ * TDS_CONVERT_CHAR/TDS_CONVERT_BINARY. Nullable types are not supported, use tds_get_conversion_type
+ * to get a not-nullable type.
+ *
+ * If you convert to SYBDECIMAL/SYBNUMERIC you MUST initialize precision and scale of cr->n.
+ *
+ * In case of fixed type you can pass directly the pointer to the value.
+ *
+ * Do not expect strings to be zero terminated. Databases support zero inside
+ * string. Using strlen may result on data loss or even a segmentation fault.
+ * Instead, use memcpy to copy destination using length returned.
+ *
+ * This function does not handle NULL, @p srclen should be >0.  Client libraries handle NULLs each in their own way.
+ * @param tds_ctx  context (used in conversion to data and to return messages)
+ * @param srctype  type of source
+ * @param src      pointer to source data to convert
+ * @param srclen   length in bytes of source (not counting terminator or strings)
+ * @param desttype type of destination
+ * @param cr       structure to hold result
+ * @return length of result or TDS_CONVERT_* failure code on failure. All TDS_CONVERT_* error constants are <0.
+ */
+TDS_INT
+tds_convert(const TDSCONTEXT *tds_ctx, int srctype, const void *src, TDS_UINT srclen, int desttype, CONV_RESULT *cr)
+{
+	assert(srclen >= 0 && srclen <= 2147483647u);
+
+	if (srctype == SYBVARIANT) {
+		const TDSVARIANT *v = (const TDSVARIANT*) src;
+		srctype = v->type;
+		src = v->data;
+		srclen = v->data_len;
+		/* a variant cannot contain another variant */
+		if (srctype == SYBVARIANT)
+			return TDS_CONVERT_NOAVAIL;
+	}
+
+	return tds_get_convert_func(srctype, desttype)(tds_ctx, srctype, src, srclen, desttype, cr);
+}
+
+/**
+ * Convert a type to a character or binary type writing result directly
+ * into a buffer provided by the caller. No memory is allocated.
+ * Output is not zero terminated and no more than @p destlen bytes are written.
+ * @param tds_ctx   context (used in conversion to data and to return messages)
+ * @param srctype   type of source
+ * @param src       pointer to source data to convert
+ * @param srclen    length in bytes of source (not counting terminator or strings)
+ * @param desttype  type of destination, must be a character or binary type
+ * @param dest      buffer to hold result
+ * @param destlen   size of @p dest in bytes
+ * @param truncated if not NULL set to true if result was truncated, false otherwise
+ * @return full length of result (can be bigger than @p destlen) or TDS_CONVERT_* failure code
+ */
+TDS_INT
+tds_convert_to_buffer(const TDSCONTEXT *tds_ctx, int srctype, const void *src, TDS_UINT srclen,
+		      int desttype, void *dest, TDS_UINT destlen, bool *truncated)
+{
+	CONV_RESULT cr;
+	TDS_INT length;
+
+	if (truncated)
+		*truncated = false;
+
+	switch (desttype) {
+	case CASE_ALL_CHAR:
+	case TDS_CONVERT_CHAR:
+		desttype = TDS_CONVERT_CHAR;
+		cr.cc.c = (TDS_CHAR *) dest;
+		cr.cc.len = destlen;
+		break;
+	case CASE_ALL_BINARY:
+		desttype = TDS_CONVERT_BINARY;
+		cr.cb.ib = (TDS_CHAR *) dest;
+		cr.cb.len = destlen;
+		break;
+	default:
+		return TDS_CONVERT_NOAVAIL;
+	}
 
+	length = tds_convert(tds_ctx, srctype, src, srclen, desttype, &cr);
+	if (truncated && length > 0 && (TDS_UINT) length > destlen)
+		*truncated = true;
 	return length;
 }
 
@@ -2203,15 +2443,15 @@ string_to_datetime(const char *instr, TDS_UINT len, int desttype, CONV_RESULT *
 
 	struct tds_time t;
 
-	unsigned int dt_time;
-	TDS_INT dt_days;
-	int i;
-
 	enum states current_state;
 
 	memset(&t, '\0', sizeof(t));
 	t.tm_mday = 1;
 
+	/* most dates come in ISO/ODBC canonical format, avoid heuristics */
+	if (parse_iso_datetime(instr, instr + len, &t))
+		return tds_time_to_result(&t, desttype, cr);
+
 	in = tds_strndup(instr, len);
 	test_alloc(in);
 
@@ -2402,40 +2642,138 @@ string_to_datetime(const char *instr, TDS_UINT len, int desttype, CONV_RESULT *
 		tok = strtok_r(NULL, " ,", &lasts);
 	}
 
-	i = (t.tm_mon - 13) / 12;
-	dt_days = 1461 * (t.tm_year + 1900 + i) / 4 +
-		(367 * (t.tm_mon - 1 - 12 * i)) / 12 - (3 * ((t.tm_year + 2000 + i) / 100)) / 4 + t.tm_mday - 693932;
+	free(in);
 
+	return tds_time_to_result(&t, desttype, cr);
+
+string_garbled:
+	tdsdump_log(TDS_DBG_INFO1,
+		    "error_handler:  Attempt to convert data stopped by syntax error in source field \n");
 	free(in);
+	return TDS_CONVERT_SYNTAX;
+}
+
+/**
+ * Parse date in ISO 8601/ODBC canonical format.
+ * Accepted format is "YYYY-MM-DD[{ |T}hh:mm[:ss[.fffffffff]]]" with optional
+ * surrounding spaces. Any other string (or out of range values) are left to
+ * the generic parser.
+ * @return true if string was parsed
+ */
+static bool
+parse_iso_datetime(const char *s, const char *end, struct tds_time *t)
+{
+#define DIGIT(n) ((unsigned) (s[n] - '0') < 10u)
+#define NUM2(n) ((s[n] - '0') * 10 + (s[(n)+1] - '0'))
+	unsigned int year, month, mday, hour = 0, minute = 0, second = 0, ns = 0;
+
+	while (s < end && *s == ' ')
+		++s;
+	while (s < end && end[-1] == ' ')
+		--end;
+
+	if (end - s < 10 || !DIGIT(0) || !DIGIT(1) || !DIGIT(2) || !DIGIT(3) || s[4] != '-'
+	    || !DIGIT(5) || !DIGIT(6) || s[7] != '-' || !DIGIT(8) || !DIGIT(9))
+		return false;
+	year = NUM2(0) * 100 + NUM2(2);
+	month = NUM2(5);
+	mday = NUM2(8);
+	if (year < 1753 || month < 1 || month > 12 || mday < 1 || mday > 31)
+		return false;
+	s += 10;
+
+	if (s < end) {
+		if (*s == 'T') {
+			++s;
+		} else if (*s == ' ') {
+			while (*++s == ' ')
+				continue;
+		} else {
+			return false;
+		}
+		if (end - s < 5 || !DIGIT(0) || !DIGIT(1) || s[2] != ':' || !DIGIT(3) || !DIGIT(4))
+			return false;
+		hour = NUM2(0);
+		minute = NUM2(3);
+		s += 5;
+		if (s < end) {
+			if (end - s < 3 || s[0] != ':' || !DIGIT(1) || !DIGIT(2))
+				return false;
+			second = NUM2(1);
+			s += 3;
+		}
+		if (s < end) {
+			unsigned int ns_mul = 1000000000u;
+
+			if (*s++ != '.' || s == end || end - s > 9)
+				return false;
+			for (; s < end; ++s) {
+				if (!DIGIT(0))
+					return false;
+				ns = ns * 10u + (s[0] - '0');
+				ns_mul /= 10u;
+			}
+			ns *= ns_mul;
+		}
+		if (hour > 23 || minute > 59 || second > 59)
+			return false;
+	}
+
+	t->tm_year = year - 1900;
+	t->tm_mon = month - 1;
+	t->tm_mday = mday;
+	t->tm_hour = hour;
+	t->tm_min = minute;
+	t->tm_sec = second;
+	t->tm_ns = ns;
+	return true;
+#undef NUM2
+#undef DIGIT
+}
+
+/**
+ * Convert a parsed date to the requested date/time type.
+ * @return size of destination type
+ */
+static int
+tds_time_to_result(const struct tds_time *t, int desttype, CONV_RESULT *cr)
+{
+	unsigned int dt_time;
+	TDS_INT dt_days;
+	int i;
+
+	i = (t->tm_mon - 13) / 12;
+	dt_days = 1461 * (t->tm_year + 1900 + i) / 4 +
+		(367 * (t->tm_mon - 1 - 12 * i)) / 12 - (3 * ((t->tm_year + 2000 + i) / 100)) / 4 + t->tm_mday - 693932;
 
 	if (desttype == SYBDATE) {
 		cr->date = dt_days;
 		return sizeof(TDS_DATE);
 	}
-	dt_time = t.tm_hour * 60 + t.tm_min;
+	dt_time = t->tm_hour * 60 + t->tm_min;
 	/* TODO check for overflow */
 	if (desttype == SYBDATETIME4) {
 		cr->dt4.days = dt_days;
 		cr->dt4.minutes = dt_time;
 		return sizeof(TDS_DATETIME4);
 	}
-	dt_time = dt_time * 60 + t.tm_sec;
+	dt_time = dt_time * 60 + t->tm_sec;
 	if (desttype == SYBDATETIME) {
 		cr->dt.dtdays = dt_days;
-		cr->dt.dttime = dt_time * 300 + (t.tm_ns / 1000000u * 300 + 150) / 1000;
+		cr->dt.dttime = dt_time * 300 + (t->tm_ns / 1000000u * 300 + 150) / 1000;
 		return sizeof(TDS_DATETIME);
 	}
 	if (desttype == SYBTIME) {
-		cr->time = dt_time * 300 + (t.tm_ns / 1000000u * 300 + 150) / 1000;
+		cr->time = dt_time * 300 + (t->tm_ns / 1000000u * 300 + 150) / 1000;
 		return sizeof(TDS_TIME);
 	}
 	if (desttype == SYB5BIGTIME) {
-		cr->bigtime = dt_time * UINT64_C(1000000) + t.tm_ns / 1000u;
+		cr->bigtime = dt_time * UINT64_C(1000000) + t->tm_ns / 1000u;
 		return sizeof(TDS_BIGTIME);
 	}
 	if (desttype == SYB5BIGDATETIME) {
 		cr->bigdatetime = (dt_days + BIGDATETIME_BIAS) * (UINT64_C(86400) * 1000000u)
-				  + dt_time * UINT64_C(1000000) + t.tm_ns / 1000u;
+				  + dt_time * UINT64_C(1000000) + t->tm_ns / 1000u;
 		return sizeof(TDS_BIGDATETIME);
 	}
 
@@ -2445,14 +2783,8 @@ string_to_datetime(const char *instr, TDS_UINT len, int desttype, CONV_RESULT *
 	cr->dta.date = dt_days;
 	cr->dta.has_time = 1;
 	cr->dta.time_prec = 7; /* TODO correct value */
-	cr->dta.time = dt_time * UINT64_C(10000000) + t.tm_ns / 100u;
+	cr->dta.time = dt_time * UINT64_C(10000000) + t->tm_ns / 100u;
 	return sizeof(TDS_DATETIMEALL);
-
-string_garbled:
-	tdsdump_log(TDS_DBG_INFO1,
-		    "error_handler:  Attempt to convert data stopped by syntax error in source field \n");
-	free(in);
-	return TDS_CONVERT_SYNTAX;
 }
 
 static int
@@ -2464,12 +2796,13 @@ stringz_to_numeric(const char *instr, CONV_RESULT * cr)
 static int
 string_to_numeric(const char *instr, const char *pend, CONV_RESULT * cr)
 {
-	char mynumber[(MAXPRECISION + 7) / 8 * 8 + 8];
+	char mynumber[MAXPRECISION];
 
-	/* num packaged 8 digit, see below for detail */
-	TDS_UINT packed_num[(MAXPRECISION + 7) / 8];
+	/* number as 32 bit limbs, least significant first */
+	TDS_UINT limbs[(sizeof(cr->n.array) - 1 + 3) / 4];
+	int n_limbs;
 
-	char *ptr;
+	char *ptr, *end;
 
 	int i = 0;
 	int j = 0;
@@ -2494,25 +2827,15 @@ string_to_numeric(const char *instr, const char *pend, CONV_RESULT * cr)
 
 	cr->n.array[0] = negative ? 1 : 0;
 
-	/* translate a number like 000ddddd.ffff to 00000000dddddffff00 */
-
-	/* 
-	 * Having disposed of any sign and leading blanks, 
-	 * vet the digit string, counting places before and after 
-	 * the decimal point.  Dispense with trailing blanks, if any.  
-	 */
-
-	ptr = mynumber;
-	for (i = 0; i < 8; ++i)
-		*ptr++ = '0';
+	/* translate a number like 000ddddd.ffff to dddddffff00 */
 
 	/* too many digits, error */
 	if (cr->n.precision - cr->n.scale < digits)
 		return TDS_CONVERT_OVERFLOW;
 
 	/* copy digits before the dot */
-	memcpy(ptr, instr, digits);
-	ptr += digits;
+	memcpy(mynumber, instr, digits);
+	ptr = mynumber + digits;
 	instr += digits + 1;
 
 	/* copy digits after the dot */
@@ -2522,61 +2845,49 @@ string_to_numeric(const char *instr, const char *pend, CONV_RESULT * cr)
 
 	/* fill up decimal digits */
 	memset(ptr + decimals, '0', cr->n.scale - decimals);
-	ptr += cr->n.scale;
+	end = ptr + cr->n.scale;
 
 	/*
-	 * Packaged number explanation: 
-	 * We package 8 decimal digits in one number.  
-	 * Because 10^8 = 5^8 * 2^8 = 5^8 * 256, dividing 10^8 by 256 leaves no remainder.
-	 * We can thus split it into bytes in an optimized way.
+	 * Convert to 32 bit limbs (least significant first) taking
+	 * 9 decimal digits at a time, number = number * 10^9 + digits.
+	 * First chunk takes the digits left over.
 	 */
+	n_limbs = 0;
+	for (ptr = mynumber; ptr != end;) {
+		int chunk_len = (int) ((end - ptr) % 9u);
+		TDS_UINT chunk = 0, mult = 1;
+		uint64_t carry;
+
+		if (!chunk_len)
+			chunk_len = 9;
+		for (i = 0; i < chunk_len; ++i) {
+			chunk = chunk * 10u + (*ptr++ - '0');
+			mult *= 10u;
+		}
 
-	/* transform to packaged one */
-	j = -1;
-	ptr -= 8;
-	do {
-		TDS_UINT n = *ptr++;
-
-		for (i = 1; i < 8; ++i)
-			n = n * 10u + *ptr++;
-		/* fix packet number and store */
-		packed_num[++j] = n - ((TDS_UINT) '0' * 11111111lu);
-		ptr -= 16;
-	} while (ptr > mynumber);
+		carry = chunk;
+		for (i = 0; i < n_limbs; ++i) {
+			carry += (uint64_t) limbs[i] * mult;
+			limbs[i] = (TDS_UINT) carry;
+			carry >>= 32;
+		}
+		if (carry)
+			limbs[n_limbs++] = (TDS_UINT) carry;
+	}
 
+	/*
+	 * Store limbs as big endian bytes at the end of the array.
+	 * Precision was checked so the number fits in the bytes.
+	 */
 	memset(cr->n.array + 1, 0, sizeof(cr->n.array) - 1);
 	bytes = tds_numeric_bytes_per_prec[cr->n.precision];
-	while (j > 0 && !packed_num[j])
-		--j;
-
-	for (;;) {
-		bool is_zero = true;
-		TDS_UINT carry = 0;
-		i = j;
-		if (!packed_num[j])
-			--j;
-		do {
-			TDS_UINT tmp = packed_num[i];
-			if (tmp)
-				is_zero = false;
-
-			/* divide for 256 for find another byte */
-			/*
-			 * carry * (25u*25u*25u*25u) = carry * 10^8 / 256u
-			 * using unsigned number is just an optimization
-			 * compiler can translate division to a shift and remainder 
-			 * to a binary AND
-			 */
-			packed_num[i] = carry * (25u * 25u * 25u * 25u) + tmp / 256u;
-			carry = tmp % 256u;
-		} while(--i >= 0);
-		if (is_zero)
-			break;
-		/*
-		 * source number is limited to 38 decimal digit
-		 * 10^39-1 < 2^128 (16 byte) so this cannot make an overflow
-		 */
-		cr->n.array[--bytes] = carry;
+	for (i = 0; i < n_limbs; ++i) {
+		TDS_UINT limb = limbs[i];
+
+		for (j = 0; j < 4 && bytes > 1; ++j) {
+			cr->n.array[--bytes] = (unsigned char) limb;
+			limb >>= 8;
+		}
 	}
 	return sizeof(TDS_NUMERIC);
 }
@@ -3167,6 +3478,154 @@ two_digit(char *out, int num)
 		out[0] = ' ';
 }
 
+/**
+ * Format a date directly, without calling strftime(3).
+ * Handle only conversions not depending on locale (%b and %p only for "C" locale)
+ * which are the ones used by default formats.
+ * @return length of string, 0 if buffer is too small, (size_t) -1 if format
+ *         requires strftime(3)
+ */
+static size_t
+tds_strftime_direct(char *buf, size_t maxsize, const char *format, const TDSDATEREC * dr, int prec)
+{
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	char *p = buf;
+	const char *const end = buf + maxsize;
+	const char *fmt;
+	bool z_found = false;
+	int c_locale = -1;
+
+	for (fmt = format; *fmt; ++fmt) {
+		char tmp[12];
+		const char *out = tmp;
+		size_t len = 2;
+		bool is_num = true;
+		int num = 0;
+
+		/* terminator space is checked at the end, a '.' could be removed by %z */
+		if (*fmt != '%') {
+			if (p >= end)
+				return 0;
+			*p++ = *fmt;
+			continue;
+		}
+
+		switch (*++fmt) {
+		case 0:
+			/* not terminated format, output a '%' */
+			--fmt;
+			/* fall thru */
+		case '%':
+			out = "%";
+			len = 1;
+			is_num = false;
+			break;
+		case 'Y':
+			if (dr->year < 1000 || dr->year > 9999)
+				return (size_t) -1;
+			len = tds_u32toa_fast(tmp, dr->year);
+			is_num = false;
+			break;
+		case 'y':
+			if (dr->year < 0)
+				return (size_t) -1;
+			num = dr->year % 100;
+			break;
+		case 'm':
+			num = dr->month + 1;
+			break;
+		case 'd':
+			num = dr->day;
+			break;
+		case 'H':
+			num = dr->hour;
+			break;
+		case 'M':
+			num = dr->minute;
+			break;
+		case 'S':
+			num = dr->second;
+			break;
+		case 'I':
+			if (dr->hour < 0)
+				return (size_t) -1;
+			num = (dr->hour + 11u) % 12u + 1;
+			break;
+		case 'e':
+			two_digit(tmp, dr->day);
+			is_num = false;
+			break;
+		case 'l':
+			two_digit(tmp, (dr->hour + 11u) % 12u + 1);
+			is_num = false;
+			break;
+		case 'b':
+		case 'p':
+			if (c_locale < 0) {
+				const char *locale = setlocale(LC_TIME, NULL);
+
+				c_locale = locale && (strcmp(locale, "C") == 0 || strcmp(locale, "POSIX") == 0);
+			}
+			if (!c_locale)
+				return (size_t) -1;
+			is_num = false;
+			if (*fmt == 'p') {
+				out = dr->hour > 11 ? "PM" : "AM";
+				break;
+			}
+			if (dr->month < 0 || dr->month > 11)
+				return (size_t) -1;
+			out = months + dr->month * 3;
+			len = 3;
+			break;
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			if (fmt[1] != 'z')
+				return (size_t) -1;
+			prec = *fmt++ - '0';
+			/* fall thru */
+		case 'z':
+			/* following %z are passed to strftime(3) */
+			if (z_found)
+				return (size_t) -1;
+			z_found = true;
+			if (!prec && p > buf && p[-1] == '.') {
+				--p;
+				continue;
+			}
+			memset(tmp, '0', 10);
+			tds_u32toa_fast_right(tmp, dr->decimicrosecond & 0x7fffffff);
+			out = tmp + 3;
+			len = prec;
+			is_num = false;
+			break;
+		default:
+			return (size_t) -1;
+		}
+
+		if (is_num) {
+			if (num < 0 || num > 99)
+				return (size_t) -1;
+			tds02dfast(tmp, num);
+		}
+		if ((size_t) (end - p) < len)
+			return 0;
+		memcpy(p, out, len);
+		p += len;
+	}
+	if (p >= end)
+		return 0;
+	*p = 0;
+	return p - buf;
+}
+
 /**
  * format a date string according to an "extended" strftime(3) formatting definition.
  * @param buf     output buffer
@@ -3193,6 +3652,10 @@ tds_strftime(char *buf, size_t maxsize, const char *format, const TDSDATEREC * d
 	if (prec < 0 || prec > 7)
 		prec = 3;
 
+	length = tds_strftime_direct(buf, maxsize, format, dr, prec);
+	if (length != (size_t) -1)
+		return length;
+
 	tm.tm_sec = dr->second;
 	tm.tm_min = dr->minute;
 	tm.tm_hour = dr->hour;
@@ -1721,6 +1721,156 @@ tds_get_column_funcs(TDSCONNECTION *conn, int type)
 	}
 	return &tds_generic_funcs;
 }
+
+/**
+ * Choose how a column should be decoded by tds_process_rows_batch().
+ * Only generic types without conversion or padding can be read
+ * directly from wire, others use their get_data function.
+ * \param conn connection results come from
+ * \param col  column to check
+ */
+TDS_ROW_BATCH_KIND
+tds_get_row_batch_kind(TDSCONNECTION * conn, const TDSCOLUMN * col)
+{
+	if (is_blob_col(col))
+		return TDS_BATCH_BLOB;
+	if (col->funcs != &tds_generic_funcs)
+		return TDS_BATCH_DIRECT;
+	if (conn->use_iconv_in && col->char_conv)
+		return TDS_BATCH_DIRECT;
+
+	/* these types are padded, see tds_generic_get */
+	switch (col->column_type) {
+	case SYBLONGBINARY:
+	case SYBCHAR:
+	case XSYBCHAR:
+	case SYBBINARY:
+	case XSYBBINARY:
+		return TDS_BATCH_DIRECT;
+	default:
+		break;
+	}
+
+	switch (col->column_varint_size) {
+	case 0:
+		if (col->column_size != tds_get_size_by_type(col->column_type))
+			break;
+		return TDS_BATCH_FIXED;
+	case 1:
+	case 2:
+		return TDS_BATCH_VARLEN;
+	}
+	return TDS_BATCH_DIRECT;
+}
+
+/**
+ * Check if column can refer to data inside packet.
+ * Non character data must be properly aligned.
+ */
+static bool
+tds_column_view_usable(const TDSCOLUMN *curcol, const unsigned char *data, int colsize)
+{
+	int type = tds_get_conversion_type(curcol->column_type, curcol->column_size);
+	unsigned align;
+
+	if (is_char_type(type) || is_binary_type(type))
+		return true;
+#ifdef WORDS_BIGENDIAN
+	/* data must be swapped */
+	return false;
+#else
+	align = colsize < 8 ? colsize : 8;
+	return (align & (align - 1)) == 0 && ((TDS_UINTPTR) data & (align - 1)) == 0;
+#endif
+}
+
+/**
+ * Read a column of a row letting column_data point directly to the
+ * received packet instead of copying data into the row buffer.
+ * Data are valid till next row is read (or results are freed); column_data
+ * is restored calling tds_release_column_views.
+ * Columns which require conversions or data not contained in current
+ * packet are read using get_data.
+ * \tds
+ * \param curcol column to read
+ */
+TDSRET
+tds_get_column_view(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	int colsize, discard_len = 0;
+	unsigned char *data;
+
+	switch (tds_get_row_batch_kind(tds->conn, curcol)) {
+	case TDS_BATCH_FIXED:
+		colsize = curcol->column_size;
+		break;
+	case TDS_BATCH_VARLEN:
+		if (curcol->column_varint_size == 2) {
+			colsize = tds_get_smallint(tds);
+		} else {
+			colsize = tds_get_byte(tds);
+			if (colsize == 0)
+				colsize = -1;
+		}
+		break;
+	default:
+		return curcol->funcs->get_data(tds, curcol);
+	}
+	if (IS_TDSDEAD(tds))
+		return TDS_FAIL;
+
+	if (colsize < 0) {
+		curcol->column_cur_size = -1;
+		return TDS_SUCCESS;
+	}
+
+	/* see tds_generic_get */
+	if (colsize > curcol->column_size) {
+		discard_len = colsize - curcol->column_size;
+		colsize = curcol->column_size;
+	}
+
+	data = tds->in_buf + tds->in_pos;
+	if (tds->in_len - tds->in_pos >= (unsigned) colsize
+	    && tds_column_view_usable(curcol, data, colsize)) {
+		curcol->column_data_saved = curcol->column_data;
+		curcol->column_data = data;
+		tds->in_pos += colsize;
+		tds->recv_packet_pinned = true;
+	} else if (!tds_get_n(tds, curcol->column_data, colsize)) {
+		return TDS_FAIL;
+	}
+	if (discard_len > 0)
+		tds_get_n(tds, NULL, discard_len);
+	curcol->column_cur_size = colsize;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Copy data of columns pointing into received packets back to
+ * row buffer, so results can be used after packets are released.
+ * \param info results to fix, can be NULL
+ */
+void
+tds_copy_column_views(TDSRESULTINFO * info)
+{
+	TDSCOLUMN *curcol;
+	unsigned int i;
+
+	if (!info)
+		return;
+
+	for (i = 0; i < info->num_cols; i++) {
+		curcol = info->columns[i];
+		if (!curcol->column_data_saved)
+			continue;
+		if (curcol->column_cur_size > 0)
+			memcpy(curcol->column_data_saved, curcol->column_data, curcol->column_cur_size);
+		curcol->column_data = curcol->column_data_saved;
+		curcol->column_data_saved = NULL;
+	}
+}
+
 #include "tds_types.h"
 
 #ifdef WORDS_BIGENDIAN
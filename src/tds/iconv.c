@@ -44,6 +44,15 @@
 #include <iconv.h>
 #endif
 
+/* vector instructions for built-in conversions */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TDS_ICONV_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define TDS_ICONV_NEON 1
+#endif
+
 #define CHARSIZE(charset) ( ((charset)->min_bytes_per_char == (charset)->max_bytes_per_char )? \
 				(charset)->min_bytes_per_char : 0 )
 
@@ -51,8 +60,10 @@
 static int collate2charset(TDSCONNECTION * conn, const TDS_UCHAR collate[5]);
 static size_t skip_one_input_sequence(iconv_t cd, const TDS_ENCODING * charset, const char **input, size_t * input_size);
 static bool tds_iconv_info_init(TDSICONV * char_conv, int client_canonic, int server_canonic);
+static bool tds_iconv_builtin_charset(int canonic);
 static bool tds_iconv_init(void);
-static void _iconv_close(iconv_t * cd);
+static iconv_t tds_iconv_cache_open(int to_canonic, int from_canonic);
+static void tds_iconv_cache_close(iconv_t * cd, int to_canonic, int from_canonic);
 static void tds_iconv_info_close(TDSICONV * char_conv);
 
 
@@ -472,6 +483,8 @@ tds_iconv_info_init(TDSICONV * char_conv, int client_canonical, int server_canon
 	}
 
 	char_conv->flags = 0;
+	if (tds_iconv_builtin_charset(client_canonical) && tds_iconv_builtin_charset(server_canonical))
+		char_conv->flags = TDS_ENCODING_BUILTIN;
 
 	/* get iconv names */
 	if (!iconv_names[client_canonical]) {
@@ -488,12 +501,12 @@ tds_iconv_info_init(TDSICONV * char_conv, int client_canonical, int server_canon
 		}
 	}
 
-	char_conv->to.cd = tds_sys_iconv_open(iconv_names[server_canonical], iconv_names[client_canonical]);
+	char_conv->to.cd = tds_iconv_cache_open(server_canonical, client_canonical);
 	if (char_conv->to.cd == (iconv_t) -1) {
 		tdsdump_log(TDS_DBG_FUNC, "tds_iconv_info_init: cannot convert \"%s\"->\"%s\"\n", client->name, server->name);
 	}
 
-	char_conv->from.cd = tds_sys_iconv_open(iconv_names[client_canonical], iconv_names[server_canonical]);
+	char_conv->from.cd = tds_iconv_cache_open(client_canonical, server_canonical);
 	if (char_conv->from.cd == (iconv_t) -1) {
 		tdsdump_log(TDS_DBG_FUNC, "tds_iconv_info_init: cannot convert \"%s\"->\"%s\"\n", server->name, client->name);
 	}
@@ -506,11 +519,91 @@ tds_iconv_info_init(TDSICONV * char_conv, int client_canonical, int server_canon
 }
 
 
+/*
+ * Process wide cache of idle iconv descriptors.
+ * Opening a descriptor is quite expensive and every connection needs a few of
+ * them, so descriptors of closed connections are kept for next connections.
+ * Descriptors contain shift state so they are never shared at the same time,
+ * only reused after being reset.
+ */
+typedef struct tds_iconv_cache_entry
+{
+	struct tds_iconv_cache_entry *next;
+	iconv_t cd;
+	short to_canonic, from_canonic;
+} TDS_ICONV_CACHE_ENTRY;
+
+/* maximum number of idle descriptors kept */
+#define ICONV_CACHE_MAX 64
+
+static tds_mutex iconv_cache_mutex = TDS_MUTEX_INITIALIZER;
+static TDS_ICONV_CACHE_ENTRY *iconv_cache;
+static unsigned int iconv_cache_count;
+
+/**
+ * Get a descriptor to convert from \a from_canonic to \a to_canonic,
+ * from cache if available.
+ */
+static iconv_t
+tds_iconv_cache_open(int to_canonic, int from_canonic)
+{
+	TDS_ICONV_CACHE_ENTRY *entry, **prev;
+	iconv_t cd;
+
+	tds_mutex_lock(&iconv_cache_mutex);
+	for (prev = &iconv_cache; (entry = *prev) != NULL; prev = &entry->next) {
+		if (entry->to_canonic == to_canonic && entry->from_canonic == from_canonic) {
+			*prev = entry->next;
+			--iconv_cache_count;
+			break;
+		}
+	}
+	tds_mutex_unlock(&iconv_cache_mutex);
+
+	if (entry) {
+		cd = entry->cd;
+		free(entry);
+		return cd;
+	}
+
+	return tds_sys_iconv_open(iconv_names[to_canonic], iconv_names[from_canonic]);
+}
+
+/**
+ * Release a descriptor got from tds_iconv_cache_open(), keeping it for reuse
+ * if possible.
+ */
 static void
-_iconv_close(iconv_t * cd)
+tds_iconv_cache_close(iconv_t * cd, int to_canonic, int from_canonic)
 {
 	static const iconv_t invalid = (iconv_t) -1;
+	TDS_ICONV_CACHE_ENTRY *entry;
+
+	if (*cd == invalid)
+		return;
+
+	/* reset shift state */
+	tds_sys_iconv(*cd, NULL, NULL, NULL, NULL);
+
+	entry = tds_new(TDS_ICONV_CACHE_ENTRY, 1);
+	if (entry) {
+		entry->cd = *cd;
+		entry->to_canonic = to_canonic;
+		entry->from_canonic = from_canonic;
+
+		tds_mutex_lock(&iconv_cache_mutex);
+		if (iconv_cache_count < ICONV_CACHE_MAX) {
+			entry->next = iconv_cache;
+			iconv_cache = entry;
+			++iconv_cache_count;
+			entry = NULL;
+			*cd = invalid;
+		}
+		tds_mutex_unlock(&iconv_cache_mutex);
+		free(entry);
+	}
 
+	/* cache full or out of memory */
 	if (*cd != invalid) {
 		tds_sys_iconv_close(*cd);
 		*cd = invalid;
@@ -520,8 +613,8 @@ _iconv_close(iconv_t * cd)
 static void
 tds_iconv_info_close(TDSICONV * char_conv)
 {
-	_iconv_close(&char_conv->to.cd);
-	_iconv_close(&char_conv->from.cd);
+	tds_iconv_cache_close(&char_conv->to.cd, char_conv->to.charset.canonic, char_conv->from.charset.canonic);
+	tds_iconv_cache_close(&char_conv->from.cd, char_conv->from.charset.canonic, char_conv->to.charset.canonic);
 }
 
 void
@@ -558,6 +651,347 @@ tds_iconv_err(TDSSOCKET *tds, int err)
 		tdserror(tds_get_ctx(tds), tds, err, 0);
 }
 
+/*
+ * Built-in converters between UTF-16LE/UCS-2LE, UTF-8, ISO-8859-1 and CP1252.
+ * These are the conversions used for almost every string exchanged with a
+ * TDS 7 server so we avoid calling iconv(3) for them.
+ * The converters stop at the first sequence they cannot handle (invalid,
+ * incomplete or not representable) and let iconv(3) deal with the rest,
+ * so error handling is the same.
+ */
+
+/* CP1252 characters in range 0x80-0x9f, 0 for undefined */
+static const uint16_t cp1252_80[32] = {
+	0x20ac, 0x0000, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+	0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x0000, 0x017d, 0x0000,
+	0x0000, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+	0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x0000, 0x017e, 0x0178,
+};
+
+static bool
+tds_iconv_builtin_charset(int canonic)
+{
+	switch (canonic) {
+	case TDS_CHARSET_ISO_8859_1:
+	case TDS_CHARSET_CP1252:
+	case TDS_CHARSET_UTF_8:
+	case TDS_CHARSET_UCS_2LE:
+	case TDS_CHARSET_UTF_16LE:
+		return true;
+	}
+	return false;
+}
+
+static inline bool
+tds_iconv_is_wide(int canonic)
+{
+	return canonic == TDS_CHARSET_UCS_2LE || canonic == TDS_CHARSET_UTF_16LE;
+}
+
+/**
+ * Copy bytes from \a in to \a out while they are ASCII.
+ * \return number of bytes copied
+ */
+static size_t
+tds_iconv_copy_ascii(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t i = 0;
+
+#if TDS_ICONV_SSE2
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+
+		if (_mm_movemask_epi8(v))
+			break;
+		_mm_storeu_si128((__m128i *) (out + i), v);
+	}
+#elif TDS_ICONV_NEON
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(in + i);
+
+		if (vmaxvq_u8(v) >= 0x80)
+			break;
+		vst1q_u8(out + i, v);
+	}
+#endif
+	for (; i < len && in[i] < 0x80; ++i)
+		out[i] = in[i];
+	return i;
+}
+
+/**
+ * Convert 16 bit little endian units to bytes while units are not above \a max
+ * (0x7f or 0xff).
+ * \return number of units converted
+ */
+static size_t
+tds_iconv_narrow(const uint8_t *in, size_t len, uint8_t *out, unsigned max)
+{
+	size_t i = 0;
+
+#if TDS_ICONV_SSE2
+	const __m128i mask = _mm_set1_epi16((short) (0xffff ^ max));
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 8 <= len; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i * 2));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask), zero)) != 0xffff)
+			break;
+		_mm_storel_epi64((__m128i *) (out + i), _mm_packus_epi16(v, v));
+	}
+#elif TDS_ICONV_NEON
+	for (; i + 8 <= len; i += 8) {
+		uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(in + i * 2));
+
+		if (vmaxvq_u16(v) > max)
+			break;
+		vst1_u8(out + i, vmovn_u16(v));
+	}
+#endif
+	for (; i < len && in[i * 2 + 1] == 0 && in[i * 2] <= max; ++i)
+		out[i] = in[i * 2];
+	return i;
+}
+
+/**
+ * Convert bytes to 16 bit little endian units while bytes are ASCII
+ * (or any byte if \a all is set).
+ * \return number of bytes converted
+ */
+static size_t
+tds_iconv_widen(const uint8_t *in, size_t len, uint8_t *out, bool all)
+{
+	size_t i = 0;
+	const unsigned max = all ? 0xff : 0x7f;
+
+#if TDS_ICONV_SSE2
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+
+		if (!all && _mm_movemask_epi8(v))
+			break;
+		_mm_storeu_si128((__m128i *) (out + i * 2), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *) (out + i * 2 + 16), _mm_unpackhi_epi8(v, zero));
+	}
+#elif TDS_ICONV_NEON
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(in + i);
+
+		if (!all && vmaxvq_u8(v) >= 0x80)
+			break;
+		vst1q_u8(out + i * 2, vreinterpretq_u8_u16(vmovl_u8(vget_low_u8(v))));
+		vst1q_u8(out + i * 2 + 16, vreinterpretq_u8_u16(vmovl_u8(vget_high_u8(v))));
+	}
+#endif
+	for (; i < len && in[i] <= max; ++i) {
+		out[i * 2] = in[i];
+		out[i * 2 + 1] = 0;
+	}
+	return i;
+}
+
+/**
+ * Decode a single character.
+ * \return bytes used or 0 if the sequence must be handled by iconv
+ */
+static size_t
+tds_iconv_decode(int canonic, const uint8_t *in, size_t len, uint32_t *cp)
+{
+	uint32_t c = in[0], c2;
+
+	switch (canonic) {
+	case TDS_CHARSET_ISO_8859_1:
+		*cp = c;
+		return 1;
+	case TDS_CHARSET_CP1252:
+		if (c >= 0x80 && c < 0xa0 && !(c = cp1252_80[c - 0x80]))
+			return 0;
+		*cp = c;
+		return 1;
+	case TDS_CHARSET_UTF_8:
+		if (c < 0x80) {
+			*cp = c;
+			return 1;
+		}
+		if (c < 0xc2 || c >= 0xf5)
+			return 0;
+		if (c < 0xe0) {
+			if (len < 2 || (in[1] & 0xc0) != 0x80)
+				return 0;
+			*cp = ((c & 0x1f) << 6) | (in[1] & 0x3f);
+			return 2;
+		}
+		if (c < 0xf0) {
+			if (len < 3 || (in[1] & 0xc0) != 0x80 || (in[2] & 0xc0) != 0x80)
+				return 0;
+			c = ((c & 0x0f) << 12) | ((in[1] & 0x3f) << 6) | (in[2] & 0x3f);
+			if (c < 0x800 || (c >= 0xd800 && c < 0xe000))
+				return 0;
+			*cp = c;
+			return 3;
+		}
+		if (len < 4 || (in[1] & 0xc0) != 0x80 || (in[2] & 0xc0) != 0x80 || (in[3] & 0xc0) != 0x80)
+			return 0;
+		c = ((c & 0x07) << 18) | ((in[1] & 0x3f) << 12) | ((in[2] & 0x3f) << 6) | (in[3] & 0x3f);
+		if (c < 0x10000 || c > 0x10ffff)
+			return 0;
+		*cp = c;
+		return 4;
+	case TDS_CHARSET_UCS_2LE:
+	case TDS_CHARSET_UTF_16LE:
+		if (len < 2)
+			return 0;
+		c = TDS_GET_UA2LE(in);
+		if (c < 0xd800 || c >= 0xe000) {
+			*cp = c;
+			return 2;
+		}
+		/* surrogates, only valid as pair in UTF-16 */
+		if (canonic == TDS_CHARSET_UCS_2LE || c >= 0xdc00 || len < 4)
+			return 0;
+		c2 = TDS_GET_UA2LE(in + 2);
+		if (c2 < 0xdc00 || c2 >= 0xe000)
+			return 0;
+		*cp = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+		return 4;
+	}
+	return 0;
+}
+
+/**
+ * Encode a single character.
+ * \return bytes written or 0 if not representable or no space left
+ */
+static size_t
+tds_iconv_encode(int canonic, uint32_t cp, uint8_t *out, size_t len)
+{
+	unsigned n;
+
+	if (!len)
+		return 0;
+
+	switch (canonic) {
+	case TDS_CHARSET_ISO_8859_1:
+		if (cp >= 0x100)
+			return 0;
+		out[0] = (uint8_t) cp;
+		return 1;
+	case TDS_CHARSET_CP1252:
+		if (cp < 0x80 || (cp >= 0xa0 && cp < 0x100)) {
+			out[0] = (uint8_t) cp;
+			return 1;
+		}
+		for (n = 0; n < TDS_VECTOR_SIZE(cp1252_80); ++n) {
+			if (cp1252_80[n] == cp) {
+				out[0] = (uint8_t) (0x80 + n);
+				return 1;
+			}
+		}
+		return 0;
+	case TDS_CHARSET_UTF_8:
+		if (cp < 0x80) {
+			out[0] = (uint8_t) cp;
+			return 1;
+		}
+		if (cp < 0x800) {
+			if (len < 2)
+				return 0;
+			out[0] = (uint8_t) (0xc0 | (cp >> 6));
+			out[1] = (uint8_t) (0x80 | (cp & 0x3f));
+			return 2;
+		}
+		if (cp < 0x10000) {
+			if (len < 3)
+				return 0;
+			out[0] = (uint8_t) (0xe0 | (cp >> 12));
+			out[1] = (uint8_t) (0x80 | ((cp >> 6) & 0x3f));
+			out[2] = (uint8_t) (0x80 | (cp & 0x3f));
+			return 3;
+		}
+		if (len < 4)
+			return 0;
+		out[0] = (uint8_t) (0xf0 | (cp >> 18));
+		out[1] = (uint8_t) (0x80 | ((cp >> 12) & 0x3f));
+		out[2] = (uint8_t) (0x80 | ((cp >> 6) & 0x3f));
+		out[3] = (uint8_t) (0x80 | (cp & 0x3f));
+		return 4;
+	case TDS_CHARSET_UCS_2LE:
+	case TDS_CHARSET_UTF_16LE:
+		if (cp < 0x10000) {
+			if (len < 2)
+				return 0;
+			TDS_PUT_UA2LE(out, cp);
+			return 2;
+		}
+		if (canonic == TDS_CHARSET_UCS_2LE || len < 4)
+			return 0;
+		cp -= 0x10000;
+		TDS_PUT_UA2LE(out, 0xd800 + (cp >> 10));
+		TDS_PUT_UA2LE(out + 2, 0xdc00 + (cp & 0x3ff));
+		return 4;
+	}
+	return 0;
+}
+
+/**
+ * Convert using built-in converters.
+ * Same parameters as iconv(3); stops at the first character which
+ * cannot be converted or when output is full, never fails.
+ */
+static void
+tds_iconv_builtin(const TDSICONVDIR *from, const TDSICONVDIR *to,
+		  const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft)
+{
+	const int from_canonic = from->charset.canonic, to_canonic = to->charset.canonic;
+	const bool from_wide = tds_iconv_is_wide(from_canonic), to_wide = tds_iconv_is_wide(to_canonic);
+	const uint8_t *in = (const uint8_t *) *inbuf;
+	const uint8_t *const in_end = in + *inbytesleft;
+	uint8_t *out = (uint8_t *) *outbuf;
+	uint8_t *const out_end = out + *outbytesleft;
+	size_t n, used;
+	uint32_t cp;
+
+	for (;;) {
+		/* run of characters with trivial mapping */
+		if (from_wide && !to_wide) {
+			n = TDS_MIN((size_t) (in_end - in) / 2u, (size_t) (out_end - out));
+			n = tds_iconv_narrow(in, n, out, to_canonic == TDS_CHARSET_ISO_8859_1 ? 0xff : 0x7f);
+			in += n * 2;
+			out += n;
+		} else if (!from_wide && to_wide) {
+			n = TDS_MIN((size_t) (in_end - in), (size_t) (out_end - out) / 2u);
+			n = tds_iconv_widen(in, n, out, from_canonic == TDS_CHARSET_ISO_8859_1);
+			in += n;
+			out += n * 2;
+		} else if (!from_wide && !to_wide) {
+			n = TDS_MIN((size_t) (in_end - in), (size_t) (out_end - out));
+			n = tds_iconv_copy_ascii(in, n, out);
+			in += n;
+			out += n;
+		}
+		if (in >= in_end)
+			break;
+
+		/* single character */
+		used = tds_iconv_decode(from_canonic, in, in_end - in, &cp);
+		if (!used)
+			break;
+		n = tds_iconv_encode(to_canonic, cp, out, out_end - out);
+		if (!n)
+			break;
+		in += used;
+		out += n;
+	}
+
+	*inbytesleft -= (const char *) in - *inbuf;
+	*inbuf = (const char *) in;
+	*outbytesleft -= (char *) out - *outbuf;
+	*outbuf = (char *) out;
+}
+
 /** 
  * Wrapper around iconv(3).  Same parameters, with slightly different behavior.
  * \param tds state information for the socket and the TDS protocol
@@ -650,6 +1084,15 @@ tds_iconv(TDSSOCKET * tds, TDSICONV * conv, TDS_ICONV_DIRECTION io,
 		return conv_errno ? (size_t) -1 : 0;
 	}
 
+	/* common conversions, iconv(3) is used only for what's left */
+	if (conv->flags & TDS_ENCODING_BUILTIN) {
+		tds_iconv_builtin(from, to, inbuf, inbytesleft, outbuf, outbytesleft);
+		if (*inbytesleft == 0) {
+			errno = 0;
+			return 0;
+		}
+	}
+
 	/*
 	 * Call iconv() as many times as necessary, until we reach the end of input or exhaust output.  
 	 */
@@ -698,7 +1141,7 @@ tds_iconv(TDSSOCKET * tds, TDSICONV * conv, TDS_ICONV_DIRECTION io,
 		 * do not convert singlebyte <-> singlebyte.
 		 */
 		if (error_cd == invalid) {
-			error_cd = tds_sys_iconv_open(to->charset.name, iconv_names[POS_UTF8]);
+			error_cd = tds_iconv_cache_open(to->charset.canonic, POS_UTF8);
 			if (error_cd == invalid) {
 				break;	/* what to do? */
 			}
@@ -749,9 +1192,7 @@ tds_iconv(TDSSOCKET * tds, TDSICONV * conv, TDS_ICONV_DIRECTION io,
 		break;
 	}
 
-	if (error_cd != invalid) {
-		tds_sys_iconv_close(error_cd);
-	}
+	tds_iconv_cache_close(&error_cd, to->charset.canonic, POS_UTF8);
 
 	errno = conv_errno;
 	return irreversible;
@@ -563,6 +563,7 @@ tds_alloc_row(TDSRESULTINFO * res_info)
 		col = res_info->columns[i];
 
 		col->column_data = ptr + row_size;
+		col->column_data_saved = NULL;
 
 		row_size += col->funcs->row_len(col);
 		row_size += (TDS_ALIGN_SIZE - 1);
@@ -578,6 +579,73 @@ tds_alloc_compute_row(TDSCOMPUTEINFO * res_info)
 	return tds_alloc_row(res_info);
 }
 
+/**
+ * Allocate a batch to decode up to \a max_rows rows of \a res_info.
+ * Decoding method of every column is decided here, so batch should
+ * be allocated again if result metadata change.
+ * \param conn     connection results come from
+ * \param res_info results to decode
+ * \param max_rows maximum number of rows in a single batch
+ * \return allocated batch or NULL on failure
+ */
+TDSROWBATCH *
+tds_alloc_row_batch(TDSCONNECTION * conn, TDSRESULTINFO * res_info, TDS_UINT max_rows)
+{
+	TDSROWBATCH *batch;
+	TDSROWBATCHCOLUMN *bcol;
+	TDS_USMALLINT i;
+
+	if (!res_info || !res_info->num_cols || !max_rows)
+		return NULL;
+
+	TEST_MALLOC(batch, TDSROWBATCH);
+	batch->info = res_info;
+	++res_info->ref_count;
+	batch->max_rows = max_rows;
+	TEST_CALLOC(batch->columns, TDSROWBATCHCOLUMN, res_info->num_cols);
+	batch->num_cols = res_info->num_cols;
+
+	for (i = 0; i < res_info->num_cols; ++i) {
+		bcol = &batch->columns[i];
+		bcol->column = res_info->columns[i];
+		bcol->kind = tds_get_row_batch_kind(conn, bcol->column);
+		if (bcol->kind == TDS_BATCH_BLOB)
+			bcol->stride = sizeof(size_t);
+		else
+			bcol->stride = bcol->column->funcs->row_len(bcol->column);
+		bcol->stride += (TDS_ALIGN_SIZE - 1);
+		bcol->stride -= bcol->stride % TDS_ALIGN_SIZE;
+
+		TEST_CALLOC(bcol->data, unsigned char, (size_t) bcol->stride * max_rows);
+		TEST_CALLOC(bcol->lengths, TDS_INT, max_rows);
+	}
+	return batch;
+
+      Cleanup:
+	tds_free_row_batch(batch);
+	return NULL;
+}
+
+void
+tds_free_row_batch(TDSROWBATCH * batch)
+{
+	TDS_USMALLINT i;
+
+	if (!batch)
+		return;
+
+	if (batch->columns) {
+		for (i = 0; i < batch->num_cols; ++i) {
+			free(batch->columns[i].data);
+			free(batch->columns[i].lengths);
+			free(batch->columns[i].heap);
+		}
+		free(batch->columns);
+	}
+	tds_free_results(batch->info);
+	free(batch);
+}
+
 void
 tds_free_param_results(TDSPARAMINFO * param_info)
 {
@@ -664,6 +732,16 @@ void
 tds_free_all_results(TDSSOCKET * tds)
 {
 	tdsdump_log(TDS_DBG_FUNC, "tds_free_all_results()\n");
+	/*
+	 * results referenced elsewhere (cursors, dynamics, row batches)
+	 * must not point into packets released below
+	 */
+	tds_copy_column_views(tds->current_results);
+	tds_copy_column_views(tds->res_info);
+	if (tds->cur_cursor)
+		tds_copy_column_views(tds->cur_cursor->res_info);
+	if (tds->cur_dyn)
+		tds_copy_column_views(tds->cur_dyn->res_info);
 	tds_detach_results(tds->res_info);
 	tds_free_results(tds->res_info);
 	tds->res_info = NULL;
@@ -671,6 +749,7 @@ tds_free_all_results(TDSSOCKET * tds)
 	tds_free_param_results(tds->param_info);
 	tds->param_info = NULL;
 	tds_free_compute_results(tds);
+	tds_release_pinned_packets(tds);
 	tds->has_status = false;
 	tds->in_row = false;
 	tds->ret_status = 0;
@@ -988,6 +1067,7 @@ tds_alloc_login(bool use_environment)
 	login->check_ssl_hostname = 1;
 	login->use_utf16 = 1;
 	login->bulk_copy = 1;
+	login->packet_cache_size = -1;
 	tds_dstr_init(&login->server_name);
 	tds_dstr_init(&login->language);
 	tds_dstr_init(&login->server_charset);
@@ -1118,6 +1198,8 @@ tds_free_packets(TDSPACKET *packet)
 static void
 tds_deinit_connection(TDSCONNECTION *conn)
 {
+	unsigned i;
+
 	if (conn->authentication)
 		conn->authentication->free(conn, conn->authentication);
 	conn->authentication = NULL;
@@ -1129,11 +1211,16 @@ tds_deinit_connection(TDSCONNECTION *conn)
 	/* close connection and free inactive sockets */
 	tds_connection_close(conn);
 	tds_wakeup_close(&conn->wakeup);
+	tds_query_cache_free(conn);
 	tds_iconv_free(conn);
 	free(conn->product_name);
 	free(conn->server);
 	tds_free_env(conn);
-	tds_free_packets(conn->packet_cache);
+	tdsdump_log(TDS_DBG_INFO1, "packet cache: %lu hits, %lu misses, %lu discarded\n",
+		    conn->packet_cache_stats.hits, conn->packet_cache_stats.misses,
+		    conn->packet_cache_stats.discarded);
+	for (i = 0; i < TDS_PACKET_CACHE_CLASSES; ++i)
+		tds_free_packets(conn->packet_cache[i]);
 	tds_mutex_free(&conn->list_mtx);
 #if ENABLE_ODBC_MARS
 	tds_free_packets(conn->packets);
@@ -1152,6 +1239,7 @@ tds_init_connection(TDSCONNECTION *conn, TDSCONTEXT *context, unsigned int bufsi
 	conn->tds_ctx = context;
 	conn->ncharsize = 1;
 	conn->unicharsize = 1;
+	conn->max_cached_packets = TDS_DEF_PACKET_CACHE;
 
 	if (tds_wakeup_init(&conn->wakeup))
 		goto Cleanup;
@@ -1451,6 +1539,9 @@ tds_free_socket(TDSSOCKET * tds)
 
 	tds_connection_remove_socket(tds->conn, tds);
 	tds_free_packets(tds->recv_packet);
+	tds_free_packets(tds->pinned_packets);
+	tds_free_packets(tds->ahead_packets);
+	tds_free_packets(tds->ahead_packet);
 	if (tds->frozen_packets)
 		tds_free_packets(tds->frozen_packets);
 	else
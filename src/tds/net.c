@@ -700,6 +700,57 @@ tds_select(TDSSOCKET * tds, unsigned tds_sel, int timeout_seconds)
 	return 0;
 }
 
+/**
+ * Wait until any of some sockets is ready or the timeout expires.
+ * Dead sockets and sockets with data buffered by TLS are reported as
+ * ready without waiting.
+ * \param sockets     sockets to check
+ * \param tds_sels    for each socket TDSSELREAD and/or TDSSELWRITE
+ * \param num         number of sockets
+ * \param timeout_ms  timeout in milliseconds, negative to wait forever
+ * \return index of a ready socket, -1 on timeout, -2 on error
+ */
+int
+tds_select_any(TDSSOCKET ** sockets, const unsigned *tds_sels, unsigned num, int timeout_ms)
+{
+	struct pollfd *fds;
+	unsigned n;
+	int rc;
+
+	for (n = 0; n < num; ++n) {
+		TDSSOCKET *tds = sockets[n];
+
+		if (IS_TDSDEAD(tds))
+			return n;
+		if ((tds_sels[n] & TDSSELREAD) && tds->conn->tls_session && tds_ssl_pending(tds->conn))
+			return n;
+	}
+
+	fds = tds_new(struct pollfd, num);
+	if (!fds)
+		return -2;
+	for (n = 0; n < num; ++n) {
+		fds[n].fd = tds_get_s(sockets[n]);
+		fds[n].events = tds_sels[n];
+		fds[n].revents = 0;
+	}
+
+	do {
+		rc = poll(fds, num, timeout_ms < 0 ? -1 : timeout_ms);
+	} while (rc < 0 && sock_errno == TDSSOCK_EINTR);
+
+	if (rc > 0) {
+		for (n = 0; n < num; ++n)
+			if (fds[n].revents)
+				break;
+		rc = n;
+	} else {
+		rc = rc ? -2 : -1;
+	}
+	free(fds);
+	return rc;
+}
+
 /**
  * Read from an OS socket
  * @TODO remove tds, save error somewhere, report error in another way
@@ -900,6 +951,17 @@ tds_check_cancel(TDSCONNECTION *conn)
 }
 #endif
 
+/**
+ * Read data already received from server, without waiting.
+ * Data buffered by TLS are not considered, socket is read directly.
+ * \return bytes read, 0 if no data are available, -1 on error
+ */
+ptrdiff_t
+tds_read_nowait(TDSSOCKET * tds, unsigned char *buf, size_t buflen)
+{
+	return tds_socket_read(tds->conn, tds, buf, buflen);
+}
+
 /**
  * Loops until we have received some characters
  * return -1 on failure
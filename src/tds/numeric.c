@@ -86,28 +86,40 @@ tds_money_to_string(TDS_INT8 money, char *s, bool use_2_digits)
 }
 
 /**
- * @return <0 if error
+ * Put 9 digits (with leading zeroes) before p.
+ * @return new start of digits
+ */
+static inline char *
+tds_numeric_put_chunk(char *p, uint32_t chunk)
+{
+	size_t pad = tds_u32toa_fast_right(p - 10, chunk);
+
+	memset(p - 9, '0', pad - 1);
+	return p - 9;
+}
+
+/**
+ * Format a numeric into a caller buffer.
+ * Buffer must have space for at least MAXPRECISION + 4 characters
+ * (sign, leading "0.", digits and terminator).
+ * @return length of string written (excluding terminator), <0 if error
  */
 TDS_INT
 tds_numeric_to_string(const TDS_NUMERIC * numeric, char *s)
 {
 	const unsigned char *number;
 
-	unsigned int packet[sizeof(numeric->array) / 2];
-	unsigned int *pnum, *packet_start;
-	unsigned int *const packet_end = packet + TDS_VECTOR_SIZE(packet);
-
-	unsigned int packet10k[(MAXPRECISION + 3) / 4];
-	unsigned int *p;
+	/* number as 32 bit limbs, least significant first */
+	uint32_t limbs[(sizeof(numeric->array) - 1 + 3) / 4];
+	unsigned int n_limbs;
 
-	int num_bytes;
-	unsigned int remainder, n, i, m;
+	/* digits are written backward, 9 for each limb, plus some space for padding */
+	char digits[(TDS_VECTOR_SIZE(limbs) + 2) * 9];
+	char *const digits_end = digits + sizeof(digits);
+	char *p;
 
-	/* a bit of debug */
-#if ENABLE_EXTRA_CHECKS
-	memset(packet, 0x55, sizeof(packet));
-	memset(packet10k, 0x55, sizeof(packet10k));
-#endif
+	char *const start = s;
+	unsigned int num_bytes, num_digits, scale, i;
 
 	if (numeric->precision < 1 || numeric->precision > MAXPRECISION || numeric->scale > numeric->precision)
 		return TDS_CONVERT_FAIL;
@@ -116,81 +128,86 @@ tds_numeric_to_string(const TDS_NUMERIC * numeric, char *s)
 	if (numeric->array[0] == 1)
 		*s++ = '-';
 
-	/* put number in a 16bit array */
-	number = numeric->array;
-	num_bytes = tds_numeric_bytes_per_prec[numeric->precision];
+	/* put number in a 32bit array */
+	number = numeric->array + 1;
+	num_bytes = tds_numeric_bytes_per_prec[numeric->precision] - 1;
 
-	n = num_bytes - 1;
-	pnum = packet_end;
-	for (; n > 1; n -= 2)
-		*--pnum = TDS_GET_UA2BE(&number[n - 1]);
-	if (n == 1)
-		*--pnum = number[n];
+	n_limbs = 0;
+	for (; num_bytes >= 4; num_bytes -= 4)
+		limbs[n_limbs++] = TDS_GET_UA4BE(number + num_bytes - 4);
+	if (num_bytes) {
+		uint32_t limb = 0;
+
+		for (i = 0; i < num_bytes; ++i)
+			limb = (limb << 8) | number[i];
+		limbs[n_limbs++] = limb;
+	}
 	/* remove leading zeroes */
-	while (!*pnum) {
-		++pnum;
-		/* we consumed all numbers, it's a zero */
-		if (pnum == packet_end) {
-			*s++ = '0';
-			if (numeric->scale) {
-				*s++ = '.';
-				i = numeric->scale;
-				do {
-					*s++ = '0';
-				} while (--i);
-			}
-			*s = 0;
-			return 1;
+	while (n_limbs && !limbs[n_limbs - 1])
+		--n_limbs;
+
+	p = digits_end;
+
+	/*
+	 * Divide by 10^9 till number fits in 64 bit.
+	 * Division of a 64 bit number by a constant is translated by
+	 * the compiler to a multiplication by the reciprocal.
+	 */
+	while (n_limbs > 2) {
+		uint64_t rem = 0;
+
+		for (i = n_limbs; i-- > 0;) {
+			const uint64_t cur = (rem << 32) | limbs[i];
+
+			limbs[i] = (uint32_t) (cur / 1000000000u);
+			rem = cur % 1000000000u;
 		}
+		if (!limbs[n_limbs - 1])
+			--n_limbs;
+
+		p = tds_numeric_put_chunk(p, (uint32_t) rem);
 	}
-	packet_start = pnum;
-
-	/* transform 2^16 base number in 10^4 base number */
-	for (p = packet10k + TDS_VECTOR_SIZE(packet10k); packet_start != packet_end;) {
-		pnum = packet_start;
-		n = *pnum;
-		remainder = n % 10000u;
-		if (!(*pnum++ = (n / 10000u)))
-			packet_start = pnum;
-		for (; pnum != packet_end; ++pnum) {
-			n = remainder * (256u * 256u) + *pnum;
-			remainder = n % 10000u;
-			*pnum = n / 10000u;
-		}
-		*--p = remainder;
+
+	/* remaining 64 bit part */
+	if (n_limbs) {
+		uint64_t n = limbs[0];
+
+		if (n_limbs > 1)
+			n |= ((uint64_t) limbs[1]) << 32;
+		for (; n >= 1000000000u; n /= 1000000000u)
+			p = tds_numeric_put_chunk(p, (uint32_t) (n % 1000000000u));
+		p -= 10 - tds_u32toa_fast_right(p - 10, (uint32_t) n);
 	}
 
-	/* transform to 10 base number and output */
-	i = 4 * (unsigned int)((packet10k + TDS_VECTOR_SIZE(packet10k)) - p);	/* current digit */
-	/* skip leading zeroes */
-	n = 1000;
-	remainder = *p;
-	while (remainder < n)
-		n /= 10, --i;
-	if (i <= numeric->scale) {
+	/* skip leading zeroes, could be present in last chunk */
+	while (p != digits_end && *p == '0')
+		++p;
+	/* it's a zero */
+	if (p == digits_end)
+		*--p = '0';
+
+	/* output digits placing the decimal point */
+	num_digits = (unsigned int) (digits_end - p);
+	scale = numeric->scale;
+	if (num_digits <= scale) {
 		*s++ = '0';
 		*s++ = '.';
-		m = i;
-		while (m < numeric->scale)
-			*s++ = '0', ++m;
-	}
-	for (;;) {
-		*s++ = (remainder / n) + '0';
-		--i;
-		remainder %= n;
-		n /= 10;
-		if (!n) {
-			n = 1000;
-			if (++p == packet10k + TDS_VECTOR_SIZE(packet10k))
-				break;
-			remainder = *p;
-		}
-		if (i == numeric->scale)
+		memset(s, '0', scale - num_digits);
+		s += scale - num_digits;
+		memcpy(s, p, num_digits);
+		s += num_digits;
+	} else {
+		memcpy(s, p, num_digits - scale);
+		s += num_digits - scale;
+		if (scale) {
 			*s++ = '.';
+			memcpy(s, p + num_digits - scale, scale);
+			s += scale;
+		}
 	}
 	*s = 0;
 
-	return 1;
+	return (TDS_INT) (s - start);
 }
 
 #define TDS_WORD  uint32_t
@@ -56,39 +56,64 @@ static TDSRET tds_update_recv_wnd(TDSSOCKET *tds, TDS_UINT new_recv_wnd);
 static int tds_packet_write(TDSCONNECTION *conn);
 #endif
 
+/**
+ * Compute size class of a packet capacity for packet cache.
+ * Class 0 holds packets up to 255 bytes, every following class
+ * doubles the size, last class holds all bigger packets.
+ */
+static unsigned
+tds_packet_cache_class(unsigned capacity)
+{
+	unsigned cls = 0;
+
+	capacity >>= 8;
+	while (capacity && cls < TDS_PACKET_CACHE_CLASSES - 1) {
+		capacity >>= 1;
+		++cls;
+	}
+	return cls;
+}
+
 /* get packet from the cache */
 static TDSPACKET *
 tds_get_packet(TDSCONNECTION *conn, unsigned len)
 {
-	TDSPACKET *packet, *to_free = NULL;
+	TDSPACKET *packet = NULL, **prev;
+	unsigned cls;
 
 	tds_mutex_lock(&conn->list_mtx);
-	while ((packet = conn->packet_cache) != NULL) {
-		--conn->num_cached_packets;
-		conn->packet_cache = packet->next;
 
-		/* return it */
-		if (packet->capacity >= len) {
-			TDS_MARK_UNDEFINED(packet->buf, packet->capacity);
-			packet->next = NULL;
-			tds_packet_zero_data_start(packet);
-			packet->data_len = 0;
-			packet->sid = 0;
+	/*
+	 * Packets in the class of the request can be smaller than requested,
+	 * search a big enough one; all packets in following classes fit
+	 * so take first available.
+	 */
+	cls = tds_packet_cache_class(len);
+	for (prev = &conn->packet_cache[cls]; (packet = *prev) != NULL; prev = &packet->next)
+		if (packet->capacity >= len)
 			break;
-		}
+	while (!packet && ++cls < TDS_PACKET_CACHE_CLASSES) {
+		prev = &conn->packet_cache[cls];
+		packet = *prev;
+	}
 
-		/* discard packet if too small */
-		packet->next = to_free;
-		to_free = packet;
+	if (packet) {
+		*prev = packet->next;
+		--conn->num_cached_packets;
+		++conn->packet_cache_stats.hits;
+	} else {
+		++conn->packet_cache_stats.misses;
 	}
 	tds_mutex_unlock(&conn->list_mtx);
 
-	if (to_free)
-		tds_free_packets(to_free);
-
 	if (!packet)
-		packet = tds_alloc_packet(NULL, len);
+		return tds_alloc_packet(NULL, len);
 
+	TDS_MARK_UNDEFINED(packet->buf, packet->capacity);
+	packet->next = NULL;
+	tds_packet_zero_data_start(packet);
+	packet->data_len = 0;
+	packet->sid = 0;
 	return packet;
 }
 
@@ -96,32 +121,72 @@ tds_get_packet(TDSCONNECTION *conn, unsigned len)
 static void
 tds_packet_cache_add(TDSCONNECTION *conn, TDSPACKET *packet)
 {
-	TDSPACKET *last;
-	unsigned count = 1;
+	TDSPACKET *next;
+	unsigned cls;
 
 	assert(conn && packet);
 	tds_mutex_check_owned(&conn->list_mtx);
 
-	if (conn->num_cached_packets >= 8) {
-		tds_free_packets(packet);
-		return;
-	}
+	for (; packet; packet = next) {
+		next = packet->next;
 
-	for (last = packet; last->next; last = last->next)
-		++count;
+		if (conn->num_cached_packets >= conn->max_cached_packets) {
+			packet->next = NULL;
+			tds_free_packets(packet);
+			++conn->packet_cache_stats.discarded;
+			continue;
+		}
 
-	last->next = conn->packet_cache;
-	conn->packet_cache = packet;
-	conn->num_cached_packets += count;
+		cls = tds_packet_cache_class(packet->capacity);
+		packet->next = conn->packet_cache[cls];
+		conn->packet_cache[cls] = packet;
+		++conn->num_cached_packets;
+	}
 
 #if ENABLE_EXTRA_CHECKS
-	count = 0;
-	for (packet = conn->packet_cache; packet; packet = packet->next)
-		++count;
-	assert(count == conn->num_cached_packets);
+	{
+		unsigned count = 0;
+
+		for (cls = 0; cls < TDS_PACKET_CACHE_CLASSES; ++cls)
+			for (packet = conn->packet_cache[cls]; packet; packet = packet->next) {
+				assert(tds_packet_cache_class(packet->capacity) == cls);
+				++count;
+			}
+		assert(count == conn->num_cached_packets);
+	}
 #endif
 }
 
+/* move received packet to pinned list, column views refer to it */
+static void
+tds_pin_recv_packet(TDSSOCKET *tds)
+{
+	tds->recv_packet->next = tds->pinned_packets;
+	tds->pinned_packets = tds->recv_packet;
+	tds->recv_packet = NULL;
+	tds->recv_packet_pinned = false;
+}
+
+/**
+ * Release packets referred by column views.
+ * After this call column views are no longer valid.
+ * \tds
+ */
+void
+tds_release_pinned_packets(TDSSOCKET *tds)
+{
+	TDSCONNECTION *conn = tds->conn;
+
+	tds->recv_packet_pinned = false;
+	if (!tds->pinned_packets)
+		return;
+
+	tds_mutex_lock(&conn->list_mtx);
+	tds_packet_cache_add(conn, tds->pinned_packets);
+	tds_mutex_unlock(&conn->list_mtx);
+	tds->pinned_packets = NULL;
+}
+
 #if ENABLE_ODBC_MARS
 /* read partial packet */
 static bool
@@ -508,6 +573,170 @@ tds_connection_put_packet(TDSSOCKET *tds, TDSPACKET *packet)
 }
 #endif /* ENABLE_ODBC_MARS */
 
+/**
+ * Continue reading packet started by tds_read_ahead.
+ * \tds
+ * \param wait  true to wait for data, false to read only data already received
+ * \return 1 if packet is complete, 0 if more data are needed, -1 on error
+ */
+static int
+tds_ahead_fill(TDSSOCKET * tds, bool wait)
+{
+	TDSPACKET *packet = tds->ahead_packet;
+
+	for (;;) {
+		unsigned pktlen = 8;
+		ptrdiff_t len;
+
+		if (tds->ahead_pos >= 4) {
+			pktlen = TDS_GET_A2BE(packet->buf + 2);
+			/* packet must at least contains header */
+			if (TDS_UNLIKELY(pktlen < 8))
+				break;
+			if (TDS_UNLIKELY(pktlen > packet->capacity)) {
+				packet = tds_realloc_packet(packet, pktlen);
+				if (TDS_UNLIKELY(!packet))
+					break;
+				tds->ahead_packet = packet;
+			}
+		}
+		if (tds->ahead_pos >= pktlen) {
+			packet->data_len = pktlen;
+			return 1;
+		}
+
+		if (wait)
+			len = tds_goodread(tds, packet->buf + tds->ahead_pos, pktlen - tds->ahead_pos);
+		else
+			len = tds_read_nowait(tds, packet->buf + tds->ahead_pos, pktlen - tds->ahead_pos);
+		if (len < 0)
+			break;
+		if (len == 0)
+			return 0;
+		tds->ahead_pos += (unsigned) len;
+	}
+	tds_close_socket(tds);
+	return -1;
+}
+
+/**
+ * Read packets already received from server, without waiting.
+ * Packets are kept and returned by following tds_read_packet calls so
+ * the caller can start processing a reply only when enough data are
+ * available and the processing won't block.
+ * With TLS or MARS data are not read; the function only reports
+ * whether some data are available.
+ * \tds
+ * \param min_len  unread bytes sufficient to proceed even if reply is not complete
+ * \return 1 if reply is complete or at least min_len bytes are available,
+ *         0 if more data are needed, -1 on error
+ */
+int
+tds_read_ahead(TDSSOCKET * tds, size_t min_len)
+{
+	TDSPACKET *packet, **tail;
+	size_t available = 0;
+
+	if (IS_TDSDEAD(tds))
+		return -1;
+
+	/* current packet not processed yet */
+	if (tds->in_pos < tds->in_len) {
+		if (tds->in_buf[1] & TDS_STATUS_EOM)
+			return 1;
+		available = tds->in_len - tds->in_pos;
+	}
+
+	/* data can't be read ahead, just check some are available */
+	if (tds->conn->tls_session
+#if ENABLE_ODBC_MARS
+	    || tds->conn->mars
+#endif
+	    ) {
+		unsigned tds_sel = TDSSELREAD;
+
+		return available || tds_select_any(&tds, &tds_sel, 1, 0) >= 0 ? 1 : 0;
+	}
+
+	for (tail = &tds->ahead_packets; (packet = *tail) != NULL; tail = &packet->next) {
+		if (packet->buf[1] & TDS_STATUS_EOM)
+			return 1;
+		available += packet->data_len - 8;
+	}
+
+	while (available < min_len) {
+		int rc;
+
+		if (!tds->ahead_packet) {
+			packet = tds_get_packet(tds->conn, tds->recv_packet->capacity);
+			if (TDS_UNLIKELY(!packet)) {
+				tds_close_socket(tds);
+				return -1;
+			}
+			tds->ahead_packet = packet;
+			tds->ahead_pos = 0;
+		}
+
+		rc = tds_ahead_fill(tds, false);
+		if (rc <= 0)
+			return rc;
+
+		/* queue the complete packet */
+		packet = tds->ahead_packet;
+		tds->ahead_packet = NULL;
+		packet->next = NULL;
+		*tail = packet;
+		tail = &packet->next;
+		tdsdump_dump_buf(TDS_DBG_NETWORK, "Received packet", packet->buf, packet->data_len);
+
+		if (packet->buf[1] & TDS_STATUS_EOM)
+			return 1;
+		available += packet->data_len - 8;
+	}
+	return 1;
+}
+
+/**
+ * Make next packet read by tds_read_ahead the current one.
+ * \tds
+ * \return bytes in packet or -1 on failure
+ */
+static int
+tds_read_ahead_packet(TDSSOCKET * tds)
+{
+	TDSCONNECTION *conn = tds->conn;
+	TDSPACKET *packet = tds->ahead_packets;
+
+	if (packet) {
+		tds->ahead_packets = packet->next;
+	} else {
+		/* finish packet partially read */
+		if (tds_ahead_fill(tds, true) < 0)
+			return -1;
+		packet = tds->ahead_packet;
+		tds->ahead_packet = NULL;
+		tdsdump_dump_buf(TDS_DBG_NETWORK, "Received packet", packet->buf, packet->data_len);
+	}
+	packet->next = NULL;
+
+	/* do not overwrite data referred by column views */
+	if (tds->recv_packet_pinned) {
+		tds_pin_recv_packet(tds);
+	} else {
+		tds_mutex_lock(&conn->list_mtx);
+		tds_packet_cache_add(conn, tds->recv_packet);
+		tds_mutex_unlock(&conn->list_mtx);
+	}
+	tds->recv_packet = packet;
+
+	tds->in_buf = packet->buf;
+	tds->in_len = packet->data_len;
+	tds->in_pos = 8;
+	tds->in_flag = tds->in_buf[0];
+
+	return tds->in_len;
+}
+
 /**
  * Read in one 'packet' from the server.  This is a wrapped outer packet of
  * the protocol (they bundle result packets into chunks and wrap them at
@@ -521,6 +750,9 @@ tds_read_packet(TDSSOCKET * tds)
 #if ENABLE_ODBC_MARS
 	TDSCONNECTION *conn = tds->conn;
 
+	if (tds->ahead_packets || tds->ahead_packet)
+		return tds_read_ahead_packet(tds);
+
 	tds_mutex_lock(&conn->list_mtx);
 
 	for (;;) {
@@ -541,7 +773,10 @@ tds_read_packet(TDSSOCKET * tds)
 			/* remove our packet from list */
 			TDSPACKET *packet = *p_packet;
 			*p_packet = packet->next;
-			tds_packet_cache_add(conn, tds->recv_packet);
+			if (tds->recv_packet_pinned)
+				tds_pin_recv_packet(tds);
+			else
+				tds_packet_cache_add(conn, tds->recv_packet);
 			tds_mutex_unlock(&conn->list_mtx);
 
 			packet->next = NULL;
@@ -594,13 +829,30 @@ tds_read_packet(TDSSOCKET * tds)
 	tds_mutex_unlock(&conn->list_mtx);
 	return -1;
 #else /* !ENABLE_ODBC_MARS */
-	unsigned char *pkt = tds->in_buf, *p, *end;
+	unsigned char *pkt, *p, *end;
 
 	if (IS_TDSDEAD(tds)) {
 		tdsdump_log(TDS_DBG_NETWORK, "Read attempt when state is TDS_DEAD");
 		return -1;
 	}
 
+	if (tds->ahead_packets || tds->ahead_packet)
+		return tds_read_ahead_packet(tds);
+
+	/* do not overwrite data referred by column views */
+	if (tds->recv_packet_pinned) {
+		TDSPACKET *packet = tds_get_packet(tds->conn, tds->recv_packet->capacity);
+
+		if (TDS_UNLIKELY(!packet)) {
+			tds_close_socket(tds);
+			return -1;
+		}
+		tds_pin_recv_packet(tds);
+		tds->recv_packet = packet;
+		tds->in_buf = packet->buf;
+	}
+	pkt = tds->in_buf;
+
 	tds->in_len = 0;
 	tds->in_pos = 0;
 	for (p = pkt, end = p+8; p < end;) {
@@ -45,14 +45,30 @@
 
 #include <assert.h>
 
+/** growing buffer used to build converted queries */
+typedef struct tds_query_buf
+{
+	char *data;
+	size_t len, size;
+} TDSQUERYBUF;
+
+typedef struct tds_query_cache_entry TDSQUERYCACHEENTRY;
+
+/** query is sent as is, no parameters */
+#define TDS7_QUERY_PLAIN 0
+/** placeholders replaced by "@PX" and declared from query */
+#define TDS7_QUERY_PLACEHOLDERS 1
+/** like TDS7_QUERY_PLACEHOLDERS if query contains placeholders, otherwise parameters declared by name */
+#define TDS7_QUERY_EXECUTESQL 2
+
 static TDSRET tds5_put_params(TDSSOCKET * tds, TDSPARAMINFO * info, int flags) TDS_WUR;
-static void tds7_put_query_params(TDSSOCKET * tds, const char *query, size_t query_len);
 static TDSRET tds_put_data_info(TDSSOCKET * tds, TDSCOLUMN * curcol, int flags);
 static inline TDSRET tds_put_data(TDSSOCKET * tds, TDSCOLUMN * curcol);
-static TDSRET tds7_write_param_def_from_query(TDSSOCKET * tds, const char* converted_query,
-					      size_t converted_query_len, TDSPARAMINFO * params) TDS_WUR;
-static TDSRET tds7_write_param_def_from_params(TDSSOCKET * tds, const char* query, size_t query_len,
-					       TDSPARAMINFO * params) TDS_WUR;
+static const TDSQUERYCACHEENTRY *tds_query_cache_get(TDSSOCKET * tds, int kind, const char *query, size_t query_len,
+						     TDSPARAMINFO * params);
+static void tds_query_cache_release(const TDSQUERYCACHEENTRY * entry);
+static void tds7_put_query_text(TDSSOCKET * tds, const TDSQUERYCACHEENTRY * entry);
+static void tds7_put_param_def(TDSSOCKET * tds, const TDSQUERYCACHEENTRY * entry);
 
 static TDSRET tds_put_param_as_string(TDSSOCKET * tds, TDSPARAMINFO * params, int n);
 static TDSRET tds_send_emulated_execute(TDSSOCKET * tds, const char *query, TDSPARAMINFO * params);
@@ -390,29 +406,20 @@ tds_submit_query_params(TDSSOCKET * tds, const char *query, TDSPARAMINFO * param
 		tds_put_string(tds, query, (int)query_len);
 	} else {
 		TDSCOLUMN *param;
-		int count, i;
-		size_t converted_query_len;
-		const char *converted_query;
-		TDSFREEZE outer;
-		TDSRET rc;
+		int i;
+		const TDSQUERYCACHEENTRY *converted;
 
-		converted_query =
-			tds_convert_string(tds, tds->conn->char_convs[client2ucs2],
-					   query, query_len, &converted_query_len);
-		if (!converted_query) {
+		converted = tds_query_cache_get(tds, TDS7_QUERY_EXECUTESQL, query, query_len, params);
+		if (!converted) {
 			tds_set_state(tds, TDS_IDLE);
 			return TDS_FAIL;
 		}
 
-		count = tds_count_placeholders_ucs2le(converted_query, converted_query + converted_query_len);
-
 		if (tds_start_query_head(tds, TDS_RPC, head) != TDS_SUCCESS) {
-			tds_convert_string_free(query, converted_query);
+			tds_query_cache_release(converted);
 			return TDS_FAIL;
 		}
 
-		tds_freeze(tds, &outer, 0);
-
 		/* procedure name */
 		if (IS_TDS71_PLUS(tds->conn)) {
 			tds_put_smallint(tds, -1);
@@ -423,28 +430,9 @@ tds_submit_query_params(TDSSOCKET * tds, const char *query, TDSPARAMINFO * param
 		tds_put_smallint(tds, 0);
  
 		/* string with sql statement */
-		if (!count) {
-			tds_put_byte(tds, 0);
-			tds_put_byte(tds, 0);
-			tds_put_byte(tds, SYBNTEXT);	/* must be Ntype */
-			TDS_PUT_INT(tds, converted_query_len);
-			if (IS_TDS71_PLUS(tds->conn))
-				tds_put_n(tds, tds->conn->collation, 5);
-			TDS_PUT_INT(tds, converted_query_len);
-			tds_put_n(tds, converted_query, converted_query_len);
-
-			rc = tds7_write_param_def_from_params(tds, converted_query, converted_query_len, params);
-		} else {
-			tds7_put_query_params(tds, converted_query, converted_query_len);
-
-			rc = tds7_write_param_def_from_query(tds, converted_query, converted_query_len, params);
-		}
-		tds_convert_string_free(query, converted_query);
-		if (TDS_FAILED(rc)) {
-			tds_freeze_abort(&outer);
-			return rc;
-		}
-		tds_freeze_close(&outer);
+		tds7_put_query_text(tds, converted);
+		tds7_put_param_def(tds, converted);
+		tds_query_cache_release(converted);
 
 		for (i = 0; i < num_params; i++) {
 			param = params->columns[i];
@@ -958,22 +946,55 @@ tds_get_column_declaration(TDSSOCKET * tds, TDSCOLUMN * curcol, char *out)
 }
 
 /**
- * Write string with parameters definition, useful for TDS7+.
+ * Append data to a growing buffer
+ * \return false on memory error
+ */
+static bool
+tds_query_buf_put(TDSQUERYBUF * buf, const void *data, size_t len)
+{
+	if (buf->len + len > buf->size) {
+		size_t size = TDS_MAX(buf->size * 2u, buf->len + len + 64u);
+
+		if (!TDS_RESIZE(buf->data, size))
+			return false;
+		buf->size = size;
+	}
+	if (len)
+		memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	return true;
+}
+
+/**
+ * Append an ASCII string to a growing buffer converting it to UCS2-LE
+ * \return false on memory error
+ */
+static bool
+tds_query_buf_put_ascii(TDSQUERYBUF * buf, const char *s)
+{
+	char buffer[256];
+	size_t len = strlen(s);
+
+	assert(len > 0 && len <= sizeof(buffer) / 2);
+	return tds_query_buf_put(buf, buffer, tds_ascii_to_ucs2(buffer, s));
+}
+
+/**
+ * Build string with parameters definition, useful for TDS7+.
  * Looks like "@P1 INT, @P2 VARCHAR(100)"
  * \param tds     state information for the socket and the TDS protocol
+ * \param out     buffer to append definition to (ucs2le encoded)
  * \param converted_query     query to send to server in ucs2le encoding
  * \param converted_query_len query length in bytes
  * \param params  parameters to build declaration
- * \return result of write
+ * \return TDS_FAIL or TDS_SUCCESS
  */
-/* TODO find a better name for this function */
 static TDSRET
-tds7_write_param_def_from_query(TDSSOCKET * tds, const char* converted_query, size_t converted_query_len, TDSPARAMINFO * params)
+tds7_build_param_def_from_query(TDSSOCKET * tds, TDSQUERYBUF * out, const char* converted_query,
+				size_t converted_query_len, TDSPARAMINFO * params)
 {
 	char declaration[128], *p;
 	int i, count;
-	unsigned int written;
-	TDSFREEZE outer, inner;
 
 	assert(IS_TDS7_PLUS(tds->conn));
 
@@ -983,17 +1004,6 @@ tds7_write_param_def_from_query(TDSSOCKET * tds, const char* converted_query, si
 
 	count = tds_count_placeholders_ucs2le(converted_query, converted_query + converted_query_len);
 
-	/* string with parameters types */
-	tds_put_byte(tds, 0);
-	tds_put_byte(tds, 0);
-	tds_put_byte(tds, SYBNTEXT);	/* must be Ntype */
-
-	/* put parameters definitions */
-	tds_freeze(tds, &outer, 4);
-	if (IS_TDS71_PLUS(tds->conn))
-		tds_put_n(tds, tds->conn->collation, 5);
-	tds_freeze(tds, &inner, 4);
-
 	for (i = 0; i < count; ++i) {
 		p = declaration;
 		if (i)
@@ -1004,32 +1014,28 @@ tds7_write_param_def_from_query(TDSSOCKET * tds, const char* converted_query, si
 		if (!params || i >= params->num_cols) {
 			strcpy(p, "varchar(4000)");
 		} else if (TDS_FAILED(tds_get_column_declaration(tds, params->columns[i], p))) {
-			tds_freeze_abort(&inner);
-			tds_freeze_abort(&outer);
 			return TDS_FAIL;
 		}
 
-		tds_put_string(tds, declaration, -1);
+		if (!tds_query_buf_put_ascii(out, declaration))
+			return TDS_FAIL;
 	}
-
-	written = tds_freeze_written(&inner) - 4;
-	tds_freeze_close_len(&inner, written ? written : -1);
-	tds_freeze_close_len(&outer, written);
 	return TDS_SUCCESS;
 }
 
 /**
- * Write string with parameters definition, useful for TDS7+.
+ * Build string with parameters definition, useful for TDS7+.
  * Looks like "@P1 INT, @P2 VARCHAR(100)"
  * \param tds       state information for the socket and the TDS protocol
+ * \param out       buffer to append definition to (ucs2le encoded)
  * \param query     query to send to server encoded in ucs2le
  * \param query_len query length in bytes
  * \param params    parameters to build declaration
- * \return result of the operation
+ * \return TDS_FAIL or TDS_SUCCESS
  */
-/* TODO find a better name for this function */
 static TDSRET
-tds7_write_param_def_from_params(TDSSOCKET * tds, const char* query, size_t query_len, TDSPARAMINFO * params)
+tds7_build_param_def_from_params(TDSSOCKET * tds, TDSQUERYBUF * out, const char* query, size_t query_len,
+				 TDSPARAMINFO * params)
 {
 	char declaration[40];
 	int i;
@@ -1037,8 +1043,6 @@ tds7_write_param_def_from_params(TDSSOCKET * tds, const char* query, size_t quer
 		const char *p;
 		size_t len;
 	} *ids = NULL;
-	TDSFREEZE outer, inner;
-	unsigned int written;
 
 	assert(IS_TDS7_PLUS(tds->conn));
 
@@ -1046,22 +1050,8 @@ tds7_write_param_def_from_params(TDSSOCKET * tds, const char* query, size_t quer
 	if (params)
 		CHECK_PARAMINFO_EXTRA(params);
 
-	/* string with parameters types */
-	tds_put_byte(tds, 0);
-	tds_put_byte(tds, 0);
-	tds_put_byte(tds, SYBNTEXT);	/* must be Ntype */
-
-	/* put parameters definitions */
-	tds_freeze(tds, &outer, 4);
-	if (IS_TDS71_PLUS(tds->conn))
-		tds_put_n(tds, tds->conn->collation, 5);
-	tds_freeze(tds, &inner, 4);
-
-	if (!params || !params->num_cols) {
-		tds_freeze_close_len(&inner, -1);
-		tds_freeze_close_len(&outer, 0);
+	if (!params || !params->num_cols)
 		return TDS_SUCCESS;
-	}
 
 	/* try to detect missing names */
 	ids = tds_new0(struct tds_ids, params->num_cols);
@@ -1088,89 +1078,396 @@ tds7_write_param_def_from_params(TDSSOCKET * tds, const char* query, size_t quer
 	}
 
 	for (i = 0; i < params->num_cols; ++i) {
-		if (i)
-			tds_put_smallint(tds, ',');
+		if (i && !tds_query_buf_put_ascii(out, ","))
+			goto Cleanup;
 
 		/* this part of buffer can be not-ascii compatible, use all ucs2... */
 		if (ids[i].p) {
-			tds_put_n(tds, ids[i].p, ids[i].len);
+			if (!tds_query_buf_put(out, ids[i].p, ids[i].len))
+				goto Cleanup;
 		} else {
 			const DSTR *name = &params->columns[i]->column_name;
-			tds_put_string(tds, tds_dstr_cstr(name), (int) tds_dstr_len(name));
+			const char *converted_name;
+			size_t converted_name_len;
+			bool ok;
+
+			if (!tds_dstr_isempty(name)) {
+				converted_name = tds_convert_string(tds, tds->conn->char_convs[client2ucs2],
+								    tds_dstr_cstr(name), tds_dstr_len(name),
+								    &converted_name_len);
+				if (!converted_name)
+					goto Cleanup;
+				ok = tds_query_buf_put(out, converted_name, converted_name_len);
+				tds_convert_string_free(tds_dstr_cstr(name), converted_name);
+				if (!ok)
+					goto Cleanup;
+			}
 		}
-		tds_put_smallint(tds, ' ');
+		if (!tds_query_buf_put_ascii(out, " "))
+			goto Cleanup;
 
 		/* get this parameter declaration */
 		tds_get_column_declaration(tds, params->columns[i], declaration);
-		if (!declaration[0])
+		if (!declaration[0] || !tds_query_buf_put_ascii(out, declaration))
 			goto Cleanup;
-		tds_put_string(tds, declaration, -1);
 	}
 	free(ids);
-
-	written = tds_freeze_written(&inner) - 4;
-	tds_freeze_close_len(&inner, written);
-	tds_freeze_close_len(&outer, written);
-
 	return TDS_SUCCESS;
 
       Cleanup:
 	free(ids);
-	tds_freeze_abort(&inner);
-	tds_freeze_abort(&outer);
 	return TDS_FAIL;
 }
 
-
 /**
- * Output params types and query (required by sp_prepare/sp_executesql/sp_prepexec)
- * \param tds       state information for the socket and the TDS protocol
+ * Build query replacing placeholders with "@PX" parameters
+ * (required by sp_prepare/sp_executesql/sp_prepexec)
+ * \param out       buffer to append query to (ucs2le encoded)
  * \param query     query (encoded in ucs2le)
  * \param query_len query length in bytes
+ * \return false on memory error
  */
-static void
-tds7_put_query_params(TDSSOCKET * tds, const char *query, size_t query_len)
+static bool
+tds7_build_query_params(TDSQUERYBUF * out, const char *query, size_t query_len)
 {
-	size_t len;
-	int i, num_placeholders;
+	int i;
 	const char *s, *e;
 	char buf[24];
 	const char *const query_end = query + query_len;
 
-	CHECK_TDS_EXTRA(tds);
-
-	assert(IS_TDS7_PLUS(tds->conn));
-
-	/* we use all "@PX" for parameters */
-	num_placeholders = tds_count_placeholders_ucs2le(query, query_end);
-	len = num_placeholders * 2;
-	/* adjust for the length of X */
-	for (i = 10; i <= num_placeholders; i *= 10) {
-		len += num_placeholders - i + 1;
-	}
-
-	/* string with sql statement */
-	/* replace placeholders with dummy parametes */
-	tds_put_byte(tds, 0);
-	tds_put_byte(tds, 0);
-	tds_put_byte(tds, SYBNTEXT);	/* must be Ntype */
-	len = 2u * len + query_len;
-	TDS_PUT_INT(tds, len);
-	if (IS_TDS71_PLUS(tds->conn))
-		tds_put_n(tds, tds->conn->collation, 5);
-	TDS_PUT_INT(tds, len);
 	s = query;
 	/* TODO do a test with "...?" and "...?)" */
 	for (i = 1;; ++i) {
 		e = tds_next_placeholder_ucs2le(s, query_end, 0);
 		assert(e && query <= e && e <= query_end);
-		tds_put_n(tds, s, e - s);
+		if (!tds_query_buf_put(out, s, e - s))
+			return false;
 		if (e == query_end)
 			break;
 		sprintf(buf, "@P%d", i);
-		tds_put_string(tds, buf, -1);
+		if (!tds_query_buf_put_ascii(out, buf))
+			return false;
 		s = e + 2;
 	}
+	return true;
+}
+
+/*
+ * Cache of converted queries.
+ *
+ * Executing a query with parameters on TDS 7+ requires converting the
+ * query to UCS-2, replacing placeholders and building the declaration
+ * of the parameters. Applications usually execute the same few
+ * statements many times so the results are kept in a per-connection
+ * cache, keyed by query text and parameter types, and evicted in
+ * least recently used order.
+ */
+
+/** maximum number of queries kept for every connection */
+#define TDS_QUERY_CACHE_ENTRIES 256
+#define TDS_QUERY_CACHE_BUCKETS 256
+/** queries bigger than this (in bytes) are not cached */
+#define TDS_QUERY_CACHE_MAX_QUERY 65536
+
+struct tds_query_cache_entry
+{
+	TDSQUERYCACHEENTRY *hash_next;
+	TDSQUERYCACHEENTRY *lru_prev, *lru_next;
+	uint32_t hash;
+	/** TDS7_QUERY_* */
+	uint8_t kind;
+	/** false if entry is not in cache and must be freed after use */
+	bool cached;
+	/* key, query (client encoding) and parameters signature */
+	size_t query_len, sig_len;
+	/* converted statement and parameters declaration (ucs2le) */
+	size_t text_len, def_len;
+	/* data follows this structure */
+};
+
+struct tds_query_cache
+{
+	TDSQUERYCACHEENTRY *buckets[TDS_QUERY_CACHE_BUCKETS];
+	/** most recently used entry */
+	TDSQUERYCACHEENTRY *lru_first;
+	/** least recently used entry */
+	TDSQUERYCACHEENTRY *lru_last;
+	unsigned num_entries;
+	/** buffer to compute signatures, kept to avoid allocations */
+	TDSQUERYBUF sig;
+	unsigned long hits, misses;
+};
+
+#define QC_QUERY(e) ((const char *) ((e) + 1))
+#define QC_SIG(e) (QC_QUERY(e) + (e)->query_len)
+#define QC_TEXT(e) (QC_SIG(e) + (e)->sig_len)
+#define QC_DEF(e) (QC_TEXT(e) + (e)->text_len)
+
+static uint32_t
+tds_query_cache_hash(uint32_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	/* FNV-1a */
+	while (len--)
+		hash = (hash ^ *p++) * 16777619u;
+	return hash;
+}
+
+/**
+ * Compute a signature of parameters types.
+ * Contains everything used by tds_get_column_declaration (and names if \a names).
+ */
+static bool
+tds_query_cache_signature(TDSSOCKET * tds, TDSQUERYBUF * sig, TDSPARAMINFO * params, bool names)
+{
+	unsigned char desc[16];
+	int i;
+
+	sig->len = 0;
+	for (i = 0; params && i < params->num_cols; ++i) {
+		TDSCOLUMN *curcol = params->columns[i];
+
+		desc[0] = (unsigned char) curcol->on_server.column_type;
+		desc[1] = curcol->column_varint_size;
+		desc[2] = curcol->column_prec;
+		desc[3] = curcol->column_scale;
+		TDS_PUT_UA4LE(desc + 4, (TDS_UINT) tds_fix_column_size(tds, curcol));
+		TDS_PUT_UA4LE(desc + 8, (TDS_UINT) curcol->column_usertype);
+		TDS_PUT_UA4LE(desc + 12, (TDS_UINT) (names ? tds_dstr_len(&curcol->column_name) : 0));
+		if (!tds_query_buf_put(sig, desc, sizeof(desc)))
+			return false;
+		if (names && !tds_query_buf_put(sig, tds_dstr_cstr(&curcol->column_name), tds_dstr_len(&curcol->column_name)))
+			return false;
+	}
+	return true;
+}
+
+static void
+tds_query_cache_unlink(TDSQUERYCACHE * cache, TDSQUERYCACHEENTRY * entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_first = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_last = entry->lru_prev;
+}
+
+static void
+tds_query_cache_link_first(TDSQUERYCACHE * cache, TDSQUERYCACHEENTRY * entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_first;
+	if (cache->lru_first)
+		cache->lru_first->lru_prev = entry;
+	else
+		cache->lru_last = entry;
+	cache->lru_first = entry;
+}
+
+static void
+tds_query_cache_evict(TDSQUERYCACHE * cache)
+{
+	TDSQUERYCACHEENTRY *entry = cache->lru_last, **pentry;
+
+	tds_query_cache_unlink(cache, entry);
+	for (pentry = &cache->buckets[entry->hash % TDS_QUERY_CACHE_BUCKETS]; *pentry != entry; pentry = &(*pentry)->hash_next)
+		continue;
+	*pentry = entry->hash_next;
+	--cache->num_entries;
+	free(entry);
+}
+
+/**
+ * Free cache of converted queries
+ */
+void
+tds_query_cache_free(TDSCONNECTION * conn)
+{
+	TDSQUERYCACHE *cache = conn->query_cache;
+
+	if (!cache)
+		return;
+
+	tdsdump_log(TDS_DBG_INFO1, "query cache: %lu hits, %lu misses\n", cache->hits, cache->misses);
+	while (cache->lru_last)
+		tds_query_cache_evict(cache);
+	free(cache->sig.data);
+	TDS_ZERO_FREE(conn->query_cache);
+}
+
+/**
+ * Get query converted to be sent using RPCs, using cache if possible
+ * \tds
+ * \param kind      TDS7_QUERY_* constant
+ * \param query     query in client encoding
+ * \param query_len query length in bytes
+ * \param params    parameters of the query, can be NULL
+ * \return converted query, release with tds_query_cache_release, or NULL on error
+ */
+static const TDSQUERYCACHEENTRY *
+tds_query_cache_get(TDSSOCKET * tds, int kind, const char *query, size_t query_len, TDSPARAMINFO * params)
+{
+	TDSQUERYCACHE *cache = tds->conn->query_cache;
+	TDSQUERYCACHEENTRY *entry, **pentry = NULL;
+	TDSQUERYBUF text = { NULL, 0, 0 }, def = { NULL, 0, 0 };
+	const char *converted_query;
+	size_t converted_query_len, sig_len = 0;
+	uint32_t hash = 0;
+	bool ok = false;
+
+	assert(IS_TDS7_PLUS(tds->conn));
+
+	if (!cache) {
+		cache = tds_new0(TDSQUERYCACHE, 1);
+		if (!cache)
+			return NULL;
+		tds->conn->query_cache = cache;
+	}
+
+	if (query_len <= TDS_QUERY_CACHE_MAX_QUERY) {
+		uint8_t hash_kind = (uint8_t) kind;
+
+		if (!tds_query_cache_signature(tds, &cache->sig, params, kind == TDS7_QUERY_EXECUTESQL))
+			return NULL;
+		sig_len = cache->sig.len;
+
+		hash = tds_query_cache_hash(2166136261u, &hash_kind, 1);
+		hash = tds_query_cache_hash(hash, query, query_len);
+		hash = tds_query_cache_hash(hash, cache->sig.data, sig_len);
+
+		pentry = &cache->buckets[hash % TDS_QUERY_CACHE_BUCKETS];
+		for (entry = *pentry; entry; entry = entry->hash_next) {
+			if (entry->hash != hash || entry->kind != kind
+			    || entry->query_len != query_len || entry->sig_len != sig_len
+			    || memcmp(QC_QUERY(entry), query, query_len) != 0
+			    || memcmp(QC_SIG(entry), cache->sig.data, sig_len) != 0)
+				continue;
+			++cache->hits;
+			if (entry != cache->lru_first) {
+				tds_query_cache_unlink(cache, entry);
+				tds_query_cache_link_first(cache, entry);
+			}
+			return entry;
+		}
+	}
+	++cache->misses;
+
+	converted_query = tds_convert_string(tds, tds->conn->char_convs[client2ucs2], query, query_len, &converted_query_len);
+	if (!converted_query)
+		return NULL;
+
+	if (kind == TDS7_QUERY_PLAIN
+	    || (kind == TDS7_QUERY_EXECUTESQL
+		&& !tds_count_placeholders_ucs2le(converted_query, converted_query + converted_query_len))) {
+		ok = tds_query_buf_put(&text, converted_query, converted_query_len);
+		if (ok && kind == TDS7_QUERY_EXECUTESQL)
+			ok = TDS_SUCCEED(tds7_build_param_def_from_params(tds, &def, converted_query,
+									  converted_query_len, params));
+	} else {
+		ok = tds7_build_query_params(&text, converted_query, converted_query_len)
+		     && TDS_SUCCEED(tds7_build_param_def_from_query(tds, &def, converted_query,
+								    converted_query_len, params));
+	}
+	tds_convert_string_free(query, converted_query);
+
+	entry = NULL;
+	if (ok) {
+		if (!pentry)
+			query_len = 0;
+		entry = (TDSQUERYCACHEENTRY *) malloc(sizeof(*entry) + query_len + sig_len + text.len + def.len);
+	}
+	if (entry) {
+		char *p = (char *) (entry + 1);
+
+		entry->hash = hash;
+		entry->kind = (uint8_t) kind;
+		entry->cached = pentry != NULL;
+		entry->query_len = query_len;
+		entry->sig_len = sig_len;
+		entry->text_len = text.len;
+		entry->def_len = def.len;
+		memcpy(p, query, query_len);
+		p += query_len;
+		if (sig_len)
+			memcpy(p, cache->sig.data, sig_len);
+		p += sig_len;
+		if (text.len)
+			memcpy(p, text.data, text.len);
+		p += text.len;
+		if (def.len)
+			memcpy(p, def.data, def.len);
+
+		if (entry->cached) {
+			if (cache->num_entries >= TDS_QUERY_CACHE_ENTRIES)
+				tds_query_cache_evict(cache);
+			entry->hash_next = *pentry;
+			*pentry = entry;
+			tds_query_cache_link_first(cache, entry);
+			++cache->num_entries;
+		}
+	}
+	free(text.data);
+	free(def.data);
+	return entry;
+}
+
+/**
+ * Release a query returned by tds_query_cache_get
+ */
+static void
+tds_query_cache_release(const TDSQUERYCACHEENTRY * entry)
+{
+	if (!entry->cached)
+		free((TDSQUERYCACHEENTRY *) entry);
+}
+
+/**
+ * Output statement (required by sp_prepare/sp_executesql/sp_prepexec)
+ * \tds
+ * \param entry converted query
+ */
+static void
+tds7_put_query_text(TDSSOCKET * tds, const TDSQUERYCACHEENTRY * entry)
+{
+	CHECK_TDS_EXTRA(tds);
+
+	tds_put_byte(tds, 0);
+	tds_put_byte(tds, 0);
+	tds_put_byte(tds, SYBNTEXT);	/* must be Ntype */
+	TDS_PUT_INT(tds, entry->text_len);
+	if (IS_TDS71_PLUS(tds->conn))
+		tds_put_n(tds, tds->conn->collation, 5);
+	TDS_PUT_INT(tds, entry->text_len);
+	tds_put_n(tds, QC_TEXT(entry), entry->text_len);
+}
+
+/**
+ * Output parameters definition (required by sp_prepare/sp_executesql/sp_prepexec)
+ * \tds
+ * \param entry converted query
+ */
+static void
+tds7_put_param_def(TDSSOCKET * tds, const TDSQUERYCACHEENTRY * entry)
+{
+	CHECK_TDS_EXTRA(tds);
+
+	/* string with parameters types */
+	tds_put_byte(tds, 0);
+	tds_put_byte(tds, 0);
+	tds_put_byte(tds, SYBNTEXT);	/* must be Ntype */
+	TDS_PUT_INT(tds, entry->def_len);
+	if (IS_TDS71_PLUS(tds->conn))
+		tds_put_n(tds, tds->conn->collation, 5);
+	/* empty definition is sent as NULL */
+	if (entry->def_len)
+		TDS_PUT_INT(tds, entry->def_len);
+	else
+		tds_put_int(tds, -1);
+	tds_put_n(tds, QC_DEF(entry), entry->def_len);
 }
 
 /**
@@ -1232,16 +1529,12 @@ tds_submit_prepare(TDSSOCKET * tds, const char *query, const char *id, TDSDYNAMI
 	tds_set_cur_dyn(tds, dyn);
 
 	if (IS_TDS7_PLUS(tds->conn)) {
-		size_t converted_query_len;
-		const char *converted_query;
-		TDSFREEZE outer;
-		TDSRET rc;
+		const TDSQUERYCACHEENTRY *converted;
 
-		converted_query = tds_convert_string(tds, tds->conn->char_convs[client2ucs2], query, query_len, &converted_query_len);
-		if (!converted_query)
+		converted = tds_query_cache_get(tds, TDS7_QUERY_PLACEHOLDERS, query, query_len, params);
+		if (!converted)
 			goto failure;
 
-		tds_freeze(tds, &outer, 0);
 		tds_start_query(tds, TDS_RPC);
 		/* procedure name */
 		if (IS_TDS71_PLUS(tds->conn)) {
@@ -1259,14 +1552,9 @@ tds_submit_prepare(TDSSOCKET * tds, const char *query, const char *id, TDSDYNAMI
 		tds_put_byte(tds, 4);
 		tds_put_byte(tds, 0);
 
-		rc = tds7_write_param_def_from_query(tds, converted_query, converted_query_len, params);
-		tds7_put_query_params(tds, converted_query, converted_query_len);
-		tds_convert_string_free(query, converted_query);
-		if (TDS_FAILED(rc)) {
-			tds_freeze_abort(&outer);
-			return rc;
-		}
-		tds_freeze_close(&outer);
+		tds7_put_param_def(tds, converted);
+		tds7_put_query_text(tds, converted);
+		tds_query_cache_release(converted);
 
 		/* options, 1 == RETURN_METADATA */
 		tds_put_byte(tds, 0);
@@ -1338,24 +1626,21 @@ tds_submit_execdirect(TDSSOCKET * tds, const char *query, TDSPARAMINFO * params,
 
 	if (IS_TDS7_PLUS(tds->conn)) {
 		int i;
-		size_t converted_query_len;
-		const char *converted_query;
-		TDSRET rc;
+		const TDSQUERYCACHEENTRY *converted;
 
 		if (tds_set_state(tds, TDS_WRITING) != TDS_WRITING)
 			return TDS_FAIL;
 
-		converted_query = tds_convert_string(tds, tds->conn->char_convs[client2ucs2], query, (int)query_len, &converted_query_len);
-		if (!converted_query) {
+		converted = tds_query_cache_get(tds, TDS7_QUERY_PLACEHOLDERS, query, query_len, params);
+		if (!converted) {
 			tds_set_state(tds, TDS_IDLE);
 			return TDS_FAIL;
 		}
 
 		if (tds_start_query_head(tds, TDS_RPC, head) != TDS_SUCCESS) {
-			tds_convert_string_free(query, converted_query);
+			tds_query_cache_release(converted);
 			return TDS_FAIL;
 		}
-		tds_freeze(tds, &outer, 0);
 		/* procedure name */
 		if (IS_TDS71_PLUS(tds->conn)) {
 			tds_put_smallint(tds, -1);
@@ -1365,14 +1650,9 @@ tds_submit_execdirect(TDSSOCKET * tds, const char *query, TDSPARAMINFO * params,
 		}
 		tds_put_smallint(tds, 0);
 
-		tds7_put_query_params(tds, converted_query, converted_query_len);
-		rc = tds7_write_param_def_from_query(tds, converted_query, converted_query_len, params);
-		tds_convert_string_free(query, converted_query);
-		if (TDS_FAILED(rc)) {
-			tds_freeze_abort(&outer);
-			return rc;
-		}
-		tds_freeze_close(&outer);
+		tds7_put_query_text(tds, converted);
+		tds7_put_param_def(tds, converted);
+		tds_query_cache_release(converted);
 
 		for (i = 0; i < params->num_cols; i++) {
 			param = params->columns[i];
@@ -1471,9 +1751,7 @@ tds71_submit_prepexec(TDSSOCKET * tds, const char *query, const char *id, TDSDYN
 	int query_len;
 	TDSRET rc = TDS_FAIL;
 	TDSDYNAMIC *dyn;
-	size_t converted_query_len;
-	const char *converted_query;
-	TDSFREEZE outer;
+	const TDSQUERYCACHEENTRY *converted;
 
 	CHECK_TDS_EXTRA(tds);
 	if (params)
@@ -1496,11 +1774,10 @@ tds71_submit_prepexec(TDSSOCKET * tds, const char *query, const char *id, TDSDYN
 
 	query_len = (int)strlen(query);
 
-	converted_query = tds_convert_string(tds, tds->conn->char_convs[client2ucs2], query, query_len, &converted_query_len);
-	if (!converted_query)
+	converted = tds_query_cache_get(tds, TDS7_QUERY_PLACEHOLDERS, query, query_len, params);
+	if (!converted)
 		goto failure;
 
-	tds_freeze(tds, &outer, 0);
 	tds_start_query(tds, TDS_RPC);
 	/* procedure name */
 	if (IS_TDS71_PLUS(tds->conn)) {
@@ -1518,14 +1795,9 @@ tds71_submit_prepexec(TDSSOCKET * tds, const char *query, const char *id, TDSDYN
 	tds_put_byte(tds, 4);
 	tds_put_byte(tds, 0);
 
-	rc = tds7_write_param_def_from_query(tds, converted_query, converted_query_len, params);
-	tds7_put_query_params(tds, converted_query, converted_query_len);
-	tds_convert_string_free(query, converted_query);
-	if (TDS_FAILED(rc)) {
-		tds_freeze_abort(&outer);
-		return rc;
-	}
-	tds_freeze_close(&outer);
+	tds7_put_param_def(tds, converted);
+	tds7_put_query_text(tds, converted);
+	tds_query_cache_release(converted);
 
 	if (params) {
 		int i;
@@ -1926,24 +2198,26 @@ tds_submit_unprepare(TDSSOCKET * tds, TDSDYNAMIC * dyn)
 }
 
 /**
- * Send RPC as string query.
+ * Put RPC as string query.
  * This function is used on old protocol which does not support RPC queries.
  * \tds
  * \param rpc_name  name of RPC to invoke
  * \param params    parameters to send to server
+ * \param num_vars  number of variables already declared in the batch, updated
  * \returns TDS_FAIL or TDS_SUCCESS
  */
 static TDSRET
-tds4_send_emulated_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * params)
+tds4_put_emulated_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * params, unsigned int *num_vars)
 {
 	TDSCOLUMN *param;
-	int i, n;
+	int i;
+	unsigned int n;
 	int num_params = params ? params->num_cols : 0;
 	const char *sep = " ";
 	char buf[80];
 
 	/* create params and set */
-	for (i = 0, n = 0; i < num_params; ++i) {
+	for (i = 0, n = *num_vars; i < num_params; ++i) {
 
 		param = params->columns[i];
 
@@ -1951,9 +2225,9 @@ tds4_send_emulated_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * par
 		if (!param->column_output)
 			continue;
 		++n;
-		sprintf(buf, " DECLARE @P%d ", n);
+		sprintf(buf, " DECLARE @P%u ", n);
 		tds_get_column_declaration(tds, param, buf + strlen(buf));
-		sprintf(buf + strlen(buf), " SET @P%d=", n);
+		sprintf(buf + strlen(buf), " SET @P%u=", n);
 		tds_put_string(tds, buf, -1);
 		tds_put_param_as_string(tds, params, i);
 	}
@@ -1963,7 +2237,7 @@ tds4_send_emulated_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * par
 	tds_put_string(tds, rpc_name, -1);
 
 	/* put arguments */
-	for (i = 0, n = 0; i < num_params; ++i) {
+	for (i = 0, n = *num_vars; i < num_params; ++i) {
 		param = params->columns[i];
 		tds_put_string(tds, sep, -1);
 		if (!tds_dstr_isempty(&param->column_name)) {
@@ -1972,15 +2246,52 @@ tds4_send_emulated_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * par
 		}
 		if (param->column_output) {
 			++n;
-			sprintf(buf, "@P%d OUTPUT", n);
+			sprintf(buf, "@P%u OUTPUT", n);
 			tds_put_string(tds, buf, -1);
 		} else {
 			tds_put_param_as_string(tds, params, i);
 		}
 		sep = ",";
 	}
+	*num_vars = n;
 
-	return tds_query_flush_packet(tds);
+	return TDS_SUCCESS;
+}
+
+/**
+ * Put a RPC request (name, flags and parameters) for TDS 7+.
+ * Packet must be already started.
+ * \tds
+ * \param rpc_name  name of RPC to invoke
+ * \param params    parameters to send to server
+ * \returns TDS_FAIL or TDS_SUCCESS
+ */
+static TDSRET
+tds7_put_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * params)
+{
+	int i;
+	int num_params = params ? params->num_cols : 0;
+
+	/* procedure name */
+	TDS_START_LEN_USMALLINT(tds) {
+		tds_put_string(tds, rpc_name, -1);
+	} TDS_END_LEN_STRING
+
+	/*
+	 * TODO support flags
+	 * bit 0 (1 as flag) in TDS7/TDS5 is "recompile"
+	 * bit 1 (2 as flag) in TDS7+ is "no metadata" bit 
+	 * (I don't know meaning of "no metadata")
+	 */
+	tds_put_smallint(tds, 0);
+
+	for (i = 0; i < num_params; i++) {
+		TDSCOLUMN *param = params->columns[i];
+
+		TDS_PROPAGATE(tds_put_data_info(tds, param, TDS_PUT_DATA_USE_NAME));
+		TDS_PROPAGATE(tds_put_data(tds, param));
+	}
+	return TDS_SUCCESS;
 }
 
 /**
@@ -1992,8 +2303,6 @@ tds4_send_emulated_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * par
 TDSRET
 tds_submit_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * params, TDSHEADERS * head)
 {
-	TDSCOLUMN *param;
-	int i;
 	int num_params = params ? params->num_cols : 0;
 
 	CHECK_TDS_EXTRA(tds);
@@ -2013,24 +2322,7 @@ tds_submit_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * params, TDS
 		if (tds_start_query_head(tds, TDS_RPC, head) != TDS_SUCCESS)
 			return TDS_FAIL;
 
-		/* procedure name */
-		TDS_START_LEN_USMALLINT(tds) {
-			tds_put_string(tds, rpc_name, -1);
-		} TDS_END_LEN_STRING
-
-		/*
-		 * TODO support flags
-		 * bit 0 (1 as flag) in TDS7/TDS5 is "recompile"
-		 * bit 1 (2 as flag) in TDS7+ is "no metadata" bit 
-		 * (I don't know meaning of "no metadata")
-		 */
-		tds_put_smallint(tds, 0);
-
-		for (i = 0; i < num_params; i++) {
-			param = params->columns[i];
-			TDS_PROPAGATE(tds_put_data_info(tds, param, TDS_PUT_DATA_USE_NAME));
-			TDS_PROPAGATE(tds_put_data(tds, param));
-		}
+		TDS_PROPAGATE(tds7_put_rpc(tds, rpc_name, params));
 
 		return tds_query_flush_packet(tds);
 	}
@@ -2056,8 +2348,12 @@ tds_submit_rpc(TDSSOCKET * tds, const char *rpc_name, TDSPARAMINFO * params, TDS
 	}
 
 	/* emulate it for TDS4.x, send RPC for mssql */
-	if (tds->conn->tds_version < 0x500)
-		return tds4_send_emulated_rpc(tds, rpc_name, params);
+	if (tds->conn->tds_version < 0x500) {
+		unsigned int num_vars = 0;
+
+		TDS_PROPAGATE(tds4_put_emulated_rpc(tds, rpc_name, params, &num_vars));
+		return tds_query_flush_packet(tds);
+	}
 
 	/* TODO continue, support for TDS4?? */
 	tds_set_state(tds, TDS_IDLE);
@@ -2395,24 +2691,18 @@ tds_cursor_open(TDSSOCKET * tds, TDSCURSOR * cursor, TDSPARAMINFO *params, bool
 		*something_to_send = true;
 	}
 	if (IS_TDS7_PLUS(tds->conn)) {
-		const char *converted_query;
-		size_t converted_query_len;
+		const TDSQUERYCACHEENTRY *converted;
 		int num_params = params ? params->num_cols : 0;
-		TDSFREEZE outer;
-		TDSRET rc = TDS_SUCCESS;
 
 		/* cursor statement */
-		converted_query =
-			tds_convert_string(tds, tds->conn->char_convs[client2ucs2], cursor->query,
-					   strlen(cursor->query), &converted_query_len);
-		if (!converted_query) {
+		converted = tds_query_cache_get(tds, num_params ? TDS7_QUERY_PLACEHOLDERS : TDS7_QUERY_PLAIN,
+						cursor->query, strlen(cursor->query), params);
+		if (!converted) {
 			if (!*something_to_send)
 				tds_set_state(tds, TDS_IDLE);
 			return TDS_FAIL;
 		}
 
-		tds_freeze(tds, &outer, 0);
-
 		/* RPC call to sp_cursoropen */
 		tds_start_query(tds, TDS_RPC);
 
@@ -2435,18 +2725,7 @@ tds_cursor_open(TDSSOCKET * tds, TDSCURSOR * cursor, TDSPARAMINFO *params, bool
 		tds_put_byte(tds, 4);
 		tds_put_byte(tds, 0);
 
-		if (num_params) {
-			tds7_put_query_params(tds, converted_query, converted_query_len);
-		} else {
-			tds_put_byte(tds, 0);
-			tds_put_byte(tds, 0);
-			tds_put_byte(tds, SYBNTEXT);	/* must be Ntype */
-			TDS_PUT_INT(tds, converted_query_len);
-			if (IS_TDS71_PLUS(tds->conn))
-				tds_put_n(tds, tds->conn->collation, 5);
-			TDS_PUT_INT(tds, converted_query_len);
-			tds_put_n(tds, converted_query, (int)converted_query_len);
-		}
+		tds7_put_query_text(tds, converted);
 
 		/* type */
 		tds_put_byte(tds, 0);	/* no parameter name */
@@ -2475,7 +2754,7 @@ tds_cursor_open(TDSSOCKET * tds, TDSCURSOR * cursor, TDSPARAMINFO *params, bool
 		if (num_params) {
 			int i;
 
-			rc = tds7_write_param_def_from_query(tds, converted_query, converted_query_len, params);
+			tds7_put_param_def(tds, converted);
 
 			for (i = 0; i < num_params; i++) {
 				TDSCOLUMN *param = params->columns[i];
@@ -2485,14 +2764,7 @@ tds_cursor_open(TDSSOCKET * tds, TDSCURSOR * cursor, TDSPARAMINFO *params, bool
 				tds_put_data(tds, param);
 			}
 		}
-		tds_convert_string_free(cursor->query, converted_query);
-		if (TDS_FAILED(rc)) {
-			tds_freeze_abort(&outer);
-			if (!*something_to_send)
-				tds_set_state(tds, TDS_IDLE);
-			return rc;
-		}
-		tds_freeze_close(&outer);
+		tds_query_cache_release(converted);
 
 		*something_to_send = true;
 		tds->current_op = TDS_OP_CURSOROPEN;
@@ -3369,6 +3641,7 @@ tds_multiple_init(TDSSOCKET *tds, TDSMULTIPLE *multiple, TDS_MULTIPLE_TYPE type,
 	unsigned char packet_type;
 	multiple->type = type;
 	multiple->flags = 0;
+	multiple->num_vars = 0;
 
 	if (tds_set_state(tds, TDS_WRITING) != TDS_WRITING)
 		return TDS_FAIL;
@@ -3433,6 +3706,42 @@ tds_multiple_execute(TDSSOCKET *tds, TDSMULTIPLE *multiple, TDSDYNAMIC * dyn)
 	return tds_send_emulated_execute(tds, dyn->query, dyn->params);
 }
 
+/**
+ * Add a RPC call to a multiple request.
+ * On TDS 7+ calls are sent as a RPC stream, on older protocols
+ * they are emulated using a language query.
+ * \tds
+ * \param multiple  multiple request initialized with TDS_MULTIPLE_RPC
+ * \param rpc_name  name of RPC to invoke
+ * \param params    parameters to send to server
+ * \returns TDS_FAIL or TDS_SUCCESS
+ */
+TDSRET
+tds_multiple_rpc(TDSSOCKET *tds, TDSMULTIPLE *multiple, const char *rpc_name, TDSPARAMINFO * params)
+{
+	assert(multiple->type == TDS_MULTIPLE_RPC);
+	assert(rpc_name);
+
+	/* distinguish from dynamic query  */
+	tds_release_cur_dyn(tds);
+
+	if (IS_TDS7_PLUS(tds->conn)) {
+		if (multiple->flags & MUL_STARTED) {
+			/* TODO define constant */
+			tds_put_byte(tds, IS_TDS72_PLUS(tds->conn) ? 0xff : 0x80);
+		}
+		multiple->flags |= MUL_STARTED;
+
+		return tds7_put_rpc(tds, rpc_name, params);
+	}
+
+	if (multiple->flags & MUL_STARTED)
+		tds_put_string(tds, " ", 1);
+	multiple->flags |= MUL_STARTED;
+
+	return tds4_put_emulated_rpc(tds, rpc_name, params, &multiple->num_vars);
+}
+
 /**
  * Send option commands to server.
  * Option commands are used to change server options.
@@ -1940,6 +1940,38 @@ tds_process_compute(TDSSOCKET * tds)
 	return TDS_SUCCESS;
 }
 
+/**
+ * Restore row buffer of columns pointing into received packets
+ * and release these packets.
+ * Must be called before reading another row.
+ */
+static void
+tds_release_column_views(TDSSOCKET * tds, TDSRESULTINFO * info)
+{
+	unsigned int i;
+	TDSCOLUMN *curcol;
+
+	for (i = 0; i < info->num_cols; i++) {
+		curcol = info->columns[i];
+		if (curcol->column_data_saved) {
+			curcol->column_data = curcol->column_data_saved;
+			curcol->column_data_saved = NULL;
+		}
+	}
+	tds_release_pinned_packets(tds);
+}
+
+/**
+ * Read a column of a row, using column views if enabled.
+ */
+static inline TDSRET
+tds_get_row_column(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	if (tds->column_views)
+		return tds_get_column_view(tds, curcol);
+	return curcol->funcs->get_data(tds, curcol);
+}
+
 /**
  * tds_process_row() processes rows and places them in the row buffer.
  * \tds
@@ -1957,10 +1989,11 @@ tds_process_row(TDSSOCKET * tds)
 	if (!info || info->num_cols <= 0)
 		return TDS_FAIL;
 
+	tds_release_column_views(tds, info);
 	for (i = 0; i < info->num_cols; i++) {
 		tdsdump_log(TDS_DBG_INFO1, "tds_process_row(): reading column %d\n", i);
 		curcol = info->columns[i];
-		TDS_PROPAGATE(curcol->funcs->get_data(tds, curcol));
+		TDS_PROPAGATE(tds_get_row_column(tds, curcol));
 	}
 	return TDS_SUCCESS;
 }
@@ -1982,6 +2015,7 @@ tds_process_nbcrow(TDSSOCKET * tds)
 	if (!info || info->num_cols <= 0)
 		return TDS_FAIL;
 
+	tds_release_column_views(tds, info);
 	nbcbuf = (char *) alloca((info->num_cols + 7) / 8);
 	tds_get_n(tds, nbcbuf, (info->num_cols + 7) / 8);
 	for (i = 0; i < info->num_cols; i++) {
@@ -1990,9 +2024,200 @@ tds_process_nbcrow(TDSSOCKET * tds)
 		if (nbcbuf[i / 8] & (1 << (i % 8))) {
 			curcol->column_cur_size = -1;
 		} else {
+			TDS_PROPAGATE(tds_get_row_column(tds, curcol));
+		}
+	}
+	return TDS_SUCCESS;
+}
+
+/**
+ * Copy a blob decoded in current_row to batch heap.
+ */
+static TDSRET
+tds_row_batch_add_blob(TDSROWBATCHCOLUMN *bcol, TDS_UINT row)
+{
+	TDSCOLUMN *curcol = bcol->column;
+	const TDSBLOB *blob = (const TDSBLOB *) curcol->column_data;
+	size_t len;
+
+	((size_t *) bcol->data)[row] = bcol->heap_len;
+	bcol->lengths[row] = curcol->column_cur_size;
+	if (curcol->column_cur_size <= 0)
+		return TDS_SUCCESS;
+
+	len = curcol->column_cur_size;
+	/* variant can store a structure (numeric or date), use real data length */
+	if (curcol->column_type == SYBVARIANT)
+		len = ((const TDSVARIANT *) blob)->data_len;
+	if (!blob->textvalue || !len)
+		return TDS_SUCCESS;
+
+	if (bcol->heap_len + len > bcol->heap_size) {
+		size_t new_size = TDS_MAX(bcol->heap_size * 2, bcol->heap_len + len);
+
+		if (!TDS_RESIZE(bcol->heap, new_size))
+			return TDS_FAIL;
+		bcol->heap_size = new_size;
+	}
+	memcpy(bcol->heap + bcol->heap_len, blob->textvalue, len);
+	bcol->heap_len += len;
+	bcol->lengths[row] = (TDS_INT) len;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Decode a single row into next free slot of batch.
+ * \tds
+ * \param batch  batch to fill
+ * \param nbcbuf NULL bitmap for NBC rows, NULL for normal rows
+ */
+static TDSRET
+tds_process_batch_row(TDSSOCKET * tds, TDSROWBATCH * batch, const unsigned char *nbcbuf)
+{
+	const TDS_UINT row = batch->num_rows;
+	TDS_USMALLINT i;
+
+	for (i = 0; i < batch->num_cols; i++) {
+		TDSROWBATCHCOLUMN *bcol = &batch->columns[i];
+		TDSCOLUMN *curcol = bcol->column;
+		unsigned char *dest = bcol->data + (size_t) bcol->stride * row;
+		unsigned char *saved_data;
+		int colsize, discard_len;
+		TDSRET rc;
+
+		if (nbcbuf && (nbcbuf[i / 8] & (1 << (i % 8)))) {
+			if (bcol->kind == TDS_BATCH_BLOB)
+				((size_t *) bcol->data)[row] = bcol->heap_len;
+			bcol->lengths[row] = -1;
+			continue;
+		}
+
+		switch (bcol->kind) {
+		case TDS_BATCH_FIXED:
+			colsize = curcol->column_size;
+			if (!tds_get_n(tds, dest, colsize))
+				return TDS_FAIL;
+			break;
+		case TDS_BATCH_VARLEN:
+			if (curcol->column_varint_size == 1) {
+				colsize = tds_get_byte(tds);
+				if (colsize == 0)
+					colsize = -1;
+			} else {
+				colsize = tds_get_smallint(tds);
+			}
+			if (IS_TDSDEAD(tds))
+				return TDS_FAIL;
+			if (colsize < 0)
+				break;
+			/* same as tds_generic_get, discard exceeding data */
+			discard_len = 0;
+			if (colsize > curcol->column_size) {
+				discard_len = colsize - curcol->column_size;
+				colsize = curcol->column_size;
+			}
+			if (!tds_get_n(tds, dest, colsize))
+				return TDS_FAIL;
+			if (discard_len > 0)
+				tds_get_n(tds, NULL, discard_len);
+			break;
+		case TDS_BATCH_DIRECT:
+			/* let type code decode directly into the batch */
+			saved_data = curcol->column_data;
+			curcol->column_data = dest;
+			rc = curcol->funcs->get_data(tds, curcol);
+			curcol->column_data = saved_data;
+			TDS_PROPAGATE(rc);
+			bcol->lengths[row] = curcol->column_cur_size;
+			continue;
+		case TDS_BATCH_BLOB:
+		default:
 			TDS_PROPAGATE(curcol->funcs->get_data(tds, curcol));
+			TDS_PROPAGATE(tds_row_batch_add_blob(bcol, row));
+			continue;
+		}
+		bcol->lengths[row] = colsize;
+#ifdef WORDS_BIGENDIAN
+		if (colsize > 0)
+			tds_swap_datatype(tds_get_conversion_type(curcol->column_type, colsize), dest);
+#endif
+	}
+	++batch->num_rows;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Decode multiple rows at once into a columnar batch.
+ * Should be called after tds_process_tokens() returned the format
+ * (TDS_ROWFMT_RESULT) of the results \a batch was allocated for.
+ * Rows are read till the batch is full or a token which is not a row
+ * is found; other tokens are left to tds_process_tokens().
+ * Type of every column is resolved by tds_alloc_row_batch() so this
+ * function does not need to dispatch on every value.
+ * Content of current_row is undefined after this call.
+ * \tds
+ * \param batch batch to fill, \c num_rows is set to the number of rows decoded
+ * \retval TDS_SUCCESS some rows decoded or no more rows (\c num_rows == 0)
+ * \retval TDS_NO_MORE_RESULTS if no data are expected
+ * \retval TDS_FAIL on error
+ */
+TDSRET
+tds_process_rows_batch(TDSSOCKET * tds, TDSROWBATCH * batch)
+{
+	TDSRESULTINFO *info;
+	unsigned char *nbcbuf;
+	TDS_USMALLINT i;
+	uint8_t marker;
+	TDSRET rc;
+
+	CHECK_TDS_EXTRA(tds);
+
+	tdsdump_log(TDS_DBG_FUNC, "tds_process_rows_batch(%p, %p)\n", tds, batch);
+
+	batch->num_rows = 0;
+	for (i = 0; i < batch->num_cols; i++)
+		batch->columns[i].heap_len = 0;
+
+	if (tds->state == TDS_IDLE || tds->state == TDS_SENDING)
+		return TDS_NO_MORE_RESULTS;
+
+	/* same as tds_process_tokens, rows go to cursor or normal results */
+	info = tds->cur_cursor ? tds->cur_cursor->res_info : tds->res_info;
+	if (!info || info != batch->info || info->num_cols != batch->num_cols) {
+		tdsdump_log(TDS_DBG_ERROR, "tds_process_rows_batch(): batch does not match current results\n");
+		return TDS_FAIL;
+	}
+
+	if (tds_set_state(tds, TDS_READING) != TDS_READING)
+		return TDS_FAIL;
+
+	tds_set_current_results(tds, info);
+	tds_release_column_views(tds, info);
+	nbcbuf = (unsigned char *) alloca((info->num_cols + 7) / 8);
+	while (batch->num_rows < batch->max_rows && !tds->in_cancel) {
+		marker = tds_peek(tds);
+		if (marker == TDS_ROW_TOKEN) {
+			tds_get_byte(tds);
+			rc = tds_process_batch_row(tds, batch, NULL);
+		} else if (marker == TDS_NBC_ROW_TOKEN) {
+			tds_get_byte(tds);
+			tds_get_n(tds, nbcbuf, (info->num_cols + 7) / 8);
+			rc = tds_process_batch_row(tds, batch, nbcbuf);
+		} else {
+			break;
+		}
+		if (TDS_FAILED(rc)) {
+			tds_close_socket(tds);
+			return rc;
 		}
+		info->rows_exist = true;
 	}
+
+	if (IS_TDSDEAD(tds))
+		return TDS_FAIL;
+
+	tds_set_state(tds, TDS_PENDING);
+	tdsdump_log(TDS_DBG_INFO1, "tds_process_rows_batch(): %u rows decoded\n", (unsigned) batch->num_rows);
 	return TDS_SUCCESS;
 }
 
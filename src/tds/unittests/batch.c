@@ -0,0 +1,210 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ * Copyright (C) 2026  agent
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test decoding rows in batch (tds_process_rows_batch)
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#undef getpid
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include <freetds/replacements.h>
+#include <freetds/utils.h>
+
+/* build a TDS 7.4 reply with 3 rows and final DONE */
+static void
+build_stream(void)
+{
+	static const char textptr[16] = "0123456789abcdef";
+	static const char timestamp[8] = "TIMESTMP";
+
+	fake_reply_start(512);
+
+	/* first row, all values */
+	fake_reply_put_num(TDS_ROW_TOKEN, 1);
+	fake_reply_put_num(1, 4);
+	fake_reply_put_num(4, 1);
+	fake_reply_put_num(100, 4);
+	fake_reply_put_num(3, 2);
+	fake_reply_put("abc", 3);
+	fake_reply_put("\x05\x01\x39\x30\x00\x00", 6);	/* 123.45 */
+	fake_reply_put_num(16, 1);
+	fake_reply_put(textptr, 16);
+	fake_reply_put(timestamp, 8);
+	fake_reply_put_num(4, 4);
+	fake_reply_put("blob", 4);
+
+	/* second row, NBC with some NULLs */
+	fake_reply_put_num(TDS_NBC_ROW_TOKEN, 1);
+	fake_reply_put_num((1 << 1) | (1 << 3) | (1 << 4), 1);
+	fake_reply_put_num(2, 4);
+	fake_reply_put_num(0, 2);
+
+	/* third row, NULLs using normal row */
+	fake_reply_put_num(TDS_ROW_TOKEN, 1);
+	fake_reply_put_num(3, 4);
+	fake_reply_put_num(0, 1);
+	fake_reply_put_num(0xffff, 2);
+	fake_reply_put_num(0, 1);
+	fake_reply_put_num(0, 1);
+
+	fake_reply_put_num(TDS_DONE_TOKEN, 1);
+	fake_reply_put_num(TDS_DONE_COUNT, 2);
+	fake_reply_put_num(0xc1, 2);
+	fake_reply_put_num(3, 8);
+
+	fake_reply_end();
+}
+
+static TDSRESULTINFO *
+build_results(TDSSOCKET *tds)
+{
+	TDSRESULTINFO *info;
+	TDSCOLUMN *col;
+
+	info = tds_alloc_results(5);
+	assert(info);
+
+	tds_set_column_type(tds->conn, info->columns[0], SYBINT4);
+
+	col = info->columns[1];
+	tds_set_column_type(tds->conn, col, SYBINTN);
+	col->column_size = col->on_server.column_size = 4;
+
+	col = info->columns[2];
+	tds_set_column_type(tds->conn, col, XSYBVARCHAR);
+	col->column_size = col->on_server.column_size = 20;
+
+	col = info->columns[3];
+	tds_set_column_type(tds->conn, col, SYBNUMERIC);
+	col->column_prec = 10;
+	col->column_scale = 2;
+	col->column_size = col->on_server.column_size = 5;
+
+	col = info->columns[4];
+	tds_set_column_type(tds->conn, col, SYBIMAGE);
+	col->column_size = col->on_server.column_size = 0x7fffffff;
+
+	assert(TDS_SUCCEED(tds_alloc_row(info)));
+	return info;
+}
+
+static void
+check_int(TDSROWBATCH *batch, unsigned col, unsigned row, TDS_INT expected)
+{
+	TDS_INT value;
+
+	assert(batch->columns[col].lengths[row] == 4);
+	memcpy(&value, tds_row_batch_value(batch, col, row), 4);
+	assert(value == expected);
+}
+
+static void
+check_null(TDSROWBATCH *batch, unsigned col, unsigned row)
+{
+	assert(batch->columns[col].lengths[row] == -1);
+}
+
+TEST_MAIN()
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDS_SYS_SOCKET server;
+	TDSRESULTINFO *info;
+	TDSROWBATCH *batch;
+	TDS_INT result_type;
+	int done_flags;
+	char buf[64];
+	const TDS_NUMERIC *num;
+
+	setbuf(stdout, NULL);
+	setbuf(stderr, NULL);
+
+	tdsdump_topen(tds_dir_getenv(TDS_DIR("TDSDUMP")));
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x704;
+
+	/* provide connection to a fake server which already sent the reply */
+	server = fake_server_connect(tds);
+	build_stream();
+	fake_server_send(tds, server);
+
+	info = build_results(tds);
+	tds->res_info = info;
+	tds_set_current_results(tds, info);
+
+	batch = tds_alloc_row_batch(tds->conn, info, 2);
+	assert(batch);
+	assert(batch->columns[0].kind == TDS_BATCH_FIXED);
+	assert(batch->columns[1].kind == TDS_BATCH_VARLEN);
+	assert(batch->columns[2].kind == TDS_BATCH_VARLEN);
+	assert(batch->columns[3].kind == TDS_BATCH_DIRECT);
+	assert(batch->columns[4].kind == TDS_BATCH_BLOB);
+
+	/* first batch, full */
+	assert(TDS_SUCCEED(tds_process_rows_batch(tds, batch)));
+	assert(batch->num_rows == 2);
+	check_int(batch, 0, 0, 1);
+	check_int(batch, 1, 0, 100);
+	assert(batch->columns[2].lengths[0] == 3);
+	assert(memcmp(tds_row_batch_value(batch, 2, 0), "abc", 3) == 0);
+	num = (const TDS_NUMERIC *) tds_row_batch_value(batch, 3, 0);
+	assert(tds_numeric_to_string(num, buf) > 0);
+	assert(strcmp(buf, "123.45") == 0);
+	assert(batch->columns[4].lengths[0] == 4);
+	assert(memcmp(tds_row_batch_value(batch, 4, 0), "blob", 4) == 0);
+
+	check_int(batch, 0, 1, 2);
+	check_null(batch, 1, 1);
+	assert(batch->columns[2].lengths[1] == 0);
+	check_null(batch, 3, 1);
+	check_null(batch, 4, 1);
+
+	/* second batch, partial */
+	assert(TDS_SUCCEED(tds_process_rows_batch(tds, batch)));
+	assert(batch->num_rows == 1);
+	check_int(batch, 0, 0, 3);
+	check_null(batch, 1, 0);
+	check_null(batch, 2, 0);
+	check_null(batch, 3, 0);
+	check_null(batch, 4, 0);
+
+	/* no more rows, DONE should be still available */
+	assert(TDS_SUCCEED(tds_process_rows_batch(tds, batch)));
+	assert(batch->num_rows == 0);
+
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(result_type == TDS_DONE_RESULT);
+	assert((done_flags & TDS_DONE_COUNT) != 0);
+	assert(tds->rows_affected == 3);
+
+	tds_free_row_batch(batch);
+	fake_server_close(server);
+	tds_free_socket(tds);
+	tds_free_context(ctx);
+	return 0;
+}
@@ -0,0 +1,546 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ * Copyright (C) 2026  agent
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: micro-benchmarks of libtds hot paths.
+ * Not a test, run with "make bench" (or the "bench" CMake target).
+ *
+ * Usage: tdsbench [name_filter]
+ * TDSBENCH_MS environment variable sets the minimum time of each
+ * measure in milliseconds (default 100); every benchmark is measured
+ * 5 times and the best result is reported.
+ */
+#include "common.h"
+#include <assert.h>
+#include <time.h>
+
+#if HAVE_UNISTD_H
+#undef getpid
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif /* HAVE_SYS_TIME_H */
+
+#include <freetds/tds/iconv.h>
+#include <freetds/tds/convert.h>
+#include <freetds/thread.h>
+#include <freetds/replacements.h>
+#include <freetds/utils.h>
+
+typedef struct bench
+{
+	const char *name;
+	/** run the operation count times */
+	void (*run)(unsigned long count);
+	/** bytes processed by a single operation, 0 if set by run in op_bytes */
+	size_t bytes;
+} BENCH;
+
+static TDSCONTEXT *ctx;
+static TDSSOCKET *tds;
+static unsigned bench_ms = 100;
+
+/* keep results alive so compiler does not remove computations */
+static volatile TDS_INT sink;
+
+/* bytes processed by a single operation if not constant */
+static size_t op_bytes;
+
+static uint64_t
+now_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000000000u + tv.tv_usec * 1000u;
+#endif
+}
+
+/* conversions */
+
+typedef struct
+{
+	int srctype;
+	const void *src;
+	TDS_UINT srclen;
+	int desttype;
+} CONV_CASE;
+
+static const CONV_CASE *conv_case;
+
+static void
+run_convert(unsigned long count)
+{
+	CONV_RESULT cr;
+	TDS_INT res = 0;
+
+	while (count--) {
+		/* numeric destination takes precision and scale from the result */
+		cr.n.precision = 18;
+		cr.n.scale = 5;
+		res = tds_convert(ctx, conv_case->srctype, conv_case->src, conv_case->srclen,
+				  conv_case->desttype, &cr);
+		if (res >= 0 && is_variable_type(conv_case->desttype) && conv_case->desttype != SYBBINARY)
+			free(cr.c);
+		else if (res >= 0 && conv_case->desttype == SYBBINARY)
+			free(cr.ib);
+	}
+	assert(res >= 0);
+	sink = res;
+}
+
+static TDS_INT int4_value = 1234567890;
+static TDS_FLOAT flt8_value = 12345.6789;
+static TDS_NUMERIC numeric_value;
+static TDS_DATETIME datetime_value;
+static TDS_MONEY money_value;
+static TDS_UNIQUE unique_value = { 0x12345678, 0x1234, 0x5678, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+static const unsigned char binary_value[32] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87, 0x78, 0x69, 0x5a, 0x4b, 0x3c, 0x2d, 0x1e, 0x0f,
+};
+
+#define CONV(name, srctype, src, srclen, desttype) \
+	static const CONV_CASE conv_ ## name = { srctype, src, srclen, desttype }; \
+	static void run_ ## name(unsigned long count) { conv_case = &conv_ ## name; run_convert(count); }
+
+CONV(int4_char, SYBINT4, &int4_value, sizeof(int4_value), SYBVARCHAR)
+CONV(char_int4, SYBVARCHAR, "1234567890", 10, SYBINT4)
+CONV(flt8_char, SYBFLT8, &flt8_value, sizeof(flt8_value), SYBVARCHAR)
+CONV(char_flt8, SYBVARCHAR, "12345.6789", 10, SYBFLT8)
+CONV(numeric_char, SYBNUMERIC, &numeric_value, sizeof(numeric_value), SYBVARCHAR)
+CONV(char_numeric, SYBVARCHAR, "-1234567890123.45678", 20, SYBNUMERIC)
+CONV(money_char, SYBMONEY, &money_value, sizeof(money_value), SYBVARCHAR)
+CONV(datetime_char, SYBDATETIME, &datetime_value, sizeof(datetime_value), SYBVARCHAR)
+CONV(char_datetime_iso, SYBVARCHAR, "2026-10-17 12:34:56.789", 23, SYBDATETIME)
+CONV(char_datetime_text, SYBVARCHAR, "Oct 17 2026 12:34:56:789PM", 26, SYBDATETIME)
+CONV(binary_char, SYBVARBINARY, binary_value, sizeof(binary_value), SYBVARCHAR)
+CONV(char_binary, SYBVARCHAR, "0x000102030405060708090a0b0c0d0e0f", 34, SYBBINARY)
+CONV(unique_char, SYBUNIQUE, &unique_value, sizeof(unique_value), SYBVARCHAR)
+
+static void
+run_numeric_to_string(unsigned long count)
+{
+	char buf[64];
+	TDS_INT res = 0;
+
+	while (count--)
+		res = tds_numeric_to_string(&numeric_value, buf);
+	sink = res;
+}
+
+/* character conversions */
+
+#define TEXT_LEN 4096
+static char text_ascii[TEXT_LEN];
+static char text_utf8[TEXT_LEN];
+static size_t text_utf8_len;
+static char text_ucs2_ascii[TEXT_LEN * 2];
+static char text_ucs2[TEXT_LEN * 2];
+static size_t text_ucs2_len;
+static char conv_out[TEXT_LEN * 4];
+
+static size_t
+do_iconv(TDS_ICONV_DIRECTION dir, const char *src, size_t src_len)
+{
+	size_t out_len = sizeof(conv_out);
+	char *out = conv_out;
+
+	tds_iconv(tds, tds->conn->char_convs[client2ucs2], dir, &src, &src_len, &out, &out_len);
+	assert(src_len == 0);
+	return sizeof(conv_out) - out_len;
+}
+
+static void
+run_utf8_utf16_ascii(unsigned long count)
+{
+	while (count--)
+		do_iconv(to_server, text_ascii, TEXT_LEN);
+}
+
+static void
+run_utf8_utf16(unsigned long count)
+{
+	op_bytes = text_utf8_len;
+	while (count--)
+		do_iconv(to_server, text_utf8, text_utf8_len);
+}
+
+static void
+run_utf16_utf8_ascii(unsigned long count)
+{
+	while (count--)
+		do_iconv(to_client, text_ucs2_ascii, TEXT_LEN * 2);
+}
+
+static void
+run_utf16_utf8(unsigned long count)
+{
+	op_bytes = text_ucs2_len;
+	while (count--)
+		do_iconv(to_client, text_ucs2, text_ucs2_len);
+}
+
+/* conversions setup for a new connection */
+static void
+run_iconv_setup(unsigned long count)
+{
+	while (count--) {
+		TDSSOCKET *s = tds_alloc_socket(ctx, 512);
+
+		assert(s);
+		assert(TDS_SUCCEED(tds_iconv_open(s->conn, "UTF-8", 1)));
+		tds_srv_charset_changed(s->conn, "CP1252");
+		assert(tds_iconv_get(s->conn, "UTF-8", "CP1250"));
+		tds_free_socket(s);
+	}
+}
+
+static void
+init_texts(void)
+{
+	static const char mixed[] = "Caf\xc3\xa9 na\xc3\xafve \xe2\x82\xac \xe6\x97\xa5\xe6\x9c\xac abcdef ";
+	size_t n, len = strlen(mixed);
+
+	for (n = 0; n < TEXT_LEN; ++n)
+		text_ascii[n] = 'a' + n % 26;
+	for (text_utf8_len = 0; text_utf8_len + len <= TEXT_LEN; text_utf8_len += len)
+		memcpy(text_utf8 + text_utf8_len, mixed, len);
+
+	n = do_iconv(to_server, text_ascii, TEXT_LEN);
+	assert(n == TEXT_LEN * 2);
+	memcpy(text_ucs2_ascii, conv_out, n);
+	text_ucs2_len = do_iconv(to_server, text_utf8, text_utf8_len);
+	memcpy(text_ucs2, conv_out, text_ucs2_len);
+}
+
+/* decoding of rows */
+
+#define NUM_ROWS 1000
+static TDS_SYS_SOCKET server_socket = INVALID_SOCKET;
+
+/* build a TDS 7.4 reply with an int and a varchar column */
+static void
+build_stream(void)
+{
+	unsigned n;
+	char value[32];
+
+	fake_reply_start(4096);
+
+	fake_reply_put_num(TDS7_RESULT_TOKEN, 1);
+	fake_reply_put_num(2, 2);
+	fake_reply_put_num(0, 4);
+	fake_reply_put_num(0, 2);
+	fake_reply_put_num(SYBINT4, 1);
+	fake_reply_put_name("id");
+	fake_reply_put_num(0, 4);
+	fake_reply_put_num(1, 2);
+	fake_reply_put_num(XSYBVARCHAR, 1);
+	fake_reply_put_num(40, 2);
+	fake_reply_put("\x09\x04\xd0\x00\x34", 5);
+	fake_reply_put_name("name");
+
+	for (n = 0; n < NUM_ROWS; ++n) {
+		sprintf(value, "row number %u", n);
+		fake_reply_put_num(TDS_ROW_TOKEN, 1);
+		fake_reply_put_num(n, 4);
+		fake_reply_put_num(strlen(value), 2);
+		fake_reply_put(value, strlen(value));
+	}
+
+	fake_reply_put_num(TDS_DONE_TOKEN, 1);
+	fake_reply_put_num(TDS_DONE_COUNT, 2);
+	fake_reply_put_num(0xc1, 2);
+	fake_reply_put_num(NUM_ROWS, 8);
+	fake_reply_end();
+}
+
+static void
+send_stream(void)
+{
+	fake_server_send(tds, server_socket);
+}
+
+static void
+run_decode_rows(unsigned long count)
+{
+	TDS_INT result_type;
+	int done_flags;
+	unsigned rows;
+
+	op_bytes = fake_reply_len;
+	while (count--) {
+		send_stream();
+		rows = 0;
+		while (tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW | TDS_RETURN_DONE) == TDS_SUCCESS) {
+			if (result_type == TDS_DONE_RESULT)
+				break;
+			++rows;
+		}
+		assert(rows == NUM_ROWS);
+	}
+}
+
+static void
+run_decode_rows_batch(unsigned long count)
+{
+	TDS_INT result_type;
+	int done_flags;
+	unsigned rows;
+	TDSROWBATCH *batch;
+
+	op_bytes = fake_reply_len;
+	while (count--) {
+		send_stream();
+		assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROWFMT) == TDS_SUCCESS);
+		assert(result_type == TDS_ROWFMT_RESULT);
+		batch = tds_alloc_row_batch(tds->conn, tds->current_results, 100);
+		assert(batch);
+		rows = 0;
+		do {
+			assert(TDS_SUCCEED(tds_process_rows_batch(tds, batch)));
+			rows += batch->num_rows;
+		} while (batch->num_rows);
+		tds_free_row_batch(batch);
+		assert(rows == NUM_ROWS);
+		assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	}
+}
+
+/* writing */
+
+#ifdef TDS_HAVE_MUTEX
+/* read and discard everything written by the client */
+static TDS_THREAD_PROC_DECLARE(drain_proc, arg)
+{
+	TDS_SYS_SOCKET s = TDS_PTR2INT(arg);
+	char buf[16 * 1024];
+
+	while (READSOCKET(s, buf, sizeof(buf)) > 0)
+		continue;
+	return TDS_THREAD_RESULT(0);
+}
+
+static const char write_data[100] = "some data to write";
+
+static void
+run_freeze(unsigned long count)
+{
+	TDSFREEZE outer;
+
+	while (count--) {
+		tds_freeze(tds, &outer, 2);
+		tds_put_n(tds, write_data, sizeof(write_data));
+		tds_freeze_close(&outer);
+	}
+	tds_flush_packet(tds);
+}
+
+static void
+run_freeze_nested(unsigned long count)
+{
+	TDSFREEZE outer, inner;
+
+	while (count--) {
+		tds_freeze(tds, &outer, 4);
+		tds_put_int(tds, 123);
+		tds_freeze(tds, &inner, 2);
+		tds_put_n(tds, write_data, sizeof(write_data));
+		tds_freeze_close(&inner);
+		tds_freeze_close(&outer);
+	}
+	tds_flush_packet(tds);
+}
+
+static void
+run_put_n(unsigned long count)
+{
+	while (count--) {
+		tds_put_smallint(tds, sizeof(write_data));
+		tds_put_n(tds, write_data, sizeof(write_data));
+	}
+	tds_flush_packet(tds);
+}
+#endif
+
+static const BENCH benches[] = {
+	{ "convert_int4_char", run_int4_char, sizeof(TDS_INT) },
+	{ "convert_char_int4", run_char_int4, 10 },
+	{ "convert_flt8_char", run_flt8_char, sizeof(TDS_FLOAT) },
+	{ "convert_char_flt8", run_char_flt8, 10 },
+	{ "convert_numeric_char", run_numeric_char, sizeof(TDS_NUMERIC) },
+	{ "convert_char_numeric", run_char_numeric, 20 },
+	{ "convert_money_char", run_money_char, sizeof(TDS_MONEY) },
+	{ "convert_datetime_char", run_datetime_char, sizeof(TDS_DATETIME) },
+	{ "convert_char_datetime_iso", run_char_datetime_iso, 23 },
+	{ "convert_char_datetime_text", run_char_datetime_text, 26 },
+	{ "convert_binary_char", run_binary_char, 32 },
+	{ "convert_char_binary", run_char_binary, 34 },
+	{ "convert_unique_char", run_unique_char, sizeof(TDS_UNIQUE) },
+	{ "numeric_to_string", run_numeric_to_string, 0 },
+	{ "iconv_utf8_utf16_ascii", run_utf8_utf16_ascii, TEXT_LEN },
+	{ "iconv_utf8_utf16", run_utf8_utf16, 0 },
+	{ "iconv_utf16_utf8_ascii", run_utf16_utf8_ascii, TEXT_LEN * 2 },
+	{ "iconv_utf16_utf8", run_utf16_utf8, 0 },
+	{ "iconv_setup", run_iconv_setup, 0 },
+	{ "decode_rows", run_decode_rows, 0 },
+	{ "decode_rows_batch", run_decode_rows_batch, 0 },
+#ifdef TDS_HAVE_MUTEX
+	{ "write_freeze", run_freeze, sizeof(write_data) + 2 },
+	{ "write_freeze_nested", run_freeze_nested, sizeof(write_data) + 8 },
+	{ "write_put_n", run_put_n, sizeof(write_data) + 2 },
+#endif
+};
+
+/* measure a benchmark, returns best time per operation in ns */
+static double
+measure(const BENCH *bench)
+{
+	unsigned long count = 1;
+	uint64_t elapsed, target = (uint64_t) bench_ms * 1000000u;
+	double best = 0;
+	int i;
+
+	/* find a count which takes at least the target time */
+	for (;;) {
+		elapsed = now_ns();
+		bench->run(count);
+		elapsed = now_ns() - elapsed;
+		if (elapsed >= target / 4u)
+			break;
+		count *= 2;
+	}
+	count = (unsigned long) ((double) count * target / (elapsed ? elapsed : 1)) + 1;
+
+	for (i = 0; i < 5; ++i) {
+		double ns;
+
+		elapsed = now_ns();
+		bench->run(count);
+		elapsed = now_ns() - elapsed;
+		ns = (double) elapsed / count;
+		if (i == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+TEST_MAIN()
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+	const char *env;
+	CONV_RESULT cr;
+	unsigned i;
+#ifdef TDS_HAVE_MUTEX
+	TDS_SYS_SOCKET write_socket;
+	tds_thread drain_thread;
+	TDSSOCKET *tds_read;
+#endif
+
+	setbuf(stdout, NULL);
+	setbuf(stderr, NULL);
+
+	env = getenv("TDSBENCH_MS");
+	if (env && atoi(env) > 0)
+		bench_ms = atoi(env);
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	if (!ctx->locale->datetime_fmt) {
+		/* set default in case there's no locale file */
+		ctx->locale->datetime_fmt = strdup(STD_DATETIME_FMT);
+	}
+	tds = tds_alloc_socket(ctx, 4096);
+	assert(tds);
+	tds->conn->tds_version = 0x704;
+	tds->conn->env.block_size = 4096;
+	assert(TDS_SUCCEED(tds_iconv_open(tds->conn, "UTF-8", 1)));
+
+	/* values for conversions */
+	cr.n.precision = 18;
+	cr.n.scale = 5;
+	assert(tds_convert(ctx, SYBVARCHAR, "-1234567890123.45678", 20, SYBNUMERIC, &cr) > 0);
+	numeric_value = cr.n;
+	assert(tds_convert(ctx, SYBVARCHAR, "2026-10-17 12:34:56.789", 23, SYBDATETIME, &cr) > 0);
+	datetime_value = cr.dt;
+	assert(tds_convert(ctx, SYBVARCHAR, "123456.7891", 11, SYBMONEY, &cr) > 0);
+	money_value = cr.m;
+
+	init_texts();
+
+	/* fake server sending replies */
+	build_stream();
+	server_socket = fake_server_connect(tds);
+
+	printf("%-28s %14s %12s\n", "benchmark", "ns/op", "MB/s");
+	for (i = 0; i < TDS_VECTOR_SIZE(benches); ++i) {
+		const BENCH *bench = &benches[i];
+		size_t bytes = bench->bytes;
+		double ns;
+
+		if (filter && !strstr(bench->name, filter))
+			continue;
+		op_bytes = 0;
+
+#ifdef TDS_HAVE_MUTEX
+		/* write benchmarks need a reader on the other side */
+		if (strncmp(bench->name, "write_", 6) == 0) {
+			tds_read = tds;
+			tds = tds_alloc_socket(ctx, 4096);
+			assert(tds);
+			tds->conn->tds_version = 0x704;
+			tds->state = TDS_IDLE;
+			write_socket = fake_server_connect(tds);
+			assert(tds_thread_create(&drain_thread, drain_proc, TDS_INT2PTR(write_socket)) == 0);
+			tds->out_flag = TDS_QUERY;
+			tds_set_state(tds, TDS_WRITING);
+
+			ns = measure(bench);
+
+			tds_set_state(tds, TDS_IDLE);
+			tds_free_socket(tds);
+			tds_thread_join(drain_thread, NULL);
+			CLOSESOCKET(write_socket);
+			tds = tds_read;
+		} else
+#endif
+			ns = measure(bench);
+
+		if (!bytes)
+			bytes = op_bytes;
+		if (bytes)
+			printf("%-28s %14.1f %12.1f\n", bench->name, ns, bytes * 1000.0 / ns);
+		else
+			printf("%-28s %14.1f %12s\n", bench->name, ns, "-");
+	}
+
+	fake_server_close(server_socket);
+	tds_free_socket(tds);
+	tds_free_context(ctx);
+	return 0;
+}
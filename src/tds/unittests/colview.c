@@ -0,0 +1,159 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ * Copyright (C) 2026  agent
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test columns pointing to received packets (column views)
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#undef getpid
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include <freetds/replacements.h>
+#include <freetds/utils.h>
+
+static void
+put_row(TDS_INT num, const char *s)
+{
+	fake_reply_put_num(TDS_ROW_TOKEN, 1);
+	fake_reply_put_num(num, 4);
+	fake_reply_put_num(strlen(s), 2);
+	fake_reply_put(s, strlen(s));
+}
+
+/* build a TDS 7.4 reply with a row for each packet */
+static void
+build_stream(void)
+{
+	fake_reply_start(512);
+	put_row(1, "abc");
+
+	fake_reply_packet();
+	put_row(2, "defg");
+	fake_reply_put_num(TDS_DONE_TOKEN, 1);
+	fake_reply_put_num(TDS_DONE_COUNT, 2);
+	fake_reply_put_num(0xc1, 2);
+	fake_reply_put_num(2, 8);
+	fake_reply_end();
+}
+
+static bool
+in_packet(const TDSPACKET *packet, const void *p)
+{
+	const unsigned char *data = (const unsigned char *) p;
+
+	return data >= packet->buf && data < packet->buf + packet->capacity;
+}
+
+static void
+check_row(TDSRESULTINFO *info, TDS_INT num, const char *s)
+{
+	TDS_INT value;
+	TDSCOLUMN *col;
+
+	col = info->columns[0];
+	assert(col->column_cur_size == 4);
+	memcpy(&value, col->column_data, 4);
+	assert(value == num);
+
+	col = info->columns[1];
+	assert(col->column_cur_size == (TDS_INT) strlen(s));
+	assert(memcmp(col->column_data, s, strlen(s)) == 0);
+}
+
+TEST_MAIN()
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDS_SYS_SOCKET server;
+	TDSRESULTINFO *info;
+	TDSCOLUMN *col;
+	TDS_INT result_type;
+	int done_flags;
+	unsigned char *row_data;
+
+	setbuf(stdout, NULL);
+	setbuf(stderr, NULL);
+
+	tdsdump_topen(tds_dir_getenv(TDS_DIR("TDSDUMP")));
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x704;
+	tds->column_views = true;
+
+	/* provide connection to a fake server which already sent the reply */
+	server = fake_server_connect(tds);
+	build_stream();
+	fake_server_send(tds, server);
+
+	info = tds_alloc_results(2);
+	assert(info);
+	tds_set_column_type(tds->conn, info->columns[0], SYBINT4);
+	col = info->columns[1];
+	tds_set_column_type(tds->conn, col, XSYBVARCHAR);
+	col->column_size = col->on_server.column_size = 20;
+	assert(TDS_SUCCEED(tds_alloc_row(info)));
+	row_data = col->column_data;
+	tds->res_info = info;
+	tds_set_current_results(tds, info);
+
+	/* first row, string must point to received packet */
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW) == TDS_SUCCESS);
+	assert(result_type == TDS_ROW_RESULT);
+	check_row(info, 1, "abc");
+	assert(col->column_data_saved == row_data);
+	assert(in_packet(tds->recv_packet, col->column_data));
+	assert(tds->recv_packet_pinned);
+
+	/* reading next packet must not overwrite data */
+	assert(tds_peek(tds) == TDS_ROW_TOKEN);
+	assert(tds->pinned_packets != NULL);
+	assert(!in_packet(tds->recv_packet, col->column_data));
+	check_row(info, 1, "abc");
+
+	/* second row, previous packet released */
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW) == TDS_SUCCESS);
+	assert(result_type == TDS_ROW_RESULT);
+	assert(tds->pinned_packets == NULL);
+	check_row(info, 2, "defg");
+	assert(in_packet(tds->recv_packet, col->column_data));
+
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(result_type == TDS_DONE_RESULT);
+	assert(tds->rows_affected == 2);
+
+	/* freeing results releases packets, data of results still referenced are kept */
+	++info->ref_count;
+	tds_free_all_results(tds);
+	assert(!tds->recv_packet_pinned);
+	assert(col->column_data == row_data && col->column_data_saved == NULL);
+	check_row(info, 2, "defg");
+	tds_free_results(info);
+
+	fake_server_close(server);
+	tds_free_socket(tds);
+	tds_free_context(ctx);
+	return 0;
+}
@@ -33,4 +33,22 @@ extern int utf8_max_len;
 int get_unichar(const char **psrc);
 char *to_utf8(const char *src, char *dest);
 
+/* fake_server.c */
+extern unsigned char *fake_reply;
+extern size_t fake_reply_len;
+extern unsigned char *fake_request;
+extern size_t fake_request_len;
+
+void fake_reply_start(unsigned packet_size);
+void fake_reply_put(const void *data, size_t len);
+void fake_reply_put_num(uint64_t num, unsigned size);
+void fake_reply_put_name(const char *name);
+void fake_reply_packet(void);
+void fake_reply_end(void);
+
+TDS_SYS_SOCKET fake_server_connect(TDSSOCKET * tds);
+void fake_server_send(TDSSOCKET * tds, TDS_SYS_SOCKET server);
+void fake_server_recv(TDS_SYS_SOCKET server);
+void fake_server_close(TDS_SYS_SOCKET server);
+
 #endif
@@ -0,0 +1,216 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ * Copyright (C) 2026  agent
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Fake server used by tests decoding replies without a real server.
+ * Reply is built in memory and written to one end of a socket pair,
+ * the other end is used by the TDSSOCKET.
+ */
+#define TDS_DONT_DEFINE_DEFAULT_FUNCTIONS
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#undef getpid
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include <freetds/replacements.h>
+#include <freetds/bytes.h>
+
+unsigned char *fake_reply = NULL;
+size_t fake_reply_len = 0;
+unsigned char *fake_request = NULL;
+size_t fake_request_len = 0;
+
+static size_t reply_size, packet_start;
+static unsigned reply_packet_size;
+
+static void
+reply_append(const void *data, size_t len)
+{
+	if (fake_reply_len + len > reply_size) {
+		reply_size = (fake_reply_len + len) * 2;
+		assert(TDS_RESIZE(fake_reply, reply_size) != NULL);
+	}
+	memcpy(fake_reply + fake_reply_len, data, len);
+	fake_reply_len += len;
+}
+
+static void
+reply_close_packet(bool final)
+{
+	size_t len = fake_reply_len - packet_start;
+
+	fake_reply[packet_start + 1] = final ? TDS_STATUS_EOM : 0;
+	fake_reply[packet_start + 2] = (unsigned char) (len >> 8);
+	fake_reply[packet_start + 3] = (unsigned char) len;
+}
+
+static void
+reply_open_packet(void)
+{
+	packet_start = fake_reply_len;
+	reply_append("\x04\x00\x00\x00\x00\x00\x01\x00", 8);
+}
+
+/**
+ * Start a new reply.
+ * \param packet_size data are split into packets of this size
+ */
+void
+fake_reply_start(unsigned packet_size)
+{
+	assert(packet_size > 8);
+	reply_packet_size = packet_size;
+	fake_reply_len = 0;
+	reply_open_packet();
+}
+
+/** Append data to reply, starting new packets if needed */
+void
+fake_reply_put(const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	while (len) {
+		size_t n = packet_start + reply_packet_size - fake_reply_len;
+
+		if (n == 0) {
+			fake_reply_packet();
+			continue;
+		}
+		if (n > len)
+			n = len;
+		reply_append(p, n);
+		p += n;
+		len -= n;
+	}
+}
+
+/** Append a little endian number of size bytes */
+void
+fake_reply_put_num(uint64_t num, unsigned size)
+{
+	unsigned char buf[8];
+	unsigned n;
+
+	assert(size <= 8);
+	for (n = 0; n < size; ++n) {
+		buf[n] = num & 0xff;
+		num >>= 8;
+	}
+	fake_reply_put(buf, size);
+}
+
+/** Append an ASCII name as UCS-2 string with a byte length prefix */
+void
+fake_reply_put_name(const char *name)
+{
+	fake_reply_put_num(strlen(name), 1);
+	for (; *name; ++name)
+		fake_reply_put_num((unsigned char) *name, 2);
+}
+
+/** Terminate current packet, following data goes into a new packet */
+void
+fake_reply_packet(void)
+{
+	reply_close_packet(false);
+	reply_open_packet();
+}
+
+/** Terminate reply, last packet is marked as final */
+void
+fake_reply_end(void)
+{
+	reply_close_packet(true);
+}
+
+/**
+ * Connect tds to a fake server.
+ * \return socket used by the server
+ */
+TDS_SYS_SOCKET
+fake_server_connect(TDSSOCKET * tds)
+{
+	TDS_SYS_SOCKET sockets[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) >= 0);
+	tds_set_s(tds, sockets[0]);
+	return sockets[1];
+}
+
+/** Send reply built to tds, tds is ready to read it */
+void
+fake_server_send(TDSSOCKET * tds, TDS_SYS_SOCKET server)
+{
+	size_t sent = 0;
+
+	while (sent < fake_reply_len) {
+		int n = WRITESOCKET(server, fake_reply + sent, (int) (fake_reply_len - sent));
+
+		assert(n > 0);
+		sent += n;
+	}
+	tds->state = TDS_PENDING;
+}
+
+static void
+server_read(TDS_SYS_SOCKET server, unsigned char *buf, size_t len)
+{
+	while (len) {
+		int got = READSOCKET(server, buf, (int) len);
+
+		assert(got > 0);
+		buf += got;
+		len -= got;
+	}
+}
+
+/**
+ * Read a full request sent by the client.
+ * Payload, without packet headers, is stored in fake_request.
+ */
+void
+fake_server_recv(TDS_SYS_SOCKET server)
+{
+	unsigned char header[8];
+	size_t len;
+
+	fake_request_len = 0;
+	do {
+		server_read(server, header, 8);
+		len = TDS_GET_UA2BE(header + 2) - 8u;
+		assert(TDS_RESIZE(fake_request, fake_request_len + len) != NULL);
+		server_read(server, fake_request + fake_request_len, len);
+		fake_request_len += len;
+	} while ((header[1] & TDS_STATUS_EOM) == 0);
+}
+
+/** Close server side and release reply and request */
+void
+fake_server_close(TDS_SYS_SOCKET server)
+{
+	CLOSESOCKET(server);
+	TDS_ZERO_FREE(fake_reply);
+	fake_reply_len = reply_size = 0;
+	TDS_ZERO_FREE(fake_request);
+	fake_request_len = 0;
+}
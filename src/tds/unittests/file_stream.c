@@ -33,6 +33,88 @@
 
 static uint8_t data[1024 * 2];
 
+static unsigned int seed = 1234;
+
+static unsigned
+rnd(unsigned max)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % max;
+}
+
+/* write fields separated by terminator and read them back */
+static void
+test_terminator(const char *term, const char *tail)
+{
+	const size_t term_len = strlen(term);
+	char *big, *field;
+	size_t big_len = 0, outlen, field_len;
+	unsigned n, num_fields = 0;
+	FILE *f;
+	TDSFILESTREAM stream[1];
+	TDSRET rc;
+
+	big = tds_new(char, 400 * 1024);
+	assert(big);
+
+	/* lengths of fields are mixed to cross buffer boundaries in different positions */
+	while (big_len < 300 * 1024) {
+		size_t len = rnd(4) ? rnd(20) : rnd(100 * 1024);
+
+		for (n = 0; n < len; ++n) {
+			/* add characters of the terminator to test partial matches */
+			char c = rnd(8) ? 'a' + rnd(26) : term[rnd(term_len)];
+
+			big[big_len + n] = c;
+			if (n + 1 >= term_len && memcmp(big + big_len + n + 1 - term_len, term, term_len) == 0)
+				big[big_len + n] = 'x';
+		}
+		/* avoid terminator matching across field end */
+		if (len)
+			big[big_len + len - 1] = 'y';
+		big_len += len;
+		memcpy(big + big_len, term, term_len);
+		big_len += term_len;
+		++num_fields;
+	}
+	strcpy(big + big_len, tail);
+
+	f = fopen("file_stream.dat", "wb");
+	assert(f);
+	assert(fwrite(big, 1, big_len + strlen(tail), f) == big_len + strlen(tail));
+	fclose(f);
+
+	f = fopen("file_stream.dat", "rb");
+	assert(f);
+	assert(TDS_SUCCEED(tds_file_stream_init(stream, f)));
+
+	field = big;
+	for (n = 0; n < num_fields; ++n) {
+		char *out = NULL;
+
+		assert(tds_bcp_fread(NULL, NULL, stream, term, term_len, &out, &outlen) == TDS_SUCCESS);
+		field_len = strstr(field, term) - field;
+		assert(outlen == field_len && memcmp(out, field, field_len) == 0 && out[outlen] == 0);
+		field += field_len + term_len;
+		assert(tds_file_stream_tell(stream) == field - big);
+		free(out);
+	}
+
+	/* end of file */
+	{
+		char *out = NULL;
+
+		rc = tds_bcp_fread(NULL, NULL, stream, term, term_len, &out, &outlen);
+		free(out);
+	}
+	assert(rc == (tail[0] ? TDS_FAIL : TDS_NO_MORE_RESULTS));
+	assert(stream->inpos == stream->inlen && feof(stream->f));
+	assert(TDS_SUCCEED(tds_file_stream_close(stream)));
+
+	free(big);
+	unlink("file_stream.dat");
+}
+
 TEST_MAIN()
 {
 	static const char terminators[3][4] = {
@@ -71,5 +153,12 @@ TEST_MAIN()
 
 	unlink("file_stream.dat");
 
+	test_terminator("\t", "");
+	test_terminator("\r\n", "");
+	test_terminator("|~|", "");
+	test_terminator("aaa", "");
+	test_terminator("\n", "last line without terminator");
+	test_terminator("|~|", "|~");
+
 	return 0;
 }
@@ -0,0 +1,152 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ * Copyright (C) 2026  agent
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test built-in conversions give same results as iconv(3)
+ */
+#include "common.h"
+#include <freetds/tds/iconv.h>
+
+#include <assert.h>
+
+static const char *const pairs[][2] = {
+	{ "UTF-8", "UTF-16LE" },
+	{ "UTF-8", "UCS-2LE" },
+	{ "ISO-8859-1", "UTF-16LE" },
+	{ "CP1252", "UCS-2LE" },
+	{ "UTF-8", "ISO-8859-1" },
+	{ "UTF-8", "CP1252" },
+};
+
+static const unsigned char pieces[][4] = {
+	/* UTF-8 */
+	{ 2, 0xc3, 0xa8 }, { 3, 0xe2, 0x82, 0xac }, { 3, 0xe4, 0xb8, 0xad },
+	/* UTF-16 */
+	{ 2, 0xac, 0x20 }, { 2, 0x3d, 0xd8 }, { 2, 0x00, 0xde },
+	/* invalid or single bytes */
+	{ 1, 0xff }, { 1, 0x80 }, { 1, 0x81 }, { 1, 0xe9 }, { 1, 0xc3 }, { 2, 0xed, 0xa0 },
+};
+
+static unsigned int seed = 12345;
+
+static unsigned
+rnd(unsigned max)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % max;
+}
+
+/* build mostly ASCII input with some other sequences */
+static size_t
+build_input(unsigned char *buf, size_t max, bool wide)
+{
+	size_t len = 0, target = rnd(max - 8);
+
+	while (len < target) {
+		unsigned r = rnd(100);
+
+		if (r < 85) {
+			buf[len++] = 'a' + rnd(26);
+			if (wide)
+				buf[len++] = 0;
+		} else {
+			const unsigned char *p = pieces[rnd(TDS_VECTOR_SIZE(pieces))];
+
+			memcpy(buf + len, p + 1, p[0]);
+			len += p[0];
+		}
+	}
+	return len;
+}
+
+static void
+test(TDSICONV *conv, TDS_ICONV_DIRECTION io, const unsigned char *in, size_t in_len, size_t out_len)
+{
+	unsigned char out1[1024], out2[1024];
+	const char *ib1 = (const char *) in, *ib2 = (const char *) in;
+	char *ob1 = (char *) out1, *ob2 = (char *) out2;
+	size_t il1 = in_len, il2 = in_len, ol1 = out_len, ol2 = out_len;
+	size_t res1, res2;
+	int err1, err2;
+	iconv_t cd = io == to_server ? conv->to.cd : conv->from.cd;
+
+	/* reset shift state */
+	tds_sys_iconv(cd, NULL, NULL, NULL, NULL);
+	errno = 0;
+	res1 = tds_sys_iconv(cd, (ICONV_CONST char **) &ib1, &il1, &ob1, &ol1);
+	err1 = errno;
+
+	conv->suppress.eilseq = conv->suppress.einval = conv->suppress.e2big = 1;
+	errno = 0;
+	res2 = tds_iconv(NULL, conv, io, &ib2, &il2, &ob2, &ol2);
+	err2 = errno;
+
+	/* replacement of invalid characters for client differs from iconv(3) */
+	if (io == to_client && res1 == (size_t) -1 && err1 == EILSEQ)
+		return;
+
+	if (res1 != res2 || (res1 == (size_t) -1 && err1 != err2) || il1 != il2 || ol1 != ol2
+	    || memcmp(out1, out2, out_len - ol1) != 0) {
+		fprintf(stderr, "%s -> %s: mismatch len %u out %u res %d/%d errno %d/%d left %u/%u\n",
+			io == to_server ? conv->from.charset.name : conv->to.charset.name,
+			io == to_server ? conv->to.charset.name : conv->from.charset.name,
+			(unsigned) in_len, (unsigned) out_len, (int) res1, (int) res2, err1, err2,
+			(unsigned) il1, (unsigned) il2);
+		exit(1);
+	}
+}
+
+TEST_MAIN()
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	unsigned char in[512];
+	unsigned n, i;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	assert(TDS_SUCCEED(tds_iconv_open(tds->conn, "ISO-8859-1", 1)));
+
+	for (n = 0; n < TDS_VECTOR_SIZE(pairs); ++n) {
+		TDSICONV *conv = tds_iconv_get(tds->conn, pairs[n][0], pairs[n][1]);
+
+		assert(conv);
+		assert(conv->flags & TDS_ENCODING_BUILTIN);
+		if (conv->to.cd == (iconv_t) -1 || conv->from.cd == (iconv_t) -1) {
+			printf("%s <-> %s not supported by iconv, skipped\n", pairs[n][0], pairs[n][1]);
+			continue;
+		}
+
+		for (i = 0; i < 20000; ++i) {
+			bool to_srv = rnd(2) == 0;
+			const char *charset = pairs[n][to_srv ? 0 : 1];
+			bool wide = strncmp(charset, "UTF-16", 6) == 0 || strncmp(charset, "UCS-2", 5) == 0;
+			size_t in_len = build_input(in, sizeof(in), wide);
+			size_t out_len = rnd(3) ? 1024 : rnd(1024);
+
+			test(conv, to_srv ? to_server : to_client, in, in_len, out_len);
+		}
+	}
+
+	tds_free_socket(tds);
+	tds_free_context(ctx);
+	return 0;
+}
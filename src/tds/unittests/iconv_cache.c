@@ -0,0 +1,133 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ * Copyright (C) 2026  agent
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test iconv descriptors are reused by following connections
+ */
+#include "common.h"
+#include <freetds/tds/iconv.h>
+
+#include <assert.h>
+
+static TDSCONTEXT *ctx;
+
+static TDSSOCKET *
+new_socket(void)
+{
+	TDSSOCKET *tds = tds_alloc_socket(ctx, 512);
+
+	assert(tds);
+	assert(TDS_SUCCEED(tds_iconv_open(tds->conn, "UTF-8", 0)));
+	tds_srv_charset_changed(tds->conn, "ISO-8859-2");
+	return tds;
+}
+
+/* convert a string to server and back */
+static void
+check_convert(TDSSOCKET *tds)
+{
+	static const char in[] = "Ao\xc3\x93\xc3\xa4 \xc5\x81\xc3\xb3" "d\xc5\xba";
+	TDSICONV *conv = tds->conn->char_convs[client2server_chardata];
+	char mid[64], out[64];
+	const char *ib;
+	char *ob;
+	size_t il, ol;
+
+	ib = in;
+	il = strlen(in);
+	ob = mid;
+	ol = sizeof(mid);
+	assert(tds_iconv(tds, conv, to_server, &ib, &il, &ob, &ol) == 0 && il == 0);
+	assert(ob - mid == 9);
+
+	il = ob - mid;
+	ib = mid;
+	ob = out;
+	ol = sizeof(out);
+	assert(tds_iconv(tds, conv, to_client, &ib, &il, &ob, &ol) == 0 && il == 0);
+	assert(ob - out == strlen(in) && memcmp(out, in, strlen(in)) == 0);
+}
+
+#ifdef TDS_HAVE_MUTEX
+static TDS_THREAD_PROC_DECLARE(connect_proc, arg TDS_UNUSED)
+{
+	int i;
+
+	for (i = 0; i < 200; ++i) {
+		TDSSOCKET *tds = new_socket();
+
+		check_convert(tds);
+		tds_free_socket(tds);
+	}
+	return TDS_THREAD_RESULT(0);
+}
+#endif
+
+TEST_MAIN()
+{
+	TDSSOCKET *tds;
+	iconv_t to_cd, from_cd;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+
+	tds = new_socket();
+	to_cd = tds->conn->char_convs[client2server_chardata]->to.cd;
+	from_cd = tds->conn->char_convs[client2server_chardata]->from.cd;
+	if (to_cd == (iconv_t) -1 || from_cd == (iconv_t) -1) {
+		printf("ISO-8859-2 not supported by iconv, skipped\n");
+		tds_free_socket(tds);
+		tds_free_context(ctx);
+		return 0;
+	}
+	check_convert(tds);
+	tds_free_socket(tds);
+
+	/* a new connection get same descriptors */
+	tds = new_socket();
+	assert(tds->conn->char_convs[client2server_chardata]->to.cd == to_cd);
+	assert(tds->conn->char_convs[client2server_chardata]->from.cd == from_cd);
+	check_convert(tds);
+
+	/* descriptors cannot be shared by connections at the same time */
+	{
+		TDSSOCKET *tds2 = new_socket();
+
+		assert(tds2->conn->char_convs[client2server_chardata]->to.cd != to_cd);
+		assert(tds2->conn->char_convs[client2server_chardata]->from.cd != from_cd);
+		check_convert(tds2);
+		tds_free_socket(tds2);
+	}
+	tds_free_socket(tds);
+
+#ifdef TDS_HAVE_MUTEX
+	{
+		tds_thread th[4];
+		int i;
+
+		for (i = 0; i < 4; ++i)
+			assert(tds_thread_create(&th[i], connect_proc, NULL) == 0);
+		for (i = 0; i < 4; ++i)
+			tds_thread_join(th[i], NULL);
+	}
+#endif
+
+	tds_free_context(ctx);
+	return 0;
+}
@@ -47,7 +47,7 @@ test0(const char *src, int prec, int scale, int prec2, unsigned char scale2)
 	num = cr.n;
 
 	/* change scale with string */
-	tds_numeric_to_string(&num, buf);
+	assert(tds_numeric_to_string(&num, buf) == (TDS_INT) strlen(buf));
 	while ((p = strchr(buf, '.')) != NULL)
 		memmove(p, p+1, strlen(p));
 
@@ -72,7 +72,7 @@ test0(const char *src, int prec, int scale, int prec2, unsigned char scale2)
 	if (tds_numeric_change_prec_scale(&num, prec2, scale2) < 0)
 		strcpy(result, "error");
 	else
-		tds_numeric_to_string(&num, result);
+		assert(tds_numeric_to_string(&num, result) == (TDS_INT) strlen(result));
 
 	if (strcmp(buf, result) != 0) {
 		fprintf(stderr, "Failed! %s (%d,%d) -> (%d,%d)\n\tshould be %s\n\tis %s\n",
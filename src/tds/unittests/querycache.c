@@ -0,0 +1,244 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ * Copyright (C) 2026  agent
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test RPCs sent using the cache of converted queries
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#undef getpid
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include <freetds/replacements.h>
+#include <freetds/utils.h>
+
+#ifdef TDS_HAVE_MUTEX
+
+static TDSSOCKET *tds;
+static TDS_SYS_SOCKET server_socket;
+
+/* thread to read a request from main thread */
+static TDS_THREAD_PROC_DECLARE(read_request_proc, arg TDS_UNUSED)
+{
+	fake_server_recv(server_socket);
+	return TDS_THREAD_RESULT(0);
+}
+
+typedef TDSRET (*submit_func)(TDSPARAMINFO *params, const char *query);
+
+static TDSRET
+submit_query_params(TDSPARAMINFO *params, const char *query)
+{
+	return tds_submit_query_params(tds, query, params, NULL);
+}
+
+static TDSRET
+submit_execdirect(TDSPARAMINFO *params, const char *query)
+{
+	return tds_submit_execdirect(tds, query, params, NULL);
+}
+
+static TDSRET
+submit_prepexec(TDSPARAMINFO *params, const char *query)
+{
+	TDSDYNAMIC *dyn = NULL;
+	TDSRET rc = tds71_submit_prepexec(tds, query, NULL, &dyn, params);
+
+	tds_dynamic_deallocated(tds->conn, dyn);
+	tds_release_dynamic(&dyn);
+	return rc;
+}
+
+static void
+send_request(submit_func submit, TDSPARAMINFO *params, const char *query)
+{
+	tds_thread th;
+
+	assert(tds_thread_create(&th, read_request_proc, NULL) == 0);
+	tds->state = TDS_IDLE;
+	assert(TDS_SUCCEED(submit(params, query)));
+	tds_thread_join(th, NULL);
+}
+
+/* check string (converted to UCS-2) is in last request */
+static void
+check_string(const char *s)
+{
+	size_t i, len = strlen(s);
+	unsigned char *ucs2 = tds_new(unsigned char, len * 2);
+
+	assert(ucs2);
+	for (i = 0; i < len; ++i) {
+		ucs2[i * 2] = s[i];
+		ucs2[i * 2 + 1] = 0;
+	}
+	for (i = 0; i + len * 2 <= fake_request_len; ++i)
+		if (memcmp(fake_request + i, ucs2, len * 2) == 0)
+			break;
+	if (i + len * 2 > fake_request_len) {
+		fprintf(stderr, "String \"%s\" not found in request\n", s);
+		exit(1);
+	}
+	free(ucs2);
+}
+
+static void
+check_declaration(const char *prefix, TDSPARAMINFO *params)
+{
+	char buf[256];
+	int i;
+
+	strcpy(buf, prefix);
+	for (i = 0; i < params->num_cols; ++i) {
+		if (i)
+			strcat(buf, ",");
+		sprintf(strchr(buf, 0), "@P%d ", i + 1);
+		assert(TDS_SUCCEED(tds_get_column_declaration(tds, params->columns[i], strchr(buf, 0))));
+	}
+	check_string(buf);
+}
+
+static TDSPARAMINFO *
+add_param(TDSPARAMINFO *params, TDS_SERVER_TYPE type, TDS_INT size, const void *data)
+{
+	TDSCOLUMN *curcol;
+
+	params = tds_alloc_param_result(params);
+	assert(params);
+	curcol = params->columns[params->num_cols - 1];
+	tds_set_param_type(tds->conn, curcol, type);
+	if (size)
+		curcol->column_size = curcol->on_server.column_size = size;
+	assert(tds_alloc_param_data(curcol));
+	curcol->column_cur_size = is_fixed_type(type) ? tds_get_size_by_type(type) : size;
+	memcpy(curcol->column_data, data, curcol->column_cur_size);
+	return params;
+}
+
+static void
+test_cached(submit_func submit)
+{
+	static const TDS_INT num = 123;
+	TDSPARAMINFO *params;
+	unsigned char *first;
+	size_t first_len;
+
+	params = add_param(NULL, SYBINT4, 0, &num);
+	params = add_param(params, SYBVARCHAR, 10, "0123456789");
+
+	/* first execution fills cache, second must send same data */
+	send_request(submit, params, "select ?, ?");
+	check_string("select @P1, @P2");
+	check_declaration("", params);
+	first = tds_new(unsigned char, fake_request_len);
+	assert(first);
+	memcpy(first, fake_request, fake_request_len);
+	first_len = fake_request_len;
+
+	send_request(submit, params, "select ?, ?");
+	assert(fake_request_len == first_len && memcmp(fake_request, first, first_len) == 0);
+
+	/* different parameter type must give a different declaration */
+	params->columns[1]->column_size = params->columns[1]->on_server.column_size = 20;
+	send_request(submit, params, "select ?, ?");
+	check_string("select @P1, @P2");
+	check_declaration("", params);
+	assert(fake_request_len == first_len);
+	assert(memcmp(fake_request, first, first_len) != 0);
+
+	free(first);
+	tds_free_param_results(params);
+}
+
+TEST_MAIN()
+{
+	static const TDS_INT num = 123;
+	TDSCONTEXT *ctx;
+	TDSPARAMINFO *params;
+	char *query;
+	int i;
+
+	setbuf(stdout, NULL);
+	setbuf(stderr, NULL);
+
+	tdsdump_topen(tds_dir_getenv(TDS_DIR("TDSDUMP")));
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 4096);
+	assert(tds);
+	tds->conn->tds_version = 0x704;
+	assert(TDS_SUCCEED(tds_iconv_open(tds->conn, "UTF-8", 1)));
+
+	/* provide connection to a fake server */
+	server_socket = fake_server_connect(tds);
+
+	test_cached(submit_query_params);
+	test_cached(submit_execdirect);
+	test_cached(submit_prepexec);
+
+	/* named parameters, declaration from names */
+	params = add_param(NULL, SYBINT4, 0, &num);
+	assert(tds_dstr_copy(&params->columns[0]->column_name, "@num"));
+	for (i = 0; i < 2; ++i) {
+		send_request(submit_query_params, params, "select @num");
+		check_string("select @num");
+		check_string("@num INT");
+	}
+
+	/* many queries, old ones get evicted */
+	for (i = 0; i < 1000; ++i) {
+		char buf[64];
+
+		sprintf(buf, "select %d where 1 = ?", i % 300);
+		send_request(submit_execdirect, params, buf);
+		sprintf(buf, "select %d where 1 = @P1", i % 300);
+		check_string(buf);
+	}
+
+	/* big query, not cached */
+	query = tds_new(char, 100000);
+	assert(query);
+	memset(query, ' ', 99999);
+	memcpy(query, "select ?", 8);
+	query[99999] = 0;
+	for (i = 0; i < 2; ++i) {
+		send_request(submit_execdirect, params, query);
+		check_string("select @P1     ");
+		check_declaration("", params);
+	}
+	free(query);
+	tds_free_param_results(params);
+
+	tds->state = TDS_IDLE;
+	tds_free_socket(tds);
+	fake_server_close(server_socket);
+	tds_free_context(ctx);
+	return 0;
+}
+#else	/* !TDS_HAVE_MUTEX */
+TEST_MAIN()
+{
+	printf("Not possible for this platform.\n");
+	return 0;
+}
+#endif
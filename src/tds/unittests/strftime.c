@@ -84,5 +84,34 @@ TEST_MAIN()
 	TEST(0, "%e", "23");
 	dr.day = 5;
 	TEST(0, "x%e", "x 5");
+
+	/* formats handled without strftime(3) */
+	dr.year = 2006;
+	dr.month = 0;
+	dr.day = 2;
+	dr.hour = 13;
+	dr.minute = 4;
+	dr.second = 5;
+	dr.decimicrosecond = 3370000;
+	TEST(3, "%Y-%m-%d %H:%M:%S.%z", "2006-01-02 13:04:05.337");
+	TEST(0, "%Y-%m-%d %H:%M:%S.%z", "2006-01-02 13:04:05");
+	TEST(7, "%y%m%d %I %l %S.%z", "060102 01  1 05.3370000");
+	TEST(3, "%b %e %Y %I:%M%p", "Jan  2 2006 01:04PM");
+	dr.hour = 0;
+	TEST(3, "%b %e %Y %I:%M%p", "Jan  2 2006 12:04AM");
+	dr.month = 11;
+	TEST(3, "%d %b %Y %j", "02 Dec 2006 001");
+
+	/* buffer too small */
+	{
+		char out[20];
+
+		memset(out, 'x', sizeof(out));
+		assert(tds_strftime(out, 10, "%Y-%m-%d", &dr, 3) == 0);
+		assert(tds_strftime(out, 11, "%Y-%m-%d", &dr, 3) == 10);
+		assert(strcmp(out, "2006-12-02") == 0);
+		assert(tds_strftime(out, 5, "%Y.%z", &dr, 0) == 4);
+		assert(strcmp(out, "2006") == 0);
+	}
 	return 0;
 }
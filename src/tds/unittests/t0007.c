@@ -24,6 +24,7 @@
  */
 
 #include "common.h"
+#include <assert.h>
 #include <freetds/tds/convert.h>
 
 #define TO32(n) ((unsigned int)((unsigned int)(n) & 0xfffffffflu))
@@ -363,6 +364,17 @@ TEST_MAIN()
 	test2("2006-01-02 12:34:56.337", SYBMSDATETIME2, SYBTIME, "13588901");
 
 	test2("2006-01-02 12:34:56.337", SYBMSDATETIME2, SYBCHAR, "len=27 2006-01-02 12:34:56.3370000");
+
+	/* ISO 8601/ODBC canonical formats */
+	test("2006-01-02T12:34:56.337", SYBDATETIME, "38717 13588901");
+	test("  2006-01-02   12:34  ", SYBDATETIME, "38717 13572000");
+	test("2006-01-02 12:34:56", SYBDATETIME, "38717 13588800");
+	test2("2006-01-02T12:34:56.123456789", SYBMSDATETIME2, SYBCHAR, "len=27 2006-01-02 12:34:56.1234567");
+	test("2006-01-0212:34", SYBDATETIME, "error");
+	test("2006-01-02T", SYBDATETIME, "error");
+	/* not canonical, handled by generic parser */
+	test("01/02/2006 12:34:56", SYBDATETIME, "38717 13588800");
+	test("2006-01-02 12:34:56.337PM", SYBDATETIME, "38717 13588901");
 #if 0
 	/* FIXME should fail conversion ?? */
 	test2("2006-01-02", SYBDATE, SYBTIME, "0");
@@ -435,6 +447,96 @@ TEST_MAIN()
 		}
 	}
 
+	/* conversion to caller buffer */
+	{
+		char buf[16];
+		bool truncated;
+		TDS_INT len;
+		static const TDS_INT num = -12345;
+		static const TDS_UCHAR bin[] = { 0x01, 0x23, 0xab };
+
+		memset(buf, 'x', sizeof(buf));
+		len = tds_convert_to_buffer(&ctx, SYBINT4, &num, sizeof(num), SYBVARCHAR, buf, 10, &truncated);
+		assert(len == 6 && !truncated);
+		assert(memcmp(buf, "-12345xx", 8) == 0);
+
+		memset(buf, 'x', sizeof(buf));
+		len = tds_convert_to_buffer(&ctx, SYBINT4, &num, sizeof(num), SYBCHAR, buf, 3, &truncated);
+		assert(len == 6 && truncated);
+		assert(memcmp(buf, "-12xx", 5) == 0);
+
+		memset(buf, 'x', sizeof(buf));
+		len = tds_convert_to_buffer(&ctx, SYBBINARY, bin, sizeof(bin), TDS_CONVERT_CHAR, buf, 5, &truncated);
+		assert(len == 6 && truncated);
+		assert(memcmp(buf, "0123axx", 7) == 0);
+
+		memset(buf, 'x', sizeof(buf));
+		len = tds_convert_to_buffer(&ctx, SYBVARCHAR, "0x0123ab", 8, SYBVARBINARY, buf, 2, &truncated);
+		assert(len == 3 && truncated);
+		assert(memcmp(buf, "\x01\x23xx", 4) == 0);
+
+		len = tds_convert_to_buffer(&ctx, SYBVARCHAR, "0x0123ab", 8, SYBBINARY, buf, 3, NULL);
+		assert(len == 3 && memcmp(buf, bin, 3) == 0);
+
+		len = tds_convert_to_buffer(&ctx, SYBVARCHAR, "123", 3, SYBINT4, buf, sizeof(buf), &truncated);
+		assert(len == TDS_CONVERT_NOAVAIL && !truncated);
+	}
+
+	/* conversions resolved in advance */
+	{
+		char buf[16];
+		CONV_RESULT cr_dst;
+		TDS_CONVERT_FUNC convert;
+		TDS_INT len;
+		static const TDS_INT num = 12345;
+
+		convert = tds_get_convert_func(SYBINT4, SYBVARCHAR);
+		cr_dst.cc.c = buf;
+		cr_dst.cc.len = sizeof(buf);
+		len = convert(&ctx, SYBINT4, &num, sizeof(num), TDS_CONVERT_CHAR, &cr_dst);
+		assert(len == 5 && memcmp(buf, "12345", 5) == 0);
+
+		convert = tds_get_convert_func(SYBVARCHAR, SYBINT8);
+		len = convert(&ctx, SYBVARCHAR, " -987 ", 6, SYBINT8, &cr_dst);
+		assert(len == sizeof(TDS_INT8) && cr_dst.bi == -987);
+
+		convert = tds_get_convert_func(SYBVARCHAR, SYBBINARY);
+		cr_dst.cb.ib = buf;
+		cr_dst.cb.len = sizeof(buf);
+		len = convert(&ctx, SYBVARCHAR, "0x4142", 6, TDS_CONVERT_BINARY, &cr_dst);
+		assert(len == 2 && memcmp(buf, "AB", 2) == 0);
+
+		convert = tds_get_convert_func(SYBINT2, SYBFLT8);
+		{
+			static const TDS_SMALLINT small = -123;
+
+			len = convert(&ctx, SYBINT2, &small, sizeof(small), SYBFLT8, &cr_dst);
+			assert(len == sizeof(TDS_FLOAT) && cr_dst.f == -123.0);
+		}
+
+		convert = tds_get_convert_func(SYBVARCHAR, SYBINT4);
+		assert(convert(&ctx, SYBVARCHAR, "12a", 3, SYBINT4, &cr_dst) == TDS_CONVERT_SYNTAX);
+
+		convert = tds_get_convert_func(SYBNUMERIC, SYBVARCHAR);
+		cr_dst.n.precision = 10;
+		cr_dst.n.scale = 2;
+		assert(tds_convert(&ctx, SYBVARCHAR, "-12.50", 6, SYBNUMERIC, &cr_dst) > 0);
+		{
+			TDS_NUMERIC numeric = cr_dst.n;
+
+			cr_dst.cc.c = buf;
+			cr_dst.cc.len = sizeof(buf);
+			len = convert(&ctx, SYBNUMERIC, &numeric, sizeof(numeric), TDS_CONVERT_CHAR, &cr_dst);
+			assert(len == 6 && memcmp(buf, "-12.50", 6) == 0);
+		}
+
+		convert = tds_get_convert_func(SYBINT4, SYBDATETIME);
+		assert(convert(&ctx, SYBINT4, &num, sizeof(num), SYBDATETIME, &cr_dst) == TDS_CONVERT_NOAVAIL);
+
+		convert = tds_get_convert_func(SYBNTEXT, SYBVARCHAR);
+		assert(convert(&ctx, SYBNTEXT, "a", 1, SYBVARCHAR, &cr_dst) == TDS_CONVERT_NOAVAIL);
+	}
+
 	tds_free_locale(ctx.locale);
 
 	return 0;